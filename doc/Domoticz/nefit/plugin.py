@@ -56,7 +56,7 @@ class Thermostat:
                         Devices[3].Update(nValue=1, sValue=str(temp))
 
     def onCommand(self, mqttClient, unit, command, level, color):
-        topic = "home/ems-esp/thermostat_cmd_temp"
+        topic = "home/ems-esp/cmd/thermostat_temp"
         if (command == "Set Level"):
             mqttClient.Publish(topic, str(level))
 
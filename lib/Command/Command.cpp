@@ -0,0 +1,367 @@
+/*
+ * Command.cpp
+ *
+ * Command registry and argument parsing, see Command.h
+ */
+
+#include "Command.h"
+
+#include <FixedPoint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(ARDUINO)
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(const void * const *)(addr))
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+#define strlcpy_P(dst, src, size) (strncpy((dst), (src), (size) - 1), (dst)[(size) - 1] = '\0')
+#endif
+
+#define CMD_SLOT_EMPTY 0xFF
+#define CMD_SLOT_ALIAS 0x80 // set in a slot of an alias, the rest is the global # of the alias
+
+// the registered tables, in flash
+static const _Command *       _cmd_tables[CMD_TABLES_MAX];
+static uint8_t                _cmd_counts[CMD_TABLES_MAX];
+static const _Command_Alias * _cmd_alias_tables[CMD_TABLES_MAX];
+static uint8_t                _cmd_alias_counts[CMD_TABLES_MAX];
+static uint8_t                _cmd_table_count = 0;
+
+// open addressing hash index, a slot holds the hash of a name or alias and the global # of its command or alias
+static uint32_t _cmd_hashes[CMD_INDEX_SIZE];
+static uint8_t  _cmd_slots[CMD_INDEX_SIZE];
+static uint8_t  _cmd_total   = 0; // # commands in all tables
+static uint8_t  _cmd_aliases = 0; // # aliases in all tables
+static uint8_t  _cmd_used    = 0; // # slots taken, by commands and aliases
+
+// words are separated by whitespace, a ',' can be the decimal separator of a number
+static bool _cmd_isSeparator(char c) {
+    return (c == ' ') || (c == '\n') || (c == '\r') || (c == '\t');
+}
+
+// the command with the given global #
+static const _Command * _cmd_entry(uint8_t n) {
+    for (uint8_t t = 0; t < _cmd_table_count; t++) {
+        if (n < _cmd_counts[t]) {
+            return &_cmd_tables[t][n];
+        }
+        n -= _cmd_counts[t];
+    }
+    return NULL;
+}
+
+// the alias with the given global #
+static const _Command_Alias * _cmd_alias(uint8_t n) {
+    for (uint8_t t = 0; t < _cmd_table_count; t++) {
+        if (n < _cmd_alias_counts[t]) {
+            return &_cmd_alias_tables[t][n];
+        }
+        n -= _cmd_alias_counts[t];
+    }
+    return NULL;
+}
+
+// slot of a hash, or of the empty slot where it would go
+static uint8_t _cmd_probe(uint32_t hash) {
+    uint8_t slot = hash & (CMD_INDEX_SIZE - 1);
+    while ((_cmd_slots[slot] != CMD_SLOT_EMPTY) && (_cmd_hashes[slot] != hash)) {
+        slot = (slot + 1) & (CMD_INDEX_SIZE - 1);
+    }
+    return slot;
+}
+
+static bool _cmd_insert(uint32_t hash, uint8_t n) {
+    uint8_t slot = _cmd_probe(hash);
+    if (_cmd_slots[slot] != CMD_SLOT_EMPTY) {
+        return false; // two names with the same hash
+    }
+    _cmd_hashes[slot] = hash;
+    _cmd_slots[slot]  = n;
+    _cmd_used++;
+    return true;
+}
+
+/*
+ * register a table of commands and their aliases, both in flash
+ * returns false if there's no room for them, or a name is already taken. Those entries are left out
+ */
+bool cmd_add(const _Command * table, uint8_t count, const _Command_Alias * aliases, uint8_t alias_count) {
+    if (_cmd_used == 0) {
+        memset(_cmd_slots, CMD_SLOT_EMPTY, sizeof(_cmd_slots));
+    }
+
+    // keep the index at most 3/4 full, so a probe always ends quickly and never loops on an unknown hash
+    if ((_cmd_table_count == CMD_TABLES_MAX) || ((_cmd_used + count + alias_count) > (CMD_INDEX_SIZE * 3 / 4))) {
+        return false;
+    }
+
+    bool    ok          = true;
+    uint8_t first       = _cmd_total;
+    uint8_t first_alias = _cmd_aliases;
+
+    _cmd_tables[_cmd_table_count]       = table;
+    _cmd_counts[_cmd_table_count]       = count;
+    _cmd_alias_tables[_cmd_table_count] = aliases;
+    _cmd_alias_counts[_cmd_table_count] = alias_count;
+    _cmd_table_count++;
+    _cmd_total += count;
+    _cmd_aliases += alias_count;
+
+    for (uint8_t i = 0; i < count; i++) {
+        ok &= _cmd_insert(pgm_read_dword(&table[i].hash), first + i);
+    }
+
+    for (uint8_t i = 0; i < alias_count; i++) {
+        uint32_t target = pgm_read_dword(&aliases[i].target);
+        uint8_t  slot   = _cmd_probe(target);
+        if (_cmd_slots[slot] == CMD_SLOT_EMPTY) {
+            ok = false; // alias of an unknown command
+        } else {
+            ok &= _cmd_insert(pgm_read_dword(&aliases[i].hash), CMD_SLOT_ALIAS | (first_alias + i));
+        }
+    }
+
+    return ok;
+}
+
+/*
+ * the command, in flash, with a name or alias. NULL if there's none
+ * the hash only finds the slot, the name is compared as well so a word with the same hash isn't taken for a command
+ */
+const _Command * cmd_find(const char * name) {
+    if (_cmd_total == 0) {
+        return NULL;
+    }
+
+    uint32_t hash = CMD_HASH_SEED;
+    for (const char * p = name; *p; p++) {
+        hash = cmd_hashStep(hash, *p);
+    }
+
+    uint8_t slot = _cmd_probe(hash);
+    if (_cmd_slots[slot] == CMD_SLOT_EMPTY) {
+        return NULL;
+    }
+
+    if (_cmd_slots[slot] & CMD_SLOT_ALIAS) {
+        const _Command_Alias * alias = _cmd_alias(_cmd_slots[slot] & ~CMD_SLOT_ALIAS);
+        if (strcmp_P(name, (PGM_P)pgm_read_ptr(&alias->name)) != 0) {
+            return NULL;
+        }
+        return _cmd_entry(_cmd_slots[_cmd_probe(pgm_read_dword(&alias->target))]);
+    }
+
+    const _Command * cmd = _cmd_entry(_cmd_slots[slot]);
+    if (strcmp_P(name, (PGM_P)pgm_read_ptr(&cmd->name)) != 0) {
+        return NULL;
+    }
+    return cmd;
+}
+
+/*
+ * the command at the start of a telnet line, e.g. "thermostat temp 21" is thermostat_temp
+ * the longest match of the first CMD_WORDS_MAX words wins. args is set to the words after the name
+ */
+const _Command * cmd_findLine(char * line, char ** args) {
+    char    name[CMD_NAME_SIZE];
+    char *  ends[CMD_WORDS_MAX];
+    uint8_t lengths[CMD_WORDS_MAX];
+    uint8_t words  = 0;
+    uint8_t length = 0;
+    char *  p      = line;
+
+    // join the words with '_', a name that doesn't fit is no command
+    while (words < CMD_WORDS_MAX) {
+        while (_cmd_isSeparator(*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (words > 0) {
+            name[length++] = '_';
+        }
+        while ((*p != '\0') && !_cmd_isSeparator(*p) && (length < CMD_NAME_SIZE - 1)) {
+            name[length++] = *p++;
+        }
+        if ((*p != '\0') && !_cmd_isSeparator(*p)) {
+            break;
+        }
+        ends[words]      = p;
+        lengths[words++] = length;
+    }
+
+    // shorter names are a prefix of the longer ones
+    while (words > 0) {
+        words--;
+        name[lengths[words]] = '\0';
+        const _Command * cmd = cmd_find(name);
+        if (cmd) {
+            *args = ends[words];
+            return cmd;
+        }
+    }
+
+    return NULL;
+}
+
+// the command of an MQTT topic below the command prefix, levels are joined with '_' like the words of a telnet line
+const _Command * cmd_findTopic(const char * topic) {
+    char   name[CMD_NAME_SIZE];
+    size_t length = 0;
+
+    for (const char * p = topic; *p; p++) {
+        if (length == CMD_NAME_SIZE - 1) {
+            return NULL;
+        }
+        name[length++] = (*p == '/') ? '_' : *p;
+    }
+    name[length] = '\0';
+
+    return cmd_find(name);
+}
+
+// the commands of a registered table, in the order they were added
+const _Command * cmd_get(uint8_t table, uint8_t index) {
+    if ((table >= _cmd_table_count) || (index >= _cmd_counts[table])) {
+        return NULL;
+    }
+    return &_cmd_tables[table][index];
+}
+
+uint8_t cmd_count(uint8_t table) {
+    return (table < _cmd_table_count) ? _cmd_counts[table] : 0;
+}
+
+// copy a command out of flash
+void cmd_read(const _Command * cmd, _Command * copy) {
+    memcpy_P(copy, cmd, sizeof(_Command));
+}
+
+// index of a word of the usage, or a number below the # words. -1 if it's neither
+static int32_t _cmd_choice(const char * usage, const char * word) {
+    int32_t      index = 0;
+    const char * p     = usage;
+
+    while (*p) {
+        // words are runs of a-z, 0-9 and _, everything else separates them
+        while (*p && !(((*p >= 'a') && (*p <= 'z')) || ((*p >= '0') && (*p <= '9')) || (*p == '_'))) {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        const char * start = p;
+        while (((*p >= 'a') && (*p <= 'z')) || ((*p >= '0') && (*p <= '9')) || (*p == '_')) {
+            p++;
+        }
+        if ((strlen(word) == (size_t)(p - start)) && (strncmp(start, word, p - start) == 0)) {
+            return index;
+        }
+        index++;
+    }
+
+    char *  end;
+    int32_t n = strtol(word, &end, 10);
+    if ((end != word) && (*end == '\0') && (n >= 0) && (n < index)) {
+        return n;
+    }
+    return -1;
+}
+
+// parse a word into the argument, false if it's not valid for the command
+static bool _cmd_parse(const _Command * cmd, const char * word, _Command_Arg * arg) {
+    char * end = NULL;
+
+    switch (cmd->arg) {
+    case CMD_ARG_INT:
+    case CMD_ARG_HEX:
+        arg->value = strtol(word, &end, (cmd->arg == CMD_ARG_HEX) ? 16 : 10);
+        return (end != word) && (*end == '\0') && (arg->value >= cmd->min) && (arg->value <= cmd->max);
+
+    case CMD_ARG_FIXED:
+        return fp_parse(word, cmd->scale, &arg->value) && (arg->value >= cmd->min) && (arg->value <= cmd->max);
+
+    case CMD_ARG_BOOL:
+        if ((strcmp(word, "on") == 0) || (strcmp(word, "1") == 0) || (strcmp(word, "true") == 0)) {
+            arg->value = 1;
+            return true;
+        }
+        if ((strcmp(word, "off") == 0) || (strcmp(word, "0") == 0) || (strcmp(word, "false") == 0)) {
+            arg->value = 0;
+            return true;
+        }
+        return false;
+
+    case CMD_ARG_CHOICE: {
+        char usage[CMD_USAGE_SIZE];
+        strlcpy_P(usage, cmd->usage, sizeof(usage));
+        arg->value = _cmd_choice(usage, word);
+        return (arg->value >= 0);
+    }
+
+    default:
+        return true;
+    }
+}
+
+/*
+ * parse the argument of a command and call its handler
+ * args are the words after the name, a telnet line or an MQTT payload, and are split in place. NULL for none
+ * telnet is false for MQTT, which can't run CMD_TELNET commands
+ */
+_CMD_STATUS cmd_run(const _Command * cmd, char * args, bool telnet) {
+    if (cmd == NULL) {
+        return CMD_UNKNOWN;
+    }
+
+    _Command command;
+    cmd_read(cmd, &command);
+
+    if ((command.flags & CMD_TELNET) && !telnet) {
+        return CMD_DENIED;
+    }
+
+    _Command_Arg arg = {false, 0, NULL, NULL, telnet};
+
+    if (args) {
+        while (_cmd_isSeparator(*args)) {
+            args++;
+        }
+    }
+
+    if (args && (*args != '\0')) {
+        arg.present = true;
+        arg.text    = args;
+
+        if (command.arg == CMD_ARG_TEXT) {
+            // the rest of the line, without trailing separators
+            char * end = args + strlen(args);
+            while ((end > args) && _cmd_isSeparator(*(end - 1))) {
+                *--end = '\0';
+            }
+        } else {
+            // split off the first word
+            char * p = args;
+            while ((*p != '\0') && !_cmd_isSeparator(*p)) {
+                p++;
+            }
+            if (*p != '\0') {
+                *p++ = '\0';
+                while (_cmd_isSeparator(*p)) {
+                    p++;
+                }
+                arg.rest = (*p != '\0') ? p : NULL;
+            }
+
+            if (!_cmd_parse(&command, arg.text, &arg)) {
+                return CMD_USAGE;
+            }
+        }
+    } else if ((command.arg != CMD_ARG_NONE) && !(command.flags & CMD_OPTIONAL)) {
+        return CMD_USAGE;
+    }
+
+    return (command.handler)(&arg) ? CMD_OK : CMD_USAGE;
+}
@@ -0,0 +1,167 @@
+/*
+ * Command.h
+ *
+ * Registry of the telnet and MQTT commands. Commands are kept in tables in flash, with their strings, looked up
+ * by a hash of their name that's computed at compile time and then compared with the name, and their argument
+ * is parsed and checked before the handler is called. The same table serves both transports: a command is the
+ * words of a telnet line joined with '_' (e.g. "boiler wwtemp 60") or the levels of an MQTT topic below cmd/ joined
+ * the same way, with the payload as the argument (cmd/boiler_wwtemp or cmd/boiler/wwtemp <= 60)
+ *
+ * Doesn't need the Arduino core, so it also builds and runs on a host
+ */
+
+#ifndef Command_h
+#define Command_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#define PROGMEM
+#define PGM_P const char *
+#endif
+
+#define CMD_TABLES_MAX 2    // # tables that can be registered, the system commands and the project commands
+#define CMD_INDEX_SIZE 128  // slots of the hash index, a power of 2 and well above the # commands and aliases
+#define CMD_WORDS_MAX 2     // max # words of a telnet line that make up a command name
+#define CMD_NAME_SIZE 24    // longest name and alias, with the '\0'
+#define CMD_USAGE_SIZE 40   // longest usage, with the '\0'
+#define CMD_DESC_SIZE 88    // longest description, with the '\0'
+#define CMD_HASH_SEED 2166136261u
+#define CMD_HASH_PRIME 16777619u
+
+// argument types, the first word after the command name
+typedef enum {
+    CMD_ARG_NONE,   // nothing, any words are ignored
+    CMD_ARG_INT,    // decimal number between min and max
+    CMD_ARG_HEX,    // hex number between min and max, e.g. an EMS type ID
+    CMD_ARG_FIXED,  // decimal fraction in a unit of 1/scale between min and max, e.g. 21.5 with FP_HALF is 43
+    CMD_ARG_BOOL,   // on/off, 1/0 or true/false
+    CMD_ARG_CHOICE, // one of the words of the usage, or its index. e.g. "<hot | eco>" takes hot, eco, 0 or 1
+    CMD_ARG_TEXT    // anything, up to the end of the line
+} _CMD_ARG;
+
+// flags
+#define CMD_SETTING 0x01  // a setting, listed by 'set' and saved to the config when it's changed
+#define CMD_OPTIONAL 0x02 // the argument can be left out
+#define CMD_TELNET 0x04   // only from the telnet console, e.g. the WiFi credentials
+
+// result of cmd_run()
+typedef enum {
+    CMD_OK,
+    CMD_UNKNOWN, // no such command
+    CMD_USAGE,   // missing or bad argument, or the handler refused it
+    CMD_DENIED   // not allowed from this transport
+} _CMD_STATUS;
+
+// the parsed argument passed to a handler
+typedef struct {
+    bool         present; // false if an optional argument was left out
+    int32_t      value;   // INT, HEX, FIXED, BOOL (1=on) or CHOICE (index of the word)
+    const char * text;    // the argument as given, or NULL
+    char *       rest;    // the words after the argument, or NULL. Handlers with more than one argument parse these
+    bool         telnet;  // from the telnet console, false for MQTT
+} _Command_Arg;
+
+typedef bool (*cmd_handler_f)(const _Command_Arg * arg);
+
+typedef struct {
+    uint32_t      hash; // of the name, cmd_hash()
+    cmd_handler_f handler;
+    uint8_t       arg;   // _CMD_ARG
+    uint8_t       flags; // CMD_xxx
+    uint16_t      scale; // FIXED only, see FixedPoint.h
+    int32_t       min;   // INT, HEX and FIXED (in 1/scale)
+    int32_t       max;
+    PGM_P         name;        // words joined with '_', which is also the MQTT topic
+    PGM_P         usage;       // the arguments as shown in the help
+    PGM_P         description; // shown in the help
+} _Command;
+
+// another name for a command, e.g. an older MQTT topic
+typedef struct {
+    uint32_t hash;   // of the alias
+    uint32_t target; // hash of the command
+    PGM_P    name;   // the alias
+} _Command_Alias;
+
+// FNV-1a, also usable at compile time
+constexpr uint32_t cmd_hashStep(uint32_t hash, char c) {
+    return (hash ^ (uint8_t)c) * CMD_HASH_PRIME;
+}
+
+constexpr uint32_t cmd_hash(const char * s, uint32_t hash = CMD_HASH_SEED) {
+    return (*s == '\0') ? hash : cmd_hash(s + 1, cmd_hashStep(hash, *s));
+}
+
+// true if no two commands of a table have the same hash, for a static_assert on a constexpr table
+template <size_t N>
+constexpr bool _cmd_uniqueFrom(const _Command (&table)[N], size_t i, size_t j) {
+    return (j >= N) || ((table[i].hash != table[j].hash) && _cmd_uniqueFrom(table, i, j + 1));
+}
+
+template <size_t N>
+constexpr bool cmd_unique(const _Command (&table)[N], size_t i = 0) {
+    return (i >= N) || (_cmd_uniqueFrom(table, i, i + 1) && cmd_unique(table, i + 1));
+}
+
+/*
+ * A table is written as a list, a macro which applies its argument to every entry. It's expanded twice:
+ * CMD_STRINGS() puts the strings of the entries in flash, each in an array of its own, and CMD_ENTRIES() makes
+ * the table entries which point to them. The name is written as an identifier, its words joined with '_'
+ *
+ *   #define MY_COMMANDS(_)                                            \
+ *       _(CMD, info, CMD_ARG_NONE, 0, cmdInfo, "", "show the values") \
+ *       _(CMD_RANGE, led_gpio, CMD_ARG_INT, CMD_SETTING, 0, 16, cmdLed, "<gpio>", "set the LED pin")
+ *
+ *   CMD_STRINGS(MY_COMMANDS)
+ *   constexpr _Command my_cmds[] PROGMEM = {CMD_ENTRIES(MY_COMMANDS)};
+ *
+ * Aliases are a list of _(alias, name) with the alias a string, at most one alias per command
+ */
+#define CMD_STRINGS(list) list(CMD_STRINGS_OF)
+#define CMD_ENTRIES(list) list(CMD_ENTRY_OF)
+#define CMD_STRINGS_OF(kind, name, ...) kind##_PGM(name, __VA_ARGS__)
+#define CMD_ENTRY_OF(kind, name, ...) kind(name, __VA_ARGS__),
+
+#define CMD_TEXT(name, usage, description)                                               \
+    static_assert(sizeof(#name) <= CMD_NAME_SIZE, "command name too long");              \
+    static_assert(sizeof(usage) <= CMD_USAGE_SIZE, "command usage too long");            \
+    static_assert(sizeof(description) <= CMD_DESC_SIZE, "command description too long"); \
+    static const char cmd_##name##_name[] PROGMEM        = #name;                        \
+    static const char cmd_##name##_usage[] PROGMEM       = usage;                        \
+    static const char cmd_##name##_description[] PROGMEM = description;
+
+// the kinds of entries
+#define CMD(name, arg, flags, handler, usage, description) \
+    { cmd_hash(#name), (handler), (arg), (flags), 1, 0, 0, cmd_##name##_name, cmd_##name##_usage, cmd_##name##_description }
+#define CMD_RANGE(name, arg, flags, min, max, handler, usage, description) \
+    { cmd_hash(#name), (handler), (arg), (flags), 1, (min), (max), cmd_##name##_name, cmd_##name##_usage, cmd_##name##_description }
+#define CMD_FIXED(name, flags, scale, min, max, handler, usage, description) \
+    { cmd_hash(#name), (handler), CMD_ARG_FIXED, (flags), (scale), (min), (max), cmd_##name##_name, cmd_##name##_usage, cmd_##name##_description }
+
+// and their strings
+#define CMD_PGM(name, arg, flags, handler, usage, description) CMD_TEXT(name, usage, description)
+#define CMD_RANGE_PGM(name, arg, flags, min, max, handler, usage, description) CMD_TEXT(name, usage, description)
+#define CMD_FIXED_PGM(name, flags, scale, min, max, handler, usage, description) CMD_TEXT(name, usage, description)
+
+// aliases
+#define CMD_ALIAS_STRINGS(list) list(CMD_ALIAS_TEXT)
+#define CMD_ALIASES(list) list(CMD_ALIAS)
+#define CMD_ALIAS_TEXT(alias, name)                                          \
+    static_assert(sizeof(alias) <= CMD_NAME_SIZE, "command alias too long"); \
+    static const char cmd_##name##_alias[] PROGMEM = alias;
+#define CMD_ALIAS(alias, name) {cmd_hash(alias), cmd_hash(#name), cmd_##name##_alias},
+
+bool             cmd_add(const _Command * table, uint8_t count, const _Command_Alias * aliases, uint8_t alias_count);
+const _Command * cmd_find(const char * name);
+const _Command * cmd_findLine(char * line, char ** args);
+const _Command * cmd_findTopic(const char * topic);
+const _Command * cmd_get(uint8_t table, uint8_t index);
+uint8_t          cmd_count(uint8_t table);
+void             cmd_read(const _Command * cmd, _Command * copy);
+_CMD_STATUS      cmd_run(const _Command * cmd, char * args, bool telnet);
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * FixedPoint.cpp
+ *
+ * Fixed-point formatting and parsing, see FixedPoint.h
+ */
+
+#include "FixedPoint.h"
+
+#include <stdio.h>
+
+static const uint16_t _fp_powers[] = {1, 10, 100, 1000};
+
+// # decimals needed to show a unit of 1/scale, e.g. 1 for halves and tenths, 2 for sixteenths
+uint8_t fp_decimals(uint32_t scale) {
+    uint8_t decimals = 0;
+    while ((decimals < FP_DECIMALS_MAX) && (_fp_powers[decimals] < scale)) {
+        decimals++;
+    }
+    return decimals;
+}
+
+/*
+ * value/scale as text with the given number of decimals, rounded half away from zero
+ * |value| * 10^decimals has to fit in 32 bits, so divide big values down before formatting them
+ */
+char * fp_format(char * buffer, size_t size, int32_t value, uint32_t scale, uint8_t decimals) {
+    if (decimals > FP_DECIMALS_MAX) {
+        decimals = FP_DECIMALS_MAX;
+    }
+    if (scale == 0) {
+        scale = 1;
+    }
+
+    uint32_t power    = _fp_powers[decimals];
+    uint32_t absolute = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+    uint32_t scaled   = ((absolute * power) + (scale / 2)) / scale;
+
+    const char * sign = ((value < 0) && (scaled != 0)) ? "-" : ""; // no -0.0
+
+    if (decimals == 0) {
+        snprintf(buffer, size, "%s%u", sign, (unsigned int)scaled);
+    } else {
+        snprintf(buffer, size, "%s%u.%0*u", sign, (unsigned int)(scaled / power), decimals, (unsigned int)(scaled % power));
+    }
+
+    return buffer;
+}
+
+/*
+ * parse a decimal number like "21.5", "-3", " 0,25" into units of 1/scale, rounded to the nearest unit
+ * a comma is taken as the decimal point, digits after the 4th decimal are ignored
+ * returns false if the text isn't a number or the value doesn't fit
+ */
+bool fp_parse(const char * s, uint32_t scale, int32_t * value) {
+    if ((s == nullptr) || (scale == 0)) {
+        return false;
+    }
+
+    while ((*s == ' ') || (*s == '\t')) {
+        s++;
+    }
+
+    bool negative = (*s == '-');
+    if ((*s == '-') || (*s == '+')) {
+        s++;
+    }
+
+    uint32_t whole    = 0;
+    uint32_t fraction = 0;
+    uint32_t power    = 1;
+    bool     digits   = false;
+
+    while ((*s >= '0') && (*s <= '9')) {
+        whole = (whole * 10) + (*s++ - '0');
+        if (whole > (0x7FFFFFFF / scale)) {
+            return false; // too big
+        }
+        digits = true;
+    }
+
+    if ((*s == '.') || (*s == ',')) {
+        s++;
+        while ((*s >= '0') && (*s <= '9')) {
+            if (power < 10000) {
+                fraction = (fraction * 10) + (*s - '0');
+                power *= 10;
+            }
+            s++;
+            digits = true;
+        }
+    }
+
+    // allow trailing white space, e.g. a new line from the telnet input
+    while ((*s == ' ') || (*s == '\t') || (*s == '\r') || (*s == '\n')) {
+        s++;
+    }
+
+    if (!digits || (*s != '\0')) {
+        return false;
+    }
+
+    uint32_t result = (whole * scale) + (((fraction * scale) + (power / 2)) / power);
+    if (result > 0x7FFFFFFF) {
+        return false;
+    }
+
+    *value = negative ? -(int32_t)result : (int32_t)result;
+    return true;
+}
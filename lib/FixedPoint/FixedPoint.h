@@ -0,0 +1,28 @@
+/*
+ * FixedPoint.h
+ *
+ * Formatting and parsing of fixed-point values, kept as integers in a unit of 1/scale
+ * e.g. 215 with FP_DECI is 21.5. The ESP8266 has no FPU, so values are never converted to float or double
+ *
+ * Doesn't need the Arduino core, so it also builds and runs on a host
+ */
+
+#ifndef FixedPoint_h
+#define FixedPoint_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the scales used by the EMS devices and sensors
+#define FP_HALF 2       // half degrees, the 1 byte thermostat setpoints
+#define FP_DECI 10      // tenths, most EMS temperatures and the system pressure
+#define FP_SIXTEENTH 16 // the Dallas DS18 readings
+#define FP_CENTI 100    // hundredths, the Easy thermostat
+
+#define FP_DECIMALS_MAX 3
+
+uint8_t fp_decimals(uint32_t scale);
+char *  fp_format(char * buffer, size_t size, int32_t value, uint32_t scale, uint8_t decimals);
+bool    fp_parse(const char * s, uint32_t scale, int32_t * value);
+
+#endif
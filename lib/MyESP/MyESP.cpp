@@ -8,8 +8,17 @@
 
 #include "MyESP.h"
 
+#include <CRC32.h> // https://github.com/bakercp/CRC32
+#include <Trace.h>
+
+#include <memory>
+
 EEPROM_Rotate EEPROMr;
 
+// flight recorder, see recorderAdd()
+static MyESP_RecorderEvent _recorder[MYESP_RECORDER_SIZE];
+static uint8_t             _recorder_head = 0; // next slot to write, which holds the oldest event
+
 union system_rtcmem_t {
     struct {
         uint8_t  stability_counter;
@@ -22,6 +31,92 @@ union system_rtcmem_t {
 uint8_t RtcmemSize = (sizeof(RtcmemData) / 4u);
 auto    Rtcmem     = reinterpret_cast<volatile RtcmemData *>(RTCMEM_ADDR);
 
+// names of the parts in MYESP_HEAP
+PROGMEM const char         heap_part_mqtt[]   = "MQTT";
+PROGMEM const char         heap_part_json[]   = "JSON";
+PROGMEM const char         heap_part_telnet[] = "Telnet";
+PROGMEM const char         heap_part_ds18[]   = "DS18";
+PROGMEM const char * const heap_part_string[] = {heap_part_mqtt, heap_part_json, heap_part_telnet, heap_part_ds18};
+
+static_assert(ArraySize(heap_part_string) == MYESP_HEAP_MAX, "heap_part_string doesn't match MYESP_HEAP");
+
+// names of the parts in MYESP_CPU
+PROGMEM const char         cpu_part_uart[]    = "UART";
+PROGMEM const char         cpu_part_parser[]  = "Parser";
+PROGMEM const char         cpu_part_publish[] = "Publish";
+PROGMEM const char         cpu_part_ds18[]    = "DS18";
+PROGMEM const char         cpu_part_telnet[]  = "Telnet";
+PROGMEM const char         cpu_part_wifi[]    = "WiFi";
+PROGMEM const char         cpu_part_mqtt[]    = "MQTT";
+PROGMEM const char * const cpu_part_string[]  = {cpu_part_uart, cpu_part_parser, cpu_part_publish, cpu_part_ds18, cpu_part_telnet, cpu_part_wifi, cpu_part_mqtt};
+
+static_assert(ArraySize(cpu_part_string) == MYESP_CPU_MAX, "cpu_part_string doesn't match MYESP_CPU");
+
+// the system commands, the project adds its own with setTelnet()
+#define MYESP_COMMANDS(_)                                                                                                                                   \
+    _(CMD, reboot, CMD_ARG_NONE, 0, MyESP::_cmdReboot, "", "restart the ESP")                                                                               \
+    _(CMD, system, CMD_ARG_NONE, 0, MyESP::_cmdSystem, "", "show system stats")                                                                             \
+    _(CMD, mem, CMD_ARG_NONE, 0, MyESP::_cmdMem, "", "show heap and stack usage")                                                                           \
+    _(CMD, cpu, CMD_ARG_NONE, 0, MyESP::_cmdCpu, "", "show CPU usage")                                                                                      \
+    _(CMD, config, CMD_ARG_NONE, 0, MyESP::_cmdConfig, "", "show the config as JSON")                                                                       \
+    _(CMD, quit, CMD_ARG_NONE, CMD_TELNET, MyESP::_cmdQuit, "", "exit telnet session")                                                                      \
+    _(CMD, erase, CMD_ARG_NONE, CMD_TELNET, MyESP::_cmdErase, "", "erase all settings and restart")                                                         \
+    _(CMD, crash, CMD_ARG_CHOICE, 0, MyESP::_cmdCrash, "<dump | clear>", "show or clear the last crash")                                                    \
+    _(CMD, trace, CMD_ARG_CHOICE, CMD_OPTIONAL, MyESP::_cmdTrace, "[clear]", "dump the event trace as Chrome trace JSON")                                   \
+    _(CMD, config_import, CMD_ARG_TEXT, 0, MyESP::_cmdConfigImport, "<json>", "merge JSON settings into the config and save it")                            \
+    _(CMD, config_export, CMD_ARG_NONE, 0, MyESP::_cmdConfigExport, "", "publish the config as JSON to MQTT")                                               \
+    _(CMD, boottime, CMD_ARG_TEXT, 0, MyESP::_cmdBoottime, "<time>", "set the boot time, e.g. the server's reply to the start message")                     \
+                                                                                                                                                            \
+    _(CMD, wifi_ssid, CMD_ARG_TEXT, CMD_SETTING | CMD_OPTIONAL | CMD_TELNET, MyESP::_cmdWifiSsid, "[value]", "set the WiFi network")                        \
+    _(CMD, wifi_password, CMD_ARG_TEXT, CMD_SETTING | CMD_OPTIONAL | CMD_TELNET, MyESP::_cmdWifiPassword, "[value]", "set the WiFi password")               \
+    _(CMD, mqtt_host, CMD_ARG_TEXT, CMD_SETTING | CMD_OPTIONAL | CMD_TELNET, MyESP::_cmdMqttHost, "[value]", "set the MQTT broker")                         \
+    _(CMD, mqtt_username, CMD_ARG_TEXT, CMD_SETTING | CMD_OPTIONAL | CMD_TELNET, MyESP::_cmdMqttUsername, "[value]", "set the MQTT username")               \
+    _(CMD, mqtt_password, CMD_ARG_TEXT, CMD_SETTING | CMD_OPTIONAL | CMD_TELNET, MyESP::_cmdMqttPassword, "[value]", "set the MQTT password")               \
+    _(CMD, serial, CMD_ARG_BOOL, CMD_SETTING | CMD_OPTIONAL, MyESP::_cmdSerial, "<on | off>", "use the serial port for the console instead of the EMS bus") \
+    _(CMD, heartbeat, CMD_ARG_BOOL, CMD_SETTING | CMD_OPTIONAL, MyESP::_cmdHeartbeat, "<on | off>", "publish system stats to MQTT")
+
+#define MYESP_ALIASES(_)                            \
+    _(MQTT_TOPIC_RESTART, reboot) /* cmd/restart */ \
+    _(MQTT_TOPIC_START, boottime) /* cmd/start, the reply to the start message */
+
+CMD_STRINGS(MYESP_COMMANDS)
+CMD_ALIAS_STRINGS(MYESP_ALIASES)
+
+const _Command       MyESP::_commands[] PROGMEM = {CMD_ENTRIES(MYESP_COMMANDS)};
+const _Command_Alias MyESP::_aliases[] PROGMEM  = {CMD_ALIASES(MYESP_ALIASES)};
+
+// publish policies of the system topics, the last will is always sent with QoS 1 and retained
+const MyESP_MQTTPolicy MyESP::_policies[] PROGMEM = {
+    MQTT_POLICY(MQTT_TOPIC_HEARTBEAT, 0, false, MQTT_PRIORITY_LOW, 0, 0),
+    MQTT_POLICY(MQTT_TOPIC_CPU, 0, false, MQTT_PRIORITY_LOW, 0, 0),
+    MQTT_POLICY(MQTT_TOPIC_START, 1, false, MQTT_PRIORITY_HIGH, 0, 0),
+    MQTT_POLICY(MQTT_TOPIC_CONFIG, 1, true, MQTT_PRIORITY_LOW, 2, 10000) // it's big, don't let config_export flood the broker
+};
+
+// a command as it's typed on telnet, e.g. "boiler wwtemp" or "set shower_timer", with its arguments if usage is set
+static char * _commandKey(char * key, size_t size, const _Command * command, bool usage) {
+    bool   setting = (command->flags & CMD_SETTING);
+    size_t start   = setting ? 4 : 0;
+    char   name[CMD_NAME_SIZE];
+    char   args[CMD_USAGE_SIZE];
+
+    strlcpy_P(name, command->name, sizeof(name));
+    strlcpy_P(args, usage ? command->usage : PSTR(""), sizeof(args));
+
+    snprintf(key, size, "%s%s%s%s", setting ? "set " : "", name, args[0] ? " " : "", args);
+
+    // words of a command are joined with '_' in its name
+    if (!setting) {
+        for (size_t i = start; (i < start + strlen(name)) && key[i]; i++) {
+            if (key[i] == '_') {
+                key[i] = ' ';
+            }
+        }
+    }
+
+    return key;
+}
+
 // constructor
 MyESP::MyESP() {
     _app_hostname = strdup("MyESP");
@@ -31,16 +126,47 @@ MyESP::MyESP() {
     _boottime     = NULL;
     _load_average = 100; // calculated load average
 
-    _telnetcommand_callback = NULL;
-    _telnet_callback        = NULL;
+    _heap_min       = 0xFFFFFFFF;
+    _heap_block_min = 0xFFFFFFFF;
+    _heap_frag_max  = 0;
+    memset(_heap_counters, 0, sizeof(_heap_counters));
+
+    memset(_cpu_counters, 0, sizeof(_cpu_counters));
+    _cpu_depth = 0;
+    _cpu_busy  = 0;
+
+    _telnet_callback    = NULL;
+    _telnet_render      = NULL;
+    _telnet_render_step = 0;
 
     _command[0] = '\0';
 
     _fs_callback          = NULL;
     _fs_settings_callback = NULL;
+    _fs_config_callback   = NULL;
+    _fs_dirty             = false;
+    _fs_dirty_timestamp   = 0;
+    _fs_writes            = 0;
+    _fs_crc               = 0;
+    _fs_import            = NULL;
+    _fs_import_telnet     = false;
+
+    _metrics_server    = NULL;
+    _metrics_callback  = NULL;
+    _metrics_client    = NULL;
+    _metrics_buffer    = NULL;
+    _metrics_length    = 0;
+    _metrics_sent      = 0;
+    _metrics_mark      = 0;
+    _metrics_full      = false;
+    _metrics_step      = 0;
+    _metrics_done      = false;
+    _metrics_requests  = 0;
+    _metrics_truncated = 0;
 
     _helpProjectCmds       = NULL;
     _helpProjectCmds_count = 0;
+    (void)cmd_add(_commands, ArraySize(_commands), _aliases, ArraySize(_aliases));
 
     _use_serial                = false;
     _heartbeat                 = false;
@@ -53,7 +179,17 @@ MyESP::MyESP() {
     _mqtt_will_online_payload  = NULL;
     _mqtt_will_offline_payload = NULL;
     _mqtt_base                 = NULL;
-    _mqtt_topic                = NULL;
+    _mqtt_prefix               = NULL;
+    _mqtt_cmd_topic            = NULL;
+    _mqtt_cmd_length           = 0;
+    _mqtt_will_topic_full      = NULL;
+    _mqtt_policies             = NULL;
+    _mqtt_policy_count         = 0;
+    _mqtt_limited              = 0;
+    _mqtt_deferred             = 0;
+    _mqtt_dropped              = 0;
+    _mqtt_congested            = 0;
+    memset(_mqtt_rates, 0, sizeof(_mqtt_rates));
     _mqtt_qos                  = 0;
     _mqtt_reconnect_delay      = MQTT_RECONNECT_DELAY_MIN;
     _mqtt_last_connection      = 0;
@@ -158,6 +294,160 @@ uint32_t MyESP::getUsedHeap() {
     return getInitialFreeHeap() - ESP.getFreeHeap();
 }
 
+// keep track of the lowest free heap, and sample the largest free block and fragmentation
+// called from the main loop
+void MyESP::_heapCheck() {
+    static uint32_t last_check = 0;
+
+    uint32_t free_heap = ESP.getFreeHeap();
+    if (free_heap < _heap_min) {
+        _heap_min = free_heap;
+    }
+
+    // these walk the heap, so not on every loop
+    if ((last_check != 0) && ((millis() - last_check) < HEAP_CHECK_INTERVAL)) {
+        return;
+    }
+    last_check = millis();
+
+#if defined(ESP8266)
+    uint32_t block = ESP.getMaxFreeBlockSize();
+    if (block < _heap_block_min) {
+        _heap_block_min = block;
+    }
+
+    uint8_t frag = ESP.getHeapFragmentation();
+    if (frag > _heap_frag_max) {
+        _heap_frag_max = frag;
+    }
+#endif
+}
+
+// add the heap a part of the code didn't give back to its counter
+// free_heap_before is ESP.getFreeHeap() from just before that code ran
+void MyESP::heapTrack(uint8_t part, uint32_t free_heap_before) {
+    if (part >= MYESP_HEAP_MAX) {
+        return;
+    }
+
+    uint32_t free_heap = ESP.getFreeHeap();
+    _heap_counters[part].calls++;
+    _heap_counters[part].retained += (int32_t)(free_heap_before - free_heap);
+
+    if (free_heap < _heap_min) {
+        _heap_min = free_heap;
+    }
+}
+
+// show the heap and stack stats, with the 'mem' command
+void MyESP::showMemoryStats() {
+    uint32_t total_memory = getInitialFreeHeap();
+    uint32_t free_memory  = ESP.getFreeHeap();
+
+    myDebug_P(PSTR("%sMemory stats:%s"), COLOR_BOLD_ON, COLOR_BOLD_OFF);
+    myDebug_P(PSTR(""));
+    myDebug_P(PSTR(" [MEM] Free heap: %d bytes (%d%%), initially %d bytes, lowest %d bytes"),
+              free_memory,
+              100 * free_memory / total_memory,
+              total_memory,
+              _heap_min);
+#if defined(ESP8266)
+    myDebug_P(PSTR(" [MEM] Largest free block: %d bytes, lowest %d bytes"), ESP.getMaxFreeBlockSize(), _heap_block_min);
+    myDebug_P(PSTR(" [MEM] Fragmentation: %d%%, highest %d%%"), ESP.getHeapFragmentation(), _heap_frag_max);
+    myDebug_P(PSTR(" [MEM] Free stack: %d bytes at its lowest"), ESP.getFreeContStack());
+#endif
+
+    char buffer[20];
+    for (uint8_t i = 0; i < MYESP_HEAP_MAX; i++) {
+        strlcpy_P(buffer, heap_part_string[i], sizeof(buffer));
+        myDebug_P(PSTR(" [MEM] %s: %d calls, %d bytes retained"), buffer, _heap_counters[i].calls, _heap_counters[i].retained);
+    }
+
+    myDebug_P(PSTR(""));
+}
+
+/*
+ * CPU accounting, with the CPU cycle counter
+ *   uint32_t cpu = myESP.cpuStart();
+ *   ...
+ *   myESP.cpuTrack(MYESP_CPU_xxx, cpu);
+ * parts can be nested, only the outermost adds to the load
+ */
+uint32_t MyESP::cpuStart() {
+    _cpu_depth++;
+    return ESP.getCycleCount();
+}
+
+void MyESP::cpuTrack(uint8_t part, uint32_t start) {
+    uint32_t cycles = ESP.getCycleCount() - start; // also right when the counter wrapped
+
+    if (_cpu_depth > 0) {
+        _cpu_depth--;
+    }
+    if (_cpu_depth == 0) {
+        _cpu_busy += cycles;
+    }
+
+    if (part >= MYESP_CPU_MAX) {
+        return;
+    }
+
+    _cpu_counters[part].calls++;
+    _cpu_counters[part].cycles += cycles;
+    if (cycles > _cpu_counters[part].max_cycles) {
+        _cpu_counters[part].max_cycles = cycles;
+    }
+}
+
+// show the CPU usage of each part, with the 'cpu' command
+void MyESP::showCpuStats() {
+    uint32_t mhz = ESP.getCpuFreqMHz();
+
+    myDebug_P(PSTR("%sCPU stats:%s"), COLOR_BOLD_ON, COLOR_BOLD_OFF);
+    myDebug_P(PSTR(""));
+    myDebug_P(PSTR(" [CPU] Load: %d%% over the last %d seconds, at %d MHz"), getSystemLoadAverage(), LOADAVG_INTERVAL / 1000, mhz);
+
+    char buffer[20];
+    for (uint8_t i = 0; i < MYESP_CPU_MAX; i++) {
+        strlcpy_P(buffer, cpu_part_string[i], sizeof(buffer));
+        myDebug_P(PSTR(" [CPU] %s: %d.%d%%, %d calls, longest %d us"),
+                  buffer,
+                  _cpu_counters[i].load / 10,
+                  _cpu_counters[i].load % 10,
+                  _cpu_counters[i].calls,
+                  _cpu_counters[i].max_cycles / mhz);
+    }
+
+    myDebug_P(PSTR(""));
+}
+
+// publish the CPU usage of each part to MQTT, as part=<% of the CPU>/<longest run in us>
+void MyESP::_cpuPublish() {
+    uint32_t mhz = ESP.getCpuFreqMHz();
+
+    char payload[200] = {0};
+    char s[12];
+    char buffer[20];
+
+    strlcpy(payload, "load=", sizeof(payload));
+    strlcat(payload, ltoa(getSystemLoadAverage(), s, 10), sizeof(payload));
+    strlcat(payload, "%", sizeof(payload));
+
+    for (uint8_t i = 0; i < MYESP_CPU_MAX; i++) {
+        strlcpy_P(buffer, cpu_part_string[i], sizeof(buffer));
+        snprintf(s, sizeof(s), "%d.%d", _cpu_counters[i].load / 10, _cpu_counters[i].load % 10);
+        strlcat(payload, ", ", sizeof(payload));
+        strlcat(payload, buffer, sizeof(payload));
+        strlcat(payload, "=", sizeof(payload));
+        strlcat(payload, s, sizeof(payload));
+        strlcat(payload, "%/", sizeof(payload));
+        strlcat(payload, ultoa(_cpu_counters[i].max_cycles / mhz, s, 10), sizeof(payload));
+        strlcat(payload, "us", sizeof(payload));
+    }
+
+    myESP.mqttPublish(MQTT_TOPIC_CPU, payload);
+}
+
 // called when WiFi is connected, and used to start OTA, MQTT
 void MyESP::_wifiCallback(justwifi_messages_t code, char * parameter) {
     if ((code == MESSAGE_CONNECTED)) {
@@ -185,6 +475,7 @@ void MyESP::_wifiCallback(justwifi_messages_t code, char * parameter) {
         _mqtt_setup();
 
         _wifi_connected = true;
+        _recorderEvent(MYESP_EVENT_WIFI_CONNECTED);
 
         // finally if we don't want Serial anymore, turn it off
         if (!_use_serial) {
@@ -236,6 +527,7 @@ void MyESP::_wifiCallback(justwifi_messages_t code, char * parameter) {
     if (code == MESSAGE_DISCONNECTED) {
         myDebug_P(PSTR("[WIFI] Disconnected"));
         _wifi_connected = false;
+        _recorderEvent(MYESP_EVENT_WIFI_DISCONNECTED);
     }
 }
 
@@ -251,30 +543,24 @@ void MyESP::_mqttOnMessage(char * topic, char * payload, size_t len) {
     if (len == 0)
         return;
 
+    _recorderEvent(MYESP_EVENT_MQTT_MESSAGE);
+
     char message[len + 1];
     strlcpy(message, (char *)payload, len + 1);
 
     // myDebug_P(PSTR("[MQTT] Received %s => %s"), topic, message); // enable for debugging
 
-    // topics are in format MQTT_BASE/HOSTNAME/TOPIC
-    char * topic_magnitude = strrchr(topic, '/'); // strip out everything until last /
-    if (topic_magnitude != nullptr) {
-        topic = topic_magnitude + 1;
-    }
-
-    // check for standard messages
-    // Restart the device
-    if (strcmp(topic, MQTT_TOPIC_RESTART) == 0) {
-        myDebug_P(PSTR("[MQTT] Received restart command"), message);
-        myESP.resetESP();
+    // the only subscription is MQTT_BASE/HOSTNAME/cmd/#, the rest of the topic is the command
+    if (strncmp(topic, _mqtt_cmd_topic, _mqtt_cmd_length) != 0) {
         return;
     }
+    topic += _mqtt_cmd_length;
 
-    // handle response from a start message
-    // for example with HA it sends the system time from the server
-    if (strcmp(topic, MQTT_TOPIC_START) == 0) {
-        myDebug_P(PSTR("[MQTT] Received boottime: %s"), message);
-        myESP.setBoottime(message);
+    // a command, from the same table as telnet
+    const _Command * cmd = cmd_findTopic(topic);
+    if (cmd) {
+        myDebug_P(PSTR("[MQTT] Received command %s %s"), topic, message);
+        _commandRun(cmd, message, false);
         return;
     }
 
@@ -286,8 +572,9 @@ void MyESP::_mqttOnMessage(char * topic, char * payload, size_t len) {
 // to MQTT_BASE/app_hostname/topic
 void MyESP::mqttSubscribe(const char * topic) {
     if (mqttClient.connected() && (strlen(topic) > 0)) {
-        unsigned int packetId = mqttClient.subscribe(_mqttTopic(topic), _mqtt_qos);
-        myDebug_P(PSTR("[MQTT] Subscribing to %s (PID %d)"), _mqttTopic(topic), packetId);
+        char         buffer[MQTT_MAX_TOPIC_SIZE];
+        unsigned int packetId = mqttClient.subscribe(_mqttTopic(buffer, sizeof(buffer), topic), _mqtt_qos);
+        myDebug_P(PSTR("[MQTT] Subscribing to %s (PID %d)"), buffer, packetId);
     }
 }
 
@@ -295,32 +582,153 @@ void MyESP::mqttSubscribe(const char * topic) {
 // to MQTT_BASE/app_hostname/topic
 void MyESP::mqttUnsubscribe(const char * topic) {
     if (mqttClient.connected() && (strlen(topic) > 0)) {
-        unsigned int packetId = mqttClient.unsubscribe(_mqttTopic(topic));
-        myDebug_P(PSTR("[MQTT] Unsubscribing to %s (PID %d)"), _mqttTopic(topic), packetId);
+        char         buffer[MQTT_MAX_TOPIC_SIZE];
+        unsigned int packetId = mqttClient.unsubscribe(_mqttTopic(buffer, sizeof(buffer), topic));
+        myDebug_P(PSTR("[MQTT] Unsubscribing to %s (PID %d)"), buffer, packetId);
+    }
+}
+
+// MQTT Publish, with the QoS, retain, priority and rate limit of the topic's policy, or the defaults of setMQTT() if it has none
+// returns false if it wasn't sent: the topic's rate limit is used up, it's low priority and deferred while the MQTT client
+// or the heap are short, or the client couldn't take it. The caller can try again with the next value
+bool MyESP::mqttPublish(const char * topic, const char * payload) {
+    if (!mqttClient.connected()) {
+        return false;
+    }
+
+    MyESP_MQTTPolicy policy = {_mqtt_qos, _mqtt_retain, MQTT_PRIORITY_HIGH, 0, 0, ""};
+    const char *     full   = NULL;
+    char             buffer[MQTT_MAX_TOPIC_SIZE];
+
+    int8_t index = _mqttFindPolicy(topic);
+    if (index >= 0) {
+        memcpy_P(&policy, _mqttPolicy(index), sizeof(MyESP_MQTTPolicy));
+        full = _mqtt_rates[index].topic;
+    }
+
+    if (!full) {
+        full = _mqttTopic(buffer, sizeof(buffer), topic);
+    }
+
+    // hold back low priority topics before taking from their rate limit, so what's important goes first
+    if ((policy.priority == MQTT_PRIORITY_LOW) && _mqttCongested(strlen(full) + strlen(payload) + MQTT_PACKET_OVERHEAD)) {
+        _mqtt_deferred++;
+        return false;
+    }
+
+    if ((index >= 0) && !_mqttRateAllow(index, &policy)) {
+        _mqtt_limited++;
+        return false;
+    }
+
+    // myDebug_P(PSTR("[MQTT] Sending pubish to %s with payload %s"), full, payload);
+    uint32_t heap = ESP.getFreeHeap();
+    bool     sent = (mqttClient.publish(full, policy.qos, policy.retain, payload) != 0);
+    heapTrack(MYESP_HEAP_MQTT, heap);
+
+    // the client returns 0 when its TCP connection has no room left for the packet
+    if (!sent) {
+        _mqtt_dropped++;
+        _mqtt_congested = millis();
+    }
+
+    return sent;
+}
+
+// true if a low priority publish of size bytes has to wait
+// for MQTT_BACKOFF ms after the client couldn't take one, or if it would leave less than MQTT_HEAP_RESERVE in one block
+bool MyESP::_mqttCongested(size_t size) {
+    if (_mqtt_congested) {
+        if ((millis() - _mqtt_congested) < MQTT_BACKOFF) {
+            return true;
+        }
+        _mqtt_congested = 0;
+    }
+
+    return (ESP.getMaxFreeBlockSize() < (size + MQTT_HEAP_RESERVE));
+}
+
+// set the publish policies of the project's topics, a table in flash. Topics without one use the defaults of setMQTT()
+// has to be called before begin(), the full topics are built when WiFi first connects
+void MyESP::setMQTTPolicies(const MyESP_MQTTPolicy * policies, uint8_t count) {
+    _mqtt_policies     = policies;
+    _mqtt_policy_count = count;
+    if ((ArraySize(_policies) + count) > MQTT_POLICIES_MAX) {
+        _mqtt_policy_count = MQTT_POLICIES_MAX - ArraySize(_policies);
+    }
+}
+
+// policy by its index, the system ones first
+const MyESP_MQTTPolicy * MyESP::_mqttPolicy(uint8_t index) {
+    if (index < ArraySize(_policies)) {
+        return &_policies[index];
+    }
+    return &_mqtt_policies[index - ArraySize(_policies)];
+}
+
+// index of the first policy for a topic, -1 if there's none
+int8_t MyESP::_mqttFindPolicy(const char * topic) {
+    uint8_t count = ArraySize(_policies) + _mqtt_policy_count;
+
+    for (uint8_t i = 0; i < count; i++) {
+        const char * name = _mqttPolicy(i)->topic;
+        size_t       len  = strlen_P(name);
+        if ((len > 0) && (pgm_read_byte(name + len - 1) == '/')) {
+            if (strncmp_P(topic, name, len) == 0) {
+                return i;
+            }
+        } else if (strcmp_P(topic, name) == 0) {
+            return i;
+        }
     }
+
+    return -1;
 }
 
-// MQTT Publish
-void MyESP::mqttPublish(const char * topic, const char * payload) {
-    // myDebug_P(PSTR("[MQTT] Sending pubish to %s with payload %s"), _mqttTopic(topic), payload);
-    mqttClient.publish(_mqttTopic(topic), _mqtt_qos, _mqtt_retain, payload);
+// true if the rate limit of a topic allows another publish, and takes it
+bool MyESP::_mqttRateAllow(uint8_t index, const MyESP_MQTTPolicy * policy) {
+    if ((policy->burst == 0) || (policy->interval == 0)) {
+        return true;
+    }
+
+    MyESP_MQTTRate * rate = &_mqtt_rates[index];
+    uint32_t         now  = millis();
+
+    if (rate->tokens >= policy->burst) {
+        rate->earned = now; // full, there's nothing to earn back
+    } else {
+        uint32_t earned = (now - rate->earned) / policy->interval;
+        if (earned > 0) {
+            rate->tokens = (rate->tokens + earned >= policy->burst) ? policy->burst : rate->tokens + earned;
+            rate->earned += earned * policy->interval;
+        }
+    }
+
+    if (rate->tokens == 0) {
+        return false;
+    }
+    rate->tokens--;
+    return true;
 }
 
 // MQTT onConnect - when a connect is established
 void MyESP::_mqttOnConnect() {
     myDebug_P(PSTR("[MQTT] Connected"));
     _mqtt_reconnect_delay = MQTT_RECONNECT_DELAY_MIN;
+    _recorderEvent(MYESP_EVENT_MQTT_CONNECTED);
 
     _mqtt_last_connection = millis();
 
     // say we're alive to the Last Will topic
-    mqttClient.publish(_mqttTopic(_mqtt_will_topic), 1, true, _mqtt_will_online_payload);
+    if (_mqtt_will_topic_full) {
+        mqttClient.publish(_mqtt_will_topic_full, 1, true, _mqtt_will_online_payload);
+    }
 
-    // subscribe to general subs
-    mqttSubscribe(MQTT_TOPIC_RESTART);
+    // one subscription for all commands, they're routed by _mqttOnMessage()
+    unsigned int packetId = mqttClient.subscribe(_mqtt_cmd_topic, _mqtt_qos);
+    myDebug_P(PSTR("[MQTT] Subscribing to %s (PID %d)"), _mqtt_cmd_topic, packetId);
 
-    // subscribe to a start message and send the first publish
-    myESP.mqttSubscribe(MQTT_TOPIC_START);
+    // send the start message, the reply comes back on cmd/start
     myESP.mqttPublish(MQTT_TOPIC_START, MQTT_TOPIC_START_PAYLOAD);
 
     // call custom function to handle mqtt receives
@@ -333,9 +741,12 @@ void MyESP::_mqtt_setup() {
         myDebug_P(PSTR("[MQTT] disabled"));
     }
 
+    _mqttInternTopics();
+
     mqttClient.onConnect([this](bool sessionPresent) { _mqttOnConnect(); });
 
     mqttClient.onDisconnect([this](AsyncMqttClientDisconnectReason reason) {
+        _recorderEvent(MYESP_EVENT_MQTT_DISCONNECTED);
         if (reason == AsyncMqttClientDisconnectReason::TCP_DISCONNECTED) {
             myDebug_P(PSTR("[MQTT] TCP Disconnected"));
             (_mqtt_callback)(MQTT_DISCONNECT_EVENT, NULL, NULL); // call callback with disconnect
@@ -363,7 +774,13 @@ void MyESP::_mqtt_setup() {
     //mqttClient.onPublish([this](uint16_t packetId) { myDebug_P(PSTR("[MQTT] Publish ACK for PID %d"), packetId); });
 
     mqttClient.onMessage([this](char * topic, char * payload, AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total) {
+        uint32_t heap = ESP.getFreeHeap();
+        uint32_t cpu  = cpuStart();
+        TRACE_BEGIN(TRACE_TASK, "_mqttOnMessage");
         _mqttOnMessage(topic, payload, len);
+        TRACE_END(TRACE_TASK, "_mqttOnMessage");
+        cpuTrack(MYESP_CPU_MQTT, cpu);
+        heapTrack(MYESP_HEAP_MQTT, heap);
     });
 }
 
@@ -394,6 +811,7 @@ void MyESP::setOTA(ota_callback_f OTACallback_pre, ota_callback_f OTACallback_po
 // OTA callback when the upload process starts
 void MyESP::_OTACallback() {
     myDebug_P(PSTR("[OTA] Start"));
+    _recorderEvent(MYESP_EVENT_OTA_START);
 
     // If we are not specifically reserving the sectors we are using as
     // EEPROM in the memory layout then any OTA upgrade will overwrite
@@ -468,16 +886,46 @@ void MyESP::_eeprom_setup() {
     EEPROMr.begin(SPI_FLASH_SEC_SIZE);
 }
 
-// Set callback of sketch function to process project messages
-void MyESP::setTelnet(command_t * cmds, uint8_t count, telnetcommand_callback_f callback_cmd, telnet_callback_f callback) {
-    _helpProjectCmds        = cmds;         // command list
-    _helpProjectCmds_count  = count;        // number of commands
-    _telnetcommand_callback = callback_cmd; // external function to handle commands
-    _telnet_callback        = callback;
+// Add the commands of the project, in flash, to the ones of telnet and MQTT
+void MyESP::setTelnet(const _Command * cmds, uint8_t count, const _Command_Alias * aliases, uint8_t alias_count, telnet_callback_f callback) {
+    if (!cmd_add(cmds, count, aliases, alias_count)) {
+        myDebug_P(PSTR("[TELNET] Too many commands, or a name is used twice"));
+    }
+    _helpProjectCmds       = cmds;  // command list
+    _helpProjectCmds_count = count; // number of commands
+    _telnet_callback       = callback;
+}
+
+/*
+ * Render a long output in parts, so it doesn't overflow the telnet buffer and doesn't hold up the main loop
+ * render is called with step 0, 1, 2... each time the buffer has room for another part, until it returns false
+ * a new command stops an output that's still being rendered
+ */
+void MyESP::telnetRender(telnet_render_f render) {
+    _telnet_render      = render;
+    _telnet_render_step = 0;
+    _telnetRenderLoop(); // the first part right away
+}
+
+// render the next part of a long output, once the telnet client has taken enough of the buffer
+// without a client there's nothing to wait for, the output only goes to the serial port and the offline buffer
+void MyESP::_telnetRenderLoop() {
+    if (!_telnet_render) {
+        return;
+    }
+
+    if (SerialAndTelnet.isClientConnected() && (SerialAndTelnet.getBufferFree() < TELNET_RENDER_SPACE)) {
+        return;
+    }
+
+    if (!_telnet_render(_telnet_render_step++)) {
+        _telnet_render = NULL;
+    }
 }
 
 void MyESP::_telnetConnected() {
     myDebug_P(PSTR("[TELNET] Telnet connection established"));
+    _recorderEvent(MYESP_EVENT_TELNET_CONNECTED);
     _consoleShowHelp(); // Show the initial message
 
     // show crash dump if just restarted after a fatal crash
@@ -501,6 +949,7 @@ void MyESP::_telnetConnected() {
 
 void MyESP::_telnetDisconnected() {
     myDebug_P(PSTR("[TELNET] Telnet connection closed"));
+    _recorderEvent(MYESP_EVENT_TELNET_DISCONNECTED);
     if (_telnet_callback) {
         (_telnet_callback)(TELNET_EVENT_DISCONNECT); // call callback
     }
@@ -538,102 +987,121 @@ void MyESP::_consoleShowHelp() {
     myDebug_P(PSTR("*"));
     myDebug_P(PSTR("* Commands:"));
     myDebug_P(PSTR("*  ?=help, CTRL-D/quit=exit telnet session"));
-    myDebug_P(PSTR("*  set, system, reboot"));
+    myDebug_P(PSTR("*  set, system, mem, cpu, config, reboot, erase"));
     myDebug_P(PSTR("*  crash <dump | clear>"));
+    myDebug_P(PSTR("*  trace [clear]"));
 
     // print custom commands if available. Taken from progmem
-    if (_telnetcommand_callback) {
-        // find the longest key length so we can right align it
-        uint8_t max_len = 0;
-        for (uint8_t i = 0; i < _helpProjectCmds_count; i++) {
-            if ((strlen(_helpProjectCmds[i].key) > max_len) && (!_helpProjectCmds[i].set)) {
-                max_len = strlen(_helpProjectCmds[i].key);
-            }
+    uint8_t next = 0;
+    _printCommands(false, &next, _helpProjectCmds_count);
+    myDebug_P(PSTR("")); // newline
+}
+
+// print the project's commands or its settings from *next on, at most lines of them. *next is moved past them
+void MyESP::_printCommands(bool settings, uint8_t * next, uint8_t lines) {
+    _Command command;
+    char     key[70];
+
+    // find the longest key length so we can right align it
+    uint8_t max_len = 0;
+    for (uint8_t i = 0; i < _helpProjectCmds_count; i++) {
+        cmd_read(&_helpProjectCmds[i], &command);
+        if ((((command.flags & CMD_SETTING) != 0) == settings) && (strlen(_commandKey(key, sizeof(key), &command, true)) > max_len)) {
+            max_len = strlen(key);
         }
+    }
 
-        for (uint8_t i = 0; i < _helpProjectCmds_count; i++) {
-            if (!_helpProjectCmds[i].set) {
-                SerialAndTelnet.print(FPSTR("*  "));
-                SerialAndTelnet.print(FPSTR(_helpProjectCmds[i].key));
-                for (uint8_t j = 0; j < ((max_len + 5) - strlen(_helpProjectCmds[i].key)); j++) { // account for longest string length
-                    SerialAndTelnet.print(FPSTR(" "));                                            // padding
-                }
-                SerialAndTelnet.println(FPSTR(_helpProjectCmds[i].description));
-            }
+    for (; (*next < _helpProjectCmds_count) && (lines > 0); (*next)++) {
+        cmd_read(&_helpProjectCmds[*next], &command);
+        if (((command.flags & CMD_SETTING) != 0) == settings) {
+            char description[CMD_DESC_SIZE];
+            char line[TELNET_MAX_COMMAND_LENGTH + CMD_DESC_SIZE];
+            strlcpy_P(description, command.description, sizeof(description));
+            snprintf(line, sizeof(line), "*  %-*s%s", max_len + 5, _commandKey(key, sizeof(key), &command, true), description); // padding
+            myDebug_P(PSTR("%s"), line);
+            lines--;
         }
     }
-    myDebug_P(PSTR("")); // newline
 }
 
 // print all set commands and current values
-void MyESP::_printSetCommands() {
-    myDebug_P(PSTR("")); // newline
-    myDebug_P(PSTR("The following set commands are available:"));
-    myDebug_P(PSTR("")); // newline
-    myDebug_P(PSTR("*  set erase"));
-    myDebug_P(PSTR("*  set <wifi_ssid | wifi_password> [value]"));
-    myDebug_P(PSTR("*  set <mqtt_host | mqtt_username | mqtt_password> [value]"));
-    myDebug_P(PSTR("*  set serial <on | off>"));
+// rendered in parts through telnetRender(), step counts up from 0. Returns false when it's done
+bool MyESP::_printSetCommands(uint16_t step) {
+    static uint8_t part = 0;
+    static uint8_t next = 0; // next project command to list
 
-    // print custom commands if available. Taken from progmem
-    if (_telnetcommand_callback) {
-        // find the longest key length so we can right align it
-        uint8_t max_len = 0;
-        for (uint8_t i = 0; i < _helpProjectCmds_count; i++) {
-            if ((strlen(_helpProjectCmds[i].key) > max_len) && (_helpProjectCmds[i].set)) {
-                max_len = strlen(_helpProjectCmds[i].key);
-            }
-        }
+    if (step == 0) {
+        part = 0;
+        next = 0;
+    }
 
-        for (uint8_t i = 0; i < _helpProjectCmds_count; i++) {
-            if (_helpProjectCmds[i].set) {
-                SerialAndTelnet.print(FPSTR("*  set "));
-                SerialAndTelnet.print(FPSTR(_helpProjectCmds[i].key));
-                for (uint8_t j = 0; j < ((max_len + 5) - strlen(_helpProjectCmds[i].key)); j++) { // account for longest string length
-                    SerialAndTelnet.print(FPSTR(" "));                                            // padding
-                }
-                SerialAndTelnet.println(FPSTR(_helpProjectCmds[i].description));
-            }
+    switch (part) {
+    case 0:
+        myDebug_P(PSTR("")); // newline
+        myDebug_P(PSTR("The following set commands are available:"));
+        myDebug_P(PSTR("")); // newline
+        myDebug_P(PSTR("*  set <wifi_ssid | wifi_password> [value]"));
+        myDebug_P(PSTR("*  set <mqtt_host | mqtt_username | mqtt_password> [value]"));
+        myDebug_P(PSTR("*  set serial <on | off>"));
+        break;
+
+    case 1:
+        // print custom commands if available, TELNET_RENDER_LINES at a time. Taken from progmem
+        _printCommands(true, &next, TELNET_RENDER_LINES);
+        if (next < _helpProjectCmds_count) {
+            return true; // more to come
         }
-    }
+        break;
 
-    myDebug_P(PSTR("")); // newline
-    myDebug_P(PSTR("Stored settings:"));
-    myDebug_P(PSTR("")); // newline
-    myDebug_P(PSTR("  wifi_ssid=%s "), (!_wifi_ssid) ? "<not set>" : _wifi_ssid);
-    SerialAndTelnet.print(FPSTR("  wifi_password="));
-    if (!_wifi_password) {
-        SerialAndTelnet.print(FPSTR("<not set>"));
-    } else {
-        for (uint8_t i = 0; i < strlen(_wifi_password); i++) {
-            SerialAndTelnet.print(FPSTR("*"));
+    case 2:
+        myDebug_P(PSTR("")); // newline
+        myDebug_P(PSTR("Stored settings:"));
+        myDebug_P(PSTR("")); // newline
+        myDebug_P(PSTR("  wifi_ssid=%s "), (!_wifi_ssid) ? "<not set>" : _wifi_ssid);
+        SerialAndTelnet.print(FPSTR("  wifi_password="));
+        if (!_wifi_password) {
+            SerialAndTelnet.print(FPSTR("<not set>"));
+        } else {
+            for (uint8_t i = 0; i < strlen(_wifi_password); i++) {
+                SerialAndTelnet.print(FPSTR("*"));
+            }
         }
-    }
-    myDebug_P(PSTR("")); // newline
-    myDebug_P(PSTR("  mqtt_host=%s"), (!_mqtt_host) ? "<not set>" : _mqtt_host);
-    myDebug_P(PSTR("  mqtt_username=%s"), (!_mqtt_username) ? "<not set>" : _mqtt_username);
-    SerialAndTelnet.print(FPSTR("  mqtt_password="));
-    if (!_mqtt_password) {
-        SerialAndTelnet.print(FPSTR("<not set>"));
-    } else {
-        for (uint8_t i = 0; i < strlen(_mqtt_password); i++) {
-            SerialAndTelnet.print(FPSTR("*"));
+        myDebug_P(PSTR("")); // newline
+        myDebug_P(PSTR("  mqtt_host=%s"), (!_mqtt_host) ? "<not set>" : _mqtt_host);
+        myDebug_P(PSTR("  mqtt_username=%s"), (!_mqtt_username) ? "<not set>" : _mqtt_username);
+        SerialAndTelnet.print(FPSTR("  mqtt_password="));
+        if (!_mqtt_password) {
+            SerialAndTelnet.print(FPSTR("<not set>"));
+        } else {
+            for (uint8_t i = 0; i < strlen(_mqtt_password); i++) {
+                SerialAndTelnet.print(FPSTR("*"));
+            }
         }
-    }
 
-    myDebug_P(PSTR("")); // newline
-    myDebug_P(PSTR("  serial=%s"), (_use_serial) ? "on" : "off");
-    myDebug_P(PSTR("  heartbeat=%s"), (_heartbeat) ? "on" : "off");
+        myDebug_P(PSTR("")); // newline
+        myDebug_P(PSTR("  serial=%s"), (_use_serial) ? "on" : "off");
+        myDebug_P(PSTR("  heartbeat=%s"), (_heartbeat) ? "on" : "off");
+        break;
 
-    // print any custom settings
-    (_fs_settings_callback)(MYESP_FSACTION_LIST, 0, NULL, NULL);
+    default:
+        // print any custom settings
+        (_fs_settings_callback)(MYESP_FSACTION_LIST, 0, NULL, NULL);
 
-    myDebug_P(PSTR("")); // newline
+        myDebug_P(PSTR("")); // newline
+        return false;
+    }
+
+    part++;
+    return true;
 }
 
 // reset / restart
 void MyESP::resetESP() {
     myDebug_P(PSTR("* Reboot ESP..."));
+    _recorderEvent(MYESP_EVENT_RESTART);
+    if (_fs_dirty) {
+        (void)fs_saveConfig(); // don't lose any pending changes
+    }
     _deferredReset(100, CUSTOM_RESET_TERMINAL);
     end();
 #if defined(ARDUINO_ARCH_ESP32)
@@ -643,127 +1111,187 @@ void MyESP::resetESP() {
 #endif
 }
 
-// read next word from string buffer
-// if parameter true then a word is only terminated by a newline
-char * MyESP::_telnet_readWord(bool allow_all_chars) {
-    if (allow_all_chars) {
-        return (strtok(NULL, "\n")); // allow only newline
+bool MyESP::_cmdReboot(const _Command_Arg * arg) {
+    myESP.resetESP();
+    return true;
+}
+
+bool MyESP::_cmdSystem(const _Command_Arg * arg) {
+    myESP.showSystemStats();
+    return true;
+}
+
+bool MyESP::_cmdMem(const _Command_Arg * arg) {
+    myESP.showMemoryStats();
+    return true;
+}
+
+bool MyESP::_cmdCpu(const _Command_Arg * arg) {
+    myESP.showCpuStats();
+    return true;
+}
+
+bool MyESP::_cmdConfig(const _Command_Arg * arg) {
+    myESP._fs_printConfig();
+    return true;
+}
+
+bool MyESP::_cmdQuit(const _Command_Arg * arg) {
+    myESP.myDebug_P(PSTR("[TELNET] exiting telnet session"));
+    myESP.SerialAndTelnet.disconnectClient();
+    return true;
+}
+
+bool MyESP::_cmdErase(const _Command_Arg * arg) {
+    myESP._fs_eraseConfig();
+    return true;
+}
+
+bool MyESP::_cmdCrash(const _Command_Arg * arg) {
+    if (arg->value == 0) {
+        myESP.crashDump();
     } else {
-        return (strtok(NULL, ", \n")); // allow space and comma
+        myESP.crashClear();
     }
+    return true;
 }
 
-// change settings - always as strings
-// messy code but effective since we don't have too many settings
-// wc is word count, number of parameters after the 'set' command
-bool MyESP::_changeSetting(uint8_t wc, const char * setting, const char * value) {
-    bool ok = false;
+// dump the event trace as Chrome trace JSON, to load in chrome://tracing or https://ui.perfetto.dev
+bool MyESP::_cmdTrace(const _Command_Arg * arg) {
+    if (arg->present) {
+        trace_clear();
+    } else {
+        // recording is paused until the dump is done, or stopped by another command and the render is dropped
+        bool enabled = trace_enabled();
+        trace_enable(false);
+        std::shared_ptr<void> resume(nullptr, [enabled](void *) { trace_enable(enabled); });
 
-    // check for our internal commands first
-    if (strcmp(setting, "erase") == 0) {
-        _fs_eraseConfig();
-        return true;
+        myESP.telnetRender([resume](uint16_t step) {
+            return trace_dump([](const char * line) { myESP.myDebug("%s", line); }, step * TELNET_RENDER_LINES, TELNET_RENDER_LINES);
+        });
+    }
+    return true;
+}
 
-    } else if (strcmp(setting, "wifi_ssid") == 0) {
-        if (_wifi_ssid)
-            free(_wifi_ssid);
-        _wifi_ssid = NULL; // just to be sure
-        if (value) {
-            _wifi_ssid = strdup(value);
-        }
-        ok = true;
-        jw.enableSTA(false);
-        myDebug_P(PSTR("Note: please 'reboot' ESP to apply new WiFi settings"));
-    } else if (strcmp(setting, "wifi_password") == 0) {
-        if (_wifi_password)
-            free(_wifi_password);
-        _wifi_password = NULL; // just to be sure
-        if (value) {
-            _wifi_password = strdup(value);
-        }
-        ok = true;
-        jw.enableSTA(false);
-        myDebug_P(PSTR("Note: please 'reboot' ESP to apply new WiFi settings"));
-
-    } else if (strcmp(setting, "mqtt_host") == 0) {
-        if (_mqtt_host)
-            free(_mqtt_host);
-        _mqtt_host = NULL; // just to be sure
-        if (value) {
-            _mqtt_host = strdup(value);
-        }
-        ok = true;
-    } else if (strcmp(setting, "mqtt_username") == 0) {
-        if (_mqtt_username)
-            free(_mqtt_username);
-        _mqtt_username = NULL; // just to be sure
-        if (value) {
-            _mqtt_username = strdup(value);
-        }
-        ok = true;
-    } else if (strcmp(setting, "mqtt_password") == 0) {
-        if (_mqtt_password)
-            free(_mqtt_password);
-        _mqtt_password = NULL; // just to be sure
-        if (value) {
-            _mqtt_password = strdup(value);
-        }
-        ok = true;
+// replace a string setting, no value resets it
+void MyESP::_cmdString(char ** setting, const _Command_Arg * arg) {
+    if (*setting) {
+        free(*setting);
+    }
+    *setting = (arg->present) ? strdup(arg->text) : NULL;
+}
 
-    } else if (strcmp(setting, "serial") == 0) {
-        ok          = true;
-        _use_serial = false;
-        if (value) {
-            if (strcmp(value, "on") == 0) {
-                _use_serial = true;
-                ok          = true;
-                myDebug_P(PSTR("Reboot ESP to activate Serial mode."));
-            } else if (strcmp(value, "off") == 0) {
-                _use_serial = false;
-                ok          = true;
-                myDebug_P(PSTR("Reboot ESP to deactivate Serial mode."));
-            } else {
-                ok = false;
-            }
-        }
+// merge JSON settings into the config and save it
+// it's only kept here, MQTT commands run in the TCP task. It's parsed from the main loop, see _fs_importLoop()
+bool MyESP::_cmdConfigImport(const _Command_Arg * arg) {
+    char * json = strdup(arg->text);
+    if (!json) {
+        return false;
+    }
+    if (myESP._fs_import) {
+        free(myESP._fs_import); // replaced by the newer one
+    }
+    myESP._fs_import        = json;
+    myESP._fs_import_telnet = arg->telnet;
+    return true;
+}
+
+bool MyESP::_cmdConfigExport(const _Command_Arg * arg) {
+    myESP._fs_publishConfig();
+    return true;
+}
+
+// the boot time, for example HA replies to the start message with the system time of the server
+bool MyESP::_cmdBoottime(const _Command_Arg * arg) {
+    myESP.myDebug_P(PSTR("[MQTT] Received boottime: %s"), arg->text);
+    myESP.setBoottime(arg->text);
+    return true;
+}
+
+bool MyESP::_cmdWifiSsid(const _Command_Arg * arg) {
+    _cmdString(&myESP._wifi_ssid, arg);
+    jw.enableSTA(false);
+    myESP.myDebug_P(PSTR("Note: please 'reboot' ESP to apply new WiFi settings"));
+    return true;
+}
+
+bool MyESP::_cmdWifiPassword(const _Command_Arg * arg) {
+    _cmdString(&myESP._wifi_password, arg);
+    jw.enableSTA(false);
+    myESP.myDebug_P(PSTR("Note: please 'reboot' ESP to apply new WiFi settings"));
+    return true;
+}
+
+bool MyESP::_cmdMqttHost(const _Command_Arg * arg) {
+    _cmdString(&myESP._mqtt_host, arg);
+    return true;
+}
 
-    } else if (strcmp(setting, "heartbeat") == 0) {
-        ok         = true;
-        _heartbeat = false;
-        if (value) {
-            if (strcmp(value, "on") == 0) {
-                _heartbeat = true;
-                ok         = true;
-                myDebug_P(PSTR("Heartbeat on"));
-            } else if (strcmp(value, "off") == 0) {
-                _heartbeat = false;
-                ok         = true;
-                myDebug_P(PSTR("Heartbeat off"));
+bool MyESP::_cmdMqttUsername(const _Command_Arg * arg) {
+    _cmdString(&myESP._mqtt_username, arg);
+    return true;
+}
+
+bool MyESP::_cmdMqttPassword(const _Command_Arg * arg) {
+    _cmdString(&myESP._mqtt_password, arg);
+    return true;
+}
+
+// no value turns it off
+bool MyESP::_cmdSerial(const _Command_Arg * arg) {
+    myESP._use_serial = (arg->value == 1);
+    if (arg->present) {
+        myESP.myDebug_P(PSTR("Reboot ESP to %s Serial mode."), myESP._use_serial ? "activate" : "deactivate");
+    }
+    return true;
+}
+
+// no value turns it off
+bool MyESP::_cmdHeartbeat(const _Command_Arg * arg) {
+    myESP._heartbeat = (arg->value == 1);
+    if (arg->present) {
+        myESP.myDebug_P(PSTR("Heartbeat %s"), myESP._heartbeat ? "on" : "off");
+    }
+    return true;
+}
+
+// run a command from telnet or MQTT and report how it went. A changed setting is saved
+void MyESP::_commandRun(const _Command * cmd, char * args, bool telnet) {
+    _Command command;
+    char     key[70];
+    char     name[CMD_NAME_SIZE];
+    cmd_read(cmd, &command);
+    strlcpy_P(name, name, sizeof(name));
+
+    bool value = (args != nullptr) && (args[strspn(args, " \t\r\n")] != '\0');
+
+    switch (cmd_run(cmd, args, telnet)) {
+    case CMD_OK:
+        if (command.flags & CMD_SETTING) {
+            if (!value && (command.arg == CMD_ARG_TEXT)) {
+                myDebug_P(PSTR("%s setting reset to its default value."), name);
             } else {
-                ok = false;
+                myDebug_P(PSTR("%s changed."), name);
             }
+            fs_requestSave(); // always save the values
         }
-    } else {
-        // finally check for any custom commands
-        ok = (_fs_settings_callback)(MYESP_FSACTION_SET, wc, setting, value);
-    }
+        break;
 
-    // if we were able to recognize the set command, continue
-    if (ok) {
-        // check for 2 params
-        if (value == nullptr) {
-            myDebug_P(PSTR("%s setting reset to its default value."), setting);
+    case CMD_USAGE:
+        if (telnet) {
+            myDebug_P(PSTR("Error. Usage: %s"), _commandKey(key, sizeof(key), &command, true));
         } else {
-            // must be 3 params
-            myDebug_P(PSTR("%s changed."), setting);
+            myDebug_P(PSTR("[MQTT] Invalid value for %s"), name);
         }
+        break;
 
-        myDebug_P(PSTR("")); // newline
+    case CMD_DENIED:
+        myDebug_P(PSTR("[MQTT] %s can only be used from telnet"), name);
+        break;
 
-        (void)fs_saveConfig(); // always save the values
+    default:
+        break;
     }
-
-    return ok;
 }
 
 // force the serial on/off
@@ -779,85 +1307,41 @@ void MyESP::setUseSerial(bool toggle) {
     }
 }
 
+// a telnet command line. 'set' lists the settings, 'set <setting> [value]' changes one
 void MyESP::_telnetCommand(char * commandLine) {
-    char * str   = commandLine;
-    bool   state = false;
+    char * line = commandLine + strspn(commandLine, " \t");
 
-    if (strlen(commandLine) == 0)
+    if (strlen(line) == 0)
         return;
 
-    // count the number of arguments
-    unsigned wc = 0;
-    while (*str) {
-        if (*str == ' ' || *str == '\n' || *str == '\t') {
-            state = false;
-        } else if (state == false) {
-            state = true;
-            ++wc;
-        }
-        ++str;
-    }
-
-    // check first for reserved commands
-    char * temp             = strdup(commandLine);         // because strotok kills original string buffer
-    char * ptrToCommandName = strtok((char *)temp, " \n"); // space and newline
-
-    // set command
-    if (strcmp(ptrToCommandName, "set") == 0) {
-        bool ok = false;
-        if (wc == 1) {
-            _printSetCommands();
-            ok = true;
-        } else if (wc == 2) { // set <xxx>
-            char * setting = _telnet_readWord(false);
-            ok             = _changeSetting(wc - 1, setting, NULL);
-        } else { // set <xxx> <yyy>
-            char * setting = _telnet_readWord(false);
-            char * value   = _telnet_readWord(true); // allow strange characters
-            ok             = _changeSetting(wc - 1, setting, value);
-        }
+    _telnet_render = NULL; // stop a long output that's still being rendered
 
-        if (!ok) {
-            myDebug_P(PSTR("\nInvalid parameter for set command."));
+    bool set = (strncmp(line, "set", 3) == 0) && ((line[3] == '\0') || (line[3] == ' '));
+    if (set) {
+        line += 3;
+        if (line[strspn(line, " \t\n")] == '\0') {
+            telnetRender([this](uint16_t step) { return _printSetCommands(step); });
+            return;
         }
-
-        return;
     }
 
-    // reboot command
-    if ((strcmp(ptrToCommandName, "reboot") == 0) && (wc == 1)) {
-        resetESP();
-    }
+    char *           args = NULL;
+    const _Command * cmd  = cmd_findLine(line, &args);
 
-    // show system stats
-    if ((strcmp(ptrToCommandName, "system") == 0) && (wc == 1)) {
-        showSystemStats();
-        return;
+    if (set && (cmd != nullptr) && !(pgm_read_byte(&cmd->flags) & CMD_SETTING)) {
+        cmd = nullptr;
     }
 
-    // show system stats
-    if ((strcmp(ptrToCommandName, "quit") == 0) && (wc == 1)) {
-        myDebug_P(PSTR("[TELNET] exiting telnet session"));
-        SerialAndTelnet.disconnectClient();
-        return;
-    }
-
-
-    // crash command
-    if ((strcmp(ptrToCommandName, "crash") == 0) && (wc == 2)) {
-        char * cmd = _telnet_readWord(false);
-        if (strcmp(cmd, "dump") == 0) {
-            crashDump();
-        } else if (strcmp(cmd, "clear") == 0) {
-            crashClear();
+    if (cmd == nullptr) {
+        if (set) {
+            myDebug_P(PSTR("\nInvalid parameter for set command."));
         } else {
-            myDebug_P(PSTR("Error. Usage: crash <dump | clear>"));
+            myDebug_P(PSTR("Unknown command. Use ? for help."));
         }
-        return; // don't call custom command line callback
+        return;
     }
 
-    // call callback function
-    (_telnetcommand_callback)(wc, commandLine);
+    _commandRun(cmd, args, true);
 }
 
 // returns WiFi hostname as a String object
@@ -975,11 +1459,43 @@ bool MyESP::_rtcmemStatus() {
 
     readable = readable and (RTCMEM_MAGIC == Rtcmem->magic);
 
-    return readable;
-}
+    return readable;
+}
+
+bool MyESP::rtcmemStatus() {
+    return _rtcmem_status;
+}
+
+// copy the application data from the RTC memory, which can only be read in blocks of 4 bytes
+// the caller has to validate the contents as they are garbage after a power on
+bool MyESP::rtcmemLoad(void * data, size_t size) {
+    if (size > sizeof(Rtcmem->app)) {
+        return false;
+    }
+
+    uint8_t * p = (uint8_t *)data;
+    for (size_t i = 0; i < size; i += 4) {
+        uint32_t block = Rtcmem->app[i / 4];
+        memcpy(p + i, &block, (((size - i) < 4) ? (size - i) : 4));
+    }
+
+    return true;
+}
+
+// copy the application data to the RTC memory, in blocks of 4 bytes
+bool MyESP::rtcmemSave(const void * data, size_t size) {
+    if (size > sizeof(Rtcmem->app)) {
+        return false;
+    }
+
+    const uint8_t * p = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i += 4) {
+        uint32_t block = 0;
+        memcpy(&block, p + i, (((size - i) < 4) ? (size - i) : 4));
+        Rtcmem->app[i / 4] = block;
+    }
 
-bool MyESP::rtcmemStatus() {
-    return _rtcmem_status;
+    return true;
 }
 
 unsigned char MyESP::_getCustomResetReason() {
@@ -1095,6 +1611,8 @@ void MyESP::showSystemStats() {
     }
     myDebug(output_str);
 
+    myDebug_P(PSTR(" [FS] Config file writes: %u%s"), _fs_writes, _fs_dirty ? " (save pending)" : "");
+
 #ifdef ARDUINO_BOARD
     myDebug_P(PSTR(" [SYSTEM] Board: %s"), ARDUINO_BOARD);
 #endif
@@ -1120,7 +1638,7 @@ void MyESP::showSystemStats() {
     myDebug_P(PSTR(" [SYSTEM] Restart count: %d"), _getSystemStabilityCounter());
 
     myDebug_P(PSTR(" [SYSTEM] rtcmem status:%u blocks:%u addr:0x%p"), _rtcmemStatus(), RtcmemSize, Rtcmem);
-    for (uint8_t block = 0; block < RtcmemSize; ++block) {
+    for (uint8_t block = 0; block < (offsetof(RtcmemData, app) / 4u); ++block) { // skip the application data
         myDebug_P(PSTR(" [SYSTEM] rtcmem %02u: %u"), block, reinterpret_cast<volatile uint32_t *>(RTCMEM_ADDR)[block]);
     }
 #endif
@@ -1170,8 +1688,8 @@ void MyESP::_heartbeatCheck(bool force = false) {
         uint32_t free_memory   = ESP.getFreeHeap();
         uint8_t  mem_available = 100 * free_memory / total_memory; // as a %
 
-        char payload[300] = {0};
-        char s[10];
+        char payload[400] = {0};
+        char s[12];
         strlcpy(payload, "version=", sizeof(payload));
         strlcat(payload, _app_version, sizeof(payload)); // version
         strlcat(payload, ", IP=", sizeof(payload));
@@ -1184,13 +1702,303 @@ void MyESP::_heartbeatCheck(bool force = false) {
         strlcat(payload, ltoa(_getUptime(), s, 10), sizeof(payload)); // uptime in secs
         strlcat(payload, "secs, freemem=", sizeof(payload));
         strlcat(payload, itoa(mem_available, s, 10), sizeof(payload)); // free mem as a %
-        strlcat(payload, "%", sizeof(payload));
+        strlcat(payload, "%, minheap=", sizeof(payload));
+        strlcat(payload, ultoa(_heap_min, s, 10), sizeof(payload)); // lowest free heap in bytes
+#if defined(ESP8266)
+        strlcat(payload, ", maxblock=", sizeof(payload));
+        strlcat(payload, ultoa(ESP.getMaxFreeBlockSize(), s, 10), sizeof(payload)); // largest free block in bytes
+        strlcat(payload, ", minblock=", sizeof(payload));
+        strlcat(payload, ultoa(_heap_block_min, s, 10), sizeof(payload)); // lowest largest free block in bytes
+        strlcat(payload, ", frag=", sizeof(payload));
+        strlcat(payload, itoa(ESP.getHeapFragmentation(), s, 10), sizeof(payload)); // fragmentation as a %
+        strlcat(payload, "%, freestack=", sizeof(payload));
+        strlcat(payload, ultoa(ESP.getFreeContStack(), s, 10), sizeof(payload)); // lowest free stack in bytes
+#endif
+
+        // heap retained by each part
+        char buffer[20];
+        for (uint8_t i = 0; i < MYESP_HEAP_MAX; i++) {
+            strlcpy_P(buffer, heap_part_string[i], sizeof(buffer));
+            strlcat(payload, ", ", sizeof(payload));
+            strlcat(payload, buffer, sizeof(payload));
+            strlcat(payload, "=", sizeof(payload));
+            strlcat(payload, ltoa(_heap_counters[i].retained, s, 10), sizeof(payload));
+        }
 
         // send to MQTT
         myESP.mqttPublish(MQTT_TOPIC_HEARTBEAT, payload);
+        _cpuPublish();
+    }
+}
+
+// set the callback which adds the application's metrics, with metricsHeader(), metricsValue() and metricsAdd()
+// it renders them in parts of at most METRICS_BUFFER_SIZE, step counts up from 0. It returns true while there are more
+void MyESP::setMetrics(metrics_callback_f callback) {
+    _metrics_callback = callback;
+}
+
+// start the HTTP server for the metrics
+void MyESP::_metrics_setup() {
+    _metrics_server = new AsyncServer(METRICS_PORT);
+
+    _metrics_server->onClient(
+        [this](void * arg, AsyncClient * client) {
+            client->setRxTimeout(METRICS_CLIENT_TIMEOUT);
+            client->onData([this](void * arg, AsyncClient * client, void * data, size_t len) { _metricsRequest(client, (const char *)data, len); });
+            client->onAck([this](void * arg, AsyncClient * client, size_t len, uint32_t time) {
+                if (client == _metrics_client) {
+                    _metricsSend(); // room for more
+                }
+            });
+            client->onTimeout([](void * arg, AsyncClient * client, uint32_t time) { client->close(); });
+            client->onDisconnect([this](void * arg, AsyncClient * client) {
+                if (client == _metrics_client) {
+                    _metricsEnd(); // gone before the response was sent
+                }
+                delete client;
+            });
+        },
+        NULL);
+
+    _metrics_server->begin();
+}
+
+/*
+ * answer a HTTP request. Only GET /metrics is served, everything else is a 404
+ * the metrics are rendered a part at a time and each part is sent as the TCP send buffer has room, so the length
+ * isn't known up front and the end of the response is the end of the connection
+ * one response at a time, a scrape from another client while one is being sent gets a 503
+ * the request line is all we look at, so it has to be in the first packet
+ */
+void MyESP::_metricsRequest(AsyncClient * client, const char * request, size_t len) {
+    static const char metrics_get[] = "GET /metrics";
+    size_t            get_len       = strlen(metrics_get);
+
+    if (client == _metrics_client) {
+        return; // more of the request, or a pipelined one. The connection is closed after the response
+    }
+
+    // the short answers always fit in the empty send buffer of a new connection
+    if ((len <= get_len) || (strncmp(request, metrics_get, get_len) != 0) || ((request[get_len] != ' ') && (request[get_len] != '?'))) {
+        client->write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        client->close();
+        return;
+    }
+
+    char * buffer = (_metrics_client == NULL) ? (char *)malloc(METRICS_BUFFER_SIZE) : NULL;
+    if (buffer == NULL) {
+        client->write("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        client->close();
+        return;
+    }
+
+    _metrics_requests++;
+    _metrics_client = client;
+    _metrics_buffer = buffer;
+    _metrics_step   = 0;
+    _metrics_done   = false;
+    _metrics_sent   = 0;
+
+    // the header is the first part
+    strlcpy(_metrics_buffer, "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n", METRICS_BUFFER_SIZE);
+    _metrics_length = strlen(_metrics_buffer);
+
+    _metricsSend();
+}
+
+/*
+ * send as much of the response as the TCP send buffer takes, the rest goes when the client has acknowledged some
+ * write() copies into the send buffer, so the next part can be rendered as soon as the whole part is taken
+ */
+void MyESP::_metricsSend() {
+    while (true) {
+        if (_metrics_sent == _metrics_length) {
+            if (_metrics_done) {
+                AsyncClient * client = _metrics_client;
+                _metricsEnd();
+                client->close(); // after what's still in the send buffer
+                return;
+            }
+
+            _metrics_length    = 0;
+            _metrics_sent      = 0;
+            _metrics_mark      = 0;
+            _metrics_full      = false;
+            _metrics_buffer[0] = '\0';
+            _metrics_done      = !_metricsRender(_metrics_step++);
+            continue;
+        }
+
+        _metrics_sent += _metrics_client->write(_metrics_buffer + _metrics_sent, _metrics_length - _metrics_sent);
+        if (_metrics_sent < _metrics_length) {
+            return; // the send buffer is full
+        }
+    }
+}
+
+// free the response, once it's sent or the client is gone
+void MyESP::_metricsEnd() {
+    free(_metrics_buffer);
+    _metrics_buffer = NULL;
+    _metrics_client = NULL;
+}
+
+// render a part of our metrics, followed by the application's. Returns true while there are more
+bool MyESP::_metricsRender(uint16_t step) {
+    char labels[120];
+    char buffer[20];
+
+    switch (step) {
+    case 0:
+        snprintf(labels, sizeof(labels), "app=\"%s\",version=\"%s\",hostname=\"%s\"", _app_name, _app_version, _app_hostname);
+        metricsHeader(PSTR("esp_info"), PSTR("gauge"), PSTR("Application running on the ESP"));
+        metricsValue(PSTR("esp_info"), labels, (int32_t)1);
+
+        metricsAdd(PSTR("esp_uptime_seconds"), PSTR("counter"), PSTR("Time since boot"), (uint32_t)_getUptime());
+        metricsAdd(PSTR("esp_load_average_percent"), PSTR("gauge"), PSTR("System load average"), getSystemLoadAverage());
+        metricsAdd(PSTR("esp_wifi_rssi_dbm"), PSTR("gauge"), PSTR("WiFi signal strength"), (int32_t)WiFi.RSSI());
+        metricsAdd(PSTR("esp_mqtt_connected"), PSTR("gauge"), PSTR("1 if connected to the MQTT broker"), (int32_t)isMQTTConnected());
+        metricsAdd(PSTR("esp_mqtt_limited_total"), PSTR("counter"), PSTR("Publishes skipped by the rate limit of their topic"), _mqtt_limited);
+        metricsAdd(PSTR("esp_mqtt_deferred_total"), PSTR("counter"), PSTR("Low priority publishes deferred while the client or heap were short"), _mqtt_deferred);
+        metricsAdd(PSTR("esp_mqtt_dropped_total"), PSTR("counter"), PSTR("Publishes the MQTT client had no room for"), _mqtt_dropped);
+        return true;
+
+    case 1:
+        metricsAdd(PSTR("esp_config_writes_total"), PSTR("counter"), PSTR("Times the config has been written to flash"), _fs_writes);
+        metricsAdd(PSTR("esp_metrics_requests_total"), PSTR("counter"), PSTR("Times the metrics have been scraped"), _metrics_requests);
+        metricsAdd(PSTR("esp_metrics_truncated_total"), PSTR("counter"), PSTR("Metrics lines left out because their part of the response was full"), _metrics_truncated);
+
+        // heap
+        metricsAdd(PSTR("esp_free_heap_bytes"), PSTR("gauge"), PSTR("Free heap"), (uint32_t)ESP.getFreeHeap());
+        metricsAdd(PSTR("esp_free_heap_min_bytes"), PSTR("gauge"), PSTR("Lowest free heap since boot"), _heap_min);
+#if defined(ESP8266)
+        metricsAdd(PSTR("esp_max_free_block_bytes"), PSTR("gauge"), PSTR("Largest free heap block"), (uint32_t)ESP.getMaxFreeBlockSize());
+        metricsAdd(PSTR("esp_heap_fragmentation_percent"), PSTR("gauge"), PSTR("Heap fragmentation"), (uint32_t)ESP.getHeapFragmentation());
+#endif
+        return true;
+
+    case 2:
+        metricsHeader(PSTR("esp_heap_retained_bytes"), PSTR("gauge"), PSTR("Heap not given back by a part of the code"));
+        for (uint8_t i = 0; i < MYESP_HEAP_MAX; i++) {
+            strlcpy_P(buffer, heap_part_string[i], sizeof(buffer));
+            snprintf(labels, sizeof(labels), "part=\"%s\"", buffer);
+            metricsValue(PSTR("esp_heap_retained_bytes"), labels, _heap_counters[i].retained);
+        }
+
+        // CPU
+        metricsHeader(PSTR("esp_cpu_load_permille"), PSTR("gauge"), PSTR("Share of the CPU used by a part of the code"));
+        for (uint8_t i = 0; i < MYESP_CPU_MAX; i++) {
+            strlcpy_P(buffer, cpu_part_string[i], sizeof(buffer));
+            snprintf(labels, sizeof(labels), "part=\"%s\"", buffer);
+            metricsValue(PSTR("esp_cpu_load_permille"), labels, (uint32_t)_cpu_counters[i].load);
+        }
+        return true;
+
+    case 3:
+        metricsHeader(PSTR("esp_cpu_max_microseconds"), PSTR("gauge"), PSTR("Longest single run of a part of the code"));
+        for (uint8_t i = 0; i < MYESP_CPU_MAX; i++) {
+            strlcpy_P(buffer, cpu_part_string[i], sizeof(buffer));
+            snprintf(labels, sizeof(labels), "part=\"%s\"", buffer);
+            metricsValue(PSTR("esp_cpu_max_microseconds"), labels, (uint32_t)(_cpu_counters[i].max_cycles / ESP.getCpuFreqMHz()));
+        }
+        return (_metrics_callback != NULL);
+
+    default:
+        // and the application's
+        return (_metrics_callback)(step - 4);
+    }
+}
+
+/*
+ * add a line to the part being rendered
+ * from the first line which doesn't fit, the lines of the part are left out and counted
+ * HELP/TYPE lines are taken out again when their first value doesn't fit
+ */
+void MyESP::_metricsPrintf_P(PGM_P format_P, ...) {
+    if (_metrics_buffer == NULL) {
+        return; // not rendering
+    }
+
+    if (_metrics_full) {
+        _metrics_truncated++;
+        return;
+    }
+
+    char format[strlen_P(format_P) + 1];
+    memcpy_P(format, format_P, sizeof(format));
+
+    va_list args;
+    va_start(args, format_P);
+    int len = ets_vsnprintf(_metrics_buffer + _metrics_length, METRICS_BUFFER_SIZE - _metrics_length, format, args);
+    va_end(args);
+
+    if ((len < 0) || (_metrics_length + len >= METRICS_BUFFER_SIZE)) {
+        _metrics_truncated++;
+        _metrics_full = true; // the rest is left out as well, so no metric is half there
+        if (format[0] != '#') {
+            _metrics_length = _metrics_mark; // drop the HELP/TYPE lines too if this was their first value
+        }
+        _metrics_buffer[_metrics_length] = '\0'; // drop the partial line
+        return;
+    }
+
+    if (format[0] == '#') {
+        _metrics_mark = _metrics_length; // HELP/TYPE lines, a value has to follow
+    } else {
+        _metrics_mark = _metrics_length + len; // a value, the lines so far are complete
+    }
+
+    _metrics_length += len;
+}
+
+// the HELP and TYPE lines of a metric, type is counter or gauge
+void MyESP::metricsHeader(PGM_P name, PGM_P type, PGM_P help) {
+    char name_s[50];
+    char type_s[10];
+    char help_s[80];
+    strlcpy_P(name_s, name, sizeof(name_s));
+    strlcpy_P(type_s, type, sizeof(type_s));
+    strlcpy_P(help_s, help, sizeof(help_s));
+
+    _metricsPrintf_P(PSTR("# HELP %s %s\n# TYPE %s %s\n"), name_s, help_s, name_s, type_s);
+}
+
+// a value of a metric, labels is the part between the {} or NULL if there aren't any
+void MyESP::_metricsValue(PGM_P name, const char * labels, const char * value) {
+    char name_s[50];
+    strlcpy_P(name_s, name, sizeof(name_s));
+
+    if (labels) {
+        _metricsPrintf_P(PSTR("%s{%s} %s\n"), name_s, labels, value);
+    } else {
+        _metricsPrintf_P(PSTR("%s %s\n"), name_s, value);
     }
 }
 
+void MyESP::metricsValue(PGM_P name, const char * labels, int32_t value) {
+    char value_s[12];
+    snprintf(value_s, sizeof(value_s), "%d", (int)value);
+    _metricsValue(name, labels, value_s);
+}
+
+// counters are unsigned, printed as signed they'd turn negative after 2^31 and look like a reset
+void MyESP::metricsValue(PGM_P name, const char * labels, uint32_t value) {
+    char value_s[12];
+    snprintf(value_s, sizeof(value_s), "%u", (unsigned int)value);
+    _metricsValue(name, labels, value_s);
+}
+
+// a metric with a single value
+void MyESP::metricsAdd(PGM_P name, PGM_P type, PGM_P help, int32_t value) {
+    metricsHeader(name, type, help);
+    metricsValue(name, NULL, value);
+}
+
+void MyESP::metricsAdd(PGM_P name, PGM_P type, PGM_P help, uint32_t value) {
+    metricsHeader(name, type, help);
+    metricsValue(name, NULL, value);
+}
+
 // handler for Telnet
 void MyESP::_telnetHandle() {
     SerialAndTelnet.handle();
@@ -1216,7 +2024,9 @@ void MyESP::_telnetHandle() {
                 if (_use_serial) {
                     SerialAndTelnet.serialPrint('\n'); // force newline if in Serial
                 }
+                uint32_t heap = ESP.getFreeHeap();
                 _telnetCommand(_command);
+                heapTrack(MYESP_HEAP_TELNET, heap);
             }
             break;
 
@@ -1282,9 +2092,9 @@ void MyESP::_mqttConnect() {
     mqttClient.setCleanSession(false);
 
     // last will
-    if (_mqtt_will_topic) {
-        //myDebug_P(PSTR("[MQTT] Setting last will topic %s"), _mqttTopic(_mqtt_will_topic));
-        mqttClient.setWill(_mqttTopic(_mqtt_will_topic), 1, true,
+    if (_mqtt_will_topic_full) {
+        //myDebug_P(PSTR("[MQTT] Setting last will topic %s"), _mqtt_will_topic_full);
+        mqttClient.setWill(_mqtt_will_topic_full, 1, true,
                            _mqtt_will_offline_payload); // retain always true
     }
 
@@ -1386,184 +2196,418 @@ void MyESP::setMQTT(const char *    mqtt_host,
     }
 }
 
-// builds up a topic by prefixing the base and hostname
-char * MyESP::_mqttTopic(const char * topic) {
-    char buffer[MQTT_MAX_TOPIC_SIZE] = {0};
+// builds the topics that don't change once, the base and hostname are known by the time WiFi connects
+// the last will topic has to stay, the MQTT client keeps a pointer to it
+void MyESP::_mqttInternTopics() {
+    if (_mqtt_prefix) {
+        return; // already done on an earlier connect
+    }
+
+    char buffer[MQTT_MAX_TOPIC_SIZE];
 
-    strlcpy(buffer, _mqtt_base, sizeof(buffer));
-    strlcat(buffer, "/", sizeof(buffer));
-    strlcat(buffer, _app_hostname, sizeof(buffer));
-    strlcat(buffer, "/", sizeof(buffer));
-    strlcat(buffer, topic, sizeof(buffer));
+    snprintf(buffer, sizeof(buffer), "%s/%s/", _mqtt_base, _app_hostname);
+    _mqtt_prefix = strdup(buffer);
+
+    snprintf(buffer, sizeof(buffer), "%s%s/#", _mqtt_prefix, MQTT_TOPIC_COMMAND);
+    _mqtt_cmd_topic  = strdup(buffer);
+    _mqtt_cmd_length = strlen(_mqtt_cmd_topic) - 1; // up to and including the / before the #
+
+    if (_mqtt_will_topic) {
+        _mqtt_will_topic_full = strdup(_mqttTopic(buffer, sizeof(buffer), _mqtt_will_topic));
+    }
 
-    if (_mqtt_topic) {
-        free(_mqtt_topic);
+    // the full topics of the publish policies, except those for all topics below one. Each starts with its full burst
+    char name[sizeof(((MyESP_MQTTPolicy *)0)->topic)];
+    for (uint8_t i = 0; i < (ArraySize(_policies) + _mqtt_policy_count); i++) {
+        strlcpy_P(name, _mqttPolicy(i)->topic, sizeof(name));
+        if ((name[0] != '\0') && (name[strlen(name) - 1] != '/')) {
+            _mqtt_rates[i].topic = strdup(_mqttTopic(buffer, sizeof(buffer), name));
+        }
+        _mqtt_rates[i].tokens = pgm_read_byte(&_mqttPolicy(i)->burst);
+        _mqtt_rates[i].earned = millis();
     }
-    _mqtt_topic = strdup(buffer);
+}
 
-    return _mqtt_topic;
+// builds up a topic by prefixing the base and hostname
+char * MyESP::_mqttTopic(char * buffer, size_t size, const char * topic) {
+    strlcpy(buffer, _mqtt_prefix, size);
+    strlcat(buffer, topic, size);
+    return buffer;
 }
 
-// print contents of file
-// assumes Serial is open
+// print the config as JSON, without the passwords
+// rendered TELNET_RENDER_LINES at a time, the text is freed when the output is done or stopped
 void MyESP::_fs_printConfig() {
-    myDebug_P(PSTR("[FS] Contents:"));
+    uint32_t heap = ESP.getFreeHeap();
+    char *   text = NULL;
 
-    File configFile = SPIFFS.open(MYEMS_CONFIG_FILE, "r");
-    if (!configFile) {
-        myDebug_P(PSTR("[FS] Failed to read file for printing"));
-        return;
+    {
+        DynamicJsonDocument doc(SPIFFS_MAXSIZE);
+        JsonObject          json = doc.to<JsonObject>();
+
+        _fs_exportConfig(json);
+
+        size_t size = measureJsonPretty(json) + 1;
+        text        = (char *)malloc(size);
+        if (text) {
+            serializeJsonPretty(json, text, size);
+        }
     }
 
-    while (configFile.available()) {
-        SerialAndTelnet.print((char)configFile.read());
+    heapTrack(MYESP_HEAP_JSON, heap);
+
+    if (!text) {
+        myDebug_P(PSTR("[FS] Not enough memory to print the config"));
+        return;
     }
-    myDebug_P(PSTR("")); // newline
 
-    configFile.close();
+    std::shared_ptr<char> config(text, free);
+    char *                next = text;
+
+    telnetRender([this, config, next](uint16_t step) mutable {
+        for (uint8_t i = 0; (i < TELNET_RENDER_LINES) && next; i++) {
+            char * line = next;
+            char * end  = strchr(line, '\n');
+            next        = end ? end + 1 : NULL;
+            if (end) {
+                if ((end > line) && (end[-1] == '\r')) {
+                    end--; // ArduinoJson ends the lines with CRLF
+                }
+                *end = '\0';
+            }
+            myDebug("%s", line);
+        }
+        return (next != NULL);
+    });
+}
+
+// publish the config as JSON to MQTT, without the passwords
+void MyESP::_fs_publishConfig() {
+    DynamicJsonDocument doc(SPIFFS_MAXSIZE);
+    JsonObject          json = doc.to<JsonObject>();
+
+    _fs_exportConfig(json);
+
+    // on the heap, it's too big for the stack with many Dallas sensors
+    size_t size    = measureJson(json) + 1;
+    char * payload = (char *)malloc(size);
+    if (!payload) {
+        return;
+    }
+    serializeJson(json, payload, size);
+    mqttPublish(MQTT_TOPIC_CONFIG, payload);
+    free(payload);
 }
 
-// format File System
+// erase the config and format File System
 void MyESP::_fs_eraseConfig() {
     myDebug_P(PSTR("[FS] Erasing settings, please wait a few seconds. ESP will "
                    "automatically restart when finished."));
 
+    for (size_t i = 0; i < sizeof(MyESP_Config); i++) {
+        EEPROMr.write(MYESP_CONFIG_EEPROM_OFFSET + i, 0xFF);
+    }
+    EEPROMr.commit();
+
+    _fs_dirty = false; // so the reset won't write it back
+    _fs_crc   = 0;     // the next save has to write, whatever it holds
+
     if (SPIFFS.format()) {
         delay(1000); // wait 1 second
         resetESP();
     }
 }
 
-void MyESP::setSettings(fs_callback_f callback_fs, fs_settings_callback_f callback_settings_fs) {
+void MyESP::setSettings(fs_callback_f callback_fs, fs_settings_callback_f callback_settings_fs, fs_config_callback_f callback_config_fs) {
     _fs_callback          = callback_fs;
     _fs_settings_callback = callback_settings_fs;
+    _fs_config_callback   = callback_config_fs;
 }
 
-// load from spiffs
+// load the binary config from EEPROM
+// returns false if there isn't a valid one
 bool MyESP::_fs_loadConfig() {
-    File configFile = SPIFFS.open(MYEMS_CONFIG_FILE, "r");
-
-    size_t size = configFile.size();
-    if (size > 1024) {
-        myDebug_P(PSTR("[FS] Config file size is too large"));
-        return false;
-    } else if (size == 0) {
-        myDebug_P(PSTR("[FS] Failed to open config file"));
-        // file does not exist, so assume its the first install. Set serial to on
-        _use_serial = true;
+    // on the heap only while it's loaded, it's too big for the stack
+    MyESP_Config * config = (MyESP_Config *)malloc(sizeof(MyESP_Config));
+    if (!config) {
+        myDebug_P(PSTR("[FS] Not enough memory to load the config"));
+        return true; // run on the defaults, but don't let _fs_setup() overwrite the config in flash with them
+    }
+    EEPROMr.get(MYESP_CONFIG_EEPROM_OFFSET, *config);
+
+    if ((config->magic != MYESP_CONFIG_MAGIC) || (config->version != MYESP_CONFIG_VERSION) || (config->size < offsetof(MyESP_Config, writes))
+        || (config->size > sizeof(MyESP_Config))) {
+        myDebug_P(PSTR("[FS] No config found"));
+        free(config);
         return false;
     }
 
-    StaticJsonDocument<SPIFFS_MAXSIZE> doc;
-    JsonObject                         json = doc.to<JsonObject>();
-
-    // Deserialize the JSON document
-    DeserializationError error = deserializeJson(doc, configFile);
-    if (error) {
-        myDebug_P(PSTR("[FS] Failed to read config file. Error %s"), error.c_str());
+    if (config->crc != CRC32::calculate((uint8_t *)&config->writes, config->size - offsetof(MyESP_Config, writes))) {
+        myDebug_P(PSTR("[FS] Config is corrupt"));
+        free(config);
         return false;
     }
 
-    const char * value;
+    // anything added since this config was written is 0
+    memset((uint8_t *)config + config->size, 0, sizeof(MyESP_Config) - config->size);
 
     // fetch the standard system parameters
-    value      = json["wifi_ssid"];
-    _wifi_ssid = (value) ? strdup(value) : NULL;
+    _wifi_ssid     = (config->wifi_ssid[0]) ? strdup(config->wifi_ssid) : NULL;
+    _wifi_password = (config->wifi_password[0]) ? strdup(config->wifi_password) : NULL;
+    _mqtt_host     = (config->mqtt_host[0]) ? strdup(config->mqtt_host) : NULL;
+    _mqtt_username = (config->mqtt_username[0]) ? strdup(config->mqtt_username) : NULL;
+    _mqtt_password = (config->mqtt_password[0]) ? strdup(config->mqtt_password) : NULL;
+    _use_serial    = config->use_serial;
+    _heartbeat     = config->heartbeat;
+    _fs_writes     = config->writes;
+    _fs_crc        = CRC32::calculate((uint8_t *)&config->wifi_ssid, sizeof(MyESP_Config) - offsetof(MyESP_Config, wifi_ssid));
 
-    value          = json["wifi_password"];
-    _wifi_password = (value) ? strdup(value) : NULL;
+    // callback for loading custom settings
+    bool ok = (_fs_config_callback)(MYESP_FSACTION_LOAD, config->app, sizeof(config->app));
+    free(config);
+    return ok;
+}
 
-    value      = json["mqtt_host"];
-    _mqtt_host = (value) ? strdup(value) : NULL;
+// bring in the settings from the JSON config file of an older version
+// the file is removed once it's been imported
+bool MyESP::_fs_loadJSONConfig() {
+    if (!SPIFFS.begin()) {
+        return false;
+    }
 
-    value          = json["mqtt_username"];
-    _mqtt_username = (value) ? strdup(value) : NULL;
+    // if the last save was interrupted after removing the old config, use the new one
+    if (!SPIFFS.exists(MYEMS_CONFIG_FILE) && SPIFFS.exists(MYEMS_CONFIG_FILE_TMP)) {
+        SPIFFS.rename(MYEMS_CONFIG_FILE_TMP, MYEMS_CONFIG_FILE);
+    }
 
-    value          = json["mqtt_password"];
-    _mqtt_password = (value) ? strdup(value) : NULL;
+    if (!SPIFFS.exists(MYEMS_CONFIG_FILE)) {
+        return false;
+    }
 
-    _use_serial = (bool)json["use_serial"];
+    File configFile = SPIFFS.open(MYEMS_CONFIG_FILE, "r");
 
-    _heartbeat = (bool)json["heartbeat"];
+    size_t size = configFile.size();
+    if ((size == 0) || (size > 1024)) {
+        myDebug_P(PSTR("[FS] Config file size is invalid"));
+        configFile.close();
+        return false;
+    }
 
-    // callback for loading custom settings
-    // ok is false if there's a problem loading a custom setting (e.g. does not exist)
-    bool ok = (_fs_callback)(MYESP_FSACTION_LOAD, json);
+    DynamicJsonDocument doc(SPIFFS_MAXSIZE);
 
+    // Deserialize the JSON document
+    DeserializationError error = deserializeJson(doc, configFile);
     configFile.close();
+    if (error) {
+        myDebug_P(PSTR("[FS] Failed to read config file. Error %s"), error.c_str());
+        return false;
+    }
 
-    return ok;
+    JsonObject json = doc.as<JsonObject>();
+    (void)_fs_importConfig(json, true);
+    _fs_writes = json["fs_writes"] | _fs_writes;
+
+    myDebug_P(PSTR("[FS] Imported %s"), MYEMS_CONFIG_FILE);
+    SPIFFS.remove(MYEMS_CONFIG_FILE);
+
+    return true;
 }
 
-// save settings to spiffs
-bool MyESP::fs_saveConfig() {
-    bool ok = true;
+// replace a string setting
+void MyESP::_fs_importString(char ** setting, const char * value) {
+    if (*setting) {
+        free(*setting);
+    }
+    *setting = (value && value[0]) ? strdup(value) : NULL;
+}
 
-    // call any custom functions before handling SPIFFS
-    if (_ota_pre_callback) {
-        (_ota_pre_callback)();
+// merge JSON settings into the config, anything missing keeps its current value
+// used for the old config file and config_import. The WiFi and MQTT credentials are left out unless credentials
+// is set, like their commands they can't be changed over MQTT
+bool MyESP::_fs_importConfig(const JsonObject json, bool credentials) {
+    if (json.isNull()) {
+        return false;
+    }
+
+    // fetch the standard system parameters
+    if (credentials) {
+        if (json.containsKey("wifi_ssid")) {
+            _fs_importString(&_wifi_ssid, json["wifi_ssid"]);
+        }
+        if (json.containsKey("wifi_password")) {
+            _fs_importString(&_wifi_password, json["wifi_password"]);
+        }
+        if (json.containsKey("mqtt_host")) {
+            _fs_importString(&_mqtt_host, json["mqtt_host"]);
+        }
+        if (json.containsKey("mqtt_username")) {
+            _fs_importString(&_mqtt_username, json["mqtt_username"]);
+        }
+        if (json.containsKey("mqtt_password")) {
+            _fs_importString(&_mqtt_password, json["mqtt_password"]);
+        }
+    } else if (json.containsKey("wifi_ssid") || json.containsKey("wifi_password") || json.containsKey("mqtt_host") || json.containsKey("mqtt_username")
+               || json.containsKey("mqtt_password")) {
+        myDebug_P(PSTR("[FS] The WiFi and MQTT credentials can only be imported from telnet, they're left out"));
     }
 
-    StaticJsonDocument<SPIFFS_MAXSIZE> doc;
-    JsonObject                         json = doc.to<JsonObject>();
+    _use_serial = json["use_serial"] | _use_serial;
+    _heartbeat  = json["heartbeat"] | _heartbeat;
+
+    // callback for importing custom settings
+    return (_fs_callback)(MYESP_FSACTION_LOAD, json);
+}
 
+// fill in the config as JSON, leaving out the passwords
+void MyESP::_fs_exportConfig(const JsonObject json) {
     json["app_version"]   = _app_version;
     json["wifi_ssid"]     = _wifi_ssid;
-    json["wifi_password"] = _wifi_password;
     json["mqtt_host"]     = _mqtt_host;
     json["mqtt_username"] = _mqtt_username;
-    json["mqtt_password"] = _mqtt_password;
     json["use_serial"]    = _use_serial;
     json["heartbeat"]     = _heartbeat;
+    json["fs_writes"]     = _fs_writes;
 
-    // callback for saving custom settings
+    // callback for exporting custom settings
     (void)(_fs_callback)(MYESP_FSACTION_SAVE, json);
+}
+
+// request the settings to be saved
+// the save is done from the main loop once there have been no more requests for MYESP_CONFIG_SAVE_DELAY, so
+// changes are coalesced and it's never done while processing EMS telegrams
+void MyESP::fs_requestSave() {
+    _fs_dirty           = true;
+    _fs_dirty_timestamp = millis();
+}
+
+// merge a config import from config_import, called from the main loop
+void MyESP::_fs_importLoop() {
+    if (!_fs_import) {
+        return;
+    }
+
+    char *   text = _fs_import;
+    uint32_t heap = ESP.getFreeHeap();
+    bool     ok;
+    _fs_import = NULL;
+
+    {
+        DynamicJsonDocument  doc(SPIFFS_MAXSIZE);
+        DeserializationError error = deserializeJson(doc, text);
+        ok                         = !error && _fs_importConfig(doc.as<JsonObject>(), _fs_import_telnet);
+    }
+
+    free(text);
+    heapTrack(MYESP_HEAP_JSON, heap);
+
+    if (!ok) {
+        myDebug_P(PSTR("[FS] Config import failed, it's not valid JSON or has no known settings"));
+        return;
+    }
+
+    myDebug_P(PSTR("Imported config, please 'reboot' ESP to apply all settings"));
+    fs_requestSave();
+    _fs_publishConfig();
+}
+
+// write any requested config save, called from the main loop
+void MyESP::_fs_saveLoop() {
+    if (_fs_dirty && ((millis() - _fs_dirty_timestamp) > MYESP_CONFIG_SAVE_DELAY)) {
+        (void)fs_saveConfig();
+    }
+}
+
+// save settings to EEPROM, straight away
+// EEPROM_Rotate writes to the next sector so a failed save never loses the config
+bool MyESP::fs_saveConfig() {
+    _fs_dirty = false;
 
-    // if file exists, remove it just to be safe
-    if (SPIFFS.exists(MYEMS_CONFIG_FILE)) {
-        SPIFFS.remove(MYEMS_CONFIG_FILE);
+    // on the heap only while it's saved, it's too big for the stack
+    MyESP_Config * config = (MyESP_Config *)malloc(sizeof(MyESP_Config));
+    if (!config) {
+        myDebug_P(PSTR("[FS] Not enough memory to save the config"));
+        fs_requestSave(); // try again later
+        return false;
+    }
+    memset(config, 0, sizeof(MyESP_Config));
+
+    config->magic   = MYESP_CONFIG_MAGIC;
+    config->size    = sizeof(MyESP_Config);
+    config->version = MYESP_CONFIG_VERSION;
+
+    if (_wifi_ssid) {
+        strlcpy(config->wifi_ssid, _wifi_ssid, sizeof(config->wifi_ssid));
+    }
+    if (_wifi_password) {
+        strlcpy(config->wifi_password, _wifi_password, sizeof(config->wifi_password));
+    }
+    if (_mqtt_host) {
+        strlcpy(config->mqtt_host, _mqtt_host, sizeof(config->mqtt_host));
+    }
+    if (_mqtt_username) {
+        strlcpy(config->mqtt_username, _mqtt_username, sizeof(config->mqtt_username));
+    }
+    if (_mqtt_password) {
+        strlcpy(config->mqtt_password, _mqtt_password, sizeof(config->mqtt_password));
     }
+    config->use_serial = _use_serial;
+    config->heartbeat  = _heartbeat;
 
-    // open for writing
-    File configFile = SPIFFS.open(MYEMS_CONFIG_FILE, "w");
-    if (!configFile) {
-        myDebug_P(PSTR("[FS] Failed to open config file for writing"));
+    // callback for saving custom settings, without them the config isn't complete so it's not written
+    if (!(_fs_config_callback)(MYESP_FSACTION_SAVE, config->app, sizeof(config->app))) {
+        myDebug_P(PSTR("[FS] Failed to save the settings"));
+        free(config);
+        fs_requestSave(); // try again later
         return false;
     }
 
+    // don't wear the flash if nothing has changed, e.g. a setting was set to the value it has
+    uint32_t crc = CRC32::calculate((uint8_t *)&config->wifi_ssid, sizeof(MyESP_Config) - offsetof(MyESP_Config, wifi_ssid));
+    if (crc == _fs_crc) {
+        free(config);
+        return true;
+    }
+    _fs_crc        = crc;
+    config->writes = ++_fs_writes;
+
+    config->crc = CRC32::calculate((uint8_t *)&config->writes, sizeof(MyESP_Config) - offsetof(MyESP_Config, writes));
+
+    _recorderEvent(MYESP_EVENT_CONFIG_SAVE);
 
-    // Serialize JSON to file
-    if (serializeJson(json, configFile) == 0) {
-        myDebug_P(PSTR("[FS] Failed to write config file"));
-        ok = false;
+    // call any custom functions before writing to flash
+    if (_ota_pre_callback) {
+        (_ota_pre_callback)();
     }
 
-    configFile.close();
+    EEPROMr.put(MYESP_CONFIG_EEPROM_OFFSET, *config);
+    free(config);
+
+    bool ok = EEPROMr.commit();
+    if (!ok) {
+        myDebug_P(PSTR("[FS] Failed to write config"));
+    }
 
-    // call any custom functions before handling SPIFFS
+    // call any custom functions after writing to flash
     if (_ota_post_callback) {
         (_ota_post_callback)();
     }
 
-    return ok; // it worked
+    return ok;
 }
 
-// init the SPIFF file system and load the config
-// if it doesn't exist try and create it
+// load the config, which is in EEPROM
+// if it doesn't exist bring in an old JSON config file or create a new one
 void MyESP::_fs_setup() {
-    if (!SPIFFS.begin()) {
-        myDebug_P(PSTR("[FS] Failed to mount the file system. Erasing..."));
-        _fs_eraseConfig(); // fix for ESP32
+    if (_fs_loadConfig()) {
         return;
     }
 
-    // load the config file. if it doesn't exist (function returns false) create it
-    if (!_fs_loadConfig()) {
-        //myDebug_P(PSTR("[FS] Re-creating config file"));
-        fs_saveConfig();
+    if (!_fs_loadJSONConfig()) {
+        // assume its the first install. Set serial to on
+        _use_serial = true;
     }
 
-    // _fs_printConfig(); // enable for debugging
+    fs_saveConfig();
 }
 
 uint32_t MyESP::getSystemLoadAverage() {
@@ -1571,23 +2615,26 @@ uint32_t MyESP::getSystemLoadAverage() {
 }
 
 // calculate load average
+// the load is the share of the CPU used by the tracked parts of the code, see cpuTrack()
+// time spent in the SDK (WiFi stack, timers) isn't tracked
 void MyESP::_calculateLoad() {
-    static uint32_t last_loadcheck    = 0;
-    static uint32_t load_counter_temp = 0;
-    load_counter_temp++;
-
-    if (millis() - last_loadcheck > LOADAVG_INTERVAL) {
-        static uint32_t load_counter     = 0;
-        static uint32_t load_counter_max = 1;
-
-        load_counter      = load_counter_temp;
-        load_counter_temp = 0;
-        if (load_counter > load_counter_max) {
-            load_counter_max = load_counter;
-        }
-        _load_average  = 100 - (100 * load_counter / load_counter_max);
-        last_loadcheck = millis();
+    static uint32_t last_loadcheck = 0; // in microseconds
+
+    uint32_t elapsed = micros() - last_loadcheck;
+    if (elapsed < (LOADAVG_INTERVAL * 1000UL)) {
+        return;
+    }
+    last_loadcheck = micros();
+
+    uint64_t window = (uint64_t)elapsed * ESP.getCpuFreqMHz(); // in CPU cycles
+
+    for (uint8_t i = 0; i < MYESP_CPU_MAX; i++) {
+        _cpu_counters[i].load   = (uint16_t)((_cpu_counters[i].cycles * 1000) / window);
+        _cpu_counters[i].cycles = 0;
     }
+
+    _load_average = (uint32_t)((_cpu_busy * 100) / window);
+    _cpu_busy     = 0;
 }
 
 // returns true is MQTT is alive
@@ -1657,11 +2704,17 @@ extern "C" void custom_crash_callback(struct rst_info * rst_info, uint32_t stack
 
     // write stack trace to EEPROM and avoid overwriting settings
     int16_t current_address = SAVE_CRASH_EEPROM_OFFSET + SAVE_CRASH_STACK_TRACE;
-    for (uint32_t i = stack_start; i < stack_end; i++) {
+    for (uint32_t i = stack_start; (i < stack_end) && (current_address < SAVE_CRASH_RECORDER_OFFSET); i++) {
         byte * byteValue = (byte *)i;
         EEPROMr.write(current_address++, *byteValue);
     }
 
+    // write the flight recorder to EEPROM
+    EEPROMr.write(SAVE_CRASH_RECORDER_OFFSET + SAVE_CRASH_RECORDER_HEAD, _recorder_head);
+    EEPROMr.write(SAVE_CRASH_RECORDER_OFFSET + SAVE_CRASH_RECORDER_SIZE, MYESP_RECORDER_SIZE);
+    EEPROMr.write(SAVE_CRASH_RECORDER_OFFSET + SAVE_CRASH_RECORDER_DATA, MYESP_RECORDER_DATA);
+    EEPROMr.put(SAVE_CRASH_RECORDER_OFFSET + SAVE_CRASH_RECORDER_EVENTS, _recorder);
+
     EEPROMr.commit();
 }
 
@@ -1675,6 +2728,32 @@ void MyESP::crashClear() {
     EEPROMr.commit();
 }
 
+/**
+ * Add an event to the flight recorder, overwriting the oldest one
+ * Only the first MYESP_RECORDER_DATA bytes of the data are kept
+ * Not safe to call from an interrupt
+ */
+void MyESP::recorderAdd(uint8_t type, const uint8_t * data, uint8_t length) {
+    MyESP_RecorderEvent & event = _recorder[_recorder_head];
+
+    event.timestamp = millis();
+    event.type      = type;
+    event.length    = length;
+    memcpy(event.data, data, (length < MYESP_RECORDER_DATA) ? length : MYESP_RECORDER_DATA);
+
+    _recorder_head = (_recorder_head + 1) % MYESP_RECORDER_SIZE;
+}
+
+// add a system event to the flight recorder, with the free heap at that time
+void MyESP::_recorderEvent(uint8_t event) {
+    uint8_t  data[5];
+    uint32_t free_heap = ESP.getFreeHeap();
+
+    data[0] = event;
+    memcpy(&data[1], &free_heap, sizeof(free_heap));
+    recorderAdd(MYESP_RECORDER_SYSTEM, data, sizeof(data));
+}
+
 /**
  * Print out crash information that has been previously saved in EEPROM
  * Copied from https://github.com/krzychb/EspSaveCrash
@@ -1761,6 +2840,9 @@ void MyESP::crashDump() {
 
     int16_t current_address = SAVE_CRASH_EEPROM_OFFSET + SAVE_CRASH_STACK_TRACE;
     int16_t stack_len       = stack_end - stack_start;
+    if (stack_len > (SAVE_CRASH_RECORDER_OFFSET - current_address)) {
+        stack_len = SAVE_CRASH_RECORDER_OFFSET - current_address; // only this much was saved
+    }
 
     uint32_t stack_trace;
 
@@ -1776,6 +2858,31 @@ void MyESP::crashDump() {
         SerialAndTelnet.println();
     }
     myDebug_P(PSTR("<<<stack<<<"));
+
+    // flight recorder, from the oldest to the newest event
+    // each line is the timestamp, type, full length and the data that was kept
+    if ((EEPROMr.read(SAVE_CRASH_RECORDER_OFFSET + SAVE_CRASH_RECORDER_SIZE) == MYESP_RECORDER_SIZE)
+        && (EEPROMr.read(SAVE_CRASH_RECORDER_OFFSET + SAVE_CRASH_RECORDER_DATA) == MYESP_RECORDER_DATA)) {
+        uint8_t             head = EEPROMr.read(SAVE_CRASH_RECORDER_OFFSET + SAVE_CRASH_RECORDER_HEAD);
+        MyESP_RecorderEvent event;
+
+        myDebug_P(PSTR(">>>recorder>>>"));
+        for (uint8_t i = 0; i < MYESP_RECORDER_SIZE; i++) {
+            uint8_t slot = (head + i) % MYESP_RECORDER_SIZE;
+            EEPROMr.get(SAVE_CRASH_RECORDER_OFFSET + SAVE_CRASH_RECORDER_EVENTS + (slot * sizeof(event)), event);
+            if ((event.type == MYESP_RECORDER_NONE) || (event.type == 0xFF)) {
+                continue; // empty slot or erased EEPROM
+            }
+
+            SerialAndTelnet.printf("%08x %02x %02x", event.timestamp, event.type, event.length);
+            for (uint8_t j = 0; (j < event.length) && (j < MYESP_RECORDER_DATA); j++) {
+                SerialAndTelnet.printf(" %02x", event.data[j]);
+            }
+            SerialAndTelnet.println();
+        }
+        myDebug_P(PSTR("<<<recorder<<<"));
+    }
+
     myDebug_P(PSTR("\nTo clean this dump use the command: %scrash clear%s\n"), COLOR_BOLD_ON, COLOR_BOLD_OFF);
 }
 
@@ -1786,19 +2893,22 @@ void MyESP::begin(const char * app_hostname, const char * app_name, const char *
     _app_version  = strdup(app_version);
 
     getInitialFreeHeap(); // get initial free mem
+    _recorderEvent(MYESP_EVENT_BOOT);
 
     _rtcmemSetup();
-    _telnet_setup(); // Telnet setup, called first to set Serial
-    _eeprom_setup(); // set up EEPROM for storing crash data, if compiled with -DCRASH
-    _fs_setup();     // SPIFFS setup, do this first to get values
-    _wifi_setup();   // WIFI setup
-    _ota_setup();    // init OTA
+    _telnet_setup();  // Telnet setup, called first to set Serial
+    _eeprom_setup();  // set up EEPROM for storing crash data, if compiled with -DCRASH
+    _fs_setup();      // SPIFFS setup, do this first to get values
+    _wifi_setup();    // WIFI setup
+    _ota_setup();     // init OTA
+    _metrics_setup(); // HTTP server for the metrics
 
     // print a welcome message
     myDebug_P(PSTR("\n* %s version %s"), _app_name, _app_version);
     SerialAndTelnet.flush();
 
     _setSystemCheck(false); // reset system check
+    _heapCheck();           // first heap sample
     _heartbeatCheck(true);  // force heartbeat
 }
 
@@ -1806,14 +2916,35 @@ void MyESP::begin(const char * app_hostname, const char * app_name, const char *
  * Loop. This is called as often as possible and it handles wifi, telnet, mqtt etc
  */
 void MyESP::loop() {
+    TRACE_BEGIN(TRACE_LOOP, "MyESP::loop");
     _calculateLoad();
     _systemCheckLoop();
     _heartbeatCheck();
+    _heapCheck();
+    _fs_importLoop();
+    _fs_saveLoop();
 
+    TRACE_BEGIN(TRACE_LOOP, "telnet");
+    uint32_t cpu = cpuStart();
     _telnetHandle();
+    _telnetRenderLoop();
+    cpuTrack(MYESP_CPU_TELNET, cpu);
+    TRACE_END(TRACE_LOOP, "telnet");
+
+    TRACE_BEGIN(TRACE_LOOP, "wifi");
+    cpu = cpuStart();
     jw.loop();           // WiFi
     ArduinoOTA.handle(); // OTA
-    _mqttConnect();      // MQTT
+    cpuTrack(MYESP_CPU_WIFI, cpu);
+    TRACE_END(TRACE_LOOP, "wifi");
+
+    TRACE_BEGIN(TRACE_LOOP, "mqtt");
+    cpu = cpuStart();
+    _mqttConnect(); // MQTT
+    cpuTrack(MYESP_CPU_MQTT, cpu);
+    TRACE_END(TRACE_LOOP, "mqtt");
+
+    TRACE_END(TRACE_LOOP, "MyESP::loop");
 
     yield(); // ...and breath
 }
@@ -12,6 +12,7 @@
 #define MYESP_VERSION "1.1.16"
 
 #include <ArduinoJson.h>
+#include <Command.h>
 #include <ArduinoOTA.h>
 #include <AsyncMqttClient.h> // https://github.com/marvinroger/async-mqtt-client and for ESP32 see https://github.com/marvinroger/async-mqtt-client/issues/127
 #include <DNSServer.h>
@@ -36,9 +37,15 @@ extern struct rst_info resetInfo;
 #define OTA_PORT 8266
 #endif
 
-#define MYEMS_CONFIG_FILE "/config.json"
+#define MYEMS_CONFIG_FILE "/config.json"     // old JSON config in SPIFFS, imported once into the binary config
+#define MYEMS_CONFIG_FILE_TMP "/config.tmp"  // left behind by an interrupted save of the old JSON config
+#define MYESP_CONFIG_SAVE_DELAY 3000         // ms without any changes before a requested config save is written
+#define MYESP_CONFIG_EEPROM_OFFSET 0x0C00    // binary config in EEPROM, after the crash data
+#define MYESP_CONFIG_MAGIC 0x4D43            // "MC"
+#define MYESP_CONFIG_VERSION 1               // change when MyESP_Config can't be read by appending new fields
+#define MYESP_CONFIG_APP_SIZE 720            // bytes kept for the application's settings, what's left of the EEPROM sector
 
-#define LOADAVG_INTERVAL 30000 // Interval between calculating load average (in ms)
+#define LOADAVG_INTERVAL 30000 // Interval between calculating load average and CPU usage (in ms)
 
 // WIFI
 #define WIFI_CONNECT_TIMEOUT 10000     // Connecting timeout for WIFI in ms
@@ -50,10 +57,17 @@ extern struct rst_info resetInfo;
 #define MQTT_RECONNECT_DELAY_STEP 3000  // Increase the reconnect delay in 3 seconds after each failed attempt
 #define MQTT_RECONNECT_DELAY_MAX 120000 // Set reconnect time to 2 minutes at most
 #define MQTT_MAX_TOPIC_SIZE 50          // max length of MQTT topic
+#define MQTT_POLICIES_MAX 24            // max # topics with their own publish policy, system and project together
+#define MQTT_HEAP_RESERVE 4096          // largest free heap block that has to be left after a low priority publish
+#define MQTT_BACKOFF 2000               // ms low priority publishes are deferred after the MQTT client couldn't take one
+#define MQTT_PACKET_OVERHEAD 7          // bytes of a PUBLISH packet besides the topic and payload
 #define MQTT_TOPIC_START "start"
+#define MQTT_TOPIC_COMMAND "cmd" // everything below MQTT_BASE/hostname/cmd/ is a command, with one subscription
 #define MQTT_TOPIC_HEARTBEAT "heartbeat"
+#define MQTT_TOPIC_CPU "cpu" // CPU usage per part, sent with the heartbeat
 #define MQTT_TOPIC_START_PAYLOAD "start"
 #define MQTT_TOPIC_RESTART "restart"
+#define MQTT_TOPIC_CONFIG "config" // the config is published here as JSON
 
 // Internal MQTT events
 #define MQTT_CONNECT_EVENT 0
@@ -65,6 +79,16 @@ extern struct rst_info resetInfo;
 #define TELNET_MAX_COMMAND_LENGTH 80 // length of a command
 #define TELNET_EVENT_CONNECT 1
 #define TELNET_EVENT_DISCONNECT 0
+#define TELNET_RENDER_SPACE 1500 // free bytes in the telnet buffer before the next part of a long output is rendered
+#define TELNET_RENDER_LINES 10   // lines of a long list rendered in one part
+
+// Metrics
+#ifndef METRICS_PORT
+#define METRICS_PORT 80 // HTTP port serving the Prometheus metrics on /metrics, can be changed with -DMETRICS_PORT=<port>
+#endif
+#define METRICS_BUFFER_SIZE 2048 // one part of the response, the next part is rendered into it once it's sent
+#define METRICS_LINES 16         // values of a long list rendered in one part
+#define METRICS_CLIENT_TIMEOUT 5 // seconds to wait for the request
 
 // ANSI Colors
 #define COLOR_RESET "\x1B[0m"
@@ -100,7 +124,32 @@ PROGMEM const char * const custom_reset_string[]   = {custom_reset_hardware, cus
 #define CUSTOM_RESET_MAX 4
 
 // SPIFFS
-#define SPIFFS_MAXSIZE 800 // https://arduinojson.org/v6/assistant/
+#define SPIFFS_MAXSIZE 4096 // https://arduinojson.org/v6/assistant/, for importing and exporting the config as JSON, with names of 24 Dallas sensors
+
+/**
+ * The config as it's stored in EEPROM, loaded with a single read
+ *
+ * The CRC covers everything after the header, up to size. New settings are added at the end
+ * and are read as 0 from a config written by an older firmware.
+ */
+typedef struct {
+    uint16_t magic;        // MYESP_CONFIG_MAGIC
+    uint16_t size;         // sizeof(MyESP_Config) of the firmware that wrote it
+    uint8_t  version;      // MYESP_CONFIG_VERSION
+    uint8_t  reserved[3];  // unused, 0
+    uint32_t crc;          // CRC32 of everything after this field
+    uint32_t writes;       // # times the config has been written to flash
+    char     wifi_ssid[33];
+    char     wifi_password[65];
+    char     mqtt_host[65];
+    char     mqtt_username[33];
+    char     mqtt_password[65];
+    bool     use_serial;
+    bool     heartbeat;
+    uint8_t  app[MYESP_CONFIG_APP_SIZE]; // the application's settings, see fs_config_callback_f
+} MyESP_Config;
+
+static_assert(MYESP_CONFIG_EEPROM_OFFSET + sizeof(MyESP_Config) <= SPI_FLASH_SEC_SIZE, "MyESP_Config is too big for the EEPROM");
 
 // CRASH
 /**
@@ -130,7 +179,58 @@ PROGMEM const char * const custom_reset_string[]   = {custom_reset_hardware, cus
 #define SAVE_CRASH_DEPC 0x16            // 4 bytes
 #define SAVE_CRASH_STACK_START 0x1A     // 4 bytes
 #define SAVE_CRASH_STACK_END 0x1E       // 4 bytes
-#define SAVE_CRASH_STACK_TRACE 0x22     // variable
+#define SAVE_CRASH_STACK_TRACE 0x22     // variable, up to SAVE_CRASH_RECORDER_OFFSET
+
+/**
+ * Flight recorder, a ring of the last events which is saved with the crash data
+ * Decode it from a 'crash dump' with scripts/recorder.py
+ *
+ *  1. index of the oldest event
+ *  2. # events (MYESP_RECORDER_SIZE)
+ *  3. bytes of data per event (MYESP_RECORDER_DATA)
+ *  4. the events, see MyESP_RecorderEvent
+ */
+#define SAVE_CRASH_RECORDER_OFFSET 0x0800 // initial address for the flight recorder
+#define SAVE_CRASH_RECORDER_HEAD 0x00     // 1 byte
+#define SAVE_CRASH_RECORDER_SIZE 0x01     // 1 byte
+#define SAVE_CRASH_RECORDER_DATA 0x02     // 1 byte
+#define SAVE_CRASH_RECORDER_EVENTS 0x04   // MYESP_RECORDER_SIZE * sizeof(MyESP_RecorderEvent)
+
+#define MYESP_RECORDER_SIZE 32 // # events kept
+#define MYESP_RECORDER_DATA 10 // bytes of data kept for each event
+
+typedef enum {
+    MYESP_RECORDER_NONE,    // empty slot
+    MYESP_RECORDER_RX,      // telegram received, data is the telegram
+    MYESP_RECORDER_TX,      // telegram sent, data is the telegram
+    MYESP_RECORDER_TXQUEUE, // Tx queue change, data is set by the application
+    MYESP_RECORDER_SYSTEM,  // data is a MYESP_EVENT and the free heap (4 bytes)
+    MYESP_RECORDER_APP      // application event, data is set by the application
+} MYESP_RECORDER_TYPE;
+
+typedef enum {
+    MYESP_EVENT_BOOT,
+    MYESP_EVENT_WIFI_CONNECTED,
+    MYESP_EVENT_WIFI_DISCONNECTED,
+    MYESP_EVENT_MQTT_CONNECTED,
+    MYESP_EVENT_MQTT_DISCONNECTED,
+    MYESP_EVENT_MQTT_MESSAGE,
+    MYESP_EVENT_TELNET_CONNECTED,
+    MYESP_EVENT_TELNET_DISCONNECTED,
+    MYESP_EVENT_OTA_START,
+    MYESP_EVENT_CONFIG_SAVE,
+    MYESP_EVENT_RESTART
+} MYESP_EVENT;
+
+typedef struct {
+    uint32_t timestamp;                 // millis()
+    uint8_t  type;                      // MYESP_RECORDER_TYPE
+    uint8_t  length;                    // full length of the data, only the first MYESP_RECORDER_DATA bytes are kept
+    uint8_t  data[MYESP_RECORDER_DATA]; // data, depending on the type
+} MyESP_RecorderEvent;
+
+static_assert(SAVE_CRASH_RECORDER_OFFSET + SAVE_CRASH_RECORDER_EVENTS + (MYESP_RECORDER_SIZE * sizeof(MyESP_RecorderEvent)) <= MYESP_CONFIG_EEPROM_OFFSET,
+              "flight recorder is too big for the EEPROM");
 
 // Base address of USER RTC memory
 // https://github.com/esp8266/esp8266-wiki/wiki/Memory-Map#memmory-mapped-io-registers
@@ -145,10 +245,13 @@ PROGMEM const char * const custom_reset_string[]   = {custom_reset_hardware, cus
 #define RTCMEM_BLOCKS 96u
 #define RTCMEM_MAGIC 0x45535075
 
+#define RTCMEM_APP_BLOCKS 64u // blocks for the application, see rtcmemLoad() and rtcmemSave()
+
 struct RtcmemData {
-    uint32_t magic;  // RTCMEM_MAGIC
-    uint32_t sys;    // system reset reason (1-4)
-    uint32_t energy; // store energy count
+    uint32_t magic;                  // RTCMEM_MAGIC
+    uint32_t sys;                    // system reset reason (1-4)
+    uint32_t energy;                 // store energy count
+    uint32_t app[RTCMEM_APP_BLOCKS]; // application data kept over soft resets
 };
 
 static_assert(sizeof(RtcmemData) <= (RTCMEM_BLOCKS * 4u), "RTCMEM struct is too big");
@@ -156,22 +259,71 @@ static_assert(sizeof(RtcmemData) <= (RTCMEM_BLOCKS * 4u), "RTCMEM struct is too
 #define SYSTEM_CHECK_TIME 60000   // The system is considered stable after these many millis (1 minute)
 #define SYSTEM_CHECK_MAX 5        // After this many crashes on boot
 #define HEARTBEAT_INTERVAL 120000 // in milliseconds, how often the MQTT heartbeat is sent (2 mins)
+#define HEAP_CHECK_INTERVAL 1000  // in milliseconds, how often the largest free block and fragmentation are sampled
 
+// the parts of the code whose heap usage is tracked, see heapTrack()
+typedef enum { MYESP_HEAP_MQTT, MYESP_HEAP_JSON, MYESP_HEAP_TELNET, MYESP_HEAP_DS18, MYESP_HEAP_MAX } MYESP_HEAP;
+
+typedef struct {
+    uint32_t calls;    // # times the code ran
+    int32_t  retained; // heap it didn't give back, in bytes. Keeps growing if there's a leak
+} MyESP_HeapCounter;
+
+// the parts of the code whose CPU time is tracked, see cpuStart() and cpuTrack()
+// the parser runs inside the UART task, and publishing may run inside MQTT, so the times of parts can overlap
+typedef enum {
+    MYESP_CPU_UART,
+    MYESP_CPU_PARSER,
+    MYESP_CPU_PUBLISH,
+    MYESP_CPU_DS18,
+    MYESP_CPU_TELNET,
+    MYESP_CPU_WIFI,
+    MYESP_CPU_MQTT,
+    MYESP_CPU_MAX
+} MYESP_CPU;
+
+typedef struct {
+    uint32_t calls;      // # times the code ran
+    uint64_t cycles;     // CPU cycles used in the current LOADAVG_INTERVAL
+    uint32_t max_cycles; // longest single run
+    uint16_t load;       // share of the CPU in the last LOADAVG_INTERVAL, in 0.1%
+} MyESP_CpuCounter;
+
+// when the MQTT client or the heap are short, low priority publishes are deferred so the others get through
+typedef enum { MQTT_PRIORITY_LOW, MQTT_PRIORITY_HIGH } MYESP_MQTT_PRIORITY;
+
+// how a topic is published, tables of these are kept in flash. See setMQTTPolicies()
+// a topic is sent at most burst times back to back, and earns one publish back every interval ms
 typedef struct {
-    bool set; // is it a set command
-    char key[50];
-    char description[100];
-} command_t;
+    uint8_t  qos;
+    bool     retain;
+    uint8_t  priority;  // MYESP_MQTT_PRIORITY
+    uint8_t  burst;     // 0 for no limit
+    uint16_t interval;  // ms
+    char     topic[24]; // below MQTT_BASE/hostname/. Ending with '/' it's for all topics below it, e.g. "sensors/"
+} MyESP_MQTTPolicy;
+
+#define MQTT_POLICY(topic, qos, retain, priority, burst, interval) \
+    { (qos), (retain), (priority), (burst), (interval), topic }
+
+// what's left of the rate limit of a topic
+typedef struct {
+    char *   topic;  // the full topic, built once. NULL for a policy of all topics below one
+    uint8_t  tokens; // # publishes it can send right now
+    uint32_t earned; // millis() when the last one was earned back
+} MyESP_MQTTRate;
 
 typedef enum { MYESP_FSACTION_SET, MYESP_FSACTION_LIST, MYESP_FSACTION_SAVE, MYESP_FSACTION_LOAD } MYESP_FSACTION;
 
 typedef std::function<void(unsigned int, const char *, const char *)>            mqtt_callback_f;
 typedef std::function<void()>                                                    wifi_callback_f;
 typedef std::function<void()>                                                    ota_callback_f;
-typedef std::function<void(uint8_t, const char *)>                               telnetcommand_callback_f;
 typedef std::function<void(uint8_t)>                                             telnet_callback_f;
+typedef std::function<bool(uint16_t)>                                            telnet_render_f;
 typedef std::function<bool(MYESP_FSACTION, const JsonObject json)>               fs_callback_f;
 typedef std::function<bool(MYESP_FSACTION, uint8_t, const char *, const char *)> fs_settings_callback_f;
+typedef std::function<bool(MYESP_FSACTION, uint8_t *, size_t)>                   fs_config_callback_f;
+typedef std::function<bool(uint16_t)>                                           metrics_callback_f;
 
 // calculates size of an 2d array at compile time
 template <typename T, size_t N>
@@ -197,7 +349,8 @@ class MyESP {
     bool isMQTTConnected();
     void mqttSubscribe(const char * topic);
     void mqttUnsubscribe(const char * topic);
-    void mqttPublish(const char * topic, const char * payload);
+    bool mqttPublish(const char * topic, const char * payload);
+    void setMQTTPolicies(const MyESP_MQTTPolicy * policies, uint8_t count);
     void setMQTT(const char *    mqtt_host,
                  const char *    mqtt_username,
                  const char *    mqtt_password,
@@ -216,13 +369,15 @@ class MyESP {
     // debug & telnet
     void myDebug(const char * format, ...);
     void myDebug_P(PGM_P format_P, ...);
-    void setTelnet(command_t * cmds, uint8_t count, telnetcommand_callback_f callback_cmd, telnet_callback_f callback);
+    void setTelnet(const _Command * cmds, uint8_t count, const _Command_Alias * aliases, uint8_t alias_count, telnet_callback_f callback);
+    void telnetRender(telnet_render_f render);
     bool getUseSerial();
     void setUseSerial(bool toggle);
 
     // FS
-    void setSettings(fs_callback_f callback, fs_settings_callback_f fs_settings_callback);
+    void setSettings(fs_callback_f callback, fs_settings_callback_f fs_settings_callback, fs_config_callback_f fs_config_callback);
     bool fs_saveConfig();
+    void fs_requestSave();
 
     // Crash
     void crashClear();
@@ -230,6 +385,26 @@ class MyESP {
     void crashTest(uint8_t t);
     void crashInfo();
 
+    // flight recorder
+    void recorderAdd(uint8_t type, const uint8_t * data, uint8_t length);
+
+    // heap
+    void heapTrack(uint8_t part, uint32_t free_heap_before);
+    void showMemoryStats();
+
+    // CPU
+    uint32_t cpuStart();
+    void     cpuTrack(uint8_t part, uint32_t start);
+    void     showCpuStats();
+
+    // metrics, in the Prometheus text format. Pass counters as uint32_t, they are printed unsigned
+    void setMetrics(metrics_callback_f callback);
+    void metricsHeader(PGM_P name, PGM_P type, PGM_P help);
+    void metricsValue(PGM_P name, const char * labels, int32_t value);
+    void metricsValue(PGM_P name, const char * labels, uint32_t value);
+    void metricsAdd(PGM_P name, PGM_P type, PGM_P help, int32_t value);
+    void metricsAdd(PGM_P name, PGM_P type, PGM_P help, uint32_t value);
+
     // general
     void end();
     void loop();
@@ -242,6 +417,8 @@ class MyESP {
 
     // rtcmem and reset reason
     bool     rtcmemStatus();
+    bool     rtcmemLoad(void * data, size_t size);
+    bool     rtcmemSave(const void * data, size_t size);
     uint32_t getSystemResetReason();
 
   private:
@@ -254,7 +431,8 @@ class MyESP {
     mqtt_callback_f _mqtt_callback;
     void            _mqttOnConnect();
     void            _sendStart();
-    char *          _mqttTopic(const char * topic);
+    char *          _mqttTopic(char * buffer, size_t size, const char * topic);
+    void            _mqttInternTopics();
     char *          _mqtt_host;
     char *          _mqtt_username;
     char *          _mqtt_password;
@@ -265,9 +443,26 @@ class MyESP {
     char *          _mqtt_will_topic;
     char *          _mqtt_will_online_payload;
     char *          _mqtt_will_offline_payload;
-    char *          _mqtt_topic;
+    char *          _mqtt_prefix;          // MQTT_BASE/hostname/, built once
+    char *          _mqtt_cmd_topic;       // MQTT_BASE/hostname/cmd/#, the only subscription
+    size_t          _mqtt_cmd_length;      // length of the command prefix, without the #
+    char *          _mqtt_will_topic_full; // the last will topic with the prefix, kept by the MQTT client
     unsigned long   _mqtt_last_connection;
     bool            _mqtt_connecting;
+
+    // mqtt publish policies, the system topics first and then the project's
+    static const MyESP_MQTTPolicy _policies[];
+    const MyESP_MQTTPolicy *      _mqtt_policies; // of the project, in flash
+    uint8_t                       _mqtt_policy_count;
+    MyESP_MQTTRate                _mqtt_rates[MQTT_POLICIES_MAX];
+    uint32_t                      _mqtt_limited;   // # publishes skipped by the rate limit of their topic
+    uint32_t                      _mqtt_deferred;  // # low priority publishes held back while the client or heap were short
+    uint32_t                      _mqtt_dropped;   // # publishes the client couldn't take
+    uint32_t                      _mqtt_congested; // millis() when the client last couldn't take a publish, 0 if it could
+    bool                          _mqttCongested(size_t size);
+    const MyESP_MQTTPolicy *      _mqttPolicy(uint8_t index);
+    int8_t                        _mqttFindPolicy(const char * topic);
+    bool                          _mqttRateAllow(uint8_t index, const MyESP_MQTTPolicy * policy);
     bool            _rtcmem_status;
 
     // wifi
@@ -288,33 +483,74 @@ class MyESP {
 
     // crash
     void _eeprom_setup();
+    void _recorderEvent(uint8_t event);
 
     // telnet & debug
-    TelnetSpy                SerialAndTelnet;
-    void                     _telnetConnected();
-    void                     _telnetDisconnected();
-    void                     _telnetHandle();
-    void                     _telnetCommand(char * commandLine);
-    char *                   _telnet_readWord(bool allow_all_chars);
-    void                     _telnet_setup();
-    char                     _command[TELNET_MAX_COMMAND_LENGTH]; // the input command from either Serial or Telnet
-    command_t *              _helpProjectCmds;                    // Help of commands setted by project
-    uint8_t                  _helpProjectCmds_count;              // # available commands
-    void                     _consoleShowHelp();
-    telnetcommand_callback_f _telnetcommand_callback; // Callable for projects commands
-    telnet_callback_f        _telnet_callback;        // callback for connect/disconnect
-    bool                     _changeSetting(uint8_t wc, const char * setting, const char * value);
+    TelnetSpy         SerialAndTelnet;
+    void              _telnetConnected();
+    void              _telnetDisconnected();
+    void              _telnetHandle();
+    void              _telnetCommand(char * commandLine);
+    void              _telnet_setup();
+    char              _command[TELNET_MAX_COMMAND_LENGTH]; // the input command from either Serial or Telnet
+    const _Command *  _helpProjectCmds;                    // commands of the project, in flash
+    uint8_t           _helpProjectCmds_count;              // # available commands
+    void              _consoleShowHelp();
+    void              _printCommands(bool settings, uint8_t * next, uint8_t lines);
+    telnet_callback_f _telnet_callback;    // callback for connect/disconnect
+    telnet_render_f   _telnet_render;      // renders the next part of a long output, NULL if there's none
+    uint16_t          _telnet_render_step; // # parts rendered so far
+    void              _telnetRenderLoop();
+
+    // commands, see Command.h
+    static const _Command       _commands[]; // the system commands
+    static const _Command_Alias _aliases[];  // and the topics they had before the cmd/ prefix
+    void                        _commandRun(const _Command * cmd, char * args, bool telnet);
+    static bool                 _cmdReboot(const _Command_Arg * arg);
+    static bool                 _cmdSystem(const _Command_Arg * arg);
+    static bool                 _cmdMem(const _Command_Arg * arg);
+    static bool                 _cmdCpu(const _Command_Arg * arg);
+    static bool                 _cmdConfig(const _Command_Arg * arg);
+    static bool                 _cmdQuit(const _Command_Arg * arg);
+    static bool                 _cmdErase(const _Command_Arg * arg);
+    static bool                 _cmdCrash(const _Command_Arg * arg);
+    static bool                 _cmdTrace(const _Command_Arg * arg);
+    static bool                 _cmdConfigImport(const _Command_Arg * arg);
+    static bool                 _cmdConfigExport(const _Command_Arg * arg);
+    static bool                 _cmdBoottime(const _Command_Arg * arg);
+    static bool                 _cmdWifiSsid(const _Command_Arg * arg);
+    static bool                 _cmdWifiPassword(const _Command_Arg * arg);
+    static bool                 _cmdMqttHost(const _Command_Arg * arg);
+    static bool                 _cmdMqttUsername(const _Command_Arg * arg);
+    static bool                 _cmdMqttPassword(const _Command_Arg * arg);
+    static bool                 _cmdSerial(const _Command_Arg * arg);
+    static bool                 _cmdHeartbeat(const _Command_Arg * arg);
+    static void                 _cmdString(char ** setting, const _Command_Arg * arg);
 
     // fs
-    void _fs_setup();
-    bool _fs_loadConfig();
-    void _fs_printConfig();
-    void _fs_eraseConfig();
+    void     _fs_setup();
+    bool     _fs_loadConfig();
+    bool     _fs_loadJSONConfig();
+    bool     _fs_importConfig(const JsonObject json, bool credentials);
+    void     _fs_importString(char ** setting, const char * value);
+    void     _fs_exportConfig(const JsonObject json);
+    void     _fs_publishConfig();
+    void     _fs_printConfig();
+    void     _fs_eraseConfig();
+    void     _fs_importLoop();
+    void     _fs_saveLoop();
+    bool     _fs_dirty;           // a config save has been requested
+    uint32_t _fs_dirty_timestamp; // millis() of the last request
+    uint32_t _fs_writes;          // # times the config has been written to flash, for wear monitoring
+    uint32_t _fs_crc;             // CRC32 of the settings last loaded or saved, to skip saves that change nothing
+    char *   _fs_import;          // JSON from config_import waiting to be merged by the main loop, NULL if there's none
+    bool     _fs_import_telnet;   // it came from telnet, so it can change the WiFi and MQTT credentials
 
     // settings
     fs_callback_f          _fs_callback;
     fs_settings_callback_f _fs_settings_callback;
-    void                   _printSetCommands();
+    fs_config_callback_f   _fs_config_callback;
+    bool                   _printSetCommands(uint16_t step);
 
     // general
     char *        _app_hostname;
@@ -353,11 +589,45 @@ class MyESP {
     uint32_t getSystemLoadAverage();
     void     _calculateLoad();
     uint32_t _load_average;
+
+    // CPU usage per part
+    MyESP_CpuCounter _cpu_counters[MYESP_CPU_MAX];
+    uint8_t          _cpu_depth; // # tracked parts running, only the outermost counts towards the load
+    uint64_t         _cpu_busy;  // CPU cycles used by all tracked parts in the current LOADAVG_INTERVAL
+    void             _cpuPublish();
     uint32_t getInitialFreeHeap();
     uint32_t getUsedHeap();
 
+    // heap watermarks and per part counters
+    void              _heapCheck();
+    uint32_t          _heap_min;       // lowest free heap seen
+    uint32_t          _heap_block_min; // smallest largest free block seen
+    uint8_t           _heap_frag_max;  // highest fragmentation seen, as a %
+    MyESP_HeapCounter _heap_counters[MYESP_HEAP_MAX];
+
     // heartbeat
     void _heartbeatCheck(bool force);
+
+    // metrics
+    void               _metrics_setup();
+    void               _metricsRequest(AsyncClient * client, const char * request, size_t len);
+    bool               _metricsRender(uint16_t step);
+    void               _metricsSend();
+    void               _metricsEnd();
+    void               _metricsPrintf_P(PGM_P format_P, ...);
+    void               _metricsValue(PGM_P name, const char * labels, const char * value);
+    AsyncServer *      _metrics_server;
+    metrics_callback_f _metrics_callback;
+    AsyncClient *      _metrics_client;    // the client the response is sent to, NULL if there's none
+    char *             _metrics_buffer;    // the part being sent, only allocated while there's a response
+    size_t             _metrics_length;    // length of the part
+    size_t             _metrics_sent;      // where the rest of the part is sent from
+    size_t             _metrics_mark;      // start of the last HELP/TYPE lines, taken out again if no value fits after them
+    bool               _metrics_full;      // a line didn't fit, the rest of this part is left out
+    uint16_t           _metrics_step;      // the next part to render
+    bool               _metrics_done;      // the part being sent is the last one
+    uint32_t           _metrics_requests;  // # scrapes served
+    uint32_t           _metrics_truncated; // # lines left out because a part was full
 };
 
 extern MyESP myESP;
@@ -547,6 +547,11 @@ bool TelnetSpy::isClientConnected() {
     return connected;
 }
 
+// free space in the telnet ring buffer, unlike availableForWrite() not limited by the serial port
+uint16_t TelnetSpy::getBufferFree() {
+    return bufLen - bufUsed;
+}
+
 void TelnetSpy::setCallbackOnConnect(telnetSpyCallback callback) {
     callbackConnect = callback;
 }
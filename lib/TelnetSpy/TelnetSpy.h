@@ -189,6 +189,7 @@ class TelnetSpy : public Stream {
     void     serialPrint(char c);
 
     void                          disconnectClient();                                  // added by Proddy
+    uint16_t                      getBufferFree();                                     // free space in the telnet buffer
     typedef std::function<void()> telnetSpyCallback;                                   // added by Proddy
     void                          setCallbackOnConnect(telnetSpyCallback callback);    // changed by proddy
     void                          setCallbackOnDisconnect(telnetSpyCallback callback); // changed by proddy
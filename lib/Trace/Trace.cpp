@@ -0,0 +1,134 @@
+/*
+ * Trace.cpp
+ *
+ * Event trace recorder, see Trace.h
+ */
+
+#include "Trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(ARDUINO)
+#include <chrono>
+
+static uint32_t micros() {
+    static auto start = std::chrono::steady_clock::now();
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#endif
+
+static _Trace_Event _trace_events[TRACE_EVENTS];
+static uint16_t     _trace_head    = 0;     // next slot to write
+static bool         _trace_wrapped = false; // the ring is full, the oldest event is at _trace_head
+static bool         _trace_enabled = true;
+
+// add an event to the ring, overwriting the oldest when full
+void trace_add(uint8_t tid, uint8_t phase, PGM_P name, uint16_t arg) {
+    if (!_trace_enabled) {
+        return;
+    }
+
+    _Trace_Event * event = &_trace_events[_trace_head];
+    event->timestamp     = micros();
+    event->name          = name;
+    event->phase         = phase;
+    event->tid           = tid;
+    event->arg           = arg;
+
+    if (++_trace_head == TRACE_EVENTS) {
+        _trace_head    = 0;
+        _trace_wrapped = true;
+    }
+}
+
+void trace_clear() {
+    _trace_head    = 0;
+    _trace_wrapped = false;
+}
+
+void trace_enable(bool enable) {
+    _trace_enabled = enable;
+}
+
+bool trace_enabled() {
+    return _trace_enabled;
+}
+
+// # events in the ring
+uint16_t trace_count() {
+    return _trace_wrapped ? TRACE_EVENTS : _trace_head;
+}
+
+// copy a name from flash
+static void _trace_copyName(char * buffer, size_t size, PGM_P name) {
+    size_t i = 0;
+    while (i < size - 1) {
+        char c = (char)pgm_read_byte(name + i);
+        if (c == '\0') {
+            break;
+        }
+        buffer[i++] = c;
+    }
+    buffer[i] = '\0';
+}
+
+/*
+ * dump the ring as Chrome trace JSON, oldest event first, one line at a time
+ * only the lines from..from+lines-1 are printed, so a long dump can be printed in parts. Returns true while there are more
+ * the ring mustn't change between parts, pause recording with trace_enable(false) until the dump is done
+ * timestamps are relative to the oldest event, so a micros() wrap inside the ring doesn't matter
+ */
+bool trace_dump(trace_print_f print, uint16_t from, uint16_t lines) {
+    static const char * const thread_names[] = {"", "loop", "task", "timer"};
+
+    uint16_t count = trace_count();
+    uint16_t first = _trace_wrapped ? _trace_head : 0;
+    uint32_t start = (count > 0) ? _trace_events[first].timestamp : 0;
+    uint16_t total = count + TRACE_TIMER + 2; // header, thread names, events, footer
+    uint16_t last  = ((uint32_t)from + lines < total) ? from + lines : total;
+
+    char line[TRACE_LINE_SIZE];
+    char name[40];
+
+    for (uint16_t n = from; n < last; n++) {
+        if (n == 0) {
+            print("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        } else if (n <= TRACE_TIMER) {
+            uint8_t tid = n;
+            snprintf(line,
+                     sizeof(line),
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}%s",
+                     tid,
+                     thread_names[tid],
+                     ((count > 0) || (tid < TRACE_TIMER)) ? "," : "");
+            print(line);
+        } else if (n < total - 1) {
+            uint16_t             i     = n - TRACE_TIMER - 1;
+            const _Trace_Event * event = &_trace_events[(first + i) % TRACE_EVENTS];
+            _trace_copyName(name, sizeof(name), event->name);
+
+            int len = snprintf(line,
+                               sizeof(line),
+                               "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%u,\"pid\":1,\"tid\":%d",
+                               name,
+                               event->phase,
+                               (unsigned int)(event->timestamp - start),
+                               event->tid);
+
+            if (event->phase == TRACE_PHASE_INSTANT) {
+                snprintf(line + len, sizeof(line) - len, ",\"s\":\"t\",\"args\":{\"value\":%d}}%s", event->arg, (i < count - 1) ? "," : "");
+            } else {
+                snprintf(line + len, sizeof(line) - len, "}%s", (i < count - 1) ? "," : "");
+            }
+
+            print(line);
+        } else {
+            print("]}");
+        }
+    }
+
+    return (last < total);
+}
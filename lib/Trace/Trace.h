@@ -0,0 +1,60 @@
+/*
+ * Trace.h
+ *
+ * Event trace recorder. Begin/end and instant markers are kept in a fixed ring in RAM
+ * and can be dumped as Chrome trace JSON, to load in chrome://tracing or https://ui.perfetto.dev
+ *
+ * Doesn't need the Arduino core, so it also builds and runs on a host
+ */
+
+#ifndef Trace_h
+#define Trace_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#define PGM_P const char *
+#define PSTR(s) (s)
+#endif
+
+#define TRACE_EVENTS 128    // size of the ring, each event takes 12 bytes on the ESP8266
+#define TRACE_LINE_SIZE 120 // max length of a line of the JSON dump
+
+// where the event happened, shown as threads in the trace viewer
+typedef enum {
+    TRACE_LOOP = 1, // main loop
+    TRACE_TASK,     // system task, the EMS UART receive task
+    TRACE_TIMER     // Ticker callbacks
+} _TRACE_TID;
+
+// phases, as in the Chrome trace format
+#define TRACE_PHASE_BEGIN 'B'
+#define TRACE_PHASE_END 'E'
+#define TRACE_PHASE_INSTANT 'i'
+
+typedef struct {
+    uint32_t timestamp; // micros()
+    PGM_P    name;      // in flash (PSTR)
+    uint8_t  phase;     // TRACE_PHASE_xxx
+    uint8_t  tid;       // _TRACE_TID
+    uint16_t arg;       // value shown with the event, e.g. the EMS type
+} _Trace_Event;
+
+typedef void (*trace_print_f)(const char * line);
+
+// markers, the name must be a string literal
+#define TRACE_BEGIN(tid, name) trace_add((tid), TRACE_PHASE_BEGIN, PSTR(name), 0)
+#define TRACE_END(tid, name) trace_add((tid), TRACE_PHASE_END, PSTR(name), 0)
+#define TRACE_INSTANT(tid, name, arg) trace_add((tid), TRACE_PHASE_INSTANT, PSTR(name), (arg))
+
+void     trace_add(uint8_t tid, uint8_t phase, PGM_P name, uint16_t arg);
+void     trace_clear();
+void     trace_enable(bool enable);
+bool     trace_enabled();
+uint16_t trace_count();
+bool     trace_dump(trace_print_f print, uint16_t from, uint16_t lines);
+
+#endif
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+
+"""EMS-ESP flight recorder decoder
+
+Decodes the >>>recorder>>> block of a 'crash dump' telnet command, which holds the last
+telegrams, Tx queue changes and system events from before the crash, oldest first.
+
+Each line is the timestamp in ms (hex), the event type, the full length of the data and the
+data bytes that were kept, e.g.
+
+>>>recorder>>>
+0001a2f4 01 0b 08 0b 18 00 1b 00 00 00 00 00
+0001a2f9 03 08 00 01 01 08 00 19 00 00
+<<<recorder<<<
+
+The event types and codes must match MYESP_RECORDER_TYPE and MYESP_EVENT in lib/MyESP/MyESP.h
+and _EMS_TXQUEUE_EVENT, _EMS_TX_TELEGRAM_ACTION and _EMS_EVENT in src/ems.h
+"""
+
+import argparse
+import os
+import re
+import sys
+
+RECORDER_BEGIN = '>>>recorder>>>'
+RECORDER_END = '<<<recorder<<<'
+RECORDER_REGEX = re.compile('^(?P<timestamp>[0-9a-f]{8}) (?P<type>[0-9a-f]{2}) (?P<length>[0-9a-f]{2})(?P<data>( [0-9a-f]{2})*)$')
+
+TYPE_RX = 1
+TYPE_TX = 2
+TYPE_TXQUEUE = 3
+TYPE_SYSTEM = 4
+TYPE_APP = 5
+
+SYSTEM_EVENTS = [
+    "Boot",
+    "WiFi connected",
+    "WiFi disconnected",
+    "MQTT connected",
+    "MQTT disconnected",
+    "MQTT message received",
+    "Telnet connected",
+    "Telnet disconnected",
+    "OTA started",
+    "Config saved",
+    "Restart"
+]
+
+TXQUEUE_EVENTS = ["added", "removed", "retry", "validate", "dropped"]
+
+TX_ACTIONS = ["init", "read", "write", "validate", "raw"]
+
+EMS_EVENTS = ["EMS bus connected", "EMS bus disconnected", "Device scan started", "Device scan finished"]
+
+
+def lookup(table, index):
+    if index < len(table):
+        return table[index]
+    return "unknown ({})".format(index)
+
+
+def format_telegram(length, data):
+    out = " ".join("{:02X}".format(b) for b in data)
+    if length > len(data):
+        out += " ... ({} bytes)".format(length)
+
+    if length == 1:
+        # single byte response to a write, 01 is success and 04 an error
+        return out + " [Tx response]"
+
+    if len(data) >= 4:
+        src = data[0] & 0x7F
+        dest = data[1] & 0x7F
+        kind = "read" if data[1] & 0x80 else "write"
+        out += " [0x{:02X} -> 0x{:02X} {} type 0x{:02X} offset {}]".format(src, dest, kind, data[2], data[3])
+
+    return out
+
+
+def format_event(event_type, length, data):
+    if event_type == TYPE_RX:
+        return "Rx      " + format_telegram(length, data)
+
+    if event_type == TYPE_TX:
+        return "Tx      " + format_telegram(length, data)
+
+    if event_type == TYPE_TXQUEUE and len(data) >= 8:
+        return "TxQueue {} {} to 0x{:02X} type 0x{:04X} offset {} (queue size {}, retry {})".format(
+            lookup(TXQUEUE_EVENTS, data[0]), lookup(TX_ACTIONS, data[2]), data[3] & 0x7F, (data[4] << 8) | data[5], data[6],
+            data[1], data[7])
+
+    if event_type == TYPE_SYSTEM and len(data) >= 5:
+        free_heap = data[1] | (data[2] << 8) | (data[3] << 16) | (data[4] << 24)
+        return "System  {} (free heap {} bytes)".format(lookup(SYSTEM_EVENTS, data[0]), free_heap)
+
+    if event_type == TYPE_APP and len(data) >= 1:
+        return "EMS     " + lookup(EMS_EVENTS, data[0])
+
+    return "unknown type {}: {}".format(event_type, " ".join("{:02X}".format(b) for b in data))
+
+
+def parse_file(file):
+    events = []
+    inside = False
+
+    for line in file:
+        line = line.strip()
+        if line == RECORDER_BEGIN:
+            inside = True
+            continue
+        if line == RECORDER_END:
+            return events
+        if not inside:
+            continue
+
+        match = RECORDER_REGEX.match(line)
+        if match is None:
+            continue
+
+        data = bytes.fromhex(match.group('data').replace(' ', ''))
+        events.append((int(match.group('timestamp'), 16), int(match.group('type'), 16), int(match.group('length'), 16), data))
+
+    if not inside:
+        print("ERROR: no flight recorder found")
+    else:
+        print("ERROR: flight recorder is incomplete")
+    sys.exit(1)
+
+
+def print_events(events):
+    last = None
+    for timestamp, event_type, length, data in events:
+        delta = "" if last is None else "+{}".format(timestamp - last)
+        last = timestamp
+        print("{:>10.3f}s {:>8} {}".format(timestamp / 1000.0, delta, format_event(event_type, length, data)))
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="decode the EMS-ESP flight recorder from a crash dump.")
+    parser.add_argument("file", help="The file to read the crash dump from ('-' for STDIN)", default="-")
+
+    return parser.parse_args()
+
+
+if __name__ == "__main__":
+    args = parse_args()
+
+    if args.file == "-":
+        file = sys.stdin
+    else:
+        if not os.path.exists(args.file):
+            print("ERROR: file " + args.file + " not found")
+            sys.exit(1)
+        file = open(args.file, "r")
+
+    print_events(parse_file(file))
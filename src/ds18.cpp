@@ -1,142 +1,227 @@
 /*
  * Dallas support for external settings
  * Copied from Espurna - Copyright (C) 2017-2018 by Xose Pérez <xose dot perez at gmail dot com>
- * 
+ *
  * Paul Derbyshire - https://github.com/proddy/EMS-ESP
  *
  */
 
 #include "ds18.h"
 
+#include <FixedPoint.h>
+
 std::vector<ds_device_t> _devices;
 
 DS18::DS18() {
-    _wire     = NULL;
-    _count    = 0;
-    _gpio     = GPIO_NONE;
-    _parasite = 0;
+    _count     = 0;
+    _parasite  = 0;
+    _bus_count = 0;
+    _bus_next  = 0;
+
+    memset(_buses, 0, sizeof(_buses));
+    for (uint8_t i = 0; i < DS18_BUSES_MAX; i++) {
+        _buses[i].gpio  = GPIO_NONE;
+        _buses[i].state = DS18_STATE_IDLE;
+        _buses[i].job   = DS18_JOB_NONE;
+    }
+
+    memset(_settings, 0, sizeof(_settings));
+    memset(_names, 0, sizeof(_names));
 }
 
 DS18::~DS18() {
-    if (_wire)
-        delete _wire;
+    for (uint8_t i = 0; i < DS18_BUSES_MAX; i++) {
+        if (_buses[i].wire)
+            delete _buses[i].wire;
+    }
 }
 
-// init
-uint8_t DS18::setup(uint8_t gpio, bool parasite) {
-    uint8_t count;
+// init, with a OneWire bus on each pin. Pins set to 0 or GPIO_NONE are skipped
+uint8_t DS18::setup(const uint8_t * gpios, uint8_t buses, bool parasite) {
+    _parasite  = (parasite ? 1 : 0);
+    _bus_count = 0;
+    _bus_next  = 0;
+    _devices.clear();
 
-    _gpio     = gpio;
-    _parasite = (parasite ? 1 : 0);
+    for (uint8_t i = 0; (i < buses) && (_bus_count < DS18_BUSES_MAX); i++) {
+        if ((gpios[i] == 0) || (gpios[i] == GPIO_NONE)) {
+            continue;
+        }
 
-    // OneWire
-    if (_wire)
-        delete _wire;
-    _wire = new OneWire(_gpio);
+        ds_bus_t * bus = &_buses[_bus_count];
+        bus->gpio      = gpios[i];
+        bus->state     = DS18_STATE_IDLE;
+        bus->job       = DS18_JOB_NONE;
 
-    // Search devices
-    count = loadDevices();
+        // OneWire
+        if (bus->wire)
+            delete bus->wire;
+        bus->wire = new OneWire(bus->gpio);
 
-    // If no devices found check again pulling up the line
-    if (count == 0) {
-        pinMode(_gpio, INPUT_PULLUP);
-        count = loadDevices();
+        // Search devices. If none found check again pulling up the line
+        if (loadDevices(_bus_count) == 0) {
+            pinMode(bus->gpio, INPUT_PULLUP);
+            (void)loadDevices(_bus_count);
+        }
+
+        _bus_count++;
     }
 
-    _count = count;
+    _count = _devices.size();
 
-    return count;
+    return _count;
 }
 
-// scan every 2 seconds
+/*
+ * each sensor is sampled at its own interval and read as soon as its conversion is done
+ * conversions of several sensors run at the same time, unless in parasite mode where the bus powers them
+ * OneWire bit-bangs with interrupts off, so each call does only one step of a transaction (a reset or a few bytes)
+ * on one of the buses, taking turns, to keep the time the EMS UART and polls have to wait short, whatever the number of sensors
+ * the master sets the pace on a 1-Wire bus, so the sensors don't mind the gaps between the steps
+ */
 void DS18::loop() {
-    static uint32_t last = 0;
-    if (millis() - last < DS18_READ_INTERVAL)
+    if (_bus_count == 0) {
         return;
-    last = millis();
-
-    // Every second we either start a conversion or read the scratchpad
-    static bool conversion = true;
-    if (conversion) {
-        // Start conversion
-        _wire->reset();
-        _wire->skip();
-        _wire->write(DS18_CMD_START_CONVERSION, _parasite);
-    } else {
-        // Read scratchpads
-        for (unsigned char index = 0; index < _devices.size(); index++) {
-            // Read scratchpad
-            if (_wire->reset() == 0) {
-                // Force a CRC check error
-                _devices[index].data[0] = _devices[index].data[0] + 1;
-                return;
-            }
+    }
 
-            _wire->select(_devices[index].address);
-            _wire->write(DS18_CMD_READ_SCRATCHPAD);
+    loopBus(&_buses[_bus_next]);
 
-            uint8_t data[DS18_DATA_SIZE];
-            for (unsigned char i = 0; i < DS18_DATA_SIZE; i++) {
-                data[i] = _wire->read();
-            }
+    if (++_bus_next == _bus_count) {
+        _bus_next = 0;
+    }
+}
 
-            if (_wire->reset() != 1) {
-                // Force a CRC check error
-                _devices[index].data[0] = _devices[index].data[0] + 1;
-                return;
+// one step of the transaction on a bus
+void DS18::loopBus(ds_bus_t * bus) {
+    switch (bus->state) {
+    case DS18_STATE_IDLE:
+        if (nextJob(bus - _buses)) {
+            bus->state = DS18_STATE_RESET;
+        }
+        break;
+
+    case DS18_STATE_RESET:
+        if (bus->wire->reset() == 0) {
+            // nobody answered, the bus is open or shorted. Drop this transaction and leave the sensor alone for an interval
+            readError(bus->index);
+            _devices[bus->index].converting = false;
+            _devices[bus->index].next       = millis() + (_devices[bus->index].interval * 1000UL);
+            bus->state                      = DS18_STATE_IDLE;
+        } else {
+            bus->bytes = 0;
+            bus->state = DS18_STATE_WRITE;
+        }
+        break;
+
+    case DS18_STATE_WRITE:
+        for (uint8_t i = 0; (i < DS18_BYTES_PER_STEP) && (bus->bytes < bus->request_size); i++, bus->bytes++) {
+            // in parasite mode the bus is kept high after the conversion command to power the sensor
+            bool power = (bus->job == DS18_JOB_CONVERT) && (bus->bytes == bus->request_size - 1) && _parasite;
+            bus->wire->write(bus->request[bus->bytes], power);
+        }
+
+        if (bus->bytes == bus->request_size) {
+            bus->bytes = 0;
+            if (bus->job == DS18_JOB_READ) {
+                bus->state = DS18_STATE_READ;
+            } else {
+                finishJob(bus);
             }
+        }
+        break;
 
-            memcpy(_devices[index].data, data, DS18_DATA_SIZE);
+    case DS18_STATE_READ:
+        for (uint8_t i = 0; (i < DS18_BYTES_PER_STEP) && (bus->bytes < DS18_DATA_SIZE); i++) {
+            bus->scratchpad[bus->bytes++] = bus->wire->read();
         }
-    }
 
-    conversion = !conversion;
+        if (bus->bytes == DS18_DATA_SIZE) {
+            finishJob(bus);
+        }
+        break;
+    }
 }
 
-// return string of the device, with name and address
-char * DS18::getDeviceString(char * buffer, unsigned char index) {
-    uint8_t size = 128;
-    if (index < _count) {
-        uint8_t * address = _devices[index].address;
+// pick the next transaction of a bus, returns false if there's nothing to do yet
+bool DS18::nextJob(uint8_t bus) {
+    uint32_t now = millis();
 
-        unsigned char chip_id = chip(index);
-        if (chip_id == DS18_CHIP_DS18S20) {
-            strlcpy(buffer, "DS18S20", size);
-        } else if (chip_id == DS18_CHIP_DS18B20) {
-            strlcpy(buffer, "DS18B20", size);
-        } else if (chip_id == DS18_CHIP_DS1822) {
-            strlcpy(buffer, "DS1822", size);
-        } else if (chip_id == DS18_CHIP_DS1825) {
-            strlcpy(buffer, "DS1825", size);
-        } else {
-            strlcpy(buffer, "Unknown", size);
+    // conversions that are done
+    for (unsigned char index = 0; index < _count; index++) {
+        if ((_devices[index].bus == bus) && _devices[index].converting) {
+            if ((int32_t)(now - _devices[index].ready) >= 0) {
+                startJob(&_buses[bus], DS18_JOB_READ, index);
+                return true;
+            }
+            if (_parasite) {
+                return false; // no traffic while a sensor is powered by the bus
+            }
         }
+    }
 
-        char a[30] = {0};
-        snprintf(a,
-                 sizeof(a),
-                 " (%02X%02X%02X%02X%02X%02X%02X%02X) @ GPIO%d",
-                 address[0],
-                 address[1],
-                 address[2],
-                 address[3],
-                 address[4],
-                 address[5],
-                 address[6],
-                 address[7],
-                 _gpio);
+    // a resolution to set, unless the sensor is waiting out a failed reset
+    for (unsigned char index = 0; index < _count; index++) {
+        if ((_devices[index].bus == bus) && !_devices[index].configured && ((int32_t)(now - _devices[index].next) >= 0)) {
+            startJob(&_buses[bus], DS18_JOB_CONFIG, index);
+            return true;
+        }
+    }
 
-        strlcat(buffer, a, size);
+    // conversions that are due
+    for (unsigned char index = 0; index < _count; index++) {
+        if ((_devices[index].bus == bus) && (!_devices[index].converting) && ((int32_t)(now - _devices[index].next) >= 0)) {
+            startJob(&_buses[bus], DS18_JOB_CONVERT, index);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// build the request of a transaction
+void DS18::startJob(ds_bus_t * bus, ds_job_t job, unsigned char index) {
+    bus->job   = job;
+    bus->index = index;
+
+    bus->request[0] = DS18_CMD_MATCH_ROM;
+    memcpy(&bus->request[1], _devices[index].address, 8);
+    bus->request_size = 9;
+
+    if (job == DS18_JOB_CONFIG) {
+        bus->request[bus->request_size++] = DS18_CMD_WRITE_SCRATCHPAD;
+        bus->request[bus->request_size++] = DS18_ALARM_HIGH;
+        bus->request[bus->request_size++] = DS18_ALARM_LOW;
+        bus->request[bus->request_size++] = ((_devices[index].resolution - DS18_RESOLUTION_MIN) << 5) | 0x1F; // configuration register
+    } else if (job == DS18_JOB_CONVERT) {
+        bus->request[bus->request_size++] = DS18_CMD_START_CONVERSION;
     } else {
-        strlcpy(buffer, "invalid", size);
+        bus->request[bus->request_size++] = DS18_CMD_READ_SCRATCHPAD;
     }
+}
 
-    return buffer;
+// all bytes of a transaction have been sent, and read
+void DS18::finishJob(ds_bus_t * bus) {
+    ds_device_t * device = &_devices[bus->index];
+    uint32_t      now    = millis();
+
+    if (bus->job == DS18_JOB_CONFIG) {
+        device->configured = true;
+    } else if (bus->job == DS18_JOB_CONVERT) {
+        device->converting = true;
+        device->ready      = now + conversionTime(bus->index);
+        device->next       = now + (device->interval * 1000UL);
+    } else if (bus->job == DS18_JOB_READ) {
+        device->converting = false;
+        readValue(bus);
+    }
+
+    bus->job   = DS18_JOB_NONE;
+    bus->state = DS18_STATE_IDLE;
 }
 
 /*
- * Read sensor values
- * 
+ * Read the temperature from the scratchpad into the value cache
+ *
  *  Registers:
     byte 0: temperature LSB
     byte 1: temperature MSB
@@ -151,18 +236,17 @@ char * DS18::getDeviceString(char * buffer, unsigned char index) {
             DS18B20 & DS1822: store for crc
     byte 8: SCRATCHPAD_CRC
 */
-int16_t DS18::getRawValue(unsigned char index) {
-    if (index >= _count)
-        return 0;
-
-    uint8_t * data = _devices[index].data;
+void DS18::readValue(ds_bus_t * bus) {
+    ds_device_t * device = &_devices[bus->index];
+    uint8_t *     data   = bus->scratchpad;
 
     if (OneWire::crc8(data, DS18_DATA_SIZE - 1) != data[DS18_DATA_SIZE - 1]) {
-        return DS18_CRC_ERROR;
+        readError(bus->index);
+        return;
     }
 
     int16_t raw = (data[1] << 8) | data[0];
-    if (chip(index) == DS18_CHIP_DS18S20) {
+    if (chip(bus->index) == DS18_CHIP_DS18S20) {
         raw = raw << 3; // 9 bit resolution default
         if (data[7] == 0x10) {
             raw = (raw & 0xFFF0) + 12 - data[6]; // "count remain" gives full 12 bit resolution
@@ -176,16 +260,255 @@ int16_t DS18::getRawValue(unsigned char index) {
         else if (cfg == 0x40)
             raw = raw & ~1; // 11 bit res, 375 ms
                             // 12 bit res, 750 ms
+
+        // a sensor that lost power is back at 12 bits, so set the resolution again
+        if (cfg != ((device->resolution - DS18_RESOLUTION_MIN) << 5)) {
+            device->configured = false;
+        }
+    }
+
+    device->value = raw;
+}
+
+// ms a conversion takes at the resolution of the sensor
+uint16_t DS18::conversionTime(unsigned char index) {
+    if (chip(index) == DS18_CHIP_DS18S20) {
+        return DS18_CONVERSION_TIME; // always 9 bits, and the extra precision from the count remain
+    }
+    return (DS18_CONVERSION_TIME >> (DS18_RESOLUTION_MAX - _devices[index].resolution)) + 1;
+}
+
+// a read or a bus reset failed, the sensor has no value until the next good one
+void DS18::readError(unsigned char index) {
+    _devices[index].value = DS18_VALUE_NONE;
+    _devices[index].errors++;
+}
+
+// true if a sensor has a good reading that differs from the one last published by at least deadband (1/16 C)
+bool DS18::hasChanged(unsigned char index, uint8_t deadband) {
+    if ((index >= _count) || (_devices[index].value == DS18_VALUE_NONE)) {
+        return false;
+    }
+
+    if (_devices[index].published == DS18_VALUE_NONE) {
+        return true;
+    }
+
+    return (abs(_devices[index].value - _devices[index].published) >= deadband);
+}
+
+// keep the reading that was published, or forget it so the next reading is published
+void DS18::setPublished(unsigned char index, bool published) {
+    if (index < _count) {
+        _devices[index].published = published ? _devices[index].value : DS18_VALUE_NONE;
+    }
+}
+
+// set the name of a sensor, used instead of its address in MQTT and the console. An empty name goes back to the address
+// only letters, digits, '_' and '-' so it can go in a topic
+bool DS18::setName(unsigned char index, const char * name) {
+    if ((index >= _count) || (strlen(name) >= DS18_NAME_SIZE)) {
+        return false;
+    }
+
+    for (const char * p = name; *p; p++) {
+        if (!isalnum(*p) && (*p != '_') && (*p != '-')) {
+            return false;
+        }
+    }
+
+    return saveSetting(index, name);
+}
+
+// set the resolution of a sensor, 9 to 12 bits
+bool DS18::setResolution(unsigned char index, uint8_t resolution) {
+    if ((index >= _count) || (resolution < DS18_RESOLUTION_MIN) || (resolution > DS18_RESOLUTION_MAX)) {
+        return false;
+    }
+
+    _devices[index].resolution = resolution;
+    _devices[index].configured = (chip(index) == DS18_CHIP_DS18S20); // has a fixed resolution
+
+    return saveSetting(index, NULL);
+}
+
+// set the seconds between two samples of a sensor
+bool DS18::setInterval(unsigned char index, uint16_t interval) {
+    if ((index >= _count) || (interval == 0)) {
+        return false;
+    }
+
+    _devices[index].interval = interval;
+    _devices[index].next     = millis(); // start with the new interval straight away
+
+    return saveSetting(index, NULL);
+}
+
+uint8_t DS18::getResolution(unsigned char index) {
+    return (index < _count) ? _devices[index].resolution : 0;
+}
+
+uint16_t DS18::getInterval(unsigned char index) {
+    return (index < _count) ? _devices[index].interval : 0;
+}
+
+uint16_t DS18::getErrors(unsigned char index) {
+    return (index < _count) ? _devices[index].errors : 0;
+}
+
+// the names, resolutions and intervals by address, from the config. Call before setup()
+void DS18::setSettings(const ds_setting_t * settings, const ds_name_t * names) {
+    memcpy(_settings, settings, sizeof(_settings));
+    memcpy(_names, names, sizeof(_names));
+    for (uint8_t i = 0; i < DS18_SETTINGS_MAX; i++) {
+        _names[i][DS18_NAME_SIZE - 1] = '\0';
+    }
+}
+
+// the names, resolutions and intervals by address, for the config
+void DS18::getSettings(ds_setting_t * settings, ds_name_t * names) {
+    memcpy(settings, _settings, sizeof(_settings));
+    memcpy(names, _names, sizeof(_names));
+}
+
+// the config entry of a sensor, -1 if it has none
+int8_t DS18::findSetting(unsigned char index) {
+    for (uint8_t i = 0; i < DS18_SETTINGS_MAX; i++) {
+        if (memcmp(_settings[i].address, _devices[index].address, 8) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// keep a sensor's name, resolution and interval for the config, with a new name or NULL to keep the current one
+// the entry is freed when all are back at the defaults. Returns false if all entries are taken
+bool DS18::saveSetting(unsigned char index, const char * name) {
+    ds_device_t * device = &_devices[index];
+    int8_t        slot   = findSetting(index);
+
+    char current[DS18_NAME_SIZE] = {0};
+    if (slot != -1) {
+        strlcpy(current, _names[slot], sizeof(current));
+    }
+    if (name) {
+        strlcpy(current, name, sizeof(current));
+    }
+
+    if ((current[0] == '\0') && (device->resolution == DS18_DEFAULT_RESOLUTION) && (device->interval == DS18_DEFAULT_INTERVAL)) {
+        if (slot != -1) {
+            memset(&_settings[slot], 0, sizeof(ds_setting_t));
+            memset(_names[slot], 0, sizeof(ds_name_t));
+        }
+        return true;
     }
 
-    return raw;
+    // first free entry
+    for (uint8_t i = 0; (i < DS18_SETTINGS_MAX) && (slot == -1); i++) {
+        if (_settings[i].address[0] == 0) {
+            slot = i;
+        }
+    }
+
+    if (slot == -1) {
+        return false;
+    }
+
+    memcpy(_settings[slot].address, device->address, 8);
+    strlcpy(_names[slot], current, sizeof(ds_name_t));
+    _settings[slot].resolution = device->resolution;
+    _settings[slot].reserved   = 0;
+    _settings[slot].interval   = device->interval;
+
+    return true;
 }
 
-// return real value as a double
-// The raw temperature data is in units of sixteenths of a degree, so the value must be divided by 16 in order to convert it to degrees.
-double DS18::getValue(unsigned char index) {
-    double value = (float)getRawValue(index) / 16.0;
-    return value;
+// the name of a sensor, or its address as a hex string if it has none. s must hold DS18_ADDRESS_SIZE
+char * DS18::getName(char * s, unsigned char index) {
+    if (index >= _count) {
+        s[0] = '\0';
+        return s;
+    }
+
+    int8_t slot = findSetting(index);
+    if ((slot != -1) && (_names[slot][0] != '\0')) {
+        strlcpy(s, _names[slot], DS18_ADDRESS_SIZE);
+    } else {
+        uint8_t * address = _devices[index].address;
+        snprintf(s,
+                 DS18_ADDRESS_SIZE,
+                 "%02X%02X%02X%02X%02X%02X%02X%02X",
+                 address[0],
+                 address[1],
+                 address[2],
+                 address[3],
+                 address[4],
+                 address[5],
+                 address[6],
+                 address[7]);
+    }
+
+    return s;
+}
+
+// the reading in C with 2 decimals, worked out from the 1/16 C without floats. s must hold 8 chars
+char * DS18::getValueString(char * s, unsigned char index) {
+    int16_t raw = getRawValue(index);
+    if (raw == DS18_VALUE_NONE) {
+        strlcpy(s, "?", 8);
+        return s;
+    }
+
+    return fp_format(s, 8, raw, FP_SIXTEENTH, 2);
+}
+
+// return string of the device, with name and address
+char * DS18::getDeviceString(char * buffer, unsigned char index) {
+    uint8_t size = 128;
+    if (index < _count) {
+        uint8_t * address = _devices[index].address;
+
+        unsigned char chip_id = chip(index);
+        if (chip_id == DS18_CHIP_DS18S20) {
+            strlcpy(buffer, "DS18S20", size);
+        } else if (chip_id == DS18_CHIP_DS18B20) {
+            strlcpy(buffer, "DS18B20", size);
+        } else if (chip_id == DS18_CHIP_DS1822) {
+            strlcpy(buffer, "DS1822", size);
+        } else if (chip_id == DS18_CHIP_DS1825) {
+            strlcpy(buffer, "DS1825", size);
+        } else {
+            strlcpy(buffer, "Unknown", size);
+        }
+
+        char a[30] = {0};
+        snprintf(a,
+                 sizeof(a),
+                 " (%02X%02X%02X%02X%02X%02X%02X%02X) @ GPIO%d",
+                 address[0],
+                 address[1],
+                 address[2],
+                 address[3],
+                 address[4],
+                 address[5],
+                 address[6],
+                 address[7],
+                 _buses[_devices[index].bus].gpio);
+
+        strlcat(buffer, a, size);
+    } else {
+        strlcpy(buffer, "invalid", size);
+    }
+
+    return buffer;
+}
+
+// the last good reading in 1/16 C, or DS18_VALUE_NONE
+int16_t DS18::getRawValue(unsigned char index) {
+    if (index >= _count)
+        return DS18_VALUE_NONE;
+
+    return _devices[index].value;
 }
 
 // check for a supported DS chip version
@@ -195,26 +518,49 @@ bool DS18::validateID(unsigned char id) {
 
 // return the type
 unsigned char DS18::chip(unsigned char index) {
-    if (index < _count)
+    if (index < _devices.size())
         return _devices[index].address[0];
     return 0;
 }
 
-// scan for DS sensors and load into the vector
-uint8_t DS18::loadDevices() {
-    uint8_t address[8];
-    _wire->reset();
-    _wire->reset_search();
-    while (_wire->search(address)) {
+// scan a bus for DS sensors and add them to the vector, returns the # found on this bus
+uint8_t DS18::loadDevices(uint8_t bus) {
+    OneWire * wire  = _buses[bus].wire;
+    uint8_t   count = 0;
+    uint8_t   address[8];
+
+    wire->reset();
+    wire->reset_search();
+    while (wire->search(address)) {
         // Check CRC
-        if (_wire->crc8(address, 7) == address[7]) {
+        if (wire->crc8(address, 7) == address[7]) {
             // Check ID
             if (validateID(address[0])) {
                 ds_device_t device;
+                memset(&device, 0, sizeof(device));
                 memcpy(device.address, address, 8);
+                device.bus        = bus;
+                device.resolution = DS18_DEFAULT_RESOLUTION;
+                device.interval   = DS18_DEFAULT_INTERVAL;
+                device.value      = DS18_VALUE_NONE;
+                device.published  = DS18_VALUE_NONE;
+                device.configured = (address[0] == DS18_CHIP_DS18S20); // has a fixed resolution
+                device.next       = millis();
                 _devices.push_back(device);
+                count++;
+
+                // the sensor's own settings from the config
+                int8_t slot = findSetting(_devices.size() - 1);
+                if (slot != -1) {
+                    if ((_settings[slot].resolution >= DS18_RESOLUTION_MIN) && (_settings[slot].resolution <= DS18_RESOLUTION_MAX)) {
+                        _devices.back().resolution = _settings[slot].resolution;
+                    }
+                    if (_settings[slot].interval != 0) {
+                        _devices.back().interval = _settings[slot].interval;
+                    }
+                }
             }
         }
     }
-    return (_devices.size());
+    return count;
 }
@@ -1,7 +1,7 @@
 /*
  * Dallas support for external temperature sensors
  * Copyright (C) 2017-2018 by Xose Pérez <xose dot perez at gmail dot com>
- * 
+ *
  * Paul Derbyshire - https://github.com/proddy/EMS-ESP
  *
  */
@@ -17,38 +17,129 @@
 #define DS18_CHIP_DS1825 0x3B
 
 #define DS18_DATA_SIZE 9
-#define DS18_DISCONNECTED -127
-#define DS18_CRC_ERROR -126
+#define DS18_VALUE_NONE -32768 // no good reading, outside what a sensor can measure (-55C is -880)
 
 #define GPIO_NONE 0x99
-#define DS18_READ_INTERVAL 2000 // Force sensor read & cache every 2 seconds
+#define DS18_BUSES_MAX 3         // max number of OneWire buses, each on its own pin
+#define DS18_CONVERSION_TIME 750 // ms for a 12 bit conversion, halved for every bit less
+#define DS18_BYTES_PER_STEP 3    // bytes written or read in one step, each byte takes about 0.5ms
+
+#define DS18_RESOLUTION_MIN 9
+#define DS18_RESOLUTION_MAX 12
+#define DS18_DEFAULT_RESOLUTION 12 // bits
+#define DS18_DEFAULT_INTERVAL 2    // seconds between two samples of a sensor
+#define DS18_DEFAULT_DEADBAND 2    // change in 1/16 C before a sensor is published again, 0.125C
+#define DS18_SETTINGS_MAX 24       // max number of sensors with a name or their own resolution or interval
+#define DS18_NAME_SIZE 12          // max length of a sensor name + 1, it's used in the MQTT topic
+#define DS18_ADDRESS_SIZE 17       // the address as a hex string + 1, the name of a sensor without one
 
+#define DS18_CMD_MATCH_ROM 0x55
 #define DS18_CMD_START_CONVERSION 0x44
 #define DS18_CMD_READ_SCRATCHPAD 0xBE
+#define DS18_CMD_WRITE_SCRATCHPAD 0x4E
+#define DS18_ALARM_HIGH 0x4B // power-on default of the high alarm register, written with the configuration
+#define DS18_ALARM_LOW 0x46  // power-on default of the low alarm register
+#define DS18_REQUEST_SIZE 13 // max bytes of a request: match ROM, 8 byte address, command and 3 bytes for write scratchpad
 
 typedef struct {
-    uint8_t address[8];
-    uint8_t data[DS18_DATA_SIZE];
+    uint8_t  address[8];
+    uint8_t  bus;        // index of the OneWire bus it's on
+    uint8_t  resolution; // 9-12 bits
+    uint16_t interval;   // seconds between two samples
+    int16_t  value;      // last good reading in 1/16 C, DS18_VALUE_NONE if there's none
+    int16_t  published;  // value last published, DS18_VALUE_NONE to publish the next reading
+    uint16_t errors;     // # failed reads and bus resets
+    bool     configured; // the resolution has been written to the sensor
+    bool     converting; // waiting for a conversion to finish
+    uint32_t ready;      // millis() when the conversion is done
+    uint32_t next;       // millis() when the next conversion is due
 } ds_device_t;
 
+// a sensor's resolution and interval by address, kept in the config
+// the layout is part of the config, the names are kept apart so older configs still load
+typedef struct {
+    uint8_t  address[8]; // all 0 for an unused entry
+    uint8_t  resolution;
+    uint8_t  reserved;
+    uint16_t interval;
+} ds_setting_t;
+
+// the name of the sensor of a ds_setting_t, empty to use the address
+typedef char ds_name_t[DS18_NAME_SIZE];
+
+// the bus transactions
+typedef enum {
+    DS18_JOB_NONE,
+    DS18_JOB_CONFIG,  // write the resolution
+    DS18_JOB_CONVERT, // start a conversion
+    DS18_JOB_READ     // read the scratchpad
+} ds_job_t;
+
+// the steps of a transaction, loop() does one per call so the main loop is never blocked for long
+typedef enum {
+    DS18_STATE_IDLE,  // nothing to do for now
+    DS18_STATE_RESET, // reset the bus
+    DS18_STATE_WRITE, // write the request, a few bytes at a time
+    DS18_STATE_READ   // read part of the scratchpad
+} ds_state_t;
+
+// a OneWire bus and the transaction in progress on it
+typedef struct {
+    OneWire *  wire;
+    uint8_t    gpio;                       // the sensor pin
+    ds_state_t state;                      // the next step of loop()
+    ds_job_t   job;                        // the transaction in progress
+    uint8_t    index;                      // the sensor it's for
+    uint8_t    request[DS18_REQUEST_SIZE]; // the bytes to write
+    uint8_t    request_size;               // # bytes in request
+    uint8_t    bytes;                      // bytes written or read so far in this state
+    uint8_t    scratchpad[DS18_DATA_SIZE]; // the scratchpad being read
+} ds_bus_t;
+
 class DS18 {
   public:
     DS18();
     ~DS18();
 
-    uint8_t setup(uint8_t gpio, bool parasite);
-    void    loop();
-    char *  getDeviceString(char * s, unsigned char index);
-    double  getValue(unsigned char index);
-    int16_t getRawValue(unsigned char index); // raw values, needs / 16
+    uint8_t  setup(const uint8_t * gpios, uint8_t buses, bool parasite);
+    void     loop();
+    char *   getDeviceString(char * s, unsigned char index);
+    char *   getName(char * s, unsigned char index);
+    char *   getValueString(char * s, unsigned char index);
+    int16_t  getRawValue(unsigned char index); // 1/16 C, DS18_VALUE_NONE if there's no good reading
+    uint16_t getErrors(unsigned char index);
+    bool     hasChanged(unsigned char index, uint8_t deadband);
+    void     setPublished(unsigned char index, bool published);
+    bool     setName(unsigned char index, const char * name);
+    bool     setResolution(unsigned char index, uint8_t resolution);
+    bool     setInterval(unsigned char index, uint16_t interval);
+    uint8_t  getResolution(unsigned char index);
+    uint16_t getInterval(unsigned char index);
+    void     setSettings(const ds_setting_t * settings, const ds_name_t * names);
+    void     getSettings(ds_setting_t * settings, ds_name_t * names);
 
   protected:
     bool          validateID(unsigned char id);
     unsigned char chip(unsigned char index);
-    uint8_t       loadDevices();
+    uint8_t       loadDevices(uint8_t bus);
+
+    void     loopBus(ds_bus_t * bus);
+    void     readError(unsigned char index);
+    bool     nextJob(uint8_t bus);
+    void     startJob(ds_bus_t * bus, ds_job_t job, unsigned char index);
+    void     finishJob(ds_bus_t * bus);
+    void     readValue(ds_bus_t * bus);
+    int8_t   findSetting(unsigned char index);
+    bool     saveSetting(unsigned char index, const char * name);
+    uint16_t conversionTime(unsigned char index);
+
+    uint8_t _count;    // # devices
+    uint8_t _parasite; // parasite mode
+
+    ds_bus_t _buses[DS18_BUSES_MAX];
+    uint8_t  _bus_count; // # buses set up
+    uint8_t  _bus_next;  // the bus loop() steps next
 
-    OneWire * _wire;
-    uint8_t   _count;    // # devices
-    uint8_t   _gpio;     // the sensor pin
-    uint8_t   _parasite; // parasite mode
+    ds_setting_t _settings[DS18_SETTINGS_MAX];
+    ds_name_t    _names[DS18_SETTINGS_MAX];
 };
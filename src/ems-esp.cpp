@@ -19,7 +19,9 @@
 DS18 ds18;
 
 // shared libraries
+#include <FixedPoint.h>
 #include <MyESP.h>
+#include <Trace.h>
 
 // public libraries
 #include <ArduinoJson.h> // https://github.com/bblanchon/ArduinoJson
@@ -44,7 +46,10 @@ Ticker publishSensorValuesTimer;
 #define SYSTEMCHECK_TIME 10 // every 10 seconds check if EMS can be reached
 Ticker systemCheckTimer;
 
-#define REGULARUPDATES_TIME 60 // every minute a call is made to fetch data from EMS devices manually
+#define SNAPSHOT_TIME 30 // every 30 seconds save the EMS values to RTC memory, so they survive a soft reset
+Ticker snapshotTimer;
+
+#define REGULARUPDATES_TIME 5 // every 5 seconds the poll schedule is checked for EMS data that isn't broadcast or has gone stale
 Ticker regularUpdatesTimer;
 
 #define LEDCHECK_TIME 500 // every 1/2 second blink the heartbeat LED
@@ -55,11 +60,6 @@ Ticker scanThermostat;
 #define SCANTHERMOSTAT_TIME 1
 uint8_t scanThermostat_count = 0;
 
-// ems bus scan
-Ticker scanDevices;
-#define SCANDEVICES_TIME 350 // ms
-uint8_t scanDevices_count;
-
 Ticker showerColdShotStopTimer;
 
 // if using the shower timer, change these settings
@@ -69,20 +69,24 @@ Ticker showerColdShotStopTimer;
 #define SHOWER_COLDSHOT_DURATION 10 // in seconds. 10 seconds for cold water before turning back hot water
 #define SHOWER_MAX_DURATION 420000  // in ms. 7 minutes, before trigger a shot of cold water
 
+// 'info' is streamed to telnet in parts, long lists are split into chunks of this many lines
+#define SHOWINFO_LINES 10
+
 typedef struct {
     uint32_t timestamp;      // for internal timings, via millis()
     uint8_t  dallas_sensors; // count of dallas sensors
 
     // custom params
-    bool     shower_timer;    // true if we want to report back on shower times
-    bool     shower_alert;    // true if we want the alert of cold water
-    bool     led;             // LED on/off
-    bool     listen_mode;     // stop automatic Tx on/off
-    uint16_t publish_wait;    // frequency of MQTT publish in seconds
-    uint8_t  led_gpio;        // pin for LED
-    uint8_t  dallas_gpio;     // pin for attaching external dallas temperature sensors
-    bool     dallas_parasite; // on/off is using parasite
-    uint8_t  heating_circuit; // number of heating circuit, 1 or 2
+    bool     shower_timer;                // true if we want to report back on shower times
+    bool     shower_alert;                // true if we want the alert of cold water
+    bool     led;                         // LED on/off
+    bool     listen_mode;                 // stop automatic Tx on/off
+    uint16_t publish_wait;                // frequency of MQTT publish in seconds
+    uint8_t  led_gpio;                    // pin for LED
+    uint8_t  dallas_gpio[DS18_BUSES_MAX]; // pins of the OneWire buses for external dallas temperature sensors, 0 if not used
+    bool     dallas_parasite;             // on/off is using parasite
+    uint8_t  dallas_deadband;             // change in 1/16 C before a sensor value is published again
+    uint8_t  heating_circuit;             // number of heating circuit, 1 or 2
 } _EMSESP_Status;
 
 typedef struct {
@@ -93,45 +97,30 @@ typedef struct {
     bool     doingColdShot; // true if we've just sent a jolt of cold water
 } _EMSESP_Shower;
 
-command_t project_cmds[] = {
-
-    {true, "led <on | off>", "toggle status LED on/off"},
-    {true, "led_gpio <gpio>", "set the LED pin. Default is the onboard LED (D1=5)"},
-    {true, "dallas_gpio <gpio>", "set the pin for external Dallas temperature sensors (D5=14)"},
-    {true, "dallas_parasite <on | off>", "set to on if powering Dallas via parasite"},
-    {true, "thermostat_type <device ID>", "set the thermostat type id (e.g. 10 for 0x10)"},
-    {true, "boiler_type <device ID>", "set the boiler type id (e.g. 8 for 0x08)"},
-    {true, "listen_mode <on | off>", "when on all automatic Tx is disabled"},
-    {true, "shower_timer <on | off>", "notify via MQTT all shower durations"},
-    {true, "shower_alert <on | off>", "send a warning of cold water after shower time is exceeded"},
-    {true, "publish_wait <seconds>", "set frequency for publishing to MQTT"},
-    {true, "heating_circuit <1 | 2>", "set the thermostat HC to work with if using multiple heating circuits"},
-
-    {false, "info", "show data captured on the EMS bus"},
-    {false, "log <n | b | t | r | v>", "set logging mode to none, basic, thermostat only, raw or verbose"},
-
-#ifdef TESTS
-    {false, "test <n>", "insert a test telegram on to the EMS bus"},
-#endif
-
-    {false, "publish", "publish all values to MQTT"},
-    {false, "refresh", "fetch values from the EMS devices"},
-    {false, "devices", "list all supported and detected EMS devices and types IDs"},
-    {false, "queue", "show current Tx queue"},
-    {false, "autodetect [deep]", "detect EMS devices and attempt to automatically set boiler and thermostat types"},
-    {false, "shower <timer | alert>", "toggle either timer or alert on/off"},
-    {false, "send XX ...", "send raw telegram data as hex to EMS bus"},
-    {false, "thermostat read <type ID>", "send read request to the thermostat"},
-    {false, "thermostat temp <degrees>", "set current thermostat temperature"},
-    {false, "thermostat mode <mode>", "set mode (0=low/night, 1=manual/day, 2=auto)"},
-    {false, "thermostat scan <type ID>", "probe thermostat on all type id responses"},
-    {false, "boiler read <type ID>", "send read request to boiler"},
-    {false, "boiler wwtemp <degrees>", "set boiler warm water temperature"},
-    {false, "boiler tapwater <on | off>", "set boiler warm tap water on/off"},
-    {false, "boiler flowtemp <degrees>", "set boiler flow temperature"},
-    {false, "boiler comfort <hot | eco | intelligent>", "set boiler warm water comfort setting"}
-
-};
+// the custom settings as they're kept in the binary config, see ConfigCallback()
+// only add new settings at the end
+typedef struct {
+    uint8_t           thermostat_type;
+    uint8_t           boiler_type;
+    bool              led;
+    uint8_t           led_gpio;
+    uint8_t           dallas_gpio;
+    bool              dallas_parasite;
+    bool              listen_mode;
+    bool              shower_timer;
+    bool              shower_alert;
+    uint8_t           heating_circuit;
+    uint16_t          publish_wait;
+    _EMS_PollInterval poll_intervals[EMS_POLL_INTERVALS_MAX];
+    uint32_t          devices_checksum;                         // of the device cache, to ignore a corrupted one
+    char              devices[(EMS_DEVICES_CACHE_MAX * 8) + 1]; // detected devices from the last device scan, as a hex string
+    ds_setting_t      dallas[DS18_SETTINGS_MAX];                // resolution and sample interval of dallas sensors, by address
+    uint8_t           dallas_gpio_bus[DS18_BUSES_MAX - 1];      // pins of the other OneWire buses, after dallas_gpio
+    uint8_t           dallas_deadband;                          // 1/16 C
+    ds_name_t         dallas_names[DS18_SETTINGS_MAX];          // names of the sensors in dallas
+} _EMSESP_Config;
+
+static_assert(sizeof(_EMSESP_Config) <= MYESP_CONFIG_APP_SIZE, "_EMSESP_Config is too big for the config");
 
 // store for overall system status
 _EMSESP_Status EMSESP_Status;
@@ -144,22 +133,6 @@ void myDebugLog(const char * s) {
     }
 }
 
-// convert float to char
-char * _float_to_char(char * a, float f, uint8_t precision = 2) {
-    long p[] = {0, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
-
-    char * ret   = a;
-    long   whole = (long)f;
-    itoa(whole, a, 10);
-    while (*a != '\0')
-        a++;
-    *a++         = '.';
-    long decimal = abs((long)((f - whole) * p[precision]));
-    itoa(decimal, a, 10);
-
-    return ret;
-}
-
 // convert bool to text. bools are stored as bytes
 char * _bool_to_char(char * s, uint8_t value) {
     if (value == EMS_VALUE_INT_ON) {
@@ -174,33 +147,15 @@ char * _bool_to_char(char * s, uint8_t value) {
 
 // convert short (two bytes) to text string
 // decimals: 0 = no division, 1=divide value by 10, 10=divide value by 100
-// negative values are assumed stored as 1-compliment (https://medium.com/@LeeJulija/how-integers-are-stored-in-memory-using-twos-complement-5ba04d61a56c)
 char * _short_to_char(char * s, int16_t value, uint8_t decimals = 1) {
     // remove errors or invalid values
-    if (abs(value) >= EMS_VALUE_SHORT_NOTSET) {
+    if (value == (int16_t)EMS_VALUE_SHORT_NOTSET) {
         strlcpy(s, "?", 10);
         return (s);
     }
 
-    // just print
-    if (decimals == 0) {
-        ltoa(value, s, 10);
-        return (s);
-    }
-
-    // do floating point
-    char s2[10] = {0};
-    // check for negative values
-    if (value < 0) {
-        strlcpy(s, "-", 10);
-        value = abs(value);
-    }
-
-    strlcpy(s, ltoa(value / (decimals * 10), s2, 10), 10);
-    strlcat(s, ".", 10);
-    strlcat(s, ltoa(value % (decimals * 10), s2, 10), 10);
-
-    return s;
+    uint8_t scale = (decimals == 0) ? 1 : (decimals * 10);
+    return fp_format(s, 10, value, scale, fp_decimals(scale));
 }
 
 // takes a short value (2 bytes), converts to a fraction
@@ -223,37 +178,14 @@ void _renderShortValue(const char * prefix, const char * postfix, int16_t value,
 }
 
 // convert int (single byte) to text value
+// div: 1 = no division, 2 = halves, 10 = tenths
 char * _int_to_char(char * s, uint8_t value, uint8_t div = 1) {
     if (value == EMS_VALUE_INT_NOTSET) {
-        strlcpy(s, "?", sizeof(s));
+        strlcpy(s, "?", 10);
         return (s);
     }
 
-    static char s2[5] = {0};
-
-    switch (div) {
-    case 1:
-        itoa(value, s, 10);
-        break;
-
-    case 2:
-        strlcpy(s, itoa(value >> 1, s2, 10), 5);
-        strlcat(s, ".", sizeof(s));
-        strlcat(s, ((value & 0x01) ? "5" : "0"), 5);
-        break;
-
-    case 10:
-        strlcpy(s, itoa(value / 10, s2, 10), 5);
-        strlcat(s, ".", sizeof(s));
-        strlcat(s, itoa(value % 10, s2, 10), 5);
-        break;
-
-    default:
-        itoa(value, s, 10);
-        break;
-    }
-
-    return s;
+    return fp_format(s, 10, value, div, fp_decimals(div));
 }
 
 // takes an int value (1 byte), converts to a fraction
@@ -274,28 +206,6 @@ void _renderIntValue(const char * prefix, const char * postfix, uint8_t value, u
     myDebug(buffer);
 }
 
-// takes a long value at prints it to debug log
-void _renderLongValue(const char * prefix, const char * postfix, uint32_t value) {
-    static char buffer[200] = {0};
-    strlcpy(buffer, "  ", sizeof(buffer));
-    strlcat(buffer, prefix, sizeof(buffer));
-    strlcat(buffer, ": ", sizeof(buffer));
-
-    if (value == EMS_VALUE_LONG_NOTSET) {
-        strlcat(buffer, "?", sizeof(buffer));
-    } else {
-        char s[20] = {0};
-        strlcat(buffer, ltoa(value, s, 10), sizeof(buffer));
-    }
-
-    if (postfix != NULL) {
-        strlcat(buffer, " ", sizeof(buffer));
-        strlcat(buffer, postfix, sizeof(buffer));
-    }
-
-    myDebug(buffer);
-}
-
 // takes a bool value at prints it to debug log
 void _renderBoolValue(const char * prefix, uint8_t value) {
     static char buffer[200] = {0};
@@ -309,12 +219,48 @@ void _renderBoolValue(const char * prefix, uint8_t value) {
     myDebug(buffer);
 }
 
-// Show command - display stats on an 's' command
-void showInfo() {
-    // General stats from EMS bus
+// shows up to lines data points of a group that have a label, starting at data point first
+// returns the index of the next data point to show
+uint8_t _renderDataPoints(_EMS_VALUES values, uint8_t first, uint8_t lines) {
+    _EMS_DataPoint dp;
+    char           s[40];
+    char           label[EMS_DP_LABEL_SIZE];
+    char           unit[EMS_DP_UNIT_SIZE];
+    uint8_t        i;
+
+    for (i = first; (i < ems_getDataPointCount()) && (lines > 0); i++) {
+        ems_getDataPoint(i, &dp);
+        if ((dp.values == values) && (pgm_read_byte(dp.label) != '\0')) {
+            strlcpy_P(label, dp.label, sizeof(label));
+            strlcpy_P(unit, dp.unit, sizeof(unit));
+            myDebug_P(PSTR("  %s: %s%s%s"), label, ems_getDataPointString(&dp, s, sizeof(s)), (unit[0] != '\0') ? " " : "", unit);
+            lines--;
+        }
+    }
 
-    static char buffer_type[128] = {0};
+    return i;
+}
 
+// show a note if the values were restored after a reset and haven't been updated from the EMS bus yet
+void _renderStaleValues(_EMS_VALUES values) {
+    if (ems_getValuesStale(values)) {
+        myDebug_P(PSTR("  (values restored after a reset, %d seconds old)"), ems_getValuesAge(values));
+    }
+}
+
+// the parts of the 'info' output
+typedef enum {
+    SHOWINFO_SYSTEM,
+    SHOWINFO_BOILER,
+    SHOWINFO_BOILER_VALUES, // SHOWINFO_LINES data points at a time
+    SHOWINFO_OTHER,
+    SHOWINFO_THERMOSTAT,
+    SHOWINFO_SENSORS, // SHOWINFO_LINES sensors at a time
+    SHOWINFO_SHOWER
+} _SHOWINFO_PART;
+
+// General stats from EMS bus
+void _showInfoSystem() {
     myDebug_P(PSTR("%sEMS-ESP system stats:%s"), COLOR_BOLD_ON, COLOR_BOLD_OFF);
     _EMS_SYS_LOGGING sysLog = ems_getLogging();
     if (sysLog == EMS_SYS_LOGGING_BASIC) {
@@ -342,12 +288,15 @@ void showInfo() {
 
     if (ems_getBusConnected()) {
         myDebug_P(PSTR("  Bus is connected"));
-        myDebug_P(PSTR("  Rx: # successful read requests=%d, # CRC errors=%d"), EMS_Sys_Status.emsRxPgks, EMS_Sys_Status.emxCrcErr);
+        myDebug_P(PSTR("  Rx: # successful read requests=%d, # CRC errors=%d, # filtered=%d"),
+                  EMS_Sys_Status.emsRxPgks,
+                  EMS_Sys_Status.emxCrcErr,
+                  EMS_Sys_Status.emsRxFiltered);
 
         if (ems_getTxCapable()) {
-            char valuestr[8] = {0}; // for formatting floats
+            char valuestr[12] = {0}; // for formatting the seconds
             myDebug_P(PSTR("  Tx: Last poll=%s seconds ago, # successful write requests=%d"),
-                      _float_to_char(valuestr, (ems_getPollFrequency() / (float)1000000), 3),
+                      fp_format(valuestr, sizeof(valuestr), ems_getPollFrequency() / 1000, 1000, 3), // from microseconds
                       EMS_Sys_Status.emsTxPkgs);
         } else {
             myDebug_P(PSTR("  Tx: no signal"));
@@ -355,12 +304,17 @@ void showInfo() {
     } else {
         myDebug_P(PSTR("  No connection can be made to the EMS bus"));
     }
+}
+
+void _showInfoBoiler() {
+    char buffer_type[128] = {0};
 
     myDebug_P(PSTR(""));
     myDebug_P(PSTR("%sBoiler stats:%s"), COLOR_BOLD_ON, COLOR_BOLD_OFF);
 
     // version details
     myDebug_P(PSTR("  Boiler: %s"), ems_getBoilerDescription(buffer_type));
+    _renderStaleValues(EMS_VALUES_BOILER);
 
     // active stats
     if (ems_getBusConnected()) {
@@ -373,9 +327,6 @@ void showInfo() {
         }
     }
 
-    // UBAParameterWW
-    _renderBoolValue("Warm Water activated", EMS_Boiler.wWActivated);
-    _renderBoolValue("Warm Water circulation pump available", EMS_Boiler.wWCircPump);
     if (EMS_Boiler.wWComfort == EMS_VALUE_UBAParameterWW_wwComfort_Hot) {
         myDebug_P(PSTR("  Warm Water comfort setting: Hot"));
     } else if (EMS_Boiler.wWComfort == EMS_VALUE_UBAParameterWW_wwComfort_Eco) {
@@ -383,72 +334,10 @@ void showInfo() {
     } else if (EMS_Boiler.wWComfort == EMS_VALUE_UBAParameterWW_wwComfort_Intelligent) {
         myDebug_P(PSTR("  Warm Water comfort setting: Intelligent"));
     }
+}
 
-    _renderIntValue("Warm Water selected temperature", "C", EMS_Boiler.wWSelTemp);
-    _renderIntValue("Warm Water desired temperature", "C", EMS_Boiler.wWDesiredTemp);
-
-    // UBAMonitorWWMessage
-    _renderShortValue("Warm Water current temperature", "C", EMS_Boiler.wWCurTmp);
-    _renderIntValue("Warm Water current tap water flow", "l/min", EMS_Boiler.wWCurFlow, 10);
-    _renderLongValue("Warm Water # starts", "times", EMS_Boiler.wWStarts);
-    if (EMS_Boiler.wWWorkM != EMS_VALUE_LONG_NOTSET) {
-        myDebug_P(PSTR("  Warm Water active time: %d days %d hours %d minutes"),
-                  EMS_Boiler.wWWorkM / 1440,
-                  (EMS_Boiler.wWWorkM % 1440) / 60,
-                  EMS_Boiler.wWWorkM % 60);
-    }
-    _renderBoolValue("Warm Water 3-way valve", EMS_Boiler.wWHeat);
-
-    // UBAMonitorFast
-    _renderIntValue("Selected flow temperature", "C", EMS_Boiler.selFlowTemp);
-    _renderShortValue("Current flow temperature", "C", EMS_Boiler.curFlowTemp);
-    _renderShortValue("Return temperature", "C", EMS_Boiler.retTemp);
-    _renderBoolValue("Gas", EMS_Boiler.burnGas);
-    _renderBoolValue("Boiler pump", EMS_Boiler.heatPmp);
-    _renderBoolValue("Fan", EMS_Boiler.fanWork);
-    _renderBoolValue("Ignition", EMS_Boiler.ignWork);
-    _renderBoolValue("Circulation pump", EMS_Boiler.wWCirc);
-    _renderIntValue("Burner selected max power", "%", EMS_Boiler.selBurnPow);
-    _renderIntValue("Burner current power", "%", EMS_Boiler.curBurnPow);
-    _renderShortValue("Flame current", "uA", EMS_Boiler.flameCurr);
-    _renderIntValue("System pressure", "bar", EMS_Boiler.sysPress, 10);
-    if (EMS_Boiler.serviceCode == EMS_VALUE_SHORT_NOTSET) {
-        myDebug_P(PSTR("  System service code: %s"), EMS_Boiler.serviceCodeChar);
-    } else {
-        myDebug_P(PSTR("  System service code: %s (%d)"), EMS_Boiler.serviceCodeChar, EMS_Boiler.serviceCode);
-    }
-
-    // UBAParametersMessage
-    _renderIntValue("Heating temperature setting on the boiler", "C", EMS_Boiler.heating_temp);
-    _renderIntValue("Boiler circuit pump modulation max power", "%", EMS_Boiler.pump_mod_max);
-    _renderIntValue("Boiler circuit pump modulation min power", "%", EMS_Boiler.pump_mod_min);
-
-    // UBAMonitorSlow
-    if (EMS_Boiler.extTemp != (int16_t)EMS_VALUE_SHORT_NOTSET) {
-        _renderShortValue("Outside temperature", "C", EMS_Boiler.extTemp);
-    }
-    _renderShortValue("Boiler temperature", "C", EMS_Boiler.boilTemp);
-    _renderIntValue("Pump modulation", "%", EMS_Boiler.pumpMod);
-    _renderLongValue("Burner # starts", "times", EMS_Boiler.burnStarts);
-    if (EMS_Boiler.burnWorkMin != EMS_VALUE_LONG_NOTSET) {
-        myDebug_P(PSTR("  Total burner operating time: %d days %d hours %d minutes"),
-                  EMS_Boiler.burnWorkMin / 1440,
-                  (EMS_Boiler.burnWorkMin % 1440) / 60,
-                  EMS_Boiler.burnWorkMin % 60);
-    }
-    if (EMS_Boiler.heatWorkMin != EMS_VALUE_LONG_NOTSET) {
-        myDebug_P(PSTR("  Total heat operating time: %d days %d hours %d minutes"),
-                  EMS_Boiler.heatWorkMin / 1440,
-                  (EMS_Boiler.heatWorkMin % 1440) / 60,
-                  EMS_Boiler.heatWorkMin % 60);
-    }
-    if (EMS_Boiler.UBAuptime != EMS_VALUE_LONG_NOTSET) {
-        myDebug_P(PSTR("  Total UBA working time: %d days %d hours %d minutes"),
-                  EMS_Boiler.UBAuptime / 1440,
-                  (EMS_Boiler.UBAuptime % 1440) / 60,
-                  EMS_Boiler.UBAuptime % 60);
-    }
-
+// Solar Module and Heat Pump stats
+void _showInfoOther() {
     // For SM10/SM100 Solar Module
     if (EMS_Other.SM) {
         myDebug_P(PSTR("")); // newline
@@ -469,113 +358,211 @@ void showInfo() {
         _renderIntValue("Pump modulation", "%", EMS_Other.HPModulation);
         _renderIntValue("Pump speed", "%", EMS_Other.HPSpeed);
     }
+}
 
-    // Thermostat stats
-    if (ems_getThermostatEnabled()) {
-        myDebug_P(PSTR("")); // newline
-        myDebug_P(PSTR("%sThermostat stats:%s"), COLOR_BOLD_ON, COLOR_BOLD_OFF);
-        myDebug_P(PSTR("  Thermostat: %s"), ems_getThermostatDescription(buffer_type));
-
-        // Render Current & Setpoint Room Temperature
-        if ((ems_getThermostatModel() == EMS_MODEL_EASY)) {
-            // Temperatures are *100
-            _renderShortValue("Set room temperature", "C", EMS_Thermostat.setpoint_roomTemp, 10); // *100
-            _renderShortValue("Current room temperature", "C", EMS_Thermostat.curr_roomTemp, 10); // *100
-        } 
-        else if ((ems_getThermostatModel() == EMS_MODEL_FR10) || (ems_getThermostatModel() == EMS_MODEL_FW100)) {
-            // Temperatures are *10
-            _renderShortValue("Set room temperature", "C", EMS_Thermostat.setpoint_roomTemp, 1); // *10
-            _renderShortValue("Current room temperature", "C", EMS_Thermostat.curr_roomTemp, 1); // *10
-        }
-        else {
-            // because we store in 2 bytes short, when converting to a single byte we'll loose the negative value if its unset
-            if (EMS_Thermostat.setpoint_roomTemp <= 0) {
-                EMS_Thermostat.setpoint_roomTemp = EMS_VALUE_INT_NOTSET;
-            }
-            if (EMS_Thermostat.curr_roomTemp <= 0) {
-                EMS_Thermostat.curr_roomTemp = EMS_VALUE_INT_NOTSET;
-            }
-            _renderIntValue("Setpoint room temperature", "C", EMS_Thermostat.setpoint_roomTemp, 2); // convert to a single byte * 2
-            _renderIntValue("Current room temperature", "C", EMS_Thermostat.curr_roomTemp, 10);     // is *10
-        }
+// Thermostat stats
+void _showInfoThermostat() {
+    if (!ems_getThermostatEnabled()) {
+        return;
+    }
 
-        // Render Day/Night/Holiday Temperature
-        if ((EMS_Thermostat.holidaytemp > 0) && (EMSESP_Status.heating_circuit == 2)) {  // only if we are on a RC35 we show more info
-            _renderIntValue("Day temperature", "C", EMS_Thermostat.daytemp, 2);          // convert to a single byte * 2
-            _renderIntValue("Night temperature", "C", EMS_Thermostat.nighttemp, 2);      // convert to a single byte * 2
-            _renderIntValue("Vacation temperature", "C", EMS_Thermostat.holidaytemp, 2); // convert to a single byte * 2
-        }
+    char buffer_type[128] = {0};
 
-        // Render Thermostat Date & Time
-        myDebug_P(PSTR("  Thermostat time is %02d:%02d:%02d %d/%d/%d"),
-                  EMS_Thermostat.hour,
-                  EMS_Thermostat.minute,
-                  EMS_Thermostat.second,
-                  EMS_Thermostat.day,
-                  EMS_Thermostat.month,
-                  EMS_Thermostat.year + 2000);
-
-        // Render Termostat Mode
-        if (EMS_Thermostat.mode == 0) {
-            myDebug_P(PSTR("  Mode is set to low"));
-        } else if (EMS_Thermostat.mode == 1) {
-            myDebug_P(PSTR("  Mode is set to manual"));
-        } else if (EMS_Thermostat.mode == 2) {
-            myDebug_P(PSTR("  Mode is set to auto"));
-        } else {
-            myDebug_P(PSTR("  Mode is set to ?"));
+    myDebug_P(PSTR("")); // newline
+    myDebug_P(PSTR("%sThermostat stats:%s"), COLOR_BOLD_ON, COLOR_BOLD_OFF);
+    myDebug_P(PSTR("  Thermostat: %s"), ems_getThermostatDescription(buffer_type));
+    _renderStaleValues(EMS_VALUES_THERMOSTAT);
+
+    // Render Current & Setpoint Room Temperature
+    if ((ems_getThermostatModel() == EMS_MODEL_EASY)) {
+        // Temperatures are *100
+        _renderShortValue("Set room temperature", "C", EMS_Thermostat.setpoint_roomTemp, 10); // *100
+        _renderShortValue("Current room temperature", "C", EMS_Thermostat.curr_roomTemp, 10); // *100
+    } 
+    else if ((ems_getThermostatModel() == EMS_MODEL_FR10) || (ems_getThermostatModel() == EMS_MODEL_FW100)) {
+        // Temperatures are *10
+        _renderShortValue("Set room temperature", "C", EMS_Thermostat.setpoint_roomTemp, 1); // *10
+        _renderShortValue("Current room temperature", "C", EMS_Thermostat.curr_roomTemp, 1); // *10
+    }
+    else {
+        // because we store in 2 bytes short, when converting to a single byte we'll loose the negative value if its unset
+        if (EMS_Thermostat.setpoint_roomTemp <= 0) {
+            EMS_Thermostat.setpoint_roomTemp = EMS_VALUE_INT_NOTSET;
+        }
+        if (EMS_Thermostat.curr_roomTemp <= 0) {
+            EMS_Thermostat.curr_roomTemp = EMS_VALUE_INT_NOTSET;
         }
+        _renderIntValue("Setpoint room temperature", "C", EMS_Thermostat.setpoint_roomTemp, 2); // convert to a single byte * 2
+        _renderIntValue("Current room temperature", "C", EMS_Thermostat.curr_roomTemp, 10);     // is *10
+    }
+
+    // Render Day/Night/Holiday Temperature
+    if ((EMS_Thermostat.holidaytemp > 0) && (EMSESP_Status.heating_circuit == 2)) {  // only if we are on a RC35 we show more info
+        _renderIntValue("Day temperature", "C", EMS_Thermostat.daytemp, 2);          // convert to a single byte * 2
+        _renderIntValue("Night temperature", "C", EMS_Thermostat.nighttemp, 2);      // convert to a single byte * 2
+        _renderIntValue("Vacation temperature", "C", EMS_Thermostat.holidaytemp, 2); // convert to a single byte * 2
+    }
+
+    // Render Thermostat Date & Time
+    myDebug_P(PSTR("  Thermostat time is %02d:%02d:%02d %d/%d/%d"),
+              EMS_Thermostat.hour,
+              EMS_Thermostat.minute,
+              EMS_Thermostat.second,
+              EMS_Thermostat.day,
+              EMS_Thermostat.month,
+              EMS_Thermostat.year + 2000);
+
+    // Render Termostat Mode
+    if (EMS_Thermostat.mode == 0) {
+        myDebug_P(PSTR("  Mode is set to low"));
+    } else if (EMS_Thermostat.mode == 1) {
+        myDebug_P(PSTR("  Mode is set to manual"));
+    } else if (EMS_Thermostat.mode == 2) {
+        myDebug_P(PSTR("  Mode is set to auto"));
+    } else {
+        myDebug_P(PSTR("  Mode is set to ?"));
     }
+}
 
-    // Dallas
-    if (EMSESP_Status.dallas_sensors != 0) {
+// Dallas, up to lines sensors starting at sensor first. Returns the index of the next sensor to show
+uint8_t _showInfoSensors(uint8_t first, uint8_t lines) {
+    if (EMSESP_Status.dallas_sensors == 0) {
+        return 0;
+    }
+
+    char    buffer[128]             = {0};
+    char    name[DS18_ADDRESS_SIZE] = {0};
+    char    valuestr[8]             = {0}; // for formatting temp
+    uint8_t i;
+
+    if (first == 0) {
         myDebug_P(PSTR("")); // newline
-        char buffer[128] = {0};
-        char valuestr[8] = {0}; // for formatting temp
         myDebug_P(PSTR("%sExternal temperature sensors:%s"), COLOR_BOLD_ON, COLOR_BOLD_OFF);
-        for (uint8_t i = 0; i < EMSESP_Status.dallas_sensors; i++) {
-            myDebug_P(PSTR("  Sensor #%d %s: %s C"), i + 1, ds18.getDeviceString(buffer, i), _float_to_char(valuestr, ds18.getValue(i)));
-        }
     }
 
-    // show the Shower Info
-    if (EMSESP_Status.shower_timer) {
+    for (i = first; (i < EMSESP_Status.dallas_sensors) && (i < first + lines); i++) {
+        myDebug_P(PSTR("  Sensor #%d %s %s: %s C (%d bits, every %ds, %d errors)"),
+                  i + 1,
+                  ds18.getName(name, i),
+                  ds18.getDeviceString(buffer, i),
+                  ds18.getValueString(valuestr, i),
+                  ds18.getResolution(i),
+                  ds18.getInterval(i),
+                  ds18.getErrors(i));
+    }
+
+    return i;
+}
+
+// Show command - display stats on an 's' command
+// one part of the output is rendered per call, step counts up from 0. It's rendered through myESP.telnetRender()
+// so the telnet buffer can drain between parts. Returns false when it's done
+bool showInfo(uint16_t step) {
+    static uint8_t part  = SHOWINFO_SYSTEM;
+    static uint8_t index = 0; // next data point or sensor of a part that's shown in chunks
+
+    if (step == 0) {
+        part  = SHOWINFO_SYSTEM;
+        index = 0;
+    }
+
+    switch (part) {
+    case SHOWINFO_SYSTEM:
+        _showInfoSystem();
+        break;
+    case SHOWINFO_BOILER:
+        _showInfoBoiler();
+        break;
+    case SHOWINFO_BOILER_VALUES:
+        index = _renderDataPoints(EMS_VALUES_BOILER, index, SHOWINFO_LINES);
+        if (index < ems_getDataPointCount()) {
+            return true; // more to come
+        }
+        break;
+    case SHOWINFO_OTHER:
+        _showInfoOther();
+        break;
+    case SHOWINFO_THERMOSTAT:
+        _showInfoThermostat();
+        break;
+    case SHOWINFO_SENSORS:
+        index = _showInfoSensors(index, SHOWINFO_LINES);
+        if (index < EMSESP_Status.dallas_sensors) {
+            return true;
+        }
+        break;
+    case SHOWINFO_SHOWER:
+    default:
+        // show the Shower Info
+        if (EMSESP_Status.shower_timer) {
+            myDebug_P(PSTR("")); // newline
+            myDebug_P(PSTR("%sShower stats:%s"), COLOR_BOLD_ON, COLOR_BOLD_OFF);
+            myDebug_P(PSTR("  Shower is %s"), (EMSESP_Shower.showerOn ? "running" : "off"));
+        }
+
         myDebug_P(PSTR("")); // newline
-        myDebug_P(PSTR("%sShower stats:%s"), COLOR_BOLD_ON, COLOR_BOLD_OFF);
-        myDebug_P(PSTR("  Shower is %s"), (EMSESP_Shower.showerOn ? "running" : "off"));
+        return false;
     }
 
-    myDebug_P(PSTR("")); // newline
+    part++;
+    index = 0;
+    return true;
 }
 
-// send all dallas sensor values as a JSON package to MQTT
+// send the dallas sensor values that have changed by at least the deadband to MQTT, each to its own topic
+// no JSON document is built, so there's no limit on the number of sensors
 void publishSensorValues() {
     // don't send if MQTT is connected
     if (!myESP.isMQTTConnected()) {
         return;
     }
 
-    StaticJsonDocument<200> doc;
-    JsonObject              sensors = doc.to<JsonObject>();
-
-    bool hasdata     = false;
-    char label[8]    = {0};
-    char valuestr[8] = {0}; // for formatting temp
+    char topic[MQTT_MAX_TOPIC_SIZE] = {0};
+    char name[DS18_ADDRESS_SIZE]    = {0};
+    char valuestr[8]                = {0}; // for formatting temp
 
-    // see if the sensor values have changed, if so send
     for (uint8_t i = 0; i < EMSESP_Status.dallas_sensors; i++) {
-        double sensorValue = ds18.getValue(i);
-        if (sensorValue != DS18_DISCONNECTED && sensorValue != DS18_CRC_ERROR) {
-            sprintf(label, PAYLOAD_EXTERNAL_SENSORS, (i + 1));
-            sensors[label] = _float_to_char(valuestr, sensorValue);
-            hasdata        = true;
+        if (ds18.hasChanged(i, EMSESP_Status.dallas_deadband)) {
+            snprintf(topic, sizeof(topic), "%s/%s", TOPIC_EXTERNAL_SENSORS, ds18.getName(name, i));
+            if (myESP.mqttPublish(topic, ds18.getValueString(valuestr, i))) {
+                ds18.setPublished(i, true);
+            }
         }
     }
+}
 
-    if (hasdata) {
-        char data[200] = {0};
-        serializeJson(doc, data, sizeof(data));
-        myESP.mqttPublish(TOPIC_EXTERNAL_SENSORS, data);
+// adds a fixed-point value to a json object as a number, formatted without going through a double
+// the key must be a string literal, it's not copied
+void _publishFixed(JsonObject root, const char * key, int32_t value, uint32_t scale) {
+    char s[16];
+    root[key] = serialized(fp_format(s, sizeof(s), value, scale, fp_decimals(scale)));
+}
+
+// adds all data points of a group that have an MQTT key and a value to a json object
+void _publishDataPoints(JsonObject root, _EMS_VALUES values) {
+    _EMS_DataPoint dp;
+    int32_t        value;
+    char           s[20];
+    char           key[EMS_DP_KEY_SIZE]; // not const, so the JSON document keeps a copy
+
+    for (uint8_t i = 0; i < ems_getDataPointCount(); i++) {
+        ems_getDataPoint(i, &dp);
+        if ((dp.values != values) || (pgm_read_byte(dp.key) == '\0')) {
+            continue;
+        }
+        strlcpy_P(key, dp.key, sizeof(key));
+
+        if (dp.format == EMS_DP_CHARS) {
+            root[key] = ems_getDataPointString(&dp, s, sizeof(s));
+        } else if (ems_getDataPointValue(&dp, &value)) {
+            if ((dp.format == EMS_DP_BIT) || (dp.format == EMS_DP_FLAG)) {
+                root[key] = _bool_to_char(s, value);
+            } else if (dp.div == 1) {
+                root[key] = value;
+            } else {
+                root[key] = serialized(fp_format(s, sizeof(s), value, dp.div, fp_decimals(dp.div)));
+            }
+        }
     }
 }
 
@@ -610,55 +597,7 @@ void publishValues(bool force) {
         rootBoiler["wWComfort"] = "Intelligent";
     }
 
-    if (EMS_Boiler.wWSelTemp != EMS_VALUE_INT_NOTSET)
-        rootBoiler["wWSelTemp"] = EMS_Boiler.wWSelTemp;
-    if (EMS_Boiler.selFlowTemp != EMS_VALUE_INT_NOTSET)
-        rootBoiler["selFlowTemp"] = EMS_Boiler.selFlowTemp;
-    if (EMS_Boiler.selBurnPow != EMS_VALUE_INT_NOTSET)
-        rootBoiler["selBurnPow"] = EMS_Boiler.selBurnPow;
-    if (EMS_Boiler.curBurnPow != EMS_VALUE_INT_NOTSET)
-        rootBoiler["curBurnPow"] = EMS_Boiler.curBurnPow;
-    if (EMS_Boiler.pumpMod != EMS_VALUE_INT_NOTSET)
-        rootBoiler["pumpMod"] = EMS_Boiler.pumpMod;
-
-    if (abs(EMS_Boiler.extTemp) < EMS_VALUE_SHORT_NOTSET)
-        rootBoiler["outdoorTemp"] = (double)EMS_Boiler.extTemp / 10;
-    if (abs(EMS_Boiler.wWCurTmp) < EMS_VALUE_SHORT_NOTSET)
-        rootBoiler["wWCurTmp"] = (double)EMS_Boiler.wWCurTmp / 10;
-    if (abs(EMS_Boiler.wWCurFlow) != EMS_VALUE_INT_NOTSET)
-        rootBoiler["wWCurFlow"] = (double)EMS_Boiler.wWCurFlow / 10;
-    if (abs(EMS_Boiler.curFlowTemp) < EMS_VALUE_SHORT_NOTSET)
-        rootBoiler["curFlowTemp"] = (double)EMS_Boiler.curFlowTemp / 10;
-    if (abs(EMS_Boiler.retTemp) < EMS_VALUE_SHORT_NOTSET)
-        rootBoiler["retTemp"] = (double)EMS_Boiler.retTemp / 10;
-    if (abs(EMS_Boiler.sysPress) != EMS_VALUE_INT_NOTSET)
-        rootBoiler["sysPress"] = (double)EMS_Boiler.sysPress / 10;
-    if (abs(EMS_Boiler.boilTemp) < EMS_VALUE_SHORT_NOTSET)
-        rootBoiler["boilTemp"] = (double)EMS_Boiler.boilTemp / 10;
-
-    if (EMS_Boiler.wWActivated != EMS_VALUE_INT_NOTSET)
-        rootBoiler["wWActivated"] = _bool_to_char(s, EMS_Boiler.wWActivated);
-
-    if (EMS_Boiler.burnGas != EMS_VALUE_INT_NOTSET)
-        rootBoiler["burnGas"] = _bool_to_char(s, EMS_Boiler.burnGas);
-
-    if (EMS_Boiler.heatPmp != EMS_VALUE_INT_NOTSET)
-        rootBoiler["heatPmp"] = _bool_to_char(s, EMS_Boiler.heatPmp);
-
-    if (EMS_Boiler.fanWork != EMS_VALUE_INT_NOTSET)
-        rootBoiler["fanWork"] = _bool_to_char(s, EMS_Boiler.fanWork);
-
-    if (EMS_Boiler.ignWork != EMS_VALUE_INT_NOTSET)
-        rootBoiler["ignWork"] = _bool_to_char(s, EMS_Boiler.ignWork);
-
-    if (EMS_Boiler.wWCirc != EMS_VALUE_INT_NOTSET)
-        rootBoiler["wWCirc"] = _bool_to_char(s, EMS_Boiler.wWCirc);
-
-    if (EMS_Boiler.wWHeat != EMS_VALUE_INT_NOTSET)
-        rootBoiler["wWHeat"] = _bool_to_char(s, EMS_Boiler.wWHeat);
-
-    rootBoiler["ServiceCode"]       = EMS_Boiler.serviceCodeChar;
-    rootBoiler["ServiceCodeNumber"] = EMS_Boiler.serviceCode;
+    _publishDataPoints(rootBoiler, EMS_VALUES_BOILER);
 
     serializeJson(doc, data, sizeof(data));
 
@@ -668,21 +607,24 @@ void publishValues(bool force) {
     }
     fchecksum = crc.finalize();
     if ((previousBoilerPublishCRC != fchecksum) || force) {
-        previousBoilerPublishCRC = fchecksum;
         myDebugLog("Publishing boiler data via MQTT");
 
-        // send values via MQTT
-        myESP.mqttPublish(TOPIC_BOILER_DATA, data);
+        // send values via MQTT, if they're held back by the rate limit they're tried again with the next change
+        if (myESP.mqttPublish(TOPIC_BOILER_DATA, data)) {
+            previousBoilerPublishCRC = fchecksum;
+        }
     }
 
     // see if the heating or hot tap water has changed, if so send
     // last_boilerActive stores heating in bit 1 and tap water in bit 2
     if ((last_boilerActive != ((EMS_Boiler.tapwaterActive << 1) + EMS_Boiler.heatingActive)) || force) {
         myDebugLog("Publishing hot water and heating states via MQTT");
-        myESP.mqttPublish(TOPIC_BOILER_TAPWATER_ACTIVE, EMS_Boiler.tapwaterActive == 1 ? "1" : "0");
-        myESP.mqttPublish(TOPIC_BOILER_HEATING_ACTIVE, EMS_Boiler.heatingActive == 1 ? "1" : "0");
+        bool sent = myESP.mqttPublish(TOPIC_BOILER_TAPWATER_ACTIVE, EMS_Boiler.tapwaterActive == 1 ? "1" : "0");
+        sent &= myESP.mqttPublish(TOPIC_BOILER_HEATING_ACTIVE, EMS_Boiler.heatingActive == 1 ? "1" : "0");
 
-        last_boilerActive = ((EMS_Boiler.tapwaterActive << 1) + EMS_Boiler.heatingActive); // remember last state
+        if (sent) {
+            last_boilerActive = ((EMS_Boiler.tapwaterActive << 1) + EMS_Boiler.heatingActive); // remember last state
+        }
     }
 
     // handle the thermostat values separately
@@ -700,22 +642,22 @@ void publishValues(bool force) {
         // different logic depending on thermostat types
         if ((ems_getThermostatModel() == EMS_MODEL_EASY) || (ems_getThermostatModel() == EMS_MODEL_FR10) || (ems_getThermostatModel() == EMS_MODEL_FW100)) {
             if (abs(EMS_Thermostat.setpoint_roomTemp) < EMS_VALUE_SHORT_NOTSET)
-                rootThermostat[THERMOSTAT_SELTEMP] = (double)EMS_Thermostat.setpoint_roomTemp / 10;
+                _publishFixed(rootThermostat, THERMOSTAT_SELTEMP, EMS_Thermostat.setpoint_roomTemp, FP_DECI);
             if (abs(EMS_Thermostat.curr_roomTemp) < EMS_VALUE_SHORT_NOTSET)
-                rootThermostat[THERMOSTAT_CURRTEMP] = (double)EMS_Thermostat.curr_roomTemp / 10;
+                _publishFixed(rootThermostat, THERMOSTAT_CURRTEMP, EMS_Thermostat.curr_roomTemp, FP_DECI);
 
         } else {
             if (EMS_Thermostat.setpoint_roomTemp != EMS_VALUE_INT_NOTSET)
-                rootThermostat[THERMOSTAT_SELTEMP] = (double)EMS_Thermostat.setpoint_roomTemp / 2;
+                _publishFixed(rootThermostat, THERMOSTAT_SELTEMP, EMS_Thermostat.setpoint_roomTemp, FP_HALF);
             if (EMS_Thermostat.curr_roomTemp != EMS_VALUE_INT_NOTSET)
-                rootThermostat[THERMOSTAT_CURRTEMP] = (double)EMS_Thermostat.curr_roomTemp / 10;
+                _publishFixed(rootThermostat, THERMOSTAT_CURRTEMP, EMS_Thermostat.curr_roomTemp, FP_DECI);
 
             if (EMS_Thermostat.daytemp != EMS_VALUE_INT_NOTSET)
-                rootThermostat[THERMOSTAT_DAYTEMP] = (double)EMS_Thermostat.daytemp / 2;
+                _publishFixed(rootThermostat, THERMOSTAT_DAYTEMP, EMS_Thermostat.daytemp, FP_HALF);
             if (EMS_Thermostat.nighttemp != EMS_VALUE_INT_NOTSET)
-                rootThermostat[THERMOSTAT_NIGHTTEMP] = (double)EMS_Thermostat.nighttemp / 2;
+                _publishFixed(rootThermostat, THERMOSTAT_NIGHTTEMP, EMS_Thermostat.nighttemp, FP_HALF);
             if (EMS_Thermostat.holidaytemp != EMS_VALUE_INT_NOTSET)
-                rootThermostat[THERMOSTAT_HOLIDAYTEMP] = (double)EMS_Thermostat.holidaytemp / 2;
+                _publishFixed(rootThermostat, THERMOSTAT_HOLIDAYTEMP, EMS_Thermostat.holidaytemp, FP_HALF);
 
             if (EMS_Thermostat.heatingtype != EMS_VALUE_INT_NOTSET)
                 rootThermostat[THERMOSTAT_HEATINGTYPE] = EMS_Thermostat.heatingtype;
@@ -753,11 +695,12 @@ void publishValues(bool force) {
         }
         fchecksum = crc.finalize();
         if ((previousThermostatPublishCRC != fchecksum) || force) {
-            previousThermostatPublishCRC = fchecksum;
             myDebugLog("Publishing thermostat data via MQTT");
 
             // send values via MQTT
-            myESP.mqttPublish(TOPIC_THERMOSTAT_DATA, data);
+            if (myESP.mqttPublish(TOPIC_THERMOSTAT_DATA, data)) {
+                previousThermostatPublishCRC = fchecksum;
+            }
         }
     }
 
@@ -770,10 +713,10 @@ void publishValues(bool force) {
         JsonObject rootSM = doc.to<JsonObject>();
 
         if (abs(EMS_Other.SMcollectorTemp) < EMS_VALUE_SHORT_NOTSET)
-            rootSM[SM_COLLECTORTEMP] = (double)EMS_Other.SMcollectorTemp / 10;
+            _publishFixed(rootSM, SM_COLLECTORTEMP, EMS_Other.SMcollectorTemp, FP_DECI);
 
         if (abs(EMS_Other.SMbottomTemp) < EMS_VALUE_SHORT_NOTSET)
-            rootSM[SM_BOTTOMTEMP] = (double)EMS_Other.SMbottomTemp / 10;
+            _publishFixed(rootSM, SM_BOTTOMTEMP, EMS_Other.SMbottomTemp, FP_DECI);
 
         if (EMS_Other.SMpumpModulation != EMS_VALUE_INT_NOTSET)
             rootSM[SM_PUMPMODULATION] = EMS_Other.SMpumpModulation;
@@ -783,13 +726,13 @@ void publishValues(bool force) {
         }
 
         if (abs(EMS_Other.SMEnergyLastHour) < EMS_VALUE_SHORT_NOTSET)
-            rootSM[SM_ENERGYLASTHOUR] = (double)EMS_Other.SMEnergyLastHour / 10;
+            _publishFixed(rootSM, SM_ENERGYLASTHOUR, EMS_Other.SMEnergyLastHour, FP_DECI);
 
         if (abs(EMS_Other.SMEnergyToday) < EMS_VALUE_SHORT_NOTSET)
             rootSM[SM_ENERGYTODAY] = EMS_Other.SMEnergyToday;
 
         if (abs(EMS_Other.SMEnergyTotal) < EMS_VALUE_SHORT_NOTSET)
-            rootSM[SM_ENERGYTOTAL] = (double)EMS_Other.SMEnergyTotal / 10;
+            _publishFixed(rootSM, SM_ENERGYTOTAL, EMS_Other.SMEnergyTotal, FP_DECI);
 
         data[0] = '\0'; // reset data for next package
         serializeJson(doc, data, sizeof(data));
@@ -801,11 +744,12 @@ void publishValues(bool force) {
         }
         fchecksum = crc.finalize();
         if ((previousOtherPublishCRC != fchecksum) || force) {
-            previousOtherPublishCRC = fchecksum;
             myDebugLog("Publishing SM data via MQTT");
 
             // send values via MQTT
-            myESP.mqttPublish(TOPIC_SM_DATA, data);
+            if (myESP.mqttPublish(TOPIC_SM_DATA, data)) {
+                previousOtherPublishCRC = fchecksum;
+            }
         }
     }
 
@@ -845,57 +789,37 @@ void set_showerAlert() {
     }
 }
 
-// used to read the next string from an input buffer and convert to an 8 bit int
-uint8_t _readIntNumber() {
-    char * numTextPtr = strtok(NULL, ", \n");
-    if (numTextPtr == nullptr) {
-        return 0;
-    }
-    return atoi(numTextPtr);
-}
-
-// used to read the next string from an input buffer and convert to a double
-float _readFloatNumber() {
-    char * numTextPtr = strtok(NULL, ", \n");
-    if (numTextPtr == nullptr) {
-        return 0;
-    }
-    return atof(numTextPtr);
-}
-
-// used to read the next string from an input buffer as a hex value and convert to an 8 bit int
-uint8_t _readHexNumber() {
-    char * numTextPtr = strtok(NULL, ", \n");
-    if (numTextPtr == nullptr) {
-        return 0;
-    }
-    return (uint8_t)strtol(numTextPtr, 0, 16);
-}
-
-// used to read the next string from an input buffer
-char * _readWord() {
-    char * word = strtok(NULL, ", \n");
-    return word;
-}
-
 // publish external dallas sensor temperature values to MQTT
 void do_publishSensorValues() {
+    TRACE_BEGIN(TRACE_TIMER, "do_publishSensorValues");
     if (EMSESP_Status.dallas_sensors != 0) {
+        uint32_t heap = ESP.getFreeHeap();
+        uint32_t cpu  = myESP.cpuStart();
         publishSensorValues();
+        myESP.cpuTrack(MYESP_CPU_PUBLISH, cpu);
+        myESP.heapTrack(MYESP_HEAP_JSON, heap);
     }
+    TRACE_END(TRACE_TIMER, "do_publishSensorValues");
 }
 
 // call PublishValues without forcing, so using CRC to see if we really need to publish
 void do_publishValues() {
+    TRACE_BEGIN(TRACE_TIMER, "do_publishValues");
     // don't publish if we're not connected to the EMS bus
     if ((ems_getBusConnected()) && (!myESP.getUseSerial()) && myESP.isMQTTConnected()) {
+        uint32_t heap = ESP.getFreeHeap();
+        uint32_t cpu  = myESP.cpuStart();
         publishValues(true); // force publish
+        myESP.cpuTrack(MYESP_CPU_PUBLISH, cpu);
+        myESP.heapTrack(MYESP_HEAP_JSON, heap);
     }
+    TRACE_END(TRACE_TIMER, "do_publishValues");
 }
 
 // callback to light up the LED, called via Ticker every second
 // fast way is to use WRITE_PERI_REG(PERIPHS_GPIO_BASEADDR + (state ? 4 : 8), (1 << EMSESP_Status.led_gpio)); // 4 is on, 8 is off
 void do_ledcheck() {
+    TRACE_BEGIN(TRACE_TIMER, "do_ledcheck");
     if (EMSESP_Status.led) {
         if (ems_getBusConnected()) {
             digitalWrite(EMSESP_Status.led_gpio, (EMSESP_Status.led_gpio == LED_BUILTIN) ? LOW : HIGH); // light on. For onboard LED high=off
@@ -904,72 +828,45 @@ void do_ledcheck() {
             digitalWrite(EMSESP_Status.led_gpio, !state);
         }
     }
+    TRACE_END(TRACE_TIMER, "do_ledcheck");
 }
 
 // Thermostat scan
 void do_scanThermostat() {
+    TRACE_BEGIN(TRACE_TIMER, "do_scanThermostat");
     if ((ems_getBusConnected()) && (!myESP.getUseSerial())) {
         myDebug_P(PSTR("> Scanning thermostat message type #0x%02X..."), scanThermostat_count);
         ems_doReadCommand(scanThermostat_count, EMS_Thermostat.device_id);
         scanThermostat_count++;
     }
+    TRACE_END(TRACE_TIMER, "do_scanThermostat");
 }
 
 // do a system health check every now and then to see if we all connections
 void do_systemCheck() {
+    TRACE_BEGIN(TRACE_TIMER, "do_systemCheck");
     if ((!ems_getBusConnected()) && (!myESP.getUseSerial())) {
         myDebug_P(PSTR("Error! Unable to read the EMS bus."));
     }
+    TRACE_END(TRACE_TIMER, "do_systemCheck");
 }
 
-// force calls to get data from EMS for the types that aren't sent as broadcasts
-// only if we have a EMS connection
+// get data from EMS for the types that aren't sent as broadcasts or have gone stale
+// and move on any device scan, only if we have a EMS connection
 void do_regularUpdates() {
+    TRACE_BEGIN(TRACE_TIMER, "do_regularUpdates");
     if ((ems_getBusConnected()) && (!myESP.getUseSerial())) {
-        myDebugLog("Requesting scheduled EMS device data");
-        ems_getThermostatValues();
-        ems_getBoilerValues();
-        ems_getOtherValues();
-    }
-}
-
-// stop devices scan and restart all other timers
-void stopDeviceScan() {
-    publishValuesTimer.attach(EMSESP_Status.publish_wait, do_publishValues);             // post MQTT EMS values
-    publishSensorValuesTimer.attach(EMSESP_Status.publish_wait, do_publishSensorValues); // post MQTT sensor values
-    regularUpdatesTimer.attach(REGULARUPDATES_TIME, do_regularUpdates);                  // regular reads from the EMS
-    systemCheckTimer.attach(SYSTEMCHECK_TIME, do_systemCheck);                           // check if Boiler is online
-    scanThermostat_count = 0;
-    scanThermostat.detach();
-}
-
-// EMS device scan
-void do_scanDevices() {
-    if (scanDevices_count == 0) {
-        // we're at the finish line
-        myDebug_P(PSTR("Finished the deep EMS device scan."));
-        stopDeviceScan();
-        ems_printDevices();
-        ems_setLogging(EMS_SYS_LOGGING_NONE);
-        return;
-    }
-
-    if ((ems_getBusConnected()) && (!myESP.getUseSerial())) {
-        ems_doReadCommand(EMS_TYPE_Version, scanDevices_count++); // ask for version
+        ems_discoveryTick();
+        ems_pollTick();
     }
+    TRACE_END(TRACE_TIMER, "do_regularUpdates");
 }
 
-// initiate a force scan by sending a version command to all type ids
+// initiate a deep scan, probing all active and known device IDs
 void startDeviceScan() {
-    publishValuesTimer.detach();
-    systemCheckTimer.detach();
-    regularUpdatesTimer.detach();
-    publishSensorValuesTimer.detach();
-    scanDevices_count = 1; // starts at 1
     ems_clearDeviceList(); // empty the current list
-    ems_setLogging(EMS_SYS_LOGGING_NONE);
-    myDebug_P(PSTR("Starting a deep EMS device scan. This can take up to 2 minutes. Please wait..."));
-    scanThermostat.attach_ms(SCANDEVICES_TIME, do_scanDevices);
+    myDebug_P(PSTR("Starting a deep EMS device scan. Please wait..."));
+    ems_scanDevices(true);
 }
 
 // initiate a force scan by sending type read requests from 0 to FF to the thermostat
@@ -986,12 +883,14 @@ void startThermostatScan(uint8_t start) {
 
 // turn back on the hot water for the shower
 void _showerColdShotStop() {
+    TRACE_BEGIN(TRACE_TIMER, "_showerColdShotStop");
     if (EMSESP_Shower.doingColdShot) {
         myDebugLog("[Shower] finished shot of cold. hot water back on");
         ems_setWarmTapWaterActivated(true);
         EMSESP_Shower.doingColdShot = false;
         showerColdShotStopTimer.detach(); // disable the timer
     }
+    TRACE_END(TRACE_TIMER, "_showerColdShotStop");
 }
 
 // turn off hot water to send a shot of cold
@@ -1015,210 +914,257 @@ void runUnitTest(uint8_t test_num) {
     ems_testTelegram(test_num);
 }
 
-// callback for loading/saving settings to the file system (SPIFFS)
-bool FSCallback(MYESP_FSACTION action, const JsonObject json) {
-    if (action == MYESP_FSACTION_LOAD) {
-        bool recreate_config = true;
-
-        // led
-        EMSESP_Status.led = json["led"];
+// fill in defaults for any settings that aren't set and apply them
+void applySettings(const char * devices, uint32_t devices_checksum) {
+    if (!EMSESP_Status.led_gpio) {
+        EMSESP_Status.led_gpio = EMSESP_LED_GPIO; // default value
+    }
 
-        // led_gpio
-        if (!(EMSESP_Status.led_gpio = json["led_gpio"])) {
-            EMSESP_Status.led_gpio = EMSESP_LED_GPIO; // default value
-        }
+    if (!EMSESP_Status.dallas_gpio[0]) {
+        EMSESP_Status.dallas_gpio[0] = EMSESP_DALLAS_GPIO; // default value
+    }
 
-        // dallas_gpio
-        if (!(EMSESP_Status.dallas_gpio = json["dallas_gpio"])) {
-            EMSESP_Status.dallas_gpio = EMSESP_DALLAS_GPIO; // default value
-        }
+    if (!EMS_Thermostat.device_id) {
+        EMS_Thermostat.device_id = EMSESP_THERMOSTAT_TYPE; // set default
+    }
+    ems_updateRxFilter();
 
-        // dallas_parasite
-        EMSESP_Status.dallas_parasite = json["dallas_parasite"];
+    if (!EMS_Boiler.device_id) {
+        EMS_Boiler.device_id = EMSESP_BOILER_TYPE; // set default
+    }
 
-        // thermostat_type
-        if (!(EMS_Thermostat.device_id = json["thermostat_type"])) {
-            EMS_Thermostat.device_id = EMSESP_THERMOSTAT_TYPE; // set default
-        }
+    // detected devices from the last device scan
+    (void)ems_restoreDeviceCache(devices, devices_checksum);
 
-        // boiler_type
-        if (!(EMS_Boiler.device_id = json["boiler_type"])) {
-            EMS_Boiler.device_id = EMSESP_BOILER_TYPE; // set default
-        }
+    ems_setTxDisabled(EMSESP_Status.listen_mode);
 
-        // listen mode
-        EMSESP_Status.listen_mode = json["listen_mode"];
-        ems_setTxDisabled(EMSESP_Status.listen_mode);
+    if (!EMSESP_Status.publish_wait) {
+        EMSESP_Status.publish_wait = DEFAULT_PUBLISHWAIT; // default value
+    }
 
-        // shower_timer
-        EMSESP_Status.shower_timer = json["shower_timer"];
+    if (!EMSESP_Status.heating_circuit) {
+        EMSESP_Status.heating_circuit = DEFAULT_HEATINGCIRCUIT; // default value
+    }
+    ems_setThermostatHC(EMSESP_Status.heating_circuit);
+}
 
-        // shower_alert
-        EMSESP_Status.shower_alert = json["shower_alert"];
+// callback for loading/saving settings in the binary config
+// data is zero filled, so settings added later are 0 when loading an older config
+// false if saving failed, the config in flash is then left as it is
+bool ConfigCallback(MYESP_FSACTION action, uint8_t * data, size_t size) {
+    // on the heap only while it's converted, it's too big for the stack with the Dallas sensor names
+    // data can't be used in place, it's not aligned
+    _EMSESP_Config * config = (_EMSESP_Config *)malloc(sizeof(_EMSESP_Config));
+    if (!config) {
+        myDebug_P(PSTR("Not enough memory to convert the settings"));
+        return (action == MYESP_FSACTION_LOAD); // loading carries on with the defaults, the config isn't written over
+    }
+    bool ok = false;
+    size = (size < sizeof(_EMSESP_Config)) ? size : sizeof(_EMSESP_Config);
 
-        // publish_wait
-        if (!(EMSESP_Status.publish_wait = json["publish_wait"])) {
-            EMSESP_Status.publish_wait = DEFAULT_PUBLISHWAIT; // default value
+    if (action == MYESP_FSACTION_LOAD) {
+        memset(config, 0, sizeof(_EMSESP_Config));
+        memcpy(config, data, size);
+        config->devices[sizeof(config->devices) - 1] = '\0';
+
+        EMS_Thermostat.device_id      = config->thermostat_type;
+        EMS_Boiler.device_id          = config->boiler_type;
+        EMSESP_Status.led             = config->led;
+        EMSESP_Status.led_gpio        = config->led_gpio;
+        EMSESP_Status.dallas_gpio[0]  = config->dallas_gpio;
+        EMSESP_Status.dallas_parasite = config->dallas_parasite;
+        EMSESP_Status.listen_mode     = config->listen_mode;
+        EMSESP_Status.shower_timer    = config->shower_timer;
+        EMSESP_Status.shower_alert    = config->shower_alert;
+        EMSESP_Status.heating_circuit = config->heating_circuit;
+        EMSESP_Status.publish_wait    = config->publish_wait;
+
+        for (uint8_t i = 0; i < EMS_POLL_INTERVALS_MAX; i++) {
+            if (config->poll_intervals[i].type != EMS_ID_NONE) {
+                (void)ems_setPollInterval(config->poll_intervals[i].type, config->poll_intervals[i].interval);
+            }
         }
 
-        // heating_circuit
-        if (!(EMSESP_Status.heating_circuit = json["heating_circuit"])) {
-            EMSESP_Status.heating_circuit = DEFAULT_HEATINGCIRCUIT; // default value
-        }
-        ems_setThermostatHC(EMSESP_Status.heating_circuit);
+        applySettings(config->devices, config->devices_checksum);
+
+        memcpy(&EMSESP_Status.dallas_gpio[1], config->dallas_gpio_bus, sizeof(config->dallas_gpio_bus));
+        EMSESP_Status.dallas_deadband = config->dallas_deadband;
+        ds18.setSettings(config->dallas, config->dallas_names);
 
-        return recreate_config; // return false if some settings are missing and we need to rebuild the file
+        ok = true;
     }
 
     if (action == MYESP_FSACTION_SAVE) {
-        json["thermostat_type"] = EMS_Thermostat.device_id;
-        json["boiler_type"]     = EMS_Boiler.device_id;
-        json["led"]             = EMSESP_Status.led;
-        json["led_gpio"]        = EMSESP_Status.led_gpio;
-        json["dallas_gpio"]     = EMSESP_Status.dallas_gpio;
-        json["dallas_parasite"] = EMSESP_Status.dallas_parasite;
-        json["listen_mode"]     = EMSESP_Status.listen_mode;
-        json["shower_timer"]    = EMSESP_Status.shower_timer;
-        json["shower_alert"]    = EMSESP_Status.shower_alert;
-        json["publish_wait"]    = EMSESP_Status.publish_wait;
-        json["heating_circuit"] = EMSESP_Status.heating_circuit;
+        memset(config, 0, sizeof(_EMSESP_Config));
 
-        return true;
-    }
+        config->thermostat_type = EMS_Thermostat.device_id;
+        config->boiler_type     = EMS_Boiler.device_id;
+        config->led             = EMSESP_Status.led;
+        config->led_gpio        = EMSESP_Status.led_gpio;
+        config->dallas_gpio     = EMSESP_Status.dallas_gpio[0];
+        config->dallas_parasite = EMSESP_Status.dallas_parasite;
+        config->listen_mode     = EMSESP_Status.listen_mode;
+        config->shower_timer    = EMSESP_Status.shower_timer;
+        config->shower_alert    = EMSESP_Status.shower_alert;
+        config->heating_circuit = EMSESP_Status.heating_circuit;
+        config->publish_wait    = EMSESP_Status.publish_wait;
 
-    return false;
-}
+        memcpy(config->poll_intervals, EMS_PollIntervals, sizeof(config->poll_intervals));
 
-// callback for custom settings when showing Stored Settings with the 'set' command
-// wc is number of arguments after the 'set' command
-// returns true if the setting was recognized and changed and should be saved back to SPIFFs
-bool SettingsCallback(MYESP_FSACTION action, uint8_t wc, const char * setting, const char * value) {
-    bool ok = false;
+        (void)ems_getDeviceCache(config->devices, sizeof(config->devices));
+        config->devices_checksum = ems_getDeviceChecksum();
 
-    if (action == MYESP_FSACTION_SET) {
-        // led
-        if ((strcmp(setting, "led") == 0) && (wc == 2)) {
-            if (strcmp(value, "on") == 0) {
-                EMSESP_Status.led = true;
-                ok                = true;
-            } else if (strcmp(value, "off") == 0) {
-                EMSESP_Status.led = false;
-                ok                = true;
-                // let's make sure LED is really off - For onboard high=off
-                digitalWrite(EMSESP_Status.led_gpio, (EMSESP_Status.led_gpio == LED_BUILTIN) ? HIGH : LOW);
-            } else {
-                myDebug_P(PSTR("Error. Usage: set led <on | off>"));
-            }
-        }
+        memcpy(config->dallas_gpio_bus, &EMSESP_Status.dallas_gpio[1], sizeof(config->dallas_gpio_bus));
+        config->dallas_deadband = EMSESP_Status.dallas_deadband;
+        ds18.getSettings(config->dallas, config->dallas_names);
 
-        // test mode
-        if ((strcmp(setting, "listen_mode") == 0) && (wc == 2)) {
-            if (strcmp(value, "on") == 0) {
-                EMSESP_Status.listen_mode = true;
-                ok                        = true;
-                myDebug_P(PSTR("* in listen mode. All Tx is disabled."));
-                ems_setTxDisabled(true);
-            } else if (strcmp(value, "off") == 0) {
-                EMSESP_Status.listen_mode = false;
-                ok                        = true;
-                ems_setTxDisabled(false);
-                myDebug_P(PSTR("* out of listen mode. Tx is now enabled."));
-            } else {
-                myDebug_P(PSTR("Error. Usage: set listen_mode <on | off>"));
-            }
-        }
+        memcpy(data, config, size);
 
-        // led_gpio
-        if ((strcmp(setting, "led_gpio") == 0) && (wc == 2)) {
-            EMSESP_Status.led_gpio = atoi(value);
-            // reset pin
-            pinMode(EMSESP_Status.led_gpio, OUTPUT);
-            digitalWrite(EMSESP_Status.led_gpio, (EMSESP_Status.led_gpio == LED_BUILTIN) ? HIGH : LOW); // light off. For onboard high=off
-            ok = true;
-        }
+        ok = true;
+    }
 
-        // dallas_gpio
-        if ((strcmp(setting, "dallas_gpio") == 0) && (wc == 2)) {
-            EMSESP_Status.dallas_gpio = atoi(value);
-            ok                        = true;
-        }
+    free(config);
+    return ok;
+}
 
-        // dallas_parasite
-        if ((strcmp(setting, "dallas_parasite") == 0) && (wc == 2)) {
-            if (strcmp(value, "on") == 0) {
-                EMSESP_Status.dallas_parasite = true;
-                ok                            = true;
-            } else if (strcmp(value, "off") == 0) {
-                EMSESP_Status.dallas_parasite = false;
-                ok                            = true;
-            } else {
-                myDebug_P(PSTR("Error. Usage: set dallas_parasite <on | off>"));
-            }
+// callback for importing/exporting settings as JSON
+// on import anything that's missing keeps its current value
+bool FSCallback(MYESP_FSACTION action, const JsonObject json) {
+    if (action == MYESP_FSACTION_LOAD) {
+        EMS_Thermostat.device_id      = json["thermostat_type"] | EMS_Thermostat.device_id;
+        EMS_Boiler.device_id          = json["boiler_type"] | EMS_Boiler.device_id;
+        EMSESP_Status.led             = json["led"] | EMSESP_Status.led;
+        EMSESP_Status.led_gpio        = json["led_gpio"] | EMSESP_Status.led_gpio;
+        EMSESP_Status.dallas_gpio[0]  = json["dallas_gpio"] | EMSESP_Status.dallas_gpio[0];
+        EMSESP_Status.dallas_deadband = json["dallas_deadband"] | EMSESP_Status.dallas_deadband;
+        EMSESP_Status.dallas_parasite = json["dallas_parasite"] | EMSESP_Status.dallas_parasite;
+        EMSESP_Status.listen_mode     = json["listen_mode"] | EMSESP_Status.listen_mode;
+        EMSESP_Status.shower_timer    = json["shower_timer"] | EMSESP_Status.shower_timer;
+        EMSESP_Status.shower_alert    = json["shower_alert"] | EMSESP_Status.shower_alert;
+        EMSESP_Status.publish_wait    = json["publish_wait"] | EMSESP_Status.publish_wait;
+        EMSESP_Status.heating_circuit = json["heating_circuit"] | EMSESP_Status.heating_circuit;
+
+        // poll_interval, stored as pairs of type ID and seconds
+        JsonArray poll_intervals = json["poll_intervals"];
+        uint8_t   count          = poll_intervals.size();
+        for (uint8_t i = 0; i + 1 < count; i += 2) {
+            (void)ems_setPollInterval(poll_intervals[i], poll_intervals[i + 1]);
         }
 
-        // thermostat_type
-        if (strcmp(setting, "thermostat_type") == 0) {
-            EMS_Thermostat.device_id = ((wc == 2) ? (uint8_t)strtol(value, 0, 16) : EMS_ID_NONE);
-            ok                       = true;
-        }
+        applySettings(json["devices"], json["devices_checksum"]);
 
-        // boiler_type
-        if (strcmp(setting, "boiler_type") == 0) {
-            EMS_Boiler.device_id = ((wc == 2) ? (uint8_t)strtol(value, 0, 16) : EMS_ID_NONE);
-            ok                   = true;
+        // the other OneWire buses
+        JsonArray dallas_gpio_bus = json["dallas_gpio_bus"];
+        for (uint8_t i = 0; (i < dallas_gpio_bus.size()) && (i < DS18_BUSES_MAX - 1); i++) {
+            EMSESP_Status.dallas_gpio[i + 1] = dallas_gpio_bus[i];
         }
 
-        // shower timer
-        if ((strcmp(setting, "shower_timer") == 0) && (wc == 2)) {
-            if (strcmp(value, "on") == 0) {
-                EMSESP_Status.shower_timer = true;
-                ok                         = true;
-            } else if (strcmp(value, "off") == 0) {
-                EMSESP_Status.shower_timer = false;
-                ok                         = true;
-            } else {
-                myDebug_P(PSTR("Error. Usage: set shower_timer <on | off>"));
+        // dallas sensor settings, each with the address as a hex string
+        JsonArray dallas = json["dallas"];
+        if (!dallas.isNull()) {
+            ds_setting_t settings[DS18_SETTINGS_MAX];
+            ds_name_t    names[DS18_SETTINGS_MAX];
+            memset(settings, 0, sizeof(settings));
+            memset(names, 0, sizeof(names));
+            uint8_t count = (dallas.size() < DS18_SETTINGS_MAX) ? dallas.size() : DS18_SETTINGS_MAX;
+            for (uint8_t i = 0; i < count; i++) {
+                const char * address = dallas[i]["address"] | "";
+                if (strlen(address) != 16) {
+                    continue;
+                }
+                for (uint8_t j = 0; j < 8; j++) {
+                    char hex[3] = {address[j * 2], address[(j * 2) + 1], '\0'};
+                    settings[i].address[j] = (uint8_t)strtol(hex, 0, 16);
+                }
+                strlcpy(names[i], dallas[i]["name"] | "", sizeof(names[i]));
+                settings[i].resolution = dallas[i]["resolution"] | DS18_DEFAULT_RESOLUTION;
+                settings[i].interval   = dallas[i]["interval"] | DS18_DEFAULT_INTERVAL;
             }
+            ds18.setSettings(settings, names);
         }
 
-        // shower alert
-        if ((strcmp(setting, "shower_alert") == 0) && (wc == 2)) {
-            if (strcmp(value, "on") == 0) {
-                EMSESP_Status.shower_alert = true;
-                ok                         = true;
-            } else if (strcmp(value, "off") == 0) {
-                EMSESP_Status.shower_alert = false;
-                ok                         = true;
-            } else {
-                myDebug_P(PSTR("Error. Usage: set shower_alert <on | off>"));
+        return true;
+    }
+
+    if (action == MYESP_FSACTION_SAVE) {
+        json["thermostat_type"] = EMS_Thermostat.device_id;
+        json["boiler_type"]     = EMS_Boiler.device_id;
+        json["led"]             = EMSESP_Status.led;
+        json["led_gpio"]        = EMSESP_Status.led_gpio;
+        json["dallas_gpio"]     = EMSESP_Status.dallas_gpio[0];
+        json["dallas_deadband"] = EMSESP_Status.dallas_deadband;
+        json["dallas_parasite"] = EMSESP_Status.dallas_parasite;
+        json["listen_mode"]     = EMSESP_Status.listen_mode;
+        json["shower_timer"]    = EMSESP_Status.shower_timer;
+        json["shower_alert"]    = EMSESP_Status.shower_alert;
+        json["publish_wait"]    = EMSESP_Status.publish_wait;
+        json["heating_circuit"] = EMSESP_Status.heating_circuit;
+
+        // detected devices from the last device scan, as a hex string with its checksum
+        static char devices[(EMS_DEVICES_CACHE_MAX * 8) + 1];
+        json["devices"]          = ems_getDeviceCache(devices, sizeof(devices));
+        json["devices_checksum"] = ems_getDeviceChecksum();
+
+        // only save the overridden poll intervals
+        JsonArray poll_intervals = json.createNestedArray("poll_intervals");
+        for (uint8_t i = 0; i < EMS_POLL_INTERVALS_MAX; i++) {
+            if (EMS_PollIntervals[i].type != EMS_ID_NONE) {
+                poll_intervals.add(EMS_PollIntervals[i].type);
+                poll_intervals.add(EMS_PollIntervals[i].interval);
             }
         }
 
-        // publish_wait
-        if ((strcmp(setting, "publish_wait") == 0) && (wc == 2)) {
-            EMSESP_Status.publish_wait = atoi(value);
-            ok                         = true;
+        JsonArray dallas_gpio_bus = json.createNestedArray("dallas_gpio_bus");
+        for (uint8_t i = 1; i < DS18_BUSES_MAX; i++) {
+            dallas_gpio_bus.add(EMSESP_Status.dallas_gpio[i]);
         }
 
-        // heating_circuit
-        if ((strcmp(setting, "heating_circuit") == 0) && (wc == 2)) {
-            uint8_t hc = atoi(value);
-            if ((hc >= 1) && (hc <= 2)) {
-                EMSESP_Status.heating_circuit = hc;
-                ems_setThermostatHC(hc);
-                ok = true;
-            } else {
-                myDebug_P(PSTR("Error. Usage: set heating_circuit <1 | 2>"));
+        // only save the dallas sensors that have a name or don't use the defaults
+        ds_setting_t settings[DS18_SETTINGS_MAX];
+        ds_name_t    names[DS18_SETTINGS_MAX];
+        ds18.getSettings(settings, names);
+        JsonArray dallas = json.createNestedArray("dallas");
+        for (uint8_t i = 0; i < DS18_SETTINGS_MAX; i++) {
+            if (settings[i].address[0] != 0) {
+                char address[17];
+                for (uint8_t j = 0; j < 8; j++) {
+                    sprintf(&address[j * 2], "%02X", settings[i].address[j]);
+                }
+                JsonObject sensor    = dallas.createNestedObject();
+                sensor["address"]    = address; // copied by the JSON document
+                sensor["name"]       = names[i]; // copied by the JSON document
+                sensor["resolution"] = settings[i].resolution;
+                sensor["interval"]   = settings[i].interval;
             }
         }
 
+        return true;
     }
 
+    return false;
+}
+
+// callback for custom settings when showing Stored Settings with the 'set' command
+// they're changed through the commands, see project_cmds
+bool SettingsCallback(MYESP_FSACTION action, uint8_t wc, const char * setting, const char * value) {
     if (action == MYESP_FSACTION_LIST) {
         myDebug_P(PSTR("  led=%s"), EMSESP_Status.led ? "on" : "off");
         myDebug_P(PSTR("  led_gpio=%d"), EMSESP_Status.led_gpio);
-        myDebug_P(PSTR("  dallas_gpio=%d"), EMSESP_Status.dallas_gpio);
+        char gpios[20] = {0};
+        for (uint8_t i = 0; i < DS18_BUSES_MAX; i++) {
+            snprintf(&gpios[strlen(gpios)], sizeof(gpios) - strlen(gpios), "%s%d", (i == 0) ? "" : " ", EMSESP_Status.dallas_gpio[i]);
+        }
+        myDebug_P(PSTR("  dallas_gpio=%s"), gpios);
         myDebug_P(PSTR("  dallas_parasite=%s"), EMSESP_Status.dallas_parasite ? "on" : "off");
+        char deadband[10];
+        myDebug_P(PSTR("  dallas_deadband=%s C"), fp_format(deadband, sizeof(deadband), EMSESP_Status.dallas_deadband, FP_SIXTEENTH, 3));
+
+        char name[DS18_ADDRESS_SIZE];
+        for (uint8_t i = 0; i < EMSESP_Status.dallas_sensors; i++) {
+            myDebug_P(PSTR("  dallas_name %d=%s"), i + 1, ds18.getName(name, i));
+            myDebug_P(PSTR("  dallas_resolution %d=%d"), i + 1, ds18.getResolution(i));
+            myDebug_P(PSTR("  dallas_interval %d=%d"), i + 1, ds18.getInterval(i));
+        }
 
         if (EMS_Thermostat.device_id == EMS_ID_NONE) {
             myDebug_P(PSTR("  thermostat_type=<not set>"));
@@ -1238,9 +1184,15 @@ bool SettingsCallback(MYESP_FSACTION action, uint8_t wc, const char * setting, c
         myDebug_P(PSTR("  shower_timer=%s"), EMSESP_Status.shower_timer ? "on" : "off");
         myDebug_P(PSTR("  shower_alert=%s"), EMSESP_Status.shower_alert ? "on" : "off");
         myDebug_P(PSTR("  publish_wait=%d"), EMSESP_Status.publish_wait);
+
+        for (uint8_t i = 0; i < EMS_POLL_INTERVALS_MAX; i++) {
+            if (EMS_PollIntervals[i].type != EMS_ID_NONE) {
+                myDebug_P(PSTR("  poll_interval %02X=%d"), EMS_PollIntervals[i].type, EMS_PollIntervals[i].interval);
+            }
+        }
     }
 
-    return ok;
+    return false;
 }
 
 // call back when a telnet client connects or disconnects
@@ -1253,164 +1205,388 @@ void TelnetCallback(uint8_t event) {
     }
 }
 
-// extra commands options for telnet debug window
-// wc is the word count, i.e. number of arguments. Everything is in lower case.
-void TelnetCommandCallback(uint8_t wc, const char * commandLine) {
-    bool ok = false;
-    // get first command argument
-    char * first_cmd = strtok((char *)commandLine, ", \n");
+/*
+ * Commands, from telnet and MQTT. See Command.h
+ */
 
-    if (strcmp(first_cmd, "info") == 0) {
-        showInfo();
-        ok = true;
+bool _cmdLed(const _Command_Arg * arg) {
+    EMSESP_Status.led = arg->value;
+    if (!EMSESP_Status.led) {
+        // let's make sure LED is really off - For onboard high=off
+        digitalWrite(EMSESP_Status.led_gpio, (EMSESP_Status.led_gpio == LED_BUILTIN) ? HIGH : LOW);
     }
+    return true;
+}
 
-    if (strcmp(first_cmd, "publish") == 0) {
-        publishValues(true);
-        ok = true;
-    }
+bool _cmdLedGpio(const _Command_Arg * arg) {
+    EMSESP_Status.led_gpio = arg->value;
+    // reset pin
+    pinMode(EMSESP_Status.led_gpio, OUTPUT);
+    digitalWrite(EMSESP_Status.led_gpio, (EMSESP_Status.led_gpio == LED_BUILTIN) ? HIGH : LOW); // light off. For onboard high=off
+    return true;
+}
 
-    if (strcmp(first_cmd, "refresh") == 0) {
-        myDebug_P(PSTR("Fetching data from EMS devices..."));
-        do_regularUpdates();
-        ok = true;
+// a OneWire bus on each pin, the ones left out are not used
+bool _cmdDallasGpio(const _Command_Arg * arg) {
+    char * p                     = arg->rest;
+    EMSESP_Status.dallas_gpio[0] = arg->value;
+    for (uint8_t i = 1; i < DS18_BUSES_MAX; i++) {
+        EMSESP_Status.dallas_gpio[i] = (p) ? (uint8_t)strtol(p, &p, 10) : 0;
     }
+    return true;
+}
 
-    if (strcmp(first_cmd, "devices") == 0) {
-        ems_printAllDevices();
-        ok = true;
-    }
+bool _cmdDallasParasite(const _Command_Arg * arg) {
+    EMSESP_Status.dallas_parasite = arg->value;
+    return true;
+}
 
-    if (strcmp(first_cmd, "queue") == 0) {
-        ems_printTxQueue();
-        ok = true;
-    }
+bool _cmdThermostatType(const _Command_Arg * arg) {
+    EMS_Thermostat.device_id = (arg->present) ? arg->value : EMS_ID_NONE;
+    ems_updateRxFilter();
+    return true;
+}
 
-    if (strcmp(first_cmd, "autodetect") == 0) {
-        if (wc == 2) {
-            char * second_cmd = _readWord();
-            if (strcmp(second_cmd, "deep") == 0) {
-                startDeviceScan();
-                ok = true;
-            }
-        } else {
-            ems_scanDevices();
-            ok = true;
-        }
-    }
+bool _cmdBoilerType(const _Command_Arg * arg) {
+    EMS_Boiler.device_id = (arg->present) ? arg->value : EMS_ID_NONE;
+    return true;
+}
 
-    if (strcmp(first_cmd, "startup") == 0) {
-        ems_startupTelegrams();
-        ok = true;
+bool _cmdListenMode(const _Command_Arg * arg) {
+    EMSESP_Status.listen_mode = arg->value;
+    ems_setTxDisabled(EMSESP_Status.listen_mode);
+    if (EMSESP_Status.listen_mode) {
+        myDebug_P(PSTR("* in listen mode. All Tx is disabled."));
+    } else {
+        myDebug_P(PSTR("* out of listen mode. Tx is now enabled."));
     }
+    return true;
+}
 
-    // shower settings
-    if ((strcmp(first_cmd, "shower") == 0) && (wc == 2)) {
-        char * second_cmd = _readWord();
-        if (strcmp(second_cmd, "timer") == 0) {
-            EMSESP_Status.shower_timer = !EMSESP_Status.shower_timer;
-            myESP.mqttPublish(TOPIC_SHOWER_TIMER, EMSESP_Status.shower_timer ? "1" : "0");
-            ok = true;
-        } else if (strcmp(second_cmd, "alert") == 0) {
-            EMSESP_Status.shower_alert = !EMSESP_Status.shower_alert;
-            myESP.mqttPublish(TOPIC_SHOWER_ALERT, EMSESP_Status.shower_alert ? "1" : "0");
-            ok = true;
-        }
+// no value toggles it. The new state is published, it's also the topic of the command so only on a change
+bool _cmdShowerTimer(const _Command_Arg * arg) {
+    bool timer = (arg->present) ? arg->value : !EMSESP_Status.shower_timer;
+    if (timer != EMSESP_Status.shower_timer) {
+        EMSESP_Status.shower_timer = timer;
+        myESP.mqttPublish(TOPIC_SHOWER_TIMER, EMSESP_Status.shower_timer ? "1" : "0");
     }
+    set_showerTimer();
+    return true;
+}
 
-    // logging
-    if ((strcmp(first_cmd, "log") == 0) && (wc == 2)) {
-        char * second_cmd = _readWord();
-        if (strcmp(second_cmd, "v") == 0) {
-            ems_setLogging(EMS_SYS_LOGGING_VERBOSE);
-            ok = true;
-        } else if (strcmp(second_cmd, "b") == 0) {
-            ems_setLogging(EMS_SYS_LOGGING_BASIC);
-            ok = true;
-        } else if (strcmp(second_cmd, "t") == 0) {
-            ems_setLogging(EMS_SYS_LOGGING_THERMOSTAT);
-            ok = true;
-        } else if (strcmp(second_cmd, "r") == 0) {
-            ems_setLogging(EMS_SYS_LOGGING_RAW);
-            ok = true;
-        } else if (strcmp(second_cmd, "n") == 0) {
-            ems_setLogging(EMS_SYS_LOGGING_NONE);
-            ok = true;
-        }
+bool _cmdShowerAlert(const _Command_Arg * arg) {
+    bool alert = (arg->present) ? arg->value : !EMSESP_Status.shower_alert;
+    if (alert != EMSESP_Status.shower_alert) {
+        EMSESP_Status.shower_alert = alert;
+        myESP.mqttPublish(TOPIC_SHOWER_ALERT, EMSESP_Status.shower_alert ? "1" : "0");
     }
+    set_showerAlert();
+    return true;
+}
 
-    // thermostat commands
-    if ((strcmp(first_cmd, "thermostat") == 0) && (wc == 3)) {
-        char * second_cmd = _readWord();
-        if (strcmp(second_cmd, "temp") == 0) {
-            ems_setThermostatTemp(_readFloatNumber());
-            ok = true;
-        } else if (strcmp(second_cmd, "mode") == 0) {
-            ems_setThermostatMode(_readIntNumber());
-            ok = true;
-        } else if (strcmp(second_cmd, "read") == 0) {
-            ems_doReadCommand(_readHexNumber(), EMS_Thermostat.device_id);
-            ok = true;
-        } else if (strcmp(second_cmd, "scan") == 0) {
-            startThermostatScan(_readIntNumber());
-            ok = true;
-        }
+bool _cmdShowerColdShot(const _Command_Arg * arg) {
+    _showerColdShotStart();
+    return true;
+}
+
+bool _cmdPublishWait(const _Command_Arg * arg) {
+    EMSESP_Status.publish_wait = arg->value;
+    return true;
+}
+
+bool _cmdHeatingCircuit(const _Command_Arg * arg) {
+    EMSESP_Status.heating_circuit = arg->value;
+    ems_setThermostatHC(EMSESP_Status.heating_circuit);
+    return true;
+}
+
+// <type ID> <seconds>
+bool _cmdPollInterval(const _Command_Arg * arg) {
+    if (!arg->rest) {
+        return false;
+    }
+    if (!ems_setPollInterval(arg->value, (uint16_t)strtol(arg->rest, 0, 10))) {
+        myDebug_P(PSTR("Error. Too many poll intervals set"));
     }
+    return true;
+}
 
-    // boiler commands
-    if ((strcmp(first_cmd, "boiler") == 0) && (wc == 3)) {
-        char * second_cmd = _readWord();
-        if (strcmp(second_cmd, "wwtemp") == 0) {
-            ems_setWarmWaterTemp(_readIntNumber());
-            ok = true;
-        } else if (strcmp(second_cmd, "comfort") == 0) {
-            char * third_cmd = _readWord();
-            if (strcmp(third_cmd, "hot") == 0) {
-                ems_setWarmWaterModeComfort(1);
-                ok = true;
-            } else if (strcmp(third_cmd, "eco") == 0) {
-                ems_setWarmWaterModeComfort(2);
-                ok = true;
-            } else if (strcmp(third_cmd, "intelligent") == 0) {
-                ems_setWarmWaterModeComfort(3);
-                ok = true;
-            }
-        } else if (strcmp(second_cmd, "read") == 0) {
-            ems_doReadCommand(_readHexNumber(), EMS_Boiler.device_id);
-            ok = true;
-        } else if (strcmp(second_cmd, "tapwater") == 0) {
-            char * third_cmd = _readWord();
-            if (strcmp(third_cmd, "on") == 0) {
-                ems_setWarmTapWaterActivated(true);
-                ok = true;
-            } else if (strcmp(third_cmd, "off") == 0) {
-                ems_setWarmTapWaterActivated(false);
-                ok = true;
-            }
-        } else if (strcmp(second_cmd, "flowtemp") == 0) {
-            ems_setFlowTemp(_readIntNumber());
-            ok = true;
-        }
+// <sensor #> <9-12>, sensors as numbered in 'info'
+bool _cmdDallasResolution(const _Command_Arg * arg) {
+    uint8_t resolution = (arg->rest) ? (uint8_t)strtol(arg->rest, 0, 10) : 0;
+    if ((arg->value > EMSESP_Status.dallas_sensors) || (resolution < DS18_RESOLUTION_MIN) || (resolution > DS18_RESOLUTION_MAX)) {
+        return false;
     }
+    if (!ds18.setResolution(arg->value - 1, resolution)) {
+        myDebug_P(PSTR("Error. Too many Dallas sensor settings"));
+    }
+    return true;
+}
 
-    // send raw
-    if (strcmp(first_cmd, "send") == 0) {
-        ems_sendRawTelegram((char *)&commandLine[5]);
-        ok = true;
+// <sensor #> <seconds>
+bool _cmdDallasInterval(const _Command_Arg * arg) {
+    uint16_t interval = (arg->rest) ? (uint16_t)strtol(arg->rest, 0, 10) : 0;
+    if ((arg->value > EMSESP_Status.dallas_sensors) || (interval == 0)) {
+        return false;
     }
+    if (!ds18.setInterval(arg->value - 1, interval)) {
+        myDebug_P(PSTR("Error. Too many Dallas sensor settings"));
+    }
+    return true;
+}
 
-    // test commands
-    if ((strcmp(first_cmd, "test") == 0) && (wc == 2)) {
-        runUnitTest(_readIntNumber());
-        ok = true;
+// <sensor #> [name]
+bool _cmdDallasName(const _Command_Arg * arg) {
+    if (arg->value > EMSESP_Status.dallas_sensors) {
+        return false;
     }
+    if (ds18.setName(arg->value - 1, (arg->rest) ? arg->rest : "")) {
+        ds18.setPublished(arg->value - 1, false); // publish to the new topic
+    } else {
+        myDebug_P(PSTR("Error. Name is too long, has characters other than a-z, 0-9, _ and -, or too many Dallas sensor settings"));
+    }
+    return true;
+}
+
+bool _cmdDallasDeadband(const _Command_Arg * arg) {
+    EMSESP_Status.dallas_deadband = arg->value; // in 1/16 C
+    return true;
+}
+
+bool _cmdInfo(const _Command_Arg * arg) {
+    myESP.telnetRender(showInfo);
+    return true;
+}
+
+bool _cmdLog(const _Command_Arg * arg) {
+    static const _EMS_SYS_LOGGING levels[] = {EMS_SYS_LOGGING_NONE, EMS_SYS_LOGGING_BASIC, EMS_SYS_LOGGING_THERMOSTAT, EMS_SYS_LOGGING_RAW, EMS_SYS_LOGGING_VERBOSE};
+    ems_setLogging(levels[arg->value]);
+    return true;
+}
 
-    // check for invalid command
-    if (!ok) {
-        myDebug_P(PSTR("Unknown command. Use ? for help."));
+#ifdef TESTS
+bool _cmdTest(const _Command_Arg * arg) {
+    runUnitTest(arg->value);
+    return true;
+}
+#endif
+
+bool _cmdPublish(const _Command_Arg * arg) {
+    publishValues(true);
+    return true;
+}
+
+bool _cmdRefresh(const _Command_Arg * arg) {
+    myDebug_P(PSTR("Fetching data from EMS devices..."));
+    ems_getThermostatValues();
+    ems_getBoilerValues();
+    ems_getOtherValues();
+    return true;
+}
+
+bool _cmdDevices(const _Command_Arg * arg) {
+    myESP.telnetRender(ems_printAllDevices);
+    return true;
+}
+
+bool _cmdQueue(const _Command_Arg * arg) {
+    myESP.telnetRender(ems_printTxQueue);
+    return true;
+}
+
+bool _cmdTypes(const _Command_Arg * arg) {
+    ems_printTypeStats();
+    return true;
+}
+
+bool _cmdPoll(const _Command_Arg * arg) {
+    ems_printPollSchedule();
+    return true;
+}
+
+bool _cmdAutodetect(const _Command_Arg * arg) {
+    if (arg->present) {
+        startDeviceScan();
+    } else {
+        ems_scanDevices();
     }
+    return true;
+}
+
+bool _cmdStartup(const _Command_Arg * arg) {
+    ems_startupTelegrams();
+    return true;
+}
+
+bool _cmdSend(const _Command_Arg * arg) {
+    ems_sendRawTelegram((char *)arg->text);
+    return true;
+}
+
+bool _cmdThermostatRead(const _Command_Arg * arg) {
+    ems_doReadCommand(arg->value, EMS_Thermostat.device_id);
+    return true;
+}
+
+bool _cmdThermostatTemp(const _Command_Arg * arg) {
+    ems_setThermostatTemp(arg->value);
+    publishValues(true); // publish back immediately, can't remember why I do this?!
+    return true;
 }
 
+bool _cmdThermostatNightTemp(const _Command_Arg * arg) {
+    ems_setThermostatTemp(arg->value, 1);
+    return true;
+}
+
+bool _cmdThermostatDayTemp(const _Command_Arg * arg) {
+    ems_setThermostatTemp(arg->value, 2);
+    return true;
+}
+
+bool _cmdThermostatHolidayTemp(const _Command_Arg * arg) {
+    ems_setThermostatTemp(arg->value, 3);
+    return true;
+}
+
+// night, day, auto and the other names for them
+bool _cmdThermostatMode(const _Command_Arg * arg) {
+    static const uint8_t modes[] = {0, 1, 2, 0, 1};
+    ems_setThermostatMode(modes[arg->value]);
+    return true;
+}
+
+bool _cmdThermostatScan(const _Command_Arg * arg) {
+    startThermostatScan(arg->value);
+    return true;
+}
+
+bool _cmdBoilerRead(const _Command_Arg * arg) {
+    ems_doReadCommand(arg->value, EMS_Boiler.device_id);
+    return true;
+}
+
+bool _cmdBoilerWwTemp(const _Command_Arg * arg) {
+    ems_setWarmWaterTemp(arg->value);
+    publishValues(true); // publish back immediately, can't remember why I do this?!
+    return true;
+}
+
+bool _cmdBoilerWwActivated(const _Command_Arg * arg) {
+    ems_setWarmWaterActivated(arg->value);
+    return true;
+}
+
+bool _cmdBoilerTapWater(const _Command_Arg * arg) {
+    ems_setWarmTapWaterActivated(arg->value);
+    return true;
+}
+
+bool _cmdBoilerFlowTemp(const _Command_Arg * arg) {
+    ems_setFlowTemp(arg->value);
+    return true;
+}
+
+// hot, eco, intelligent, and comfort as another name for eco
+bool _cmdBoilerComfort(const _Command_Arg * arg) {
+    static const uint8_t modes[] = {1, 2, 3, 2};
+    ems_setWarmWaterModeComfort(modes[arg->value]);
+    return true;
+}
+
+// the test telegrams of test_data.h, only built with TESTS
+#ifdef TESTS
+#define PROJECT_TEST_COMMANDS(_) \
+    _(CMD_RANGE, test, CMD_ARG_INT, 0, 0, 0xFF, _cmdTest, "<n>", "insert a test telegram on to the EMS bus")
+#else
+#define PROJECT_TEST_COMMANDS(_)
+#endif
+
+// the settings are listed by 'set'. Every command is also an MQTT topic of its name
+#define PROJECT_COMMANDS(_)                                                                                                                                    \
+    _(CMD, led, CMD_ARG_BOOL, CMD_SETTING, _cmdLed, "<on | off>", "toggle status LED on/off")                                                                  \
+    _(CMD_RANGE, led_gpio, CMD_ARG_INT, CMD_SETTING, 0, 16, _cmdLedGpio, "<gpio>", "set the LED pin. Default is the onboard LED (D1=5)")                       \
+    _(CMD_RANGE, dallas_gpio, CMD_ARG_INT, CMD_SETTING, 0, 16, _cmdDallasGpio, "<gpio> [gpio] [gpio]", "set the pins for external Dallas temperature sensors (D5=14), one bus per pin") \
+    _(CMD, dallas_parasite, CMD_ARG_BOOL, CMD_SETTING, _cmdDallasParasite, "<on | off>", "set to on if powering Dallas via parasite")                          \
+    _(CMD_RANGE, thermostat_type, CMD_ARG_HEX, CMD_SETTING | CMD_OPTIONAL, 0, 0xFF, _cmdThermostatType, "<device ID>", "set the thermostat type id (e.g. 10 for 0x10)") \
+    _(CMD_RANGE, boiler_type, CMD_ARG_HEX, CMD_SETTING | CMD_OPTIONAL, 0, 0xFF, _cmdBoilerType, "<device ID>", "set the boiler type id (e.g. 8 for 0x08)")     \
+    _(CMD, listen_mode, CMD_ARG_BOOL, CMD_SETTING, _cmdListenMode, "<on | off>", "when on all automatic Tx is disabled")                                       \
+    _(CMD, shower_timer, CMD_ARG_BOOL, CMD_SETTING | CMD_OPTIONAL, _cmdShowerTimer, "<on | off>", "notify via MQTT all shower durations. No value toggles it") \
+    _(CMD, shower_alert, CMD_ARG_BOOL, CMD_SETTING | CMD_OPTIONAL, _cmdShowerAlert, "<on | off>", "send a warning of cold water after shower time is exceeded. No value toggles it") \
+    _(CMD_RANGE, publish_wait, CMD_ARG_INT, CMD_SETTING, 0, 0xFFFF, _cmdPublishWait, "<seconds>", "set frequency for publishing to MQTT")                      \
+    _(CMD_RANGE, heating_circuit, CMD_ARG_INT, CMD_SETTING, 1, 2, _cmdHeatingCircuit, "<1 | 2>", "set the thermostat HC to work with if using multiple heating circuits") \
+    _(CMD_RANGE, poll_interval, CMD_ARG_HEX, CMD_SETTING, 1, 0xFFFF, _cmdPollInterval, "<type ID> <seconds>", "set how long before values of a type are fetched again (0=never)") \
+    _(CMD_RANGE, dallas_resolution, CMD_ARG_INT, CMD_SETTING, 1, 0xFF, _cmdDallasResolution, "<sensor #> <9-12>", "set the resolution of a Dallas sensor in bits (12=0.0625C, 750ms)") \
+    _(CMD_RANGE, dallas_interval, CMD_ARG_INT, CMD_SETTING, 1, 0xFF, _cmdDallasInterval, "<sensor #> <seconds>", "set how often a Dallas sensor is read")      \
+    _(CMD_RANGE, dallas_name, CMD_ARG_INT, CMD_SETTING, 1, 0xFF, _cmdDallasName, "<sensor #> [name]", "name a Dallas sensor, it's published to sensors/<name>. No name to use its address") \
+    _(CMD_FIXED, dallas_deadband, CMD_SETTING, FP_SIXTEENTH, 0, 0xFF, _cmdDallasDeadband, "<C>", "set how much a Dallas sensor has to change before it's published again") \
+                                                                                                                                                               \
+    _(CMD, info, CMD_ARG_NONE, 0, _cmdInfo, "", "show data captured on the EMS bus")                                                                           \
+    _(CMD, log, CMD_ARG_CHOICE, 0, _cmdLog, "<n | b | t | r | v>", "set logging mode to none, basic, thermostat only, raw or verbose")                         \
+    PROJECT_TEST_COMMANDS(_)                                                                                                                                   \
+                                                                                                                                                               \
+    _(CMD, publish, CMD_ARG_NONE, 0, _cmdPublish, "", "publish all values to MQTT")                                                                            \
+    _(CMD, refresh, CMD_ARG_NONE, 0, _cmdRefresh, "", "fetch values from the EMS devices")                                                                     \
+    _(CMD, devices, CMD_ARG_NONE, 0, _cmdDevices, "", "list all supported and detected EMS devices and types IDs")                                             \
+    _(CMD, queue, CMD_ARG_NONE, 0, _cmdQueue, "", "show current Tx queue")                                                                                     \
+    _(CMD, types, CMD_ARG_NONE, 0, _cmdTypes, "", "show # telegrams and processing time per EMS type")                                                         \
+    _(CMD, poll, CMD_ARG_NONE, 0, _cmdPoll, "", "show the poll schedule and learned broadcast intervals")                                                      \
+    _(CMD, autodetect, CMD_ARG_CHOICE, CMD_OPTIONAL, _cmdAutodetect, "[deep]", "detect EMS devices and attempt to automatically set boiler and thermostat types") \
+    _(CMD, startup, CMD_ARG_NONE, 0, _cmdStartup, "", "send the startup telegrams to the EMS devices")                                                         \
+    _(CMD, shower_coldshot, CMD_ARG_NONE, 0, _cmdShowerColdShot, "", "send a shot of cold water, if the shower alert is on")                                   \
+    _(CMD, send, CMD_ARG_TEXT, 0, _cmdSend, "XX ...", "send raw telegram data as hex to EMS bus")                                                              \
+    _(CMD_RANGE, thermostat_read, CMD_ARG_HEX, 0, 0, 0xFFFF, _cmdThermostatRead, "<type ID>", "send read request to the thermostat")                           \
+    _(CMD_FIXED, thermostat_temp, 0, FP_HALF, 0, 0xFF, _cmdThermostatTemp, "<degrees>", "set current thermostat temperature")                                  \
+    _(CMD_FIXED, thermostat_nighttemp, 0, FP_HALF, 0, 0xFF, _cmdThermostatNightTemp, "<degrees>", "set the thermostat night temperature (RC35)")               \
+    _(CMD_FIXED, thermostat_daytemp, 0, FP_HALF, 0, 0xFF, _cmdThermostatDayTemp, "<degrees>", "set the thermostat day temperature (RC35)")                     \
+    _(CMD_FIXED, thermostat_holidaytemp, 0, FP_HALF, 0, 0xFF, _cmdThermostatHolidayTemp, "<degrees>", "set the thermostat holiday temperature (RC35)")         \
+    _(CMD, thermostat_mode, CMD_ARG_CHOICE, 0, _cmdThermostatMode, "<night | day | auto | off | manual>", "set mode (0=low/night, 1=manual/day, 2=auto)")      \
+    _(CMD_RANGE, thermostat_scan, CMD_ARG_INT, 0, 0, 0xFF, _cmdThermostatScan, "<type ID>", "probe thermostat on all type id responses")                       \
+    _(CMD_RANGE, boiler_read, CMD_ARG_HEX, 0, 0, 0xFFFF, _cmdBoilerRead, "<type ID>", "send read request to boiler")                                           \
+    _(CMD_RANGE, boiler_wwtemp, CMD_ARG_INT, 0, 0, 0xFF, _cmdBoilerWwTemp, "<degrees>", "set boiler warm water temperature")                                   \
+    _(CMD, boiler_wwactivated, CMD_ARG_BOOL, 0, _cmdBoilerWwActivated, "<on | off>", "set boiler warm water on/off")                                           \
+    _(CMD, boiler_tapwater, CMD_ARG_BOOL, 0, _cmdBoilerTapWater, "<on | off>", "set boiler warm tap water on/off")                                             \
+    _(CMD_RANGE, boiler_flowtemp, CMD_ARG_INT, 0, 0, 0xFF, _cmdBoilerFlowTemp, "<degrees>", "set boiler flow temperature")                                     \
+    _(CMD, boiler_comfort, CMD_ARG_CHOICE, 0, _cmdBoilerComfort, "<hot | eco | intelligent | comfort>", "set boiler warm water comfort setting, comfort is the same as eco")
+
+CMD_STRINGS(PROJECT_COMMANDS)
+
+constexpr _Command project_cmds[] PROGMEM = {CMD_ENTRIES(PROJECT_COMMANDS)};
+
+static_assert(cmd_unique(project_cmds), "two commands have the same name or hash");
+
+// how the topics are published, telemetry with QoS 0 and at most 3 back to back then one every 2 seconds,
+// state with QoS 1 and retained so a client that connects later gets it. Telemetry is low priority, it waits
+// while WiFi is slow so the state gets through. See MyESP_MQTTPolicy
+constexpr MyESP_MQTTPolicy project_policies[] PROGMEM = {
+
+    MQTT_POLICY(TOPIC_BOILER_DATA, 0, false, MQTT_PRIORITY_LOW, 3, 2000),
+    MQTT_POLICY(TOPIC_THERMOSTAT_DATA, 0, false, MQTT_PRIORITY_LOW, 3, 2000),
+    MQTT_POLICY(TOPIC_SM_DATA, 0, false, MQTT_PRIORITY_LOW, 3, 2000),
+    MQTT_POLICY(TOPIC_HP_DATA, 0, false, MQTT_PRIORITY_LOW, 3, 2000),
+    MQTT_POLICY(TOPIC_EXTERNAL_SENSORS "/", 0, false, MQTT_PRIORITY_LOW, 0, 0), // already limited by the deadband
+    MQTT_POLICY(TOPIC_BOILER_TAPWATER_ACTIVE, 1, true, MQTT_PRIORITY_HIGH, 0, 0),
+    MQTT_POLICY(TOPIC_BOILER_HEATING_ACTIVE, 1, true, MQTT_PRIORITY_HIGH, 0, 0),
+    MQTT_POLICY(TOPIC_SHOWER_TIMER, 1, true, MQTT_PRIORITY_HIGH, 0, 0),
+    MQTT_POLICY(TOPIC_SHOWER_ALERT, 1, true, MQTT_PRIORITY_HIGH, 0, 0),
+    MQTT_POLICY(TOPIC_SHOWERTIME, 1, false, MQTT_PRIORITY_HIGH, 0, 0)
+
+};
+
+// the MQTT topics of older versions, they still work below cmd/
+#define PROJECT_ALIASES(_)                                      \
+    _(TOPIC_THERMOSTAT_CMD_TEMP, thermostat_temp)               \
+    _(TOPIC_THERMOSTAT_CMD_MODE, thermostat_mode)               \
+    _(TOPIC_THERMOSTAT_CMD_HC, heating_circuit)                 \
+    _(TOPIC_THERMOSTAT_CMD_HOLIDAYTEMP, thermostat_holidaytemp) \
+    _(TOPIC_BOILER_WWACTIVATED, boiler_wwactivated)             \
+    _(TOPIC_BOILER_CMD_WWTEMP, boiler_wwtemp)                   \
+    _(TOPIC_BOILER_CMD_COMFORT, boiler_comfort)
+
+CMD_ALIAS_STRINGS(PROJECT_ALIASES)
+
+constexpr _Command_Alias project_aliases[] PROGMEM = {CMD_ALIASES(PROJECT_ALIASES)};
+
 // OTA callback when the OTA process starts
 // so we can disable the EMS to avoid any noise
 void OTACallback_pre() {
@@ -1423,137 +1599,61 @@ void OTACallback_post() {
     emsuart_start();
 }
 
-// MQTT Callback to handle incoming/outgoing changes
-void MQTTCallback(unsigned int type, const char * topic, const char * message) {
-    // we're connected. lets subscribe to some topics
-    if (type == MQTT_CONNECT_EVENT) {
-        myESP.mqttSubscribe(TOPIC_THERMOSTAT_CMD_TEMP);
-        myESP.mqttSubscribe(TOPIC_THERMOSTAT_CMD_MODE);
-        myESP.mqttSubscribe(TOPIC_BOILER_WWACTIVATED);
-        myESP.mqttSubscribe(TOPIC_BOILER_CMD_WWTEMP);
-        myESP.mqttSubscribe(TOPIC_BOILER_CMD_COMFORT);
-        myESP.mqttSubscribe(TOPIC_SHOWER_TIMER);
-        myESP.mqttSubscribe(TOPIC_SHOWER_ALERT);
-        myESP.mqttSubscribe(TOPIC_SHOWER_COLDSHOT);
-        myESP.mqttSubscribe(TOPIC_THERMOSTAT_CMD_HC);
-        myESP.mqttSubscribe(TOPIC_THERMOSTAT_CMD_DAYTEMP);
-        myESP.mqttSubscribe(TOPIC_THERMOSTAT_CMD_NIGHTTEMP);
-        myESP.mqttSubscribe(TOPIC_THERMOSTAT_CMD_HOLIDAYTEMP);
-
-        // publish the status of the Shower parameters
-        myESP.mqttPublish(TOPIC_SHOWER_TIMER, EMSESP_Status.shower_timer ? "1" : "0");
-        myESP.mqttPublish(TOPIC_SHOWER_ALERT, EMSESP_Status.shower_alert ? "1" : "0");
+// Metrics callback, adds the EMS bus counters to the /metrics page
+// rendered in parts, step counts up from 0. Returns true while there are more
+bool MetricsCallback(uint16_t step) {
+    static uint8_t next = 0; // next EMS type to list
+
+    if (step == 0) {
+        myESP.metricsAdd(PSTR("ems_rx_telegrams_total"), PSTR("counter"), PSTR("Telegrams received"), EMS_Sys_Status.emsRxPgks);
+        myESP.metricsAdd(PSTR("ems_tx_telegrams_total"), PSTR("counter"), PSTR("Telegrams sent"), EMS_Sys_Status.emsTxPkgs);
+        myESP.metricsAdd(PSTR("ems_crc_errors_total"), PSTR("counter"), PSTR("Telegrams received with a CRC error"), EMS_Sys_Status.emxCrcErr);
+        myESP.metricsAdd(PSTR("ems_rx_filtered_total"), PSTR("counter"), PSTR("Telegrams discarded by the Rx filter"), EMS_Sys_Status.emsRxFiltered);
+        myESP.metricsAdd(PSTR("ems_poll_frequency_microseconds"), PSTR("gauge"), PSTR("Time between polls from the bus master"), ems_getPollFrequency());
+        myESP.metricsAdd(PSTR("ems_tx_queue_depth"), PSTR("gauge"), PSTR("Telegrams waiting in the Tx queue"), (uint32_t)ems_getTxQueueSize());
+        myESP.metricsAdd(PSTR("ems_bus_connected"), PSTR("gauge"), PSTR("1 if the EMS bus is connected"), (uint32_t)EMS_Sys_Status.emsBusConnected);
+        myESP.metricsAdd(PSTR("ems_tx_capable"), PSTR("gauge"), PSTR("1 if we can send on the EMS bus"), (uint32_t)ems_getTxCapable());
+
+        next = 0;
+        myESP.metricsHeader(PSTR("ems_type_telegrams_total"), PSTR("counter"), PSTR("Telegrams received per EMS type"));
+        return true;
     }
 
-    // handle incoming MQTT publish events
-    if (type == MQTT_MESSAGE_EVENT) {
-        // thermostat temp changes
-        if (strcmp(topic, TOPIC_THERMOSTAT_CMD_TEMP) == 0) {
-            float f     = strtof((char *)message, 0);
-            char  s[10] = {0};
-            myDebug_P(PSTR("MQTT topic: thermostat temperature value %s"), _float_to_char(s, f));
-            ems_setThermostatTemp(f);
-            publishValues(true); // publish back immediately, can't remember why I do this?!
-        }
-
-        // thermostat mode changes
-        if (strcmp(topic, TOPIC_THERMOSTAT_CMD_MODE) == 0) {
-            myDebug_P(PSTR("MQTT topic: thermostat mode value %s"), message);
-            if (strcmp((char *)message, "auto") == 0) {
-                ems_setThermostatMode(2);
-            } else if (strcmp((char *)message, "day") == 0 || strcmp((char *)message, "manual") == 0) {
-                ems_setThermostatMode(1);
-            } else if (strcmp((char *)message, "night") == 0 || strcmp((char *)message, "off") == 0) {
-                ems_setThermostatMode(0);
-            }
-        }
-
-        // thermostat heating circuit change
-        if (strcmp(topic, TOPIC_THERMOSTAT_CMD_HC) == 0) {
-            myDebug_P(PSTR("MQTT topic: thermostat heating circuit value %s"), message);
-            uint8_t hc = atoi((char *)message);
-            if ((hc >= 1) && (hc <= 2)) {
-                EMSESP_Status.heating_circuit = hc;
-                ems_setThermostatHC(hc);
-            }
-        }
-
-        // set night temp value
-        if (strcmp(topic, TOPIC_THERMOSTAT_CMD_NIGHTTEMP) == 0) {
-            float f     = strtof((char *)message, 0);
-            char  s[10] = {0};
-            myDebug_P(PSTR("MQTT topic: new thermostat night temperature value %s"), _float_to_char(s, f));
-            ems_setThermostatTemp(f, 1);
-        }
-
-        // set daytemp value
-        if (strcmp(topic, TOPIC_THERMOSTAT_CMD_DAYTEMP) == 0) {
-            float f     = strtof((char *)message, 0);
-            char  s[10] = {0};
-            myDebug_P(PSTR("MQTT topic: new thermostat day temperature value %s"), _float_to_char(s, f));
-            ems_setThermostatTemp(f, 2);
-        }
-
-        // set holiday value
-        if (strcmp(topic, TOPIC_THERMOSTAT_CMD_HOLIDAYTEMP) == 0) {
-            float f     = strtof((char *)message, 0);
-            char  s[10] = {0};
-            myDebug_P(PSTR("MQTT topic: new thermostat holiday temperature value %s"), _float_to_char(s, f));
-            ems_setThermostatTemp(f, 3);
-        }
-
-        // wwActivated
-        if (strcmp(topic, TOPIC_BOILER_WWACTIVATED) == 0) {
-            if (message[0] == '1' || strcmp(message, "on") == 0) {
-                ems_setWarmWaterActivated(true);
-            } else if (message[0] == '0' || strcmp(message, "off") == 0) {
-                ems_setWarmWaterActivated(false);
-            }
-        }
+    // per type, only the ones we've seen. METRICS_LINES at a time
+    char     typeString[50];
+    char     labels[80];
+    uint16_t type;
+    uint32_t count;
+    uint8_t  lines = 0;
 
-        // boiler wwtemp changes
-        if (strcmp(topic, TOPIC_BOILER_CMD_WWTEMP) == 0) {
-            uint8_t t = atoi((char *)message);
-            myDebug_P(PSTR("MQTT topic: boiler warm water temperature value %d"), t);
-            ems_setWarmWaterTemp(t);
-            publishValues(true); // publish back immediately, can't remember why I do this?!
+    while ((lines < METRICS_LINES) && ems_getTypeCount(next, &type, typeString, sizeof(typeString), &count)) {
+        next++;
+        if (count != 0) {
+            snprintf(labels, sizeof(labels), "type=\"0x%02X\",name=\"%s\"", type, typeString);
+            myESP.metricsValue(PSTR("ems_type_telegrams_total"), labels, count);
+            lines++;
         }
+    }
 
-        // boiler ww comfort setting
-        if (strcmp(topic, TOPIC_BOILER_CMD_COMFORT) == 0) {
-            myDebug_P(PSTR("MQTT topic: boiler warm water comfort value is %s"), message);
-            if (strcmp((char *)message, "hot") == 0) {
-                ems_setWarmWaterModeComfort(1);
-            } else if (strcmp((char *)message, "comfort") == 0) {
-                ems_setWarmWaterModeComfort(2);
-            } else if (strcmp((char *)message, "intelligent") == 0) {
-                ems_setWarmWaterModeComfort(3);
-            }
-        }
+    if (lines == METRICS_LINES) {
+        return true; // there may be more
+    }
 
-        // shower timer
-        if (strcmp(topic, TOPIC_SHOWER_TIMER) == 0) {
-            if (message[0] == '1') {
-                EMSESP_Status.shower_timer = true;
-            } else if (message[0] == '0') {
-                EMSESP_Status.shower_timer = false;
-            }
-            set_showerTimer();
-        }
+    myESP.metricsAdd(PSTR("ems_unknown_telegrams_total"), PSTR("counter"), PSTR("Telegrams received with an unknown type"), ems_getUnknownTypeCount());
+    return false;
+}
 
-        // shower alert
-        if (strcmp(topic, TOPIC_SHOWER_ALERT) == 0) {
-            if (message[0] == '1') {
-                EMSESP_Status.shower_alert = true;
-            } else if (message[0] == '0') {
-                EMSESP_Status.shower_alert = false;
-            }
-            set_showerAlert();
-        }
+// MQTT Callback on connect and disconnect, the messages are commands under cmd/ and run by MyESP
+void MQTTCallback(unsigned int type, const char * topic, const char * message) {
+    // we're connected, MyESP has subscribed to the commands
+    if (type == MQTT_CONNECT_EVENT) {
+        // publish the status of the Shower parameters
+        myESP.mqttPublish(TOPIC_SHOWER_TIMER, EMSESP_Status.shower_timer ? "1" : "0");
+        myESP.mqttPublish(TOPIC_SHOWER_ALERT, EMSESP_Status.shower_alert ? "1" : "0");
 
-        // shower cold shot
-        if (strcmp(topic, TOPIC_SHOWER_COLDSHOT) == 0) {
-            _showerColdShotStart();
+        // publish all Dallas sensors again with the next values
+        for (uint8_t i = 0; i < EMSESP_Status.dallas_sensors; i++) {
+            ds18.setPublished(i, false);
         }
     }
 }
@@ -1576,7 +1676,7 @@ void WIFICallback() {
 }
 
 // Initialize the boiler settings and shower settings
-// Most of these will be overwritten after the SPIFFS config file is loaded
+// Most of these will be overwritten after the config is loaded
 void initEMSESP() {
     // general settings
     EMSESP_Status.shower_timer    = false;
@@ -1587,7 +1687,9 @@ void initEMSESP() {
     EMSESP_Status.timestamp       = millis();
     EMSESP_Status.dallas_sensors  = 0;
     EMSESP_Status.led_gpio        = EMSESP_LED_GPIO;
-    EMSESP_Status.dallas_gpio     = EMSESP_DALLAS_GPIO;
+    EMSESP_Status.dallas_deadband = DS18_DEFAULT_DEADBAND;
+    memset(EMSESP_Status.dallas_gpio, 0, sizeof(EMSESP_Status.dallas_gpio));
+    EMSESP_Status.dallas_gpio[0] = EMSESP_DALLAS_GPIO;
     EMSESP_Status.heating_circuit = 1; // default heating circuit to HC1
 
     // shower settings
@@ -1673,26 +1775,38 @@ void setup() {
     // call ems.cpp's init function to set all the internal params
     ems_init();
 
+    // bring back the last known EMS values after a soft reset
+    bool restored = ems_restoreSnapshot();
+
     systemCheckTimer.attach(SYSTEMCHECK_TIME, do_systemCheck); // check if Boiler is online
+    snapshotTimer.attach(SNAPSHOT_TIME, ems_saveSnapshot);     // save EMS values to RTC memory
 
     // set up myESP for Wifi, MQTT, MDNS and Telnet
-    myESP.setTelnet(project_cmds, ArraySize(project_cmds), TelnetCommandCallback, TelnetCallback); // set up Telnet commands
+    myESP.setTelnet(project_cmds, ArraySize(project_cmds), project_aliases, ArraySize(project_aliases), TelnetCallback); // set up Telnet and MQTT commands
     myESP.setWIFI(NULL, NULL, WIFICallback);
 
-    // MQTT host, username and password taken from the SPIFFS settings
+    // MQTT host, username and password taken from the stored config
     myESP.setMQTT(
         NULL, NULL, NULL, MQTT_BASE, MQTT_KEEPALIVE, MQTT_QOS, MQTT_RETAIN, MQTT_WILL_TOPIC, MQTT_WILL_ONLINE_PAYLOAD, MQTT_WILL_OFFLINE_PAYLOAD, MQTTCallback);
+    myESP.setMQTTPolicies(project_policies, ArraySize(project_policies));
 
     // OTA callback which is called when OTA is starting and stopping
     myESP.setOTA(OTACallback_pre, OTACallback_post);
 
-    // custom settings in SPIFFS
-    myESP.setSettings(FSCallback, SettingsCallback);
+    // custom settings in the config
+    myESP.setSettings(FSCallback, SettingsCallback, ConfigCallback);
+
+    // EMS counters on the /metrics page
+    myESP.setMetrics(MetricsCallback);
 
     // start up all the services
     myESP.begin(APP_HOSTNAME, APP_NAME, APP_VERSION);
 
-    // at this point we have all the settings from our internall SPIFFS config file
+    if (restored) {
+        myDebug_P(PSTR("Restored the EMS values from before the reset"));
+    }
+
+    // at this point we have all the settings from our stored config
 
     // enable regular checks if not in test mode
     if (!EMSESP_Status.listen_mode) {
@@ -1709,28 +1823,43 @@ void setup() {
     }
 
     // check for Dallas sensors
-    EMSESP_Status.dallas_sensors = ds18.setup(EMSESP_Status.dallas_gpio, EMSESP_Status.dallas_parasite); // returns #sensors
+    uint32_t heap                = ESP.getFreeHeap();
+    EMSESP_Status.dallas_sensors = ds18.setup(EMSESP_Status.dallas_gpio, DS18_BUSES_MAX, EMSESP_Status.dallas_parasite); // returns #sensors
+    myESP.heapTrack(MYESP_HEAP_DS18, heap);
 }
 
 //
 // Main loop
 //
 void loop() {
+    TRACE_BEGIN(TRACE_LOOP, "loop");
     EMSESP_Status.timestamp = millis();
 
     // the main loop
     myESP.loop();
 
-    // check Dallas sensors, every 2 seconds
+    // check Dallas sensors, each at its own interval
     // these values are published to MQTT separately via the timer publishSensorValuesTimer
     if (EMSESP_Status.dallas_sensors != 0) {
+        uint32_t heap = ESP.getFreeHeap();
+        uint32_t cpu  = myESP.cpuStart();
+        TRACE_BEGIN(TRACE_LOOP, "ds18.loop");
         ds18.loop();
+        TRACE_END(TRACE_LOOP, "ds18.loop");
+        myESP.cpuTrack(MYESP_CPU_DS18, cpu);
+        myESP.heapTrack(MYESP_HEAP_DS18, heap);
     }
 
     // publish the values to MQTT, only if the values have changed
     // although we don't want to publish when doing a deep scan of the thermostat
     if (ems_getEmsRefreshed() && (scanThermostat_count == 0) && (!EMSESP_Status.listen_mode)) {
+        uint32_t heap = ESP.getFreeHeap();
+        uint32_t cpu  = myESP.cpuStart();
+        TRACE_BEGIN(TRACE_LOOP, "publishValues");
         publishValues(false);
+        TRACE_END(TRACE_LOOP, "publishValues");
+        myESP.cpuTrack(MYESP_CPU_PUBLISH, cpu);
+        myESP.heapTrack(MYESP_HEAP_JSON, heap);
         ems_setEmsRefreshed(false); // reset
     }
 
@@ -1739,6 +1868,8 @@ void loop() {
         showerCheck();
     }
 
+    TRACE_END(TRACE_LOOP, "loop");
+
     if (EMSESP_DELAY != 0) {
         delay(EMSESP_DELAY); // some time to WiFi and everything else to catch up, and prevent overheating
     }
@@ -10,9 +10,11 @@
 #include "ems_devices.h"
 #include "emsuart.h"
 #include <Arduino.h>
+#include <CRC32.h>          // https://github.com/bakercp/CRC32
 #include <CircularBuffer.h> // https://github.com/rlogiacco/CircularBuffer
+#include <FixedPoint.h>
 #include <MyESP.h>
-#include <list> // std::list
+#include <Trace.h>
 
 #ifdef TESTS
 #include "test_data.h"
@@ -23,12 +25,29 @@ uint8_t _TEST_DATA_max = ArraySize(TEST_DATA);
 #define myDebug(...) myESP.myDebug(__VA_ARGS__)
 #define myDebug_P(...) myESP.myDebug_P(__VA_ARGS__)
 
-_EMS_Sys_Status EMS_Sys_Status; // EMS Status
+_EMS_Sys_Status EMS_Sys_Status;        // EMS Status
+_EMS_RxFilter   EMS_RxFilter = {true}; // which telegrams the UART interrupt handler passes on, all until ems_init() has built it
 
 CircularBuffer<_EMS_TxTelegram, EMS_TX_TELEGRAM_QUEUE_MAX> EMS_TxQueue; // FIFO queue for Tx send buffer
 
-// for storing all detected EMS devices
-std::list<_Generic_Type> Devices;
+// registry of all EMS devices, detected or just seen on the bus, indexed by device ID
+_EMS_Device EMS_Devices[EMS_DEVICES_MAX];
+
+// state of the device discovery
+_EMS_Discovery EMS_Discovery;
+
+// millis() when each group of decoded values was last updated from the bus, 0 if not yet
+uint32_t EMS_ValuesTimestamp[EMS_VALUES_MAX];
+
+// age in seconds at boot of the values restored from the RTC memory snapshot, EMS_SNAPSHOT_AGE_NEVER if none
+uint16_t EMS_ValuesRestoredAge[EMS_VALUES_MAX];
+
+static_assert(sizeof(_EMS_Snapshot) <= (RTCMEM_APP_BLOCKS * 4u), "EMS snapshot is too big for the RTC memory");
+
+// poll schedule, entries are added the first time a (device, type) is requested
+_EMS_Poll         EMS_Poll[EMS_POLL_MAX];
+uint8_t           EMS_Poll_count = 0;
+_EMS_PollInterval EMS_PollIntervals[EMS_POLL_INTERVALS_MAX]; // per-type overrides of EMS_POLL_INTERVAL_DEFAULT
 
 // macros used in the _process* functions
 #define _toByte(i) (EMS_RxTelegram->data[i])
@@ -52,6 +71,11 @@ void _process_UBATotalUptimeMessage(_EMS_RxTelegram * EMS_RxTelegram);
 void _process_UBAParametersMessage(_EMS_RxTelegram * EMS_RxTelegram);
 void _process_SetPoints(_EMS_RxTelegram * EMS_RxTelegram);
 
+// data points
+uint8_t * _ems_dataPointStruct(uint8_t values);
+void      _ems_clearDataPoints();
+void      _ems_decodeDataPoints(_EMS_RxTelegram * EMS_RxTelegram);
+
 // SM10
 void _process_SM10Monitor(_EMS_RxTelegram * EMS_RxTelegram);
 
@@ -101,83 +125,123 @@ void _process_RCPLUSStatusMode(_EMS_RxTelegram * EMS_RxTelegram);
 // Junkers FR10 & FW100
 void _process_JunkersStatusMessage(_EMS_RxTelegram * EMS_RxTelegram);
 
+// names of the EMS types, in flash. Models that share a type share its name
+#define EMS_TYPE_NAME(name) PROGMEM const char ems_type_##name[] = #name;
+EMS_TYPE_NAME(Version)
+EMS_TYPE_NAME(UBAMonitorFast)
+EMS_TYPE_NAME(UBAMonitorSlow)
+EMS_TYPE_NAME(UBAMonitorWWMessage)
+EMS_TYPE_NAME(UBAParameterWW)
+EMS_TYPE_NAME(UBATotalUptimeMessage)
+EMS_TYPE_NAME(UBAMaintenanceSettingsMessage)
+EMS_TYPE_NAME(UBAParametersMessage)
+EMS_TYPE_NAME(UBASetPoints)
+EMS_TYPE_NAME(SM10Monitor)
+EMS_TYPE_NAME(SM100Monitor)
+EMS_TYPE_NAME(SM100Status)
+EMS_TYPE_NAME(SM100Status2)
+EMS_TYPE_NAME(SM100Energy)
+EMS_TYPE_NAME(HeatPumpMonitor1)
+EMS_TYPE_NAME(HeatPumpMonitor2)
+EMS_TYPE_NAME(ISM1StatusMessage)
+EMS_TYPE_NAME(RCTime)
+EMS_TYPE_NAME(RC10Set)
+EMS_TYPE_NAME(RC10StatusMessage)
+EMS_TYPE_NAME(RCOutdoorTempMessage)
+EMS_TYPE_NAME(RC20Set)
+EMS_TYPE_NAME(RC20StatusMessage)
+EMS_TYPE_NAME(RC30Set)
+EMS_TYPE_NAME(RC30StatusMessage)
+EMS_TYPE_NAME(RC35Set_HC1)
+EMS_TYPE_NAME(RC35StatusMessage_HC1)
+EMS_TYPE_NAME(RC35Set_HC2)
+EMS_TYPE_NAME(RC35StatusMessage_HC2)
+EMS_TYPE_NAME(RC35Set)
+EMS_TYPE_NAME(RC35StatusMessage)
+EMS_TYPE_NAME(EasyStatusMessage)
+EMS_TYPE_NAME(RCPLUSStatusMessage)
+EMS_TYPE_NAME(RCPLUSSetMessage)
+EMS_TYPE_NAME(RCPLUSStatusHeating)
+EMS_TYPE_NAME(RCPLUSStatusMode)
+EMS_TYPE_NAME(JunkersStatusMessage)
+
 /**
  * Recognized EMS types and the functions they call to process the telegrams
  * Format: MODEL ID, TYPE ID, Description, function, emsplus
+ * Stored in flash (PROGMEM)
  */
-const _EMS_Type EMS_Types[] = {
+const _EMS_Type EMS_Types[] PROGMEM = {
 
     // common
-    {EMS_MODEL_ALL, EMS_TYPE_Version, "Version", _process_Version},
+    {EMS_MODEL_ALL, EMS_TYPE_Version, ems_type_Version, _process_Version},
 
     // Boiler commands
-    {EMS_MODEL_UBA, EMS_TYPE_UBAMonitorFast, "UBAMonitorFast", _process_UBAMonitorFast},
-    {EMS_MODEL_UBA, EMS_TYPE_UBAMonitorSlow, "UBAMonitorSlow", _process_UBAMonitorSlow},
-    {EMS_MODEL_UBA, EMS_TYPE_UBAMonitorWWMessage, "UBAMonitorWWMessage", _process_UBAMonitorWWMessage},
-    {EMS_MODEL_UBA, EMS_TYPE_UBAParameterWW, "UBAParameterWW", _process_UBAParameterWW},
-    {EMS_MODEL_UBA, EMS_TYPE_UBATotalUptimeMessage, "UBATotalUptimeMessage", _process_UBATotalUptimeMessage},
-    {EMS_MODEL_UBA, EMS_TYPE_UBAMaintenanceSettingsMessage, "UBAMaintenanceSettingsMessage", NULL},
-    {EMS_MODEL_UBA, EMS_TYPE_UBAParametersMessage, "UBAParametersMessage", _process_UBAParametersMessage},
-    {EMS_MODEL_UBA, EMS_TYPE_UBASetPoints, "UBASetPoints", _process_SetPoints},
+    {EMS_MODEL_UBA, EMS_TYPE_UBAMonitorFast, ems_type_UBAMonitorFast, _process_UBAMonitorFast},
+    {EMS_MODEL_UBA, EMS_TYPE_UBAMonitorSlow, ems_type_UBAMonitorSlow, _process_UBAMonitorSlow},
+    {EMS_MODEL_UBA, EMS_TYPE_UBAMonitorWWMessage, ems_type_UBAMonitorWWMessage, _process_UBAMonitorWWMessage},
+    {EMS_MODEL_UBA, EMS_TYPE_UBAParameterWW, ems_type_UBAParameterWW, _process_UBAParameterWW},
+    {EMS_MODEL_UBA, EMS_TYPE_UBATotalUptimeMessage, ems_type_UBATotalUptimeMessage, _process_UBATotalUptimeMessage},
+    {EMS_MODEL_UBA, EMS_TYPE_UBAMaintenanceSettingsMessage, ems_type_UBAMaintenanceSettingsMessage, NULL},
+    {EMS_MODEL_UBA, EMS_TYPE_UBAParametersMessage, ems_type_UBAParametersMessage, _process_UBAParametersMessage},
+    {EMS_MODEL_UBA, EMS_TYPE_UBASetPoints, ems_type_UBASetPoints, _process_SetPoints},
 
     // Other devices
-    {EMS_MODEL_OTHER, EMS_TYPE_SM10Monitor, "SM10Monitor", _process_SM10Monitor},
-    {EMS_MODEL_OTHER, EMS_TYPE_SM100Monitor, "SM100Monitor", _process_SM100Monitor},
-    {EMS_MODEL_OTHER, EMS_TYPE_SM100Status, "SM100Status", _process_SM100Status},
-    {EMS_MODEL_OTHER, EMS_TYPE_SM100Status2, "SM100Status2", _process_SM100Status2},
-    {EMS_MODEL_OTHER, EMS_TYPE_SM100Energy, "SM100Energy", _process_SM100Energy},
-    {EMS_MODEL_OTHER, EMS_TYPE_HPMonitor1, "HeatPumpMonitor1", _process_HPMonitor1},
-    {EMS_MODEL_OTHER, EMS_TYPE_HPMonitor2, "HeatPumpMonitor2", _process_HPMonitor2},
-    {EMS_MODEL_OTHER, EMS_TYPE_ISM1StatusMessage, "ISM1StatusMessage", _process_ISM1StatusMessage},
+    {EMS_MODEL_OTHER, EMS_TYPE_SM10Monitor, ems_type_SM10Monitor, _process_SM10Monitor},
+    {EMS_MODEL_OTHER, EMS_TYPE_SM100Monitor, ems_type_SM100Monitor, _process_SM100Monitor},
+    {EMS_MODEL_OTHER, EMS_TYPE_SM100Status, ems_type_SM100Status, _process_SM100Status},
+    {EMS_MODEL_OTHER, EMS_TYPE_SM100Status2, ems_type_SM100Status2, _process_SM100Status2},
+    {EMS_MODEL_OTHER, EMS_TYPE_SM100Energy, ems_type_SM100Energy, _process_SM100Energy},
+    {EMS_MODEL_OTHER, EMS_TYPE_HPMonitor1, ems_type_HeatPumpMonitor1, _process_HPMonitor1},
+    {EMS_MODEL_OTHER, EMS_TYPE_HPMonitor2, ems_type_HeatPumpMonitor2, _process_HPMonitor2},
+    {EMS_MODEL_OTHER, EMS_TYPE_ISM1StatusMessage, ems_type_ISM1StatusMessage, _process_ISM1StatusMessage},
 
     // RC10
-    {EMS_MODEL_RC10, EMS_TYPE_RCTime, "RCTime", _process_RCTime},
-    {EMS_MODEL_RC10, EMS_TYPE_RC10Set, "RC10Set", _process_RC10Set},
-    {EMS_MODEL_RC10, EMS_TYPE_RC10StatusMessage, "RC10StatusMessage", _process_RC10StatusMessage},
+    {EMS_MODEL_RC10, EMS_TYPE_RCTime, ems_type_RCTime, _process_RCTime},
+    {EMS_MODEL_RC10, EMS_TYPE_RC10Set, ems_type_RC10Set, _process_RC10Set},
+    {EMS_MODEL_RC10, EMS_TYPE_RC10StatusMessage, ems_type_RC10StatusMessage, _process_RC10StatusMessage},
 
     // RC20 and RC20F
-    {EMS_MODEL_RC20, EMS_TYPE_RCOutdoorTempMessage, "RCOutdoorTempMessage", _process_RCOutdoorTempMessage},
-    {EMS_MODEL_RC20, EMS_TYPE_RCTime, "RCTime", _process_RCTime},
-    {EMS_MODEL_RC20, EMS_TYPE_RC20Set, "RC20Set", _process_RC20Set},
-    {EMS_MODEL_RC20, EMS_TYPE_RC20StatusMessage, "RC20StatusMessage", _process_RC20StatusMessage},
+    {EMS_MODEL_RC20, EMS_TYPE_RCOutdoorTempMessage, ems_type_RCOutdoorTempMessage, _process_RCOutdoorTempMessage},
+    {EMS_MODEL_RC20, EMS_TYPE_RCTime, ems_type_RCTime, _process_RCTime},
+    {EMS_MODEL_RC20, EMS_TYPE_RC20Set, ems_type_RC20Set, _process_RC20Set},
+    {EMS_MODEL_RC20, EMS_TYPE_RC20StatusMessage, ems_type_RC20StatusMessage, _process_RC20StatusMessage},
 
-    {EMS_MODEL_RC20F, EMS_TYPE_RCOutdoorTempMessage, "RCOutdoorTempMessage", _process_RCOutdoorTempMessage},
-    {EMS_MODEL_RC20F, EMS_TYPE_RCTime, "RCTime", _process_RCTime},
-    {EMS_MODEL_RC20F, EMS_TYPE_RC20Set, "RC20Set", _process_RC20Set},
-    {EMS_MODEL_RC20F, EMS_TYPE_RC20StatusMessage, "RC20StatusMessage", _process_RC20StatusMessage},
+    {EMS_MODEL_RC20F, EMS_TYPE_RCOutdoorTempMessage, ems_type_RCOutdoorTempMessage, _process_RCOutdoorTempMessage},
+    {EMS_MODEL_RC20F, EMS_TYPE_RCTime, ems_type_RCTime, _process_RCTime},
+    {EMS_MODEL_RC20F, EMS_TYPE_RC20Set, ems_type_RC20Set, _process_RC20Set},
+    {EMS_MODEL_RC20F, EMS_TYPE_RC20StatusMessage, ems_type_RC20StatusMessage, _process_RC20StatusMessage},
 
     // RC30
-    {EMS_MODEL_RC30, EMS_TYPE_RCOutdoorTempMessage, "RCOutdoorTempMessage", _process_RCOutdoorTempMessage},
-    {EMS_MODEL_RC30, EMS_TYPE_RCTime, "RCTime", _process_RCTime},
-    {EMS_MODEL_RC30, EMS_TYPE_RC30Set, "RC30Set", _process_RC30Set},
-    {EMS_MODEL_RC30, EMS_TYPE_RC30StatusMessage, "RC30StatusMessage", _process_RC30StatusMessage},
+    {EMS_MODEL_RC30, EMS_TYPE_RCOutdoorTempMessage, ems_type_RCOutdoorTempMessage, _process_RCOutdoorTempMessage},
+    {EMS_MODEL_RC30, EMS_TYPE_RCTime, ems_type_RCTime, _process_RCTime},
+    {EMS_MODEL_RC30, EMS_TYPE_RC30Set, ems_type_RC30Set, _process_RC30Set},
+    {EMS_MODEL_RC30, EMS_TYPE_RC30StatusMessage, ems_type_RC30StatusMessage, _process_RC30StatusMessage},
 
     // RC35
-    {EMS_MODEL_RC35, EMS_TYPE_RCOutdoorTempMessage, "RCOutdoorTempMessage", _process_RCOutdoorTempMessage},
-    {EMS_MODEL_RC35, EMS_TYPE_RCTime, "RCTime", _process_RCTime},
-    {EMS_MODEL_RC35, EMS_TYPE_RC35Set_HC1, "RC35Set_HC1", _process_RC35Set},
-    {EMS_MODEL_RC35, EMS_TYPE_RC35StatusMessage_HC1, "RC35StatusMessage_HC1", _process_RC35StatusMessage},
-    {EMS_MODEL_RC35, EMS_TYPE_RC35Set_HC2, "RC35Set_HC2", _process_RC35Set},
-    {EMS_MODEL_RC35, EMS_TYPE_RC35StatusMessage_HC2, "RC35StatusMessage_HC2", _process_RC35StatusMessage},
+    {EMS_MODEL_RC35, EMS_TYPE_RCOutdoorTempMessage, ems_type_RCOutdoorTempMessage, _process_RCOutdoorTempMessage},
+    {EMS_MODEL_RC35, EMS_TYPE_RCTime, ems_type_RCTime, _process_RCTime},
+    {EMS_MODEL_RC35, EMS_TYPE_RC35Set_HC1, ems_type_RC35Set_HC1, _process_RC35Set},
+    {EMS_MODEL_RC35, EMS_TYPE_RC35StatusMessage_HC1, ems_type_RC35StatusMessage_HC1, _process_RC35StatusMessage},
+    {EMS_MODEL_RC35, EMS_TYPE_RC35Set_HC2, ems_type_RC35Set_HC2, _process_RC35Set},
+    {EMS_MODEL_RC35, EMS_TYPE_RC35StatusMessage_HC2, ems_type_RC35StatusMessage_HC2, _process_RC35StatusMessage},
 
     // ES73
-    {EMS_MODEL_ES73, EMS_TYPE_RCOutdoorTempMessage, "RCOutdoorTempMessage", _process_RCOutdoorTempMessage},
-    {EMS_MODEL_ES73, EMS_TYPE_RCTime, "RCTime", _process_RCTime},
-    {EMS_MODEL_ES73, EMS_TYPE_RC35Set_HC1, "RC35Set", _process_RC35Set},
-    {EMS_MODEL_ES73, EMS_TYPE_RC35StatusMessage_HC1, "RC35StatusMessage", _process_RC35StatusMessage},
+    {EMS_MODEL_ES73, EMS_TYPE_RCOutdoorTempMessage, ems_type_RCOutdoorTempMessage, _process_RCOutdoorTempMessage},
+    {EMS_MODEL_ES73, EMS_TYPE_RCTime, ems_type_RCTime, _process_RCTime},
+    {EMS_MODEL_ES73, EMS_TYPE_RC35Set_HC1, ems_type_RC35Set, _process_RC35Set},
+    {EMS_MODEL_ES73, EMS_TYPE_RC35StatusMessage_HC1, ems_type_RC35StatusMessage, _process_RC35StatusMessage},
 
     // Easy
-    {EMS_MODEL_EASY, EMS_TYPE_EasyStatusMessage, "EasyStatusMessage", _process_EasyStatusMessage},
+    {EMS_MODEL_EASY, EMS_TYPE_EasyStatusMessage, ems_type_EasyStatusMessage, _process_EasyStatusMessage},
 
     // Nefit 1010, RC300, RC310 (EMS Plus)
-    {EMS_MODEL_ALL, EMS_TYPE_RCPLUSStatusMessage, "RCPLUSStatusMessage", _process_RCPLUSStatusMessage},
-    {EMS_MODEL_ALL, EMS_TYPE_RCPLUSSet, "RCPLUSSetMessage", _process_RCPLUSSetMessage},
-    {EMS_MODEL_ALL, EMS_TYPE_RCPLUSStatusHeating, "RCPLUSStatusHeating", _process_RCPLUSStatusHeating},
-    {EMS_MODEL_ALL, EMS_TYPE_RCPLUSStatusMode, "RCPLUSStatusMode", _process_RCPLUSStatusMode},
+    {EMS_MODEL_ALL, EMS_TYPE_RCPLUSStatusMessage, ems_type_RCPLUSStatusMessage, _process_RCPLUSStatusMessage},
+    {EMS_MODEL_ALL, EMS_TYPE_RCPLUSSet, ems_type_RCPLUSSetMessage, _process_RCPLUSSetMessage},
+    {EMS_MODEL_ALL, EMS_TYPE_RCPLUSStatusHeating, ems_type_RCPLUSStatusHeating, _process_RCPLUSStatusHeating},
+    {EMS_MODEL_ALL, EMS_TYPE_RCPLUSStatusMode, ems_type_RCPLUSStatusMode, _process_RCPLUSStatusMode},
 
     // Junkers FR10
-    {EMS_MODEL_ALL, EMS_TYPE_JunkersStatusMessage, "JunkersStatusMessage", _process_JunkersStatusMessage}
-
+    {EMS_MODEL_ALL, EMS_TYPE_JunkersStatusMessage, ems_type_JunkersStatusMessage, _process_JunkersStatusMessage}
 
 };
 
@@ -187,12 +251,167 @@ uint8_t _Boiler_Types_max     = ArraySize(Boiler_Types);     // number of boiler
 uint8_t _Other_Types_max      = ArraySize(Other_Types);      // number of other ems devices
 uint8_t _Thermostat_Types_max = ArraySize(Thermostat_Types); // number of defined thermostat types
 
+// # telegrams received per EMS type, for the metrics
+// types shared by several models are counted against their first entry in EMS_Types
+uint32_t _EMS_Types_count[ArraySize(EMS_Types)] = {0};
+uint32_t _EMS_Types_unknown                     = 0; // # telegrams with a type not in EMS_Types
+
+// time spent in the process functions per EMS type, in microseconds
+uint32_t _EMS_Types_time[ArraySize(EMS_Types)]    = {0}; // total
+uint16_t _EMS_Types_maxtime[ArraySize(EMS_Types)] = {0}; // longest single call
+
+// a boiler value, the storage offset and size are taken from its field in _EMS_Boiler
+#define EMS_DP_BOILER(type, offset, bit, format, div, field, key, label, unit) \
+    {EMS_VALUES_BOILER, type, offset, bit, format, div, offsetof(_EMS_Boiler, field), sizeof(_EMS_Boiler::field), ems_dp_##field##_key, ems_dp_##field##_label, ems_dp_##field##_unit}
+
+// the strings of a data point, each in flash on its own and named after its field
+#define EMS_DP_TEXT(kind, type, offset, bit, format, div, field, key, label, unit)  \
+    static_assert(sizeof(key) <= EMS_DP_KEY_SIZE, "data point key too long");       \
+    static_assert(sizeof(label) <= EMS_DP_LABEL_SIZE, "data point label too long"); \
+    static_assert(sizeof(unit) <= EMS_DP_UNIT_SIZE, "data point unit too long");    \
+    static const char ems_dp_##field##_key[] PROGMEM   = key;                       \
+    static const char ems_dp_##field##_label[] PROGMEM = label;                     \
+    static const char ems_dp_##field##_unit[] PROGMEM  = unit;
+#define EMS_DP_ENTRY(kind, ...) kind(__VA_ARGS__),
+
+/*
+ * All decoded values, in the order they are shown by 'info'
+ * an empty key means it's not published to MQTT, an empty label that it's not shown
+ * the list is expanded twice, once for the strings and once for the table
+ */
+#define EMS_DATAPOINTS(_)                                                                                                                                      \
+    /* UBAParameterWW */                                                                                                                                       \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAParameterWW, EMS_OFFSET_UBAParameterWW_wwactivated, 0, EMS_DP_FLAG, 1, wWActivated, "wWActivated", "Warm Water activated", "") \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAParameterWW, 6, 0, EMS_DP_FLAG, 1, wWCircPump, "", "Warm Water circulation pump available", "")                               \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAParameterWW, EMS_OFFSET_UBAParameterWW_wwtemp, 0, EMS_DP_INT, 1, wWSelTemp, "wWSelTemp", "Warm Water selected temperature", "C") \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAParameterWW, 8, 0, EMS_DP_INT, 1, wWDesiredTemp, "", "Warm Water desired temperature", "C")                                   \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAParameterWW, EMS_OFFSET_UBAParameterWW_wwComfort, 0, EMS_DP_INT, 1, wWComfort, "", "", "") /* shown and published by name */  \
+                                                                                                                                                               \
+    /* UBAMonitorWWMessage */                                                                                                                                  \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorWWMessage, 1, 0, EMS_DP_SHORT, 10, wWCurTmp, "wWCurTmp", "Warm Water current temperature", "C")                        \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorWWMessage, 9, 0, EMS_DP_INT, 10, wWCurFlow, "wWCurFlow", "Warm Water current tap water flow", "l/min")                 \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorWWMessage, 13, 0, EMS_DP_LONG, 1, wWStarts, "", "Warm Water # starts", "times")                                        \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorWWMessage, 10, 0, EMS_DP_MINUTES, 1, wWWorkM, "", "Warm Water active time", "")                                        \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorWWMessage, 5, 1, EMS_DP_BIT, 1, wWOneTime, "", "", "")                                                                 \
+                                                                                                                                                               \
+    /* UBAMonitorFast */                                                                                                                                       \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 7, 6, EMS_DP_BIT, 1, wWHeat, "wWHeat", "Warm Water 3-way valve", "")                                             \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 0, 0, EMS_DP_INT, 1, selFlowTemp, "selFlowTemp", "Selected flow temperature", "C")                               \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 1, 0, EMS_DP_SHORT, 10, curFlowTemp, "curFlowTemp", "Current flow temperature", "C")                             \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 13, 0, EMS_DP_SHORT, 10, retTemp, "retTemp", "Return temperature", "C")                                          \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 7, 0, EMS_DP_BIT, 1, burnGas, "burnGas", "Gas", "")                                                              \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 7, 5, EMS_DP_BIT, 1, heatPmp, "heatPmp", "Boiler pump", "")                                                      \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 7, 2, EMS_DP_BIT, 1, fanWork, "fanWork", "Fan", "")                                                              \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 7, 3, EMS_DP_BIT, 1, ignWork, "ignWork", "Ignition", "")                                                         \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 7, 7, EMS_DP_BIT, 1, wWCirc, "wWCirc", "Circulation pump", "")                                                   \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 3, 0, EMS_DP_INT, 1, selBurnPow, "selBurnPow", "Burner selected max power", "%")                                 \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 4, 0, EMS_DP_INT, 1, curBurnPow, "curBurnPow", "Burner current power", "%")                                      \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 15, 0, EMS_DP_USHORT, 10, flameCurr, "", "Flame current", "uA")                                                  \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 17, 0, EMS_DP_INT, 10, sysPress, "sysPress", "System pressure", "bar") /* 0xFF if there's no sensor */           \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 18, 0, EMS_DP_CHARS, 1, serviceCodeChar, "ServiceCode", "System service code", "")                               \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorFast, 20, 0, EMS_DP_USHORT, 1, serviceCode, "ServiceCodeNumber", "System service code number", "")                     \
+                                                                                                                                                               \
+    /* UBAParametersMessage */                                                                                                                                 \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAParametersMessage, 1, 0, EMS_DP_INT, 1, heating_temp, "", "Heating temperature setting on the boiler", "C")                   \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAParametersMessage, 9, 0, EMS_DP_INT, 1, pump_mod_max, "", "Boiler circuit pump modulation max power", "%")                    \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAParametersMessage, 10, 0, EMS_DP_INT, 1, pump_mod_min, "", "Boiler circuit pump modulation min power", "%")                   \
+                                                                                                                                                               \
+    /* UBAMonitorSlow */                                                                                                                                       \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorSlow, 0, 0, EMS_DP_SHORT, 10, extTemp, "outdoorTemp", "Outside temperature", "C") /* 0x8000 if there's no sensor */    \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorSlow, 2, 0, EMS_DP_SHORT, 10, boilTemp, "boilTemp", "Boiler temperature", "C")                                         \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorSlow, 9, 0, EMS_DP_INT, 1, pumpMod, "pumpMod", "Pump modulation", "%")                                                 \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorSlow, 10, 0, EMS_DP_LONG, 1, burnStarts, "", "Burner # starts", "times")                                               \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorSlow, 13, 0, EMS_DP_MINUTES, 1, burnWorkMin, "", "Total burner operating time", "")                                    \
+    _(EMS_DP_BOILER, EMS_TYPE_UBAMonitorSlow, 19, 0, EMS_DP_MINUTES, 1, heatWorkMin, "", "Total heat operating time", "")                                      \
+                                                                                                                                                               \
+    /* UBATotalUptimeMessage */                                                                                                                                \
+    _(EMS_DP_BOILER, EMS_TYPE_UBATotalUptimeMessage, 0, 0, EMS_DP_MINUTES, 1, UBAuptime, "", "Total UBA working time", "")
+
+EMS_DATAPOINTS(EMS_DP_TEXT)
+
+constexpr _EMS_DataPoint EMS_DataPoints[] PROGMEM = {EMS_DATAPOINTS(EMS_DP_ENTRY)};
+
+uint8_t _EMS_DataPoints_max = ArraySize(EMS_DataPoints); // number of data points
+
+// size of the field a format is kept in
+constexpr uint8_t _ems_dataPointSize(uint8_t format) {
+    return ((format == EMS_DP_SHORT) || (format == EMS_DP_USHORT)) ? 2 : ((format == EMS_DP_LONG) || (format == EMS_DP_MINUTES)) ? 4 : (format == EMS_DP_CHARS) ? 3 : 1;
+}
+
+// # bytes a format takes in the telegram data
+constexpr uint8_t _ems_dataPointLength(uint8_t format) {
+    return ((format == EMS_DP_SHORT) || (format == EMS_DP_USHORT) || (format == EMS_DP_CHARS)) ? 2 : ((format == EMS_DP_LONG) || (format == EMS_DP_MINUTES)) ? 3 : 1;
+}
+
+// check at compile time that every data point fits the field it's kept in
+constexpr bool _ems_checkDataPoints(uint8_t i) {
+    return (i == ArraySize(EMS_DataPoints))
+           || ((EMS_DataPoints[i].size == _ems_dataPointSize(EMS_DataPoints[i].format)) && (EMS_DataPoints[i].div != 0) && (EMS_DataPoints[i].bit < 8)
+               && _ems_checkDataPoints(i + 1));
+}
+
+static_assert(_ems_checkDataPoints(0), "a data point's format doesn't match the size of its field");
+static_assert(ArraySize(EMS_DataPoints) < 0xFF, "too many data points");
+
+// product id lookup into the device lists, computed at compile time and kept in flash
+// _Device_Index holds the Thermostat_Types index, or the Other_Types index with EMS_PRODUCT_INDEX_OTHER set
+#define EMS_PRODUCT_INDEX_NONE 0xFF
+#define EMS_PRODUCT_INDEX_OTHER 0x80
+
+static_assert(ArraySize(Boiler_Types) < EMS_PRODUCT_INDEX_OTHER, "too many boiler types for the product index");
+static_assert(ArraySize(Thermostat_Types) < EMS_PRODUCT_INDEX_OTHER, "too many thermostat types for the product index");
+static_assert(ArraySize(Other_Types) < EMS_PRODUCT_INDEX_OTHER - 1, "too many other types for the product index");
+
+// index of the first entry of a device list with a product id, or EMS_PRODUCT_INDEX_NONE
+template <typename T, size_t N>
+constexpr uint8_t _ems_productIndexOf(const T (&list)[N], uint8_t product_id, uint8_t i = 0) {
+    return (i == N) ? EMS_PRODUCT_INDEX_NONE : (list[i].product_id == product_id) ? i : _ems_productIndexOf(list, product_id, i + 1);
+}
+
+constexpr uint8_t _ems_boilerIndex(uint8_t product_id) {
+    return _ems_productIndexOf(Boiler_Types, product_id);
+}
+
+// an Other_Types index as it's kept in _Device_Index
+constexpr uint8_t _ems_otherIndex(uint8_t i) {
+    return (i == EMS_PRODUCT_INDEX_NONE) ? EMS_PRODUCT_INDEX_NONE : (i | EMS_PRODUCT_INDEX_OTHER);
+}
+
+// thermostats take precedence over the other devices
+constexpr uint8_t _ems_deviceIndex(uint8_t product_id) {
+    return (_ems_productIndexOf(Thermostat_Types, product_id) != EMS_PRODUCT_INDEX_NONE) ? _ems_productIndexOf(Thermostat_Types, product_id)
+                                                                                         : _ems_otherIndex(_ems_productIndexOf(Other_Types, product_id));
+}
+
+// f() of every product id, 0 to 255
+#define EMS_PRODUCT_INDEX_16(f, n)                                                                                                                  \
+    f(n + 0), f(n + 1), f(n + 2), f(n + 3), f(n + 4), f(n + 5), f(n + 6), f(n + 7), f(n + 8), f(n + 9), f(n + 10), f(n + 11), f(n + 12), f(n + 13), \
+        f(n + 14), f(n + 15)
+#define EMS_PRODUCT_INDEX(f)                                                                                                        \
+    EMS_PRODUCT_INDEX_16(f, 0x00), EMS_PRODUCT_INDEX_16(f, 0x10), EMS_PRODUCT_INDEX_16(f, 0x20), EMS_PRODUCT_INDEX_16(f, 0x30),     \
+        EMS_PRODUCT_INDEX_16(f, 0x40), EMS_PRODUCT_INDEX_16(f, 0x50), EMS_PRODUCT_INDEX_16(f, 0x60), EMS_PRODUCT_INDEX_16(f, 0x70), \
+        EMS_PRODUCT_INDEX_16(f, 0x80), EMS_PRODUCT_INDEX_16(f, 0x90), EMS_PRODUCT_INDEX_16(f, 0xA0), EMS_PRODUCT_INDEX_16(f, 0xB0), \
+        EMS_PRODUCT_INDEX_16(f, 0xC0), EMS_PRODUCT_INDEX_16(f, 0xD0), EMS_PRODUCT_INDEX_16(f, 0xE0), EMS_PRODUCT_INDEX_16(f, 0xF0)
+
+constexpr uint8_t _Boiler_Index[256] PROGMEM = {EMS_PRODUCT_INDEX(_ems_boilerIndex)};
+constexpr uint8_t _Device_Index[256] PROGMEM = {EMS_PRODUCT_INDEX(_ems_deviceIndex)};
+
+void _ems_recordTxQueue(_EMS_TXQUEUE_EVENT event, _EMS_TxTelegram * EMS_TxTelegram);
+void _ems_recordEvent(_EMS_EVENT event);
+void _ems_pollSeen(_EMS_RxTelegram * EMS_RxTelegram);
+void _ems_valuesSeen(_EMS_RxTelegram * EMS_RxTelegram);
+void _ems_identifyDevice(uint8_t device_id, uint8_t product_id, uint8_t major, uint8_t minor, bool restore);
+int  _ems_findBoilerType(uint8_t product_id);
+int  _ems_findThermostatType(uint8_t product_id);
+int  _ems_findOtherType(uint8_t product_id);
+
 // these structs contain the data we store from the Boiler and Thermostat
 _EMS_Boiler     EMS_Boiler;     // for boiler
 _EMS_Thermostat EMS_Thermostat; // for thermostat
 _EMS_Other      EMS_Other;      // for other known EMS devices
 
 // CRC lookup table with poly 12 for faster checking
+// kept in RAM (not PROGMEM) as it's also read by the UART interrupt handler
 const uint8_t ems_crc_table[] = {0x00, 0x02, 0x04, 0x06, 0x08, 0x0A, 0x0C, 0x0E, 0x10, 0x12, 0x14, 0x16, 0x18, 0x1A, 0x1C, 0x1E, 0x20, 0x22, 0x24, 0x26,
                                  0x28, 0x2A, 0x2C, 0x2E, 0x30, 0x32, 0x34, 0x36, 0x38, 0x3A, 0x3C, 0x3E, 0x40, 0x42, 0x44, 0x46, 0x48, 0x4A, 0x4C, 0x4E,
                                  0x50, 0x52, 0x54, 0x56, 0x58, 0x5A, 0x5C, 0x5E, 0x60, 0x62, 0x64, 0x66, 0x68, 0x6A, 0x6C, 0x6E, 0x70, 0x72, 0x74, 0x76,
@@ -214,6 +433,15 @@ const uint32_t EMS_POLL_TIMEOUT       = 5000000; // timeout in microseconds befo
 // init stats and counters and buffers
 // uses -255 or 255 for values that haven't been set yet (EMS_VALUE_INT_NOTSET and EMS_VALUE_FLOAT_NOTSET)
 void ems_init() {
+    EMS_Discovery.status      = EMS_DISCOVERY_IDLE;
+    EMS_Discovery.cached      = false;
+    EMS_Discovery.checksum = 0;
+
+    for (uint8_t i = 0; i < EMS_VALUES_MAX; i++) {
+        EMS_ValuesTimestamp[i]   = 0;
+        EMS_ValuesRestoredAge[i] = EMS_SNAPSHOT_AGE_NEVER;
+    }
+
     // overall status
     EMS_Sys_Status.emsRxPgks        = 0;
     EMS_Sys_Status.emsTxPkgs        = 0;
@@ -229,6 +457,8 @@ void ems_init() {
     EMS_Sys_Status.emsPollFrequency = 0;
     EMS_Sys_Status.txRetryCount     = 0;
     EMS_Sys_Status.emsReverse       = false;
+    EMS_Sys_Status.emsRxFiltered    = 0;
+    EMS_Sys_Status.emsRxUnknown     = 0;
 
     // thermostat
     EMS_Thermostat.setpoint_roomTemp = EMS_VALUE_SHORT_NOTSET;
@@ -251,52 +481,8 @@ void ems_init() {
     EMS_Thermostat.circuitcalctemp   = EMS_VALUE_INT_NOTSET; // 0x48 byte 14
 
 
-    // UBAParameterWW
-    EMS_Boiler.wWActivated   = EMS_VALUE_INT_NOTSET; // Warm Water activated
-    EMS_Boiler.wWSelTemp     = EMS_VALUE_INT_NOTSET; // Warm Water selected temperature
-    EMS_Boiler.wWCircPump    = EMS_VALUE_INT_NOTSET; // Warm Water circulation pump available
-    EMS_Boiler.wWDesiredTemp = EMS_VALUE_INT_NOTSET; // Warm Water desired temperature to prevent infection
-    EMS_Boiler.wWComfort     = EMS_VALUE_INT_NOTSET;
-
-    // UBAMonitorFast
-    EMS_Boiler.selFlowTemp = EMS_VALUE_INT_NOTSET;   // Selected flow temperature
-    EMS_Boiler.curFlowTemp = EMS_VALUE_SHORT_NOTSET; // Current flow temperature
-    EMS_Boiler.retTemp     = EMS_VALUE_SHORT_NOTSET; // Return temperature
-    EMS_Boiler.burnGas     = EMS_VALUE_INT_NOTSET;   // Gas on/off
-    EMS_Boiler.fanWork     = EMS_VALUE_INT_NOTSET;   // Fan on/off
-    EMS_Boiler.ignWork     = EMS_VALUE_INT_NOTSET;   // Ignition on/off
-    EMS_Boiler.heatPmp     = EMS_VALUE_INT_NOTSET;   // Boiler pump on/off
-    EMS_Boiler.wWHeat      = EMS_VALUE_INT_NOTSET;   // 3-way valve on WW
-    EMS_Boiler.wWCirc      = EMS_VALUE_INT_NOTSET;   // Circulation on/off
-    EMS_Boiler.selBurnPow  = EMS_VALUE_INT_NOTSET;   // Burner max power
-    EMS_Boiler.curBurnPow  = EMS_VALUE_INT_NOTSET;   // Burner current power
-    EMS_Boiler.flameCurr   = EMS_VALUE_SHORT_NOTSET; // Flame current in micro amps
-    EMS_Boiler.sysPress    = EMS_VALUE_INT_NOTSET;   // System pressure
-    strlcpy(EMS_Boiler.serviceCodeChar, "??", sizeof(EMS_Boiler.serviceCodeChar));
-    EMS_Boiler.serviceCode = EMS_VALUE_SHORT_NOTSET;
-
-    // UBAMonitorSlow
-    EMS_Boiler.extTemp     = EMS_VALUE_SHORT_NOTSET; // Outside temperature
-    EMS_Boiler.boilTemp    = EMS_VALUE_SHORT_NOTSET; // Boiler temperature
-    EMS_Boiler.pumpMod     = EMS_VALUE_INT_NOTSET;   // Pump modulation
-    EMS_Boiler.burnStarts  = EMS_VALUE_LONG_NOTSET;  // # burner restarts
-    EMS_Boiler.burnWorkMin = EMS_VALUE_LONG_NOTSET;  // Total burner operating time
-    EMS_Boiler.heatWorkMin = EMS_VALUE_LONG_NOTSET;  // Total heat operating time
-
-    // UBAMonitorWWMessage
-    EMS_Boiler.wWCurTmp  = EMS_VALUE_SHORT_NOTSET; // Warm Water current temperature
-    EMS_Boiler.wWStarts  = EMS_VALUE_LONG_NOTSET;  // Warm Water # starts
-    EMS_Boiler.wWWorkM   = EMS_VALUE_LONG_NOTSET;  // Warm Water # minutes
-    EMS_Boiler.wWOneTime = EMS_VALUE_INT_NOTSET;   // Warm Water one time function on/off
-    EMS_Boiler.wWCurFlow = EMS_VALUE_INT_NOTSET;
-
-    // UBATotalUptimeMessage
-    EMS_Boiler.UBAuptime = EMS_VALUE_LONG_NOTSET; // Total UBA working hours
-
-    // UBAParametersMessage
-    EMS_Boiler.heating_temp = EMS_VALUE_INT_NOTSET; // Heating temperature setting on the boiler
-    EMS_Boiler.pump_mod_max = EMS_VALUE_INT_NOTSET; // Boiler circuit pump modulation max. power
-    EMS_Boiler.pump_mod_min = EMS_VALUE_INT_NOTSET; // Boiler circuit pump modulation min. power
+    // boiler values from the data points
+    _ems_clearDataPoints();
 
     // Other EMS devices values
     EMS_Other.SMcollectorTemp  = EMS_VALUE_SHORT_NOTSET; // collector temp from SM10/SM100
@@ -328,6 +514,33 @@ void ems_init() {
 
     // default logging is none
     ems_setLogging(EMS_SYS_LOGGING_DEFAULT);
+
+    // the Rx filter is complete before the UART is started
+    ems_updateRxFilter();
+}
+
+/**
+ * Find the index in the Boiler_Types list of a product id, or -1 if not found
+ */
+int _ems_findBoilerType(uint8_t product_id) {
+    uint8_t i = pgm_read_byte(&_Boiler_Index[product_id]);
+    return ((i == EMS_PRODUCT_INDEX_NONE) ? -1 : i);
+}
+
+/**
+ * Find the index in the Thermostat_Types list of a product id, or -1 if not found
+ */
+int _ems_findThermostatType(uint8_t product_id) {
+    uint8_t i = pgm_read_byte(&_Device_Index[product_id]);
+    return (((i == EMS_PRODUCT_INDEX_NONE) || (i & EMS_PRODUCT_INDEX_OTHER)) ? -1 : i);
+}
+
+/**
+ * Find the index in the Other_Types list of a product id, or -1 if not found
+ */
+int _ems_findOtherType(uint8_t product_id) {
+    uint8_t i = pgm_read_byte(&_Device_Index[product_id]);
+    return (((i == EMS_PRODUCT_INDEX_NONE) || !(i & EMS_PRODUCT_INDEX_OTHER)) ? -1 : (i & ~EMS_PRODUCT_INDEX_OTHER));
 }
 
 // Getters and Setters for parameters
@@ -350,6 +563,7 @@ void ems_setEmsRefreshed(bool b) {
 
 void ems_setThermostatHC(uint8_t hc) {
     EMS_Thermostat.hc = hc;
+    ems_pollClear(); // the types to poll have changed
 }
 
 bool ems_getBoilerEnabled() {
@@ -372,6 +586,99 @@ uint32_t ems_getPollFrequency() {
     return EMS_Sys_Status.emsPollFrequency;
 }
 
+uint8_t ems_getTxQueueSize() {
+    return EMS_TxQueue.size();
+}
+
+/**
+ * # telegrams received of the EMS type at index in EMS_Types
+ * returns false when index is past the last type, count is 0 for types that haven't been seen
+ */
+bool ems_getTypeCount(uint8_t index, uint16_t * type, char * typeString, size_t len, uint32_t * count) {
+    if (index >= _EMS_Types_max) {
+        return false;
+    }
+
+    *type  = pgm_read_word(&EMS_Types[index].type);
+    *count = _EMS_Types_count[index];
+    strlcpy_P(typeString, (PGM_P)pgm_read_ptr(&EMS_Types[index].typeString), len);
+
+    return true;
+}
+
+// # telegrams received with a type we don't know
+uint32_t ems_getUnknownTypeCount() {
+    return _EMS_Types_unknown + EMS_Sys_Status.emsRxUnknown; // those passed on to the parser and those discarded by the Rx filter
+}
+
+// returns the age in seconds of a group of values, or -1 if they have never been set
+int32_t ems_getValuesAge(_EMS_VALUES values) {
+    if (EMS_ValuesTimestamp[values]) {
+        return ((millis() - EMS_ValuesTimestamp[values]) / 1000);
+    }
+    if (EMS_ValuesRestoredAge[values] != EMS_SNAPSHOT_AGE_NEVER) {
+        return (EMS_ValuesRestoredAge[values] + (millis() / 1000));
+    }
+    return -1;
+}
+
+// true if a group of values was restored after a reset and hasn't been updated from the bus since
+bool ems_getValuesStale(_EMS_VALUES values) {
+    return ((EMS_ValuesTimestamp[values] == 0) && (EMS_ValuesRestoredAge[values] != EMS_SNAPSHOT_AGE_NEVER));
+}
+
+// # entries in the data point table
+uint8_t ems_getDataPointCount() {
+    return _EMS_DataPoints_max;
+}
+
+// copy a data point definition out of flash
+void ems_getDataPoint(uint8_t index, _EMS_DataPoint * dp) {
+    memcpy_P(dp, &EMS_DataPoints[index], sizeof(_EMS_DataPoint));
+}
+
+// the raw value of a data point, before it's divided. Returns false if it's not set or it's not a number
+bool ems_getDataPointValue(const _EMS_DataPoint * dp, int32_t * value) {
+    uint8_t * field = _ems_dataPointStruct(dp->values) + dp->storage;
+
+    switch (dp->format) {
+    case EMS_DP_SHORT:
+        *value = *(int16_t *)field;
+        return (*(uint16_t *)field != EMS_VALUE_SHORT_NOTSET);
+    case EMS_DP_USHORT:
+        *value = *(uint16_t *)field;
+        return (*value != EMS_VALUE_SHORT_NOTSET);
+    case EMS_DP_LONG:
+    case EMS_DP_MINUTES:
+        *value = *(uint32_t *)field;
+        return (*(uint32_t *)field != EMS_VALUE_LONG_NOTSET);
+    case EMS_DP_CHARS:
+        return false;
+    default:
+        *value = *field;
+        return (*field != EMS_VALUE_INT_NOTSET);
+    }
+}
+
+// the value of a data point as text, without the unit. "?" if it's not set
+char * ems_getDataPointString(const _EMS_DataPoint * dp, char * buffer, size_t size) {
+    int32_t value;
+
+    if (dp->format == EMS_DP_CHARS) {
+        strlcpy(buffer, (char *)(_ems_dataPointStruct(dp->values) + dp->storage), size);
+    } else if (!ems_getDataPointValue(dp, &value)) {
+        strlcpy(buffer, "?", size);
+    } else if ((dp->format == EMS_DP_BIT) || (dp->format == EMS_DP_FLAG)) {
+        strlcpy(buffer, value ? "on" : "off", size);
+    } else if (dp->format == EMS_DP_MINUTES) {
+        snprintf(buffer, size, "%d days %d hours %d minutes", (int)(value / 1440), (int)((value % 1440) / 60), (int)(value % 60));
+    } else {
+        fp_format(buffer, size, value, dp->div, fp_decimals(dp->div));
+    }
+
+    return buffer;
+}
+
 bool ems_getTxCapable() {
     if ((EMS_Sys_Status.emsPollFrequency == 0) || (EMS_Sys_Status.emsPollFrequency > EMS_POLL_TIMEOUT)) {
         EMS_Sys_Status.emsTxCapable = false;
@@ -380,9 +687,25 @@ bool ems_getTxCapable() {
 }
 
 bool ems_getBusConnected() {
+    static uint32_t _last_emsRxFiltered   = 0;
+    static bool     _last_emsBusConnected = false;
+
+    // filtered telegrams have passed the CRC check so they also tell us the bus is alive
+    if (EMS_Sys_Status.emsRxFiltered != _last_emsRxFiltered) {
+        _last_emsRxFiltered            = EMS_Sys_Status.emsRxFiltered;
+        EMS_Sys_Status.emsRxTimestamp  = millis();
+        EMS_Sys_Status.emsBusConnected = true;
+    }
+
     if ((millis() - EMS_Sys_Status.emsRxTimestamp) > EMS_BUS_TIMEOUT) {
         EMS_Sys_Status.emsBusConnected = false;
     }
+
+    if (EMS_Sys_Status.emsBusConnected != _last_emsBusConnected) {
+        _last_emsBusConnected = EMS_Sys_Status.emsBusConnected;
+        _ems_recordEvent(_last_emsBusConnected ? EMS_EVENT_BUS_CONNECTED : EMS_EVENT_BUS_DISCONNECTED);
+    }
+
     return EMS_Sys_Status.emsBusConnected;
 }
 
@@ -404,7 +727,48 @@ void ems_setLogging(_EMS_SYS_LOGGING loglevel) {
         } else if (loglevel == EMS_SYS_LOGGING_RAW) {
             myDebug_P(PSTR("System Logging set to Raw mode"));
         }
+        ems_updateRxFilter();
+    }
+}
+
+/**
+ * Rebuild the Rx filter used by the UART interrupt handler to discard telegrams we would never process
+ * Needs to be called whenever the logging level or the thermostat changes
+ * Raw and verbose logging show everything. Replies to our own requests are always dest EMS_ID_ME
+ * and while waiting for one everything is passed on, see emsuart.cpp
+ */
+void ems_updateRxFilter() {
+    _EMS_RxFilter filter; // built aside, the interrupt handler only ever sees a complete filter
+
+    memset(&filter, 0, sizeof(filter));
+
+    // broadcasts and telegrams for us
+    filter.dest[EMS_ID_NONE >> 3] |= (1 << (EMS_ID_NONE & 0x07));
+    filter.dest[EMS_ID_ME >> 3] |= (1 << (EMS_ID_ME & 0x07));
+
+    // the known types, EMS+ types are all marked by their 0xF0-0xFF header
+    // a known type without a callback is passed on and ignored by the parser, it's rare
+    for (uint8_t i = 0; i < _EMS_Types_max; i++) {
+        uint16_t type = pgm_read_word(&EMS_Types[i].type);
+        if (type > 0xFF) {
+            memset(&filter.type[0xF0 >> 3], 0xFF, 2);
+        } else {
+            filter.type[type >> 3] |= (1 << (type & 0x07));
+        }
+    }
+
+    // all telegrams to and from the thermostat are printed
+    if ((EMS_Sys_Status.emsLogging == EMS_SYS_LOGGING_THERMOSTAT) && (EMS_Thermostat.device_id != EMS_ID_NONE)) {
+        uint8_t id = EMS_Thermostat.device_id & 0x7F;
+        filter.device[id >> 3] |= (1 << (id & 0x07));
     }
+
+    filter.acceptAll = ((EMS_Sys_Status.emsLogging == EMS_SYS_LOGGING_RAW) || (EMS_Sys_Status.emsLogging == EMS_SYS_LOGGING_VERBOSE));
+
+    // swap it in with interrupts off, which is also a compiler barrier so the copy can't be moved out
+    noInterrupts();
+    memcpy(&EMS_RxFilter, &filter, sizeof(EMS_RxFilter));
+    interrupts();
 }
 
 /**
@@ -462,7 +826,7 @@ int _ems_findType(uint8_t type) {
     bool    typeFound = false;
     // scan through known ID types
     while (i < _EMS_Types_max) {
-        if (EMS_Types[i].type == type) {
+        if (pgm_read_word(&EMS_Types[i].type) == type) {
             typeFound = true; // we have a match
             break;
         }
@@ -537,6 +901,8 @@ void _ems_sendTelegram() {
 
     // if we're preventing all outbound traffic, quit
     if (EMS_Sys_Status.emsTxDisabled) {
+        _EMS_TxTelegram EMS_TxTelegram = EMS_TxQueue.first();
+        _ems_recordTxQueue(EMS_TXQUEUE_DROP, &EMS_TxTelegram);
         EMS_TxQueue.shift(); // remove from queue
         if (ems_getLogging() != EMS_SYS_LOGGING_NONE) {
             myDebug_P(PSTR("in Listen Mode. All Tx is disabled."));
@@ -550,6 +916,7 @@ void _ems_sendTelegram() {
 
     // if there is no destination, also delete it from the queue
     if (EMS_TxTelegram.dest == EMS_ID_NONE) {
+        _ems_recordTxQueue(EMS_TXQUEUE_DROP, &EMS_TxTelegram);
         EMS_TxQueue.shift(); // remove from queue
         return;
     }
@@ -566,7 +933,9 @@ void _ems_sendTelegram() {
 
         EMS_TxTelegram.data[EMS_TxTelegram.length - 1] = _crcCalculator(EMS_TxTelegram.data, EMS_TxTelegram.length); // add the CRC
         emsuart_tx_buffer(EMS_TxTelegram.data, EMS_TxTelegram.length);                                               // send the telegram to the UART Tx
-        EMS_TxQueue.shift();                                                                                         // and remove from queue
+        myESP.recorderAdd(MYESP_RECORDER_TX, EMS_TxTelegram.data, EMS_TxTelegram.length);
+        _ems_recordTxQueue(EMS_TXQUEUE_REMOVE, &EMS_TxTelegram);
+        EMS_TxQueue.shift(); // and remove from queue
         return;
     }
 
@@ -614,7 +983,9 @@ void _ems_sendTelegram() {
 
     // send the telegram to the UART Tx
     emsuart_tx_buffer(EMS_TxTelegram.data, EMS_TxTelegram.length);
+    myESP.recorderAdd(MYESP_RECORDER_TX, EMS_TxTelegram.data, EMS_TxTelegram.length);
 
+    EMS_Devices[EMS_TxTelegram.dest & 0x7F].txCount++;
     EMS_Sys_Status.emsTxStatus = EMS_TX_STATUS_WAIT;
 }
 
@@ -636,6 +1007,7 @@ void _createValidate() {
 
     // safety check: only do a validate after a write and when we have a type to validate
     if ((EMS_TxTelegram.action != EMS_TX_TELEGRAM_WRITE) || (EMS_TxTelegram.type_validate == EMS_ID_NONE)) {
+        _ems_recordTxQueue(EMS_TXQUEUE_REMOVE, &EMS_TxTelegram);
         EMS_TxQueue.shift(); // remove from queue
         return;
     }
@@ -660,15 +1032,17 @@ void _createValidate() {
     // remove old telegram from queue and add this new read one
     EMS_TxQueue.shift();                     // remove from queue
     EMS_TxQueue.unshift(new_EMS_TxTelegram); // add back to queue making it first to be picked up next (FIFO)
+    _ems_recordTxQueue(EMS_TXQUEUE_VALIDATE, &new_EMS_TxTelegram);
 }
 
 /**
  * Entry point triggered by an interrupt in emsuart.cpp
  * length is the number of all the telegram bytes up to and including the CRC at the end
+ * crc_ok is the CRC verdict, already calculated by the UART interrupt handler while the bytes came in
  * Read commands are asynchronous as they're handled by the interrupt
  * When a telegram is processed we forcefully erase it from the stack to prevent overflow
  */
-void ems_parseTelegram(uint8_t * telegram, uint8_t length) {
+void ems_parseTelegram(uint8_t * telegram, uint8_t length, bool crc_ok) {
     // create the Rx package
     static _EMS_RxTelegram EMS_RxTelegram;
     static uint32_t        _last_emsPollFrequency = 0;
@@ -677,6 +1051,11 @@ void ems_parseTelegram(uint8_t * telegram, uint8_t length) {
     EMS_RxTelegram.timestamp = millis();
     EMS_RxTelegram.length    = length;
 
+    // keep telegrams and write responses in the flight recorder, but not the polls
+    if ((length > 1) || (EMS_Sys_Status.emsTxStatus == EMS_TX_STATUS_WAIT)) {
+        myESP.recorderAdd(MYESP_RECORDER_RX, telegram, length);
+    }
+
     // check if we just received a single byte
     // it could well be a Poll request from the boiler for us, which will have a value of 0x8B (0x0B | 0x80)
     // or either a return code like 0x01 or 0x04 from the last Write command
@@ -686,6 +1065,7 @@ void ems_parseTelegram(uint8_t * telegram, uint8_t length) {
         // check first for a Poll for us
         // the poll has the MSB set - seems to work on both EMS and Junkers
         if ((value & 0x7F) == EMS_ID_ME) {
+            TRACE_INSTANT(TRACE_TASK, "poll", value);
             EMS_Sys_Status.emsTxCapable     = true;
             uint32_t timenow_microsecs      = micros();
             EMS_Sys_Status.emsPollFrequency = (timenow_microsecs - _last_emsPollFrequency);
@@ -694,15 +1074,19 @@ void ems_parseTelegram(uint8_t * telegram, uint8_t length) {
             // do we have something to send thats waiting in the Tx queue?
             // if so send it if the Queue is not in a wait state
             if ((!EMS_TxQueue.isEmpty()) && (EMS_Sys_Status.emsTxStatus == EMS_TX_STATUS_IDLE)) {
+                TRACE_BEGIN(TRACE_TASK, "_ems_sendTelegram");
                 _ems_sendTelegram(); // perform the read/write command immediately
+                TRACE_END(TRACE_TASK, "_ems_sendTelegram");
             } else {
                 // nothing to send so just send a poll acknowledgement back
                 if (EMS_Sys_Status.emsPollEnabled) {
+                    TRACE_INSTANT(TRACE_TASK, "poll ack", value);
                     emsuart_tx_poll();
                 }
             }
         } else if (EMS_Sys_Status.emsTxStatus == EMS_TX_STATUS_WAIT) {
             // this may be a single byte 01 (success) or 04 (error) from a recent write command?
+            TRACE_INSTANT(TRACE_TASK, "write response", value);
             if (value == EMS_TX_SUCCESS) {
                 EMS_Sys_Status.emsTxPkgs++;
                 // got a success 01. Send a validate to check the value of the last write
@@ -767,9 +1151,9 @@ void ems_parseTelegram(uint8_t * telegram, uint8_t length) {
     }
 
     // Assume at this point we have something that vaguely resembles a telegram in the format [src] [dest] [type] [offset] [data] [crc]
-    // validate the CRC, if it's bad ignore it
-    if (telegram[length - 1] != _crcCalculator(telegram, length)) {
-        EMS_Sys_Status.emxCrcErr++;
+    // the CRC was validated in the interrupt handler, and the error counted there. Corrupt telegrams
+    // only make it this far when we're in verbose logging mode, so we can show them and then ignore them
+    if (!crc_ok) {
         if (EMS_Sys_Status.emsLogging == EMS_SYS_LOGGING_VERBOSE) {
             _debugPrintTelegram("Corrupt telegram: ", &EMS_RxTelegram, COLOR_RED, true);
         }
@@ -871,6 +1255,16 @@ void _printMessage(_EMS_RxTelegram * EMS_RxTelegram) {
     }
 }
 
+// add the CPU cycles used by the process function of the EMS type at index in EMS_Types
+void _ems_processTime(uint8_t index, uint32_t cycles) {
+    uint32_t time = cycles / ESP.getCpuFreqMHz(); // in microseconds
+
+    _EMS_Types_time[index] += time;
+    if (time > _EMS_Types_maxtime[index]) {
+        _EMS_Types_maxtime[index] = (time > 0xFFFF) ? 0xFFFF : time;
+    }
+}
+
 /**
  * print detailed telegram
  * and then call its callback if there is one defined
@@ -892,10 +1286,12 @@ void _ems_processTelegram(_EMS_RxTelegram * EMS_RxTelegram) {
 
     // see if we recognize the type first by scanning our known EMS types list
     bool    typeFound = false;
+    bool    typeKnown = false;
     uint8_t i         = 0;
 
     while (i < _EMS_Types_max) {
-        if (EMS_Types[i].type == type) {
+        if (pgm_read_word(&EMS_Types[i].type) == type) {
+            typeKnown = true;
             // is it a broadcast or something sent to us?
             // we don't really care where it is from
             if ((dest == EMS_ID_NONE) || (dest == EMS_ID_ME)) {
@@ -906,23 +1302,34 @@ void _ems_processTelegram(_EMS_RxTelegram * EMS_RxTelegram) {
         i++;
     }
 
+    if (!typeKnown) {
+        _EMS_Types_unknown++;
+    }
+
     // if it's a common type (across ems devices) or something specifically for us process it.
     // dest will be EMS_ID_NONE and offset 0x00 for a broadcast message
     if (typeFound) {
-        if ((EMS_Types[i].processType_cb) != (void *)NULL) {
+        _EMS_Types_count[i]++;
+        EMS_processType_cb processType_cb = (EMS_processType_cb)pgm_read_ptr(&EMS_Types[i].processType_cb);
+        PGM_P              name           = (PGM_P)pgm_read_ptr(&EMS_Types[i].typeString);
+        if (processType_cb != (void *)NULL) {
             // print non-verbose message
             if ((EMS_Sys_Status.emsLogging == EMS_SYS_LOGGING_BASIC) || (EMS_Sys_Status.emsLogging == EMS_SYS_LOGGING_VERBOSE)) {
-                myDebug_P(PSTR("<--- %s(0x%02X)"), EMS_Types[i].typeString, type);
+                char typeString[50];
+                strlcpy_P(typeString, name, sizeof(typeString));
+                myDebug_P(PSTR("<--- %s(0x%02X)"), typeString, type);
             }
             // call callback function to process the telegram, only if there is data
-            if (EMS_RxTelegram->emsplus) {
-                // if EMS+ always proces it
-                (void)EMS_Types[i].processType_cb(EMS_RxTelegram);
-            } else {
-                // only if the offset is 0 as we want to handle full telegrams and not partial
-                if (EMS_RxTelegram->offset == EMS_ID_NONE) {
-                    (void)EMS_Types[i].processType_cb(EMS_RxTelegram);
-                }
+            // if EMS+ always process it, otherwise only if the offset is 0 as we want to handle full telegrams and not partial
+            if ((EMS_RxTelegram->emsplus) || (EMS_RxTelegram->offset == EMS_ID_NONE)) {
+                uint32_t cycles = ESP.getCycleCount();
+                trace_add(TRACE_TASK, TRACE_PHASE_BEGIN, name, type);
+                (void)processType_cb(EMS_RxTelegram);
+                trace_add(TRACE_TASK, TRACE_PHASE_END, name, type);
+                _ems_processTime(i, ESP.getCycleCount() - cycles);
+
+                _ems_pollSeen(EMS_RxTelegram);
+                _ems_valuesSeen(EMS_RxTelegram);
             }
         }
     }
@@ -930,11 +1337,129 @@ void _ems_processTelegram(_EMS_RxTelegram * EMS_RxTelegram) {
     EMS_Sys_Status.emsTxStatus = EMS_TX_STATUS_IDLE;
 }
 
+/**
+ * Update the timestamp of the group of values a processed telegram was decoded into
+ */
+void _ems_valuesSeen(_EMS_RxTelegram * EMS_RxTelegram) {
+    if (EMS_RxTelegram->type == EMS_TYPE_Version) {
+        return; // doesn't carry any values
+    }
+
+    uint8_t src = EMS_RxTelegram->src & 0x7F;
+    if (src == EMS_Boiler.device_id) {
+        EMS_ValuesTimestamp[EMS_VALUES_BOILER] = EMS_RxTelegram->timestamp;
+    } else if (src == EMS_Thermostat.device_id) {
+        EMS_ValuesTimestamp[EMS_VALUES_THERMOSTAT] = EMS_RxTelegram->timestamp;
+    } else {
+        EMS_ValuesTimestamp[EMS_VALUES_OTHER] = EMS_RxTelegram->timestamp;
+    }
+}
+
+/**
+ * Save the decoded values to RTC memory, with their ages and a CRC
+ */
+void ems_saveSnapshot() {
+    TRACE_BEGIN(TRACE_TIMER, "ems_saveSnapshot"); // called by a Ticker
+    _EMS_Snapshot snapshot;
+
+    snapshot.version = EMS_SNAPSHOT_VERSION;
+    snapshot.size    = sizeof(snapshot);
+    for (uint8_t i = 0; i < EMS_VALUES_MAX; i++) {
+        int32_t age     = ems_getValuesAge((_EMS_VALUES)i);
+        snapshot.age[i] = ((age < 0) || (age >= EMS_SNAPSHOT_AGE_NEVER)) ? EMS_SNAPSHOT_AGE_NEVER : age;
+    }
+    snapshot.boiler     = EMS_Boiler;
+    snapshot.thermostat = EMS_Thermostat;
+    snapshot.other      = EMS_Other;
+
+    snapshot.crc = CRC32::calculate((uint8_t *)&snapshot.age, sizeof(snapshot) - offsetof(_EMS_Snapshot, age));
+
+    (void)myESP.rtcmemSave(&snapshot, sizeof(snapshot));
+    TRACE_END(TRACE_TIMER, "ems_saveSnapshot");
+}
+
+/**
+ * Restore the decoded values from RTC memory after a soft reset, called after ems_init()
+ * They are marked as stale until updated from the bus, see ems_getValuesStale()
+ * Only the values are restored, the device settings come from the config and device scan
+ * returns false if there is no valid snapshot
+ */
+bool ems_restoreSnapshot() {
+    _EMS_Snapshot snapshot;
+
+    if (!myESP.rtcmemLoad(&snapshot, sizeof(snapshot))) {
+        return false;
+    }
+
+    if ((snapshot.version != EMS_SNAPSHOT_VERSION) || (snapshot.size != sizeof(snapshot))
+        || (snapshot.crc != CRC32::calculate((uint8_t *)&snapshot.age, sizeof(snapshot) - offsetof(_EMS_Snapshot, age)))) {
+        return false;
+    }
+
+    // keep the device settings
+    _EMS_Boiler     boiler     = EMS_Boiler;
+    _EMS_Thermostat thermostat = EMS_Thermostat;
+    _EMS_Other      other      = EMS_Other;
+
+    EMS_Boiler     = snapshot.boiler;
+    EMS_Thermostat = snapshot.thermostat;
+    EMS_Other      = snapshot.other;
+
+    EMS_Boiler.device_id  = boiler.device_id;
+    EMS_Boiler.product_id = boiler.product_id;
+    strlcpy(EMS_Boiler.version, boiler.version, sizeof(EMS_Boiler.version));
+
+    EMS_Thermostat.device_id       = thermostat.device_id;
+    EMS_Thermostat.model_id        = thermostat.model_id;
+    EMS_Thermostat.product_id      = thermostat.product_id;
+    EMS_Thermostat.write_supported = thermostat.write_supported;
+    EMS_Thermostat.hc              = thermostat.hc;
+    strlcpy(EMS_Thermostat.version, thermostat.version, sizeof(EMS_Thermostat.version));
+
+    EMS_Other.SM = other.SM;
+    EMS_Other.HP = other.HP;
+
+    for (uint8_t i = 0; i < EMS_VALUES_MAX; i++) {
+        EMS_ValuesRestoredAge[i] = snapshot.age[i];
+    }
+
+    return true;
+}
+
+/**
+ * Add a Tx queue change to the flight recorder
+ * data is the event, queue size, action, dest, type (2 bytes), offset and retry count
+ */
+void _ems_recordTxQueue(_EMS_TXQUEUE_EVENT event, _EMS_TxTelegram * EMS_TxTelegram) {
+    uint8_t data[8];
+
+    data[0] = event;
+    data[1] = EMS_TxQueue.size();
+    data[2] = EMS_TxTelegram->action;
+    data[3] = EMS_TxTelegram->dest;
+    data[4] = EMS_TxTelegram->type >> 8;
+    data[5] = EMS_TxTelegram->type & 0xFF;
+    data[6] = EMS_TxTelegram->offset;
+    data[7] = EMS_Sys_Status.txRetryCount;
+
+    myESP.recorderAdd(MYESP_RECORDER_TXQUEUE, data, sizeof(data));
+}
+
+/**
+ * Add an EMS event to the flight recorder
+ */
+void _ems_recordEvent(_EMS_EVENT event) {
+    uint8_t data = event;
+    myESP.recorderAdd(MYESP_RECORDER_APP, &data, sizeof(data));
+}
+
 /**
  * Remove current Tx telegram from queue and release lock on Tx
  */
 void _removeTxQueue() {
     if (!EMS_TxQueue.isEmpty()) {
+        _EMS_TxTelegram EMS_TxTelegram = EMS_TxQueue.first();
+        _ems_recordTxQueue(EMS_TXQUEUE_REMOVE, &EMS_TxTelegram);
         EMS_TxQueue.shift(); // remove item from top of the queue
     }
     EMS_Sys_Status.emsTxStatus = EMS_TX_STATUS_IDLE;
@@ -1006,6 +1531,7 @@ void _processType(_EMS_RxTelegram * EMS_RxTelegram) {
                 if (EMS_Sys_Status.emsLogging >= EMS_SYS_LOGGING_BASIC) {
                     myDebug_P(PSTR("Read failed. Retrying attempt %d/%d..."), EMS_Sys_Status.txRetryCount, TX_WRITE_TIMEOUT_COUNT);
                 }
+                _ems_recordTxQueue(EMS_TXQUEUE_RETRY, &EMS_TxTelegram);
             }
         }
         _ems_processTelegram(EMS_RxTelegram); // process it always
@@ -1048,6 +1574,7 @@ void _processType(_EMS_RxTelegram * EMS_RxTelegram) {
                 EMS_TxTelegram.offset    = EMS_TxTelegram.comparisonOffset; // restore old value
                 EMS_TxQueue.shift();                                        // remove validate from queue
                 EMS_TxQueue.unshift(EMS_TxTelegram);                        // add back to queue making it next in line
+                _ems_recordTxQueue(EMS_TXQUEUE_RETRY, &EMS_TxTelegram);
             }
         }
     }
@@ -1056,6 +1583,87 @@ void _processType(_EMS_RxTelegram * EMS_RxTelegram) {
 }
 
 
+// the struct a group of data points is kept in
+uint8_t * _ems_dataPointStruct(uint8_t values) {
+    if (values == EMS_VALUES_BOILER) {
+        return (uint8_t *)&EMS_Boiler;
+    }
+    if (values == EMS_VALUES_THERMOSTAT) {
+        return (uint8_t *)&EMS_Thermostat;
+    }
+    return (uint8_t *)&EMS_Other;
+}
+
+// set all data points to not set
+void _ems_clearDataPoints() {
+    for (uint8_t i = 0; i < _EMS_DataPoints_max; i++) {
+        uint8_t   format = pgm_read_byte(&EMS_DataPoints[i].format);
+        uint8_t * field  = _ems_dataPointStruct(pgm_read_byte(&EMS_DataPoints[i].values)) + pgm_read_byte(&EMS_DataPoints[i].storage);
+
+        switch (format) {
+        case EMS_DP_SHORT:
+        case EMS_DP_USHORT:
+            *(uint16_t *)field = EMS_VALUE_SHORT_NOTSET;
+            break;
+        case EMS_DP_LONG:
+        case EMS_DP_MINUTES:
+            *(uint32_t *)field = EMS_VALUE_LONG_NOTSET;
+            break;
+        case EMS_DP_CHARS:
+            strlcpy((char *)field, "??", 3);
+            break;
+        default:
+            *field = EMS_VALUE_INT_NOTSET;
+            break;
+        }
+    }
+}
+
+/**
+ * Decode all data points of the telegram's type into their structs
+ * values that lie outside the received data (e.g. a short telegram) are left as they are
+ */
+void _ems_decodeDataPoints(_EMS_RxTelegram * EMS_RxTelegram) {
+    for (uint8_t i = 0; i < _EMS_DataPoints_max; i++) {
+        if (pgm_read_word(&EMS_DataPoints[i].type) != EMS_RxTelegram->type) {
+            continue;
+        }
+
+        uint8_t format = pgm_read_byte(&EMS_DataPoints[i].format);
+        uint8_t offset = pgm_read_byte(&EMS_DataPoints[i].offset);
+        if (offset + _ems_dataPointLength(format) > EMS_RxTelegram->data_length) {
+            continue;
+        }
+
+        uint8_t * field = _ems_dataPointStruct(pgm_read_byte(&EMS_DataPoints[i].values)) + pgm_read_byte(&EMS_DataPoints[i].storage);
+
+        switch (format) {
+        case EMS_DP_SHORT:
+        case EMS_DP_USHORT:
+            *(uint16_t *)field = _toShort(offset);
+            break;
+        case EMS_DP_LONG:
+        case EMS_DP_MINUTES:
+            *(uint32_t *)field = _toLong(offset);
+            break;
+        case EMS_DP_BIT:
+            *field = _bitRead(offset, pgm_read_byte(&EMS_DataPoints[i].bit));
+            break;
+        case EMS_DP_FLAG:
+            *field = (_toByte(offset) == 0xFF); // 0xFF means on
+            break;
+        case EMS_DP_CHARS:
+            field[0] = char(_toByte(offset)); // ascii character 1
+            field[1] = char(_toByte(offset + 1));
+            field[2] = '\0';
+            break;
+        default:
+            *field = _toByte(offset);
+            break;
+        }
+    }
+}
+
 /**
  * Check if hot tap water or heating is active
  * using a quick hack for checking the heating. Selected Flow Temp >= 70
@@ -1077,11 +1685,7 @@ void _checkActive() {
  * received only after requested (not broadcasted)
  */
 void _process_UBAParameterWW(_EMS_RxTelegram * EMS_RxTelegram) {
-    EMS_Boiler.wWActivated   = (_toByte(1) == 0xFF); // 0xFF means on
-    EMS_Boiler.wWSelTemp     = _toByte(2);
-    EMS_Boiler.wWCircPump    = (_toByte(6) == 0xFF); // 0xFF means on
-    EMS_Boiler.wWDesiredTemp = _toByte(8);
-    EMS_Boiler.wWComfort     = _toByte(EMS_OFFSET_UBAParameterWW_wwComfort);
+    _ems_decodeDataPoints(EMS_RxTelegram);
 
     EMS_Sys_Status.emsRefreshed = true; // when we receieve this, lets force an MQTT publish
 }
@@ -1091,7 +1695,8 @@ void _process_UBAParameterWW(_EMS_RxTelegram * EMS_RxTelegram) {
  * received only after requested (not broadcasted)
  */
 void _process_UBATotalUptimeMessage(_EMS_RxTelegram * EMS_RxTelegram) {
-    EMS_Boiler.UBAuptime        = _toLong(0);
+    _ems_decodeDataPoints(EMS_RxTelegram);
+
     EMS_Sys_Status.emsRefreshed = true; // when we receieve this, lets force an MQTT publish
 }
 
@@ -1099,9 +1704,7 @@ void _process_UBATotalUptimeMessage(_EMS_RxTelegram * EMS_RxTelegram) {
  * UBAParametersMessage - type 0x16
  */
 void _process_UBAParametersMessage(_EMS_RxTelegram * EMS_RxTelegram) {
-    EMS_Boiler.heating_temp = _toByte(1);
-    EMS_Boiler.pump_mod_max = _toByte(9);
-    EMS_Boiler.pump_mod_min = _toByte(10);
+    _ems_decodeDataPoints(EMS_RxTelegram);
 }
 
 /**
@@ -1109,11 +1712,7 @@ void _process_UBAParametersMessage(_EMS_RxTelegram * EMS_RxTelegram) {
  * received every 10 seconds
  */
 void _process_UBAMonitorWWMessage(_EMS_RxTelegram * EMS_RxTelegram) {
-    EMS_Boiler.wWCurTmp  = _toShort(1);
-    EMS_Boiler.wWStarts  = _toLong(13);
-    EMS_Boiler.wWWorkM   = _toLong(10);
-    EMS_Boiler.wWOneTime = _bitRead(5, 1);
-    EMS_Boiler.wWCurFlow = _toByte(9);
+    _ems_decodeDataPoints(EMS_RxTelegram);
 }
 
 /**
@@ -1121,32 +1720,7 @@ void _process_UBAMonitorWWMessage(_EMS_RxTelegram * EMS_RxTelegram) {
  * received every 10 seconds
  */
 void _process_UBAMonitorFast(_EMS_RxTelegram * EMS_RxTelegram) {
-    EMS_Boiler.selFlowTemp = _toByte(0);
-    EMS_Boiler.curFlowTemp = _toShort(1);
-    EMS_Boiler.retTemp     = _toShort(13);
-
-    EMS_Boiler.burnGas = _bitRead(7, 0);
-    EMS_Boiler.fanWork = _bitRead(7, 2);
-    EMS_Boiler.ignWork = _bitRead(7, 3);
-    EMS_Boiler.heatPmp = _bitRead(7, 5);
-    EMS_Boiler.wWHeat  = _bitRead(7, 6);
-    EMS_Boiler.wWCirc  = _bitRead(7, 7);
-
-    EMS_Boiler.curBurnPow = _toByte(4);
-    EMS_Boiler.selBurnPow = _toByte(3); // burn power max setting
-
-    EMS_Boiler.flameCurr = _toShort(15);
-
-    // read the service code / installation status as appears on the display
-    EMS_Boiler.serviceCodeChar[0] = char(_toByte(18)); // ascii character 1
-    EMS_Boiler.serviceCodeChar[1] = char(_toByte(19)); // ascii character 2
-    EMS_Boiler.serviceCodeChar[2] = '\0';              // null terminate string
-
-    // read error code
-    EMS_Boiler.serviceCode = _toShort(20);
-
-    // system pressure. FF means missing
-    EMS_Boiler.sysPress = _toByte(17); // this is *10
+    _ems_decodeDataPoints(EMS_RxTelegram);
 
     // at this point do a quick check to see if the hot water or heating is active
     _checkActive();
@@ -1157,12 +1731,7 @@ void _process_UBAMonitorFast(_EMS_RxTelegram * EMS_RxTelegram) {
  * received every 60 seconds
  */
 void _process_UBAMonitorSlow(_EMS_RxTelegram * EMS_RxTelegram) {
-    EMS_Boiler.extTemp     = _toShort(0); // 0x8000 if not available
-    EMS_Boiler.boilTemp    = _toShort(2); // 0x8000 if not available
-    EMS_Boiler.pumpMod     = _toByte(9);
-    EMS_Boiler.burnStarts  = _toLong(10);
-    EMS_Boiler.burnWorkMin = _toLong(13);
-    EMS_Boiler.heatWorkMin = _toLong(19);
+    _ems_decodeDataPoints(EMS_RxTelegram);
 }
 
 /**
@@ -1498,32 +2067,146 @@ void _process_RCTime(_EMS_RxTelegram * EMS_RxTelegram) {
 
 /*
  * Clear devices list
+ * Only the detected models are cleared, the bus activity stays
  */
 void ems_clearDeviceList() {
-    Devices.clear();
+    ems_pollClear();
+    for (uint8_t i = 0; i < EMS_DEVICES_MAX; i++) {
+        EMS_Devices[i].product_id  = EMS_ID_NONE;
+        EMS_Devices[i].version[0]  = 0;
+        EMS_Devices[i].version[1]  = 0;
+        EMS_Devices[i].model_type  = EMS_DEVICE_TYPE_NONE;
+        EMS_Devices[i].model_index = 0;
+    }
 }
 
 /*
- * add an EMS device to our list of detected devices
+ * add an EMS device to our registry of detected devices
+ * model_index is the index into the device list given by model_type
  */
-void _addDevice(uint8_t product_id, uint8_t device_id, char * version, const char * model_string) {
-    _Generic_Type device;
+void _addDevice(uint8_t product_id, uint8_t device_id, uint8_t major, uint8_t minor, _EMS_DEVICE_TYPE model_type, uint8_t model_index) {
+    _EMS_Device * device = &EMS_Devices[device_id & 0x7F];
+
+    device->product_id  = product_id;
+    device->version[0]  = major;
+    device->version[1]  = minor;
+    device->model_type  = model_type;
+    device->model_index = model_index;
+}
 
-    // if its a duplicate don't add
-    bool found = false;
-    for (std::list<_Generic_Type>::iterator it = Devices.begin(); it != Devices.end(); it++) {
-        if (((it)->product_id == product_id) && ((it)->device_id == device_id)) {
-            found = true;
+/*
+ * copy the model name of a detected device from flash into buffer
+ */
+char * _ems_getDeviceModelString(const _EMS_Device * device, char * buffer, size_t size) {
+    switch (device->model_type) {
+    case EMS_DEVICE_TYPE_BOILER:
+        strlcpy_P(buffer, Boiler_Types[device->model_index].model_string, size);
+        break;
+    case EMS_DEVICE_TYPE_THERMOSTAT:
+        strlcpy_P(buffer, Thermostat_Types[device->model_index].model_string, size);
+        break;
+    case EMS_DEVICE_TYPE_OTHER:
+        strlcpy_P(buffer, Other_Types[device->model_index].model_string, size);
+        break;
+    default:
+        strlcpy(buffer, "unknown?", size);
+        break;
+    }
+    return buffer;
+}
+
+/*
+ * Collect the detected devices in device ID order as device ID, product ID, version major and minor
+ * returns the number of devices
+ */
+uint8_t _ems_getDeviceTable(uint8_t * devices, uint8_t max) {
+    uint8_t count = 0;
+    for (uint8_t i = 1; (i < EMS_DEVICES_MAX) && (count < max); i++) {
+        _EMS_Device * device = &EMS_Devices[i];
+        if (device->model_type != EMS_DEVICE_TYPE_NONE) {
+            devices[(count * 4)]     = i;
+            devices[(count * 4) + 1] = device->product_id;
+            devices[(count * 4) + 2] = device->version[0];
+            devices[(count * 4) + 3] = device->version[1];
+            count++;
         }
     }
+    return count;
+}
+
+/*
+ * FNV-1a hash of a device table, as a checksum
+ */
+uint32_t _ems_deviceChecksum(const uint8_t * devices, uint8_t count) {
+    uint32_t hash = 2166136261UL;
+    for (uint8_t i = 0; i < (count * 4); i++) {
+        hash = (hash ^ devices[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+/*
+ * Checksum of the detected devices, saved with the device cache so a corrupted or hand edited cache is ignored
+ * and used to tell if the devices changed since the cache was saved. It says nothing about the bus, the cache is
+ * verified against the bus by the next device scan
+ */
+uint32_t ems_getDeviceChecksum() {
+    uint8_t devices[EMS_DEVICES_CACHE_MAX * 4];
+    uint8_t count = _ems_getDeviceTable(devices, EMS_DEVICES_CACHE_MAX);
+    return _ems_deviceChecksum(devices, count);
+}
+
+/*
+ * Write the detected devices as a hex string for the config file, 8 characters for each device
+ */
+char * ems_getDeviceCache(char * buffer, size_t size) {
+    uint8_t devices[EMS_DEVICES_CACHE_MAX * 4];
+    uint8_t count = _ems_getDeviceTable(devices, EMS_DEVICES_CACHE_MAX);
+
+    buffer[0] = '\0';
+    for (uint8_t i = 0; (i < (count * 4)) && ((size_t)((i * 2) + 2) < size); i++) {
+        snprintf(&buffer[i * 2], 3, "%02X", devices[i]);
+    }
+    return buffer;
+}
+
+/*
+ * Restore the detected devices from the config file on a warm boot, so the boiler and thermostat
+ * are known before the bus is up. They are verified by the next device scan.
+ * returns false if the cache is empty or doesn't match its checksum
+ */
+bool ems_restoreDeviceCache(const char * devices, uint32_t checksum) {
+    if (devices == NULL) {
+        return false;
+    }
+
+    uint8_t table[EMS_DEVICES_CACHE_MAX * 4];
+    uint8_t length = strlen(devices) / 2;
+    if ((length == 0) || (length % 4) || (length > sizeof(table))) {
+        return false;
+    }
+
+    char hex[3] = {0};
+    for (uint8_t i = 0; i < length; i++) {
+        hex[0]   = devices[i * 2];
+        hex[1]   = devices[(i * 2) + 1];
+        table[i] = (uint8_t)strtol(hex, 0, 16);
+    }
 
-    if (!found) {
-        device.product_id = product_id;
-        device.device_id  = device_id;
-        strlcpy(device.version, version, sizeof(device.version));
-        strlcpy(device.model_string, model_string, sizeof(device.model_string));
-        Devices.push_back(device);
+    uint8_t count = length / 4;
+    if (_ems_deviceChecksum(table, count) != checksum) {
+        myDebug_P(PSTR("Device cache is invalid, ignoring it"));
+        return false;
     }
+
+    for (uint8_t i = 0; i < count; i++) {
+        _ems_identifyDevice(table[(i * 4)], table[(i * 4) + 1], table[(i * 4) + 2], table[(i * 4) + 3], true);
+    }
+
+    EMS_Discovery.cached   = true;
+    EMS_Discovery.checksum = checksum;
+
+    return true;
 }
 
 /**
@@ -1536,138 +2219,144 @@ void _process_Version(_EMS_RxTelegram * EMS_RxTelegram) {
         return;
     }
 
-    uint8_t product_id = _toByte(0);
+    _ems_identifyDevice(EMS_RxTelegram->src & 0x7F, _toByte(0), _toByte(1), _toByte(2), false);
+}
 
+/**
+ * Add a device to the registry from its product id and version, and set the boiler and thermostat if not already set
+ * or if the product at their device ID has changed.
+ * When restoring from the device cache the config isn't saved and no values are fetched, as the bus isn't up yet
+ */
+void _ems_identifyDevice(uint8_t device_id, uint8_t product_id, uint8_t major, uint8_t minor, bool restore) {
     char version[10] = {0};
-    snprintf(version, sizeof(version), "%02d.%02d", _toByte(1), _toByte(2));
+    snprintf(version, sizeof(version), "%02d.%02d", major, minor);
 
     // see if its a known boiler
-    int  i         = 0;
-    bool typeFound = false;
-    while (i < _Boiler_Types_max) {
-        if ((Boiler_Types[i].product_id == product_id) && ((EMS_RxTelegram->src & 0x7F) == EMS_ID_BOILER)) {
-            typeFound = true; // we have a matching product id. i is the index.
-            break;
-        }
-        i++;
+    int i = -1;
+    if (device_id == EMS_ID_BOILER) {
+        i = _ems_findBoilerType(product_id);
     }
 
-    if (typeFound) {
-        // its a boiler
-        myDebug_P(PSTR("Boiler found: %s (DeviceID:0x%02X ProductID:%d Version:%s)"), Boiler_Types[i].model_string, EMS_ID_BOILER, product_id, version);
+    if (i != -1) {
+        // its a boiler, copy the entry from flash
+        _Boiler_Type boiler_type;
+        memcpy_P(&boiler_type, &Boiler_Types[i], sizeof(boiler_type));
+
+        myDebug_P(PSTR("Boiler found: %s (DeviceID:0x%02X ProductID:%d Version:%s)"), boiler_type.model_string, EMS_ID_BOILER, product_id, version);
 
         // add to list
-        _addDevice(product_id, EMS_ID_BOILER, version, Boiler_Types[i].model_string);
+        _addDevice(product_id, EMS_ID_BOILER, major, minor, EMS_DEVICE_TYPE_BOILER, i);
 
         // if its a boiler set it, unless it already has been set by checking for a productID
         // it will take the first one found in the list
-        if ((EMS_Boiler.device_id == EMS_ID_NONE) || ((EMS_Boiler.device_id == EMS_ID_BOILER) && EMS_Boiler.product_id == EMS_ID_NONE)) {
+        if ((EMS_Boiler.device_id == EMS_ID_NONE) || ((EMS_Boiler.device_id == EMS_ID_BOILER) && EMS_Boiler.product_id != product_id)) {
             myDebug_P(PSTR("* Setting Boiler to model %s (DeviceID:0x%02X ProductID:%d Version:%s)"),
-                      Boiler_Types[i].model_string,
+                      boiler_type.model_string,
                       EMS_ID_BOILER,
                       product_id,
                       version);
 
             EMS_Boiler.device_id  = EMS_ID_BOILER;
-            EMS_Boiler.product_id = Boiler_Types[i].product_id;
+            EMS_Boiler.product_id = boiler_type.product_id;
             strlcpy(EMS_Boiler.version, version, sizeof(EMS_Boiler.version));
 
             // check to see if its a Junkers Heatronic3, which has a different poll'ing logic
-            if (EMS_Boiler.product_id == EMS_PRODUCTID_HEATRONICS) {
-                EMS_Sys_Status.emsReverse = true;
-            }
+            EMS_Sys_Status.emsReverse = (EMS_Boiler.product_id == EMS_PRODUCTID_HEATRONICS);
 
-            myESP.fs_saveConfig(); // save config to SPIFFS
+            if (!restore) {
+                myESP.fs_requestSave(); // save config to flash, from the main loop
 
-            ems_getBoilerValues(); // get Boiler values that we would usually have to wait for
+                ems_getBoilerValues(); // get Boiler values that we would usually have to wait for
+            }
         }
         return;
     }
 
     // its not a boiler, maybe its a known thermostat?
-    i = 0;
-    while (i < _Thermostat_Types_max) {
-        if (Thermostat_Types[i].product_id == product_id) {
-            typeFound = true; // we have a matching product id. i is the index.
-            break;
-        }
-        i++;
-    }
+    i = _ems_findThermostatType(product_id);
+
+    if (i != -1) {
+        // its a known thermostat, copy the entry from flash
+        _Thermostat_Type thermostat_type;
+        memcpy_P(&thermostat_type, &Thermostat_Types[i], sizeof(thermostat_type));
 
-    if (typeFound) {
-        // its a known thermostat
         if (EMS_Sys_Status.emsLogging >= EMS_SYS_LOGGING_BASIC) {
             myDebug_P(PSTR("Thermostat found: %s (DeviceID:0x%02X ProductID:%d Version:%s)"),
-                      Thermostat_Types[i].model_string,
-                      Thermostat_Types[i].device_id,
+                      thermostat_type.model_string,
+                      thermostat_type.device_id,
                       product_id,
                       version);
         }
 
         // add to list
-        _addDevice(product_id, Thermostat_Types[i].device_id, version, Thermostat_Types[i].model_string);
+        _addDevice(product_id, thermostat_type.device_id, major, minor, EMS_DEVICE_TYPE_THERMOSTAT, i);
 
         // if we don't have a thermostat set, use this one
+        // or if the product at the thermostat's device ID has changed
         if (((EMS_Thermostat.device_id == EMS_ID_NONE) || (EMS_Thermostat.model_id == EMS_MODEL_NONE)
-             || (EMS_Thermostat.device_id == Thermostat_Types[i].device_id))
-            && EMS_Thermostat.product_id == EMS_ID_NONE) {
+             || (EMS_Thermostat.device_id == thermostat_type.device_id))
+            && ((EMS_Thermostat.product_id == EMS_ID_NONE)
+                || ((EMS_Thermostat.device_id == thermostat_type.device_id) && (EMS_Thermostat.product_id != product_id)))) {
             myDebug_P(PSTR("* Setting Thermostat to %s (DeviceID:0x%02X ProductID:%d Version:%s)"),
-                      Thermostat_Types[i].model_string,
-                      Thermostat_Types[i].device_id,
+                      thermostat_type.model_string,
+                      thermostat_type.device_id,
                       product_id,
                       version);
 
-            EMS_Thermostat.model_id        = Thermostat_Types[i].model_id;
-            EMS_Thermostat.device_id       = Thermostat_Types[i].device_id;
-            EMS_Thermostat.write_supported = Thermostat_Types[i].write_supported;
+            EMS_Thermostat.model_id        = thermostat_type.model_id;
+            EMS_Thermostat.device_id       = thermostat_type.device_id;
+            EMS_Thermostat.write_supported = thermostat_type.write_supported;
             EMS_Thermostat.product_id      = product_id;
             strlcpy(EMS_Thermostat.version, version, sizeof(EMS_Thermostat.version));
 
-            myESP.fs_saveConfig(); // save config to SPIFFS
+            ems_updateRxFilter(); // thermostat has changed
 
-            // get Thermostat values (if supported)
-            ems_getThermostatValues();
+            if (!restore) {
+                myESP.fs_requestSave(); // save config to flash, from the main loop
+
+                // get Thermostat values (if supported)
+                ems_getThermostatValues();
+            }
         }
         return;
     }
 
     // finally look for the other EMS devices
-    i = 0;
-    while (i < _Other_Types_max) {
-        if (Other_Types[i].product_id == product_id) {
-            typeFound = true; // we have a matching product id. i is the index.
-            break;
-        }
-        i++;
-    }
+    i = _ems_findOtherType(product_id);
 
-    if (typeFound) {
-        myDebug_P(PSTR("Device found: %s (DeviceID:0x%02X ProductID:%d Version:%s)"), Other_Types[i].model_string, Other_Types[i].device_id, product_id, version);
+    if (i != -1) {
+        // copy the entry from flash
+        _Other_Type other_type;
+        memcpy_P(&other_type, &Other_Types[i], sizeof(other_type));
+
+        myDebug_P(PSTR("Device found: %s (DeviceID:0x%02X ProductID:%d Version:%s)"), other_type.model_string, other_type.device_id, product_id, version);
 
         // add to list
-        _addDevice(product_id, Other_Types[i].device_id, version, Other_Types[i].model_string);
+        _addDevice(product_id, other_type.device_id, major, minor, EMS_DEVICE_TYPE_OTHER, i);
 
         // see if this is a Solar Module SM10
-        if (Other_Types[i].device_id == EMS_ID_SM) {
+        if (other_type.device_id == EMS_ID_SM) {
             EMS_Other.SM = true; // we have detected a SM10
             myDebug_P(PSTR("SM10 Solar Module support enabled."));
         }
 
         // see if this is a HeatPump
-        if (Other_Types[i].device_id == EMS_ID_HP) {
+        if (other_type.device_id == EMS_ID_HP) {
             EMS_Other.HP = true; // we have detected a HP
             myDebug_P(PSTR("HeatPump support enabled."));
         }
 
         // fetch other values
-        ems_getOtherValues();
+        if (!restore) {
+            ems_getOtherValues();
+        }
         return;
 
     } else {
-        myDebug_P(PSTR("Unrecognized device found: %s (DeviceID:0x%02X ProductID:%d Version:%s)"), EMS_RxTelegram->src, product_id, version);
+        myDebug_P(PSTR("Unrecognized device found (DeviceID:0x%02X ProductID:%d Version:%s)"), device_id, product_id, version);
 
         // add to list
-        _addDevice(product_id, EMS_RxTelegram->src, version, "unknown?");
+        _addDevice(product_id, device_id, major, minor, EMS_DEVICE_TYPE_UNKNOWN, 0);
     }
 }
 
@@ -1687,41 +2376,67 @@ void _ems_detectJunkers() {
 void ems_discoverModels() {
     myDebug_P(PSTR("Starting auto discover of EMS devices..."));
 
-    // boiler...
-    ems_doReadCommand(EMS_TYPE_Version, EMS_ID_BOILER);
-    _ems_detectJunkers(); // special hack for Junkers detection
+    // with devices from the cache we can start fetching values straight away
+    if (EMS_Discovery.cached) {
+        myDebug_P(PSTR("Using the cached EMS devices, verifying them in the background"));
+        ems_getBoilerValues();
+        ems_getThermostatValues();
+        ems_getOtherValues();
+    }
+
+    // the boiler, solar module, heatpump and a hardcoded thermostat are asked straight away
+    // and any other devices are found from the bus traffic
+    ems_scanDevices(false);
+}
 
-    // solar module...
-    ems_doReadCommand(EMS_TYPE_Version, EMS_ID_SM); // check if there is Solar Module available
+/**
+ * Print the # telegrams received and the time spent processing them, per EMS type
+ */
+void ems_printTypeStats() {
+    char typeString[50];
 
-    // heatpump module...
-    ems_doReadCommand(EMS_TYPE_Version, EMS_ID_HP); // check if there is HeatPump Module available
+    myDebug_P(PSTR("EMS types received:"));
 
-    // thermostat...
-    // if it hasn't been set, auto discover it
-    if (EMS_Thermostat.device_id == EMS_ID_NONE) {
-        ems_scanDevices(); // auto-discover it
-    } else {
-        // set the model as hardcoded (see my_devices.h) and fetch the version and product id
-        ems_doReadCommand(EMS_TYPE_Version, EMS_Thermostat.device_id);
+    for (uint8_t i = 0; i < _EMS_Types_max; i++) {
+        if (_EMS_Types_count[i] == 0) {
+            continue;
+        }
+
+        strlcpy_P(typeString, (PGM_P)pgm_read_ptr(&EMS_Types[i].typeString), sizeof(typeString));
+        myDebug_P(PSTR(" %s(0x%02X): %d telegrams, processed in %d us, longest %d us"),
+                  typeString,
+                  pgm_read_word(&EMS_Types[i].type),
+                  _EMS_Types_count[i],
+                  _EMS_Types_time[i],
+                  _EMS_Types_maxtime[i]);
     }
+
+    myDebug_P(PSTR(" unknown types: %d telegrams"), ems_getUnknownTypeCount());
 }
 
 /**
  * Print the Tx queue - for debugging
+ * prints EMS_PRINT_LINES entries per call, step counts up from 0. Returns false when it's done
+ * the queue is live, so entries sent in between two calls are skipped
  */
-void ems_printTxQueue() {
+bool ems_printTxQueue(uint16_t step) {
     _EMS_TxTelegram EMS_TxTelegram;
     char            sType[20] = {0};
 
-    if (EMS_TxQueue.size() == 0) {
-        myDebug_P(PSTR("Tx queue is empty"));
-        return;
+    if (step == 0) {
+        if (EMS_TxQueue.size() == 0) {
+            myDebug_P(PSTR("Tx queue is empty"));
+            return false;
+        }
+
+        myDebug_P(PSTR("Tx queue (%d/%d)"), EMS_TxQueue.size(), EMS_TxQueue.capacity);
     }
 
-    myDebug_P(PSTR("Tx queue (%d/%d)"), EMS_TxQueue.size(), EMS_TxQueue.capacity);
+    for (uint16_t i = step * EMS_PRINT_LINES; i < (step + 1) * EMS_PRINT_LINES; i++) {
+        if (i >= EMS_TxQueue.size()) {
+            return false;
+        }
 
-    for (byte i = 0; i < EMS_TxQueue.size(); i++) {
         EMS_TxTelegram = EMS_TxQueue[i]; // retrieves the i-th element from the buffer without removing it
 
         // get action
@@ -1760,12 +2475,153 @@ void ems_printTxQueue() {
                   EMS_TxTelegram.comparisonPostRead,
                   addedTime);
     }
+
+    return (EMS_TxQueue.size() > (step + 1) * EMS_PRINT_LINES);
+}
+
+/**
+ * Return the poll interval in seconds for a type ID
+ */
+uint16_t ems_getPollInterval(uint16_t type) {
+    for (uint8_t i = 0; i < EMS_POLL_INTERVALS_MAX; i++) {
+        if (EMS_PollIntervals[i].type == type) {
+            return EMS_PollIntervals[i].interval;
+        }
+    }
+    return EMS_POLL_INTERVAL_DEFAULT;
+}
+
+/**
+ * Set the poll interval in seconds for a type ID. 0 means never poll, only use broadcasts.
+ * Setting it back to the default frees the override. Returns false if there is no space left.
+ */
+bool ems_setPollInterval(uint16_t type, uint16_t interval) {
+    int free_slot = -1;
+    for (uint8_t i = 0; i < EMS_POLL_INTERVALS_MAX; i++) {
+        if (EMS_PollIntervals[i].type == type) {
+            if (interval == EMS_POLL_INTERVAL_DEFAULT) {
+                EMS_PollIntervals[i].type = EMS_ID_NONE; // back to default
+            } else {
+                EMS_PollIntervals[i].interval = interval;
+            }
+            return true;
+        }
+        if ((free_slot == -1) && (EMS_PollIntervals[i].type == EMS_ID_NONE)) {
+            free_slot = i;
+        }
+    }
+
+    if (interval == EMS_POLL_INTERVAL_DEFAULT) {
+        return true; // nothing to override
+    }
+
+    if (free_slot == -1) {
+        return false;
+    }
+
+    EMS_PollIntervals[free_slot].type     = type;
+    EMS_PollIntervals[free_slot].interval = interval;
+    return true;
+}
+
+/**
+ * Empty the poll schedule, e.g. when the devices or heating circuit change
+ */
+void ems_pollClear() {
+    EMS_Poll_count = 0;
+}
+
+/**
+ * Find the poll schedule entry for a (device, type), or NULL
+ */
+_EMS_Poll * _ems_pollFind(uint8_t dest, uint16_t type) {
+    for (uint8_t i = 0; i < EMS_Poll_count; i++) {
+        if ((EMS_Poll[i].dest == dest) && (EMS_Poll[i].type == type)) {
+            return &EMS_Poll[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Called for each processed telegram. Updates the freshness of the matching poll entry and
+ * learns the broadcast cadence from unsolicited telegrams, as a moving average
+ */
+void _ems_pollSeen(_EMS_RxTelegram * EMS_RxTelegram) {
+    _EMS_Poll * poll = _ems_pollFind(EMS_RxTelegram->src & 0x7F, EMS_RxTelegram->type);
+    if (poll == NULL) {
+        return;
+    }
+
+    uint32_t now   = EMS_RxTelegram->timestamp;
+    poll->lastSeen = now;
+
+    if (EMS_RxTelegram->dest == EMS_ID_NONE) {
+        if (poll->lastBroadcast) {
+            uint32_t period = now - poll->lastBroadcast;
+            if (poll->broadcastPeriod) {
+                poll->broadcastPeriod = ((poll->broadcastPeriod * 3) + period) / 4;
+            } else {
+                poll->broadcastPeriod = period;
+            }
+        }
+        poll->lastBroadcast = now;
+    }
+}
+
+/**
+ * Send a read request for a (device, type) if forced or if its data has gone stale.
+ * Data is stale when nothing was received within the poll interval, or for a broadcast type
+ * when the expected broadcast is overdue by half its learned period
+ */
+void _ems_pollRead(uint16_t type, uint8_t dest, bool force) {
+    uint32_t    now  = millis();
+    _EMS_Poll * poll = _ems_pollFind(dest, type);
+
+    if ((poll == NULL) && (EMS_Poll_count < EMS_POLL_MAX)) {
+        poll                  = &EMS_Poll[EMS_Poll_count++];
+        poll->dest            = dest;
+        poll->type            = type;
+        poll->lastSeen        = now; // give it one interval before the first poll, the startup fetch is forced
+        poll->lastBroadcast   = 0;
+        poll->broadcastPeriod = 0;
+        poll->lastRequested   = 0;
+        poll->pollCount       = 0;
+    }
+
+    if (!force) {
+        if (poll == NULL) {
+            return; // schedule is full, only fetch on request
+        }
+
+        uint32_t interval = ems_getPollInterval(type) * 1000;
+        if (interval == 0) {
+            return; // never poll this type
+        }
+
+        // a broadcast type is re-read as soon as its broadcast is overdue, even if that's before the interval
+        uint32_t stale = interval;
+        if (poll->broadcastPeriod) {
+            stale = min(stale, poll->broadcastPeriod + (poll->broadcastPeriod / 2));
+        }
+
+        if (((now - poll->lastSeen) < stale) || ((now - poll->lastRequested) < interval)) {
+            return;
+        }
+    }
+
+    if (poll) {
+        poll->lastRequested = now;
+        poll->pollCount++;
+    }
+
+    ems_doReadCommand(type, dest);
 }
 
 /**
  * Generic function to return various settings from the thermostat
  */
-void ems_getThermostatValues() {
+void _ems_getThermostatValues(bool force) {
     if (!ems_getThermostatEnabled()) {
         return;
     }
@@ -1775,43 +2631,109 @@ void ems_getThermostatValues() {
     uint8_t hc       = EMS_Thermostat.hc;
 
     if (model_id == EMS_MODEL_RC20) {
-        ems_doReadCommand(EMS_TYPE_RC20StatusMessage, type); // to get the setpoint temp
-        ems_doReadCommand(EMS_TYPE_RC20Set, type);           // to get the mode
+        _ems_pollRead(EMS_TYPE_RC20StatusMessage, type, force); // to get the setpoint temp
+        _ems_pollRead(EMS_TYPE_RC20Set, type, force);           // to get the mode
     } else if (model_id == EMS_MODEL_RC30) {
-        ems_doReadCommand(EMS_TYPE_RC30StatusMessage, type); // to get the setpoint temp
-        ems_doReadCommand(EMS_TYPE_RC30Set, type);           // to get the mode
+        _ems_pollRead(EMS_TYPE_RC30StatusMessage, type, force); // to get the setpoint temp
+        _ems_pollRead(EMS_TYPE_RC30Set, type, force);           // to get the mode
     } else if ((model_id == EMS_MODEL_RC35) || (model_id == EMS_MODEL_ES73)) {
         if (hc == 1) {
-            ems_doReadCommand(EMS_TYPE_RC35StatusMessage_HC1, type); // to get the setpoint temp
-            ems_doReadCommand(EMS_TYPE_RC35Set_HC1, type);           // to get the mode
+            _ems_pollRead(EMS_TYPE_RC35StatusMessage_HC1, type, force); // to get the setpoint temp
+            _ems_pollRead(EMS_TYPE_RC35Set_HC1, type, force);           // to get the mode
         } else if (hc == 2) {
-            ems_doReadCommand(EMS_TYPE_RC35StatusMessage_HC2, type); // to get the setpoint temp
-            ems_doReadCommand(EMS_TYPE_RC35Set_HC2, type);           // to get the mode
+            _ems_pollRead(EMS_TYPE_RC35StatusMessage_HC2, type, force); // to get the setpoint temp
+            _ems_pollRead(EMS_TYPE_RC35Set_HC2, type, force);           // to get the mode
         }
     } else if ((model_id == EMS_MODEL_EASY)) {
-        ems_doReadCommand(EMS_TYPE_EasyStatusMessage, type);
+        _ems_pollRead(EMS_TYPE_EasyStatusMessage, type, force);
     }
 
-    ems_doReadCommand(EMS_TYPE_RCTime, type); // get Thermostat time
+    _ems_pollRead(EMS_TYPE_RCTime, type, force); // get Thermostat time
 }
 
 /**
- * Generic function to return various settings from the thermostat
+ * Generic function to return various settings from the boiler
  */
-void ems_getBoilerValues() {
-    ems_doReadCommand(EMS_TYPE_UBAMonitorFast, EMS_Boiler.device_id);        // get boiler stats, instead of waiting 10secs for the broadcast
-    ems_doReadCommand(EMS_TYPE_UBAMonitorSlow, EMS_Boiler.device_id);        // get more boiler stats, instead of waiting 60secs for the broadcast
-    ems_doReadCommand(EMS_TYPE_UBAParameterWW, EMS_Boiler.device_id);        // get Warm Water values
-    ems_doReadCommand(EMS_TYPE_UBAParametersMessage, EMS_Boiler.device_id);  // get MC10 boiler values
-    ems_doReadCommand(EMS_TYPE_UBATotalUptimeMessage, EMS_Boiler.device_id); // get uptime from boiler
+void _ems_getBoilerValues(bool force) {
+    uint8_t device_id = EMS_Boiler.device_id;
+
+    _ems_pollRead(EMS_TYPE_UBAMonitorFast, device_id, force);        // get boiler stats, instead of waiting 10secs for the broadcast
+    _ems_pollRead(EMS_TYPE_UBAMonitorSlow, device_id, force);        // get more boiler stats, instead of waiting 60secs for the broadcast
+    _ems_pollRead(EMS_TYPE_UBAParameterWW, device_id, force);        // get Warm Water values
+    _ems_pollRead(EMS_TYPE_UBAParametersMessage, device_id, force);  // get MC10 boiler values
+    _ems_pollRead(EMS_TYPE_UBATotalUptimeMessage, device_id, force); // get uptime from boiler
 }
 
 /*
  * Get other values from EMS devices
  */
-void ems_getOtherValues() {
+void _ems_getOtherValues(bool force) {
     if (EMS_Other.SM) {
-        ems_doReadCommand(EMS_TYPE_SM10Monitor, EMS_ID_SM); // fetch all from SM10Monitor
+        _ems_pollRead(EMS_TYPE_SM10Monitor, EMS_ID_SM, force); // fetch all from SM10Monitor
+    }
+}
+
+// fetch all values from the thermostat now
+void ems_getThermostatValues() {
+    _ems_getThermostatValues(true);
+}
+
+// fetch all values from the boiler now
+void ems_getBoilerValues() {
+    _ems_getBoilerValues(true);
+}
+
+// fetch all values from the other EMS devices now
+void ems_getOtherValues() {
+    _ems_getOtherValues(true);
+}
+
+/**
+ * Called regularly to fetch the values that are not broadcast or have gone stale
+ */
+void ems_pollTick() {
+    _ems_getThermostatValues(false);
+    _ems_getBoilerValues(false);
+    _ems_getOtherValues(false);
+}
+
+/**
+ * Print the poll schedule with the learned broadcast periods
+ */
+void ems_printPollSchedule() {
+    if (EMS_Poll_count == 0) {
+        myDebug_P(PSTR("Poll schedule is empty"));
+        return;
+    }
+
+    uint32_t now = millis();
+
+    myDebug_P(PSTR("Poll schedule:"));
+    for (uint8_t i = 0; i < EMS_Poll_count; i++) {
+        _EMS_Poll * poll = &EMS_Poll[i];
+        char        typeString[50];
+        int         j = _ems_findType(poll->type);
+        if (j != -1) {
+            strlcpy_P(typeString, (PGM_P)pgm_read_ptr(&EMS_Types[j].typeString), sizeof(typeString));
+        } else {
+            strlcpy(typeString, "?", sizeof(typeString));
+        }
+
+        char broadcast[20];
+        if (poll->broadcastPeriod) {
+            snprintf(broadcast, sizeof(broadcast), "every %ds", (int)(poll->broadcastPeriod / 1000));
+        } else {
+            strlcpy(broadcast, "no", sizeof(broadcast));
+        }
+
+        myDebug_P(PSTR(" %s(0x%02X) from 0x%02X: interval=%ds broadcast=%s lastseen=%ds ago polled=%d"),
+                  typeString,
+                  poll->type,
+                  poll->dest,
+                  ems_getPollInterval(poll->type),
+                  broadcast,
+                  (int)((now - poll->lastSeen) / 1000),
+                  poll->pollCount);
     }
 }
 
@@ -1823,21 +2745,11 @@ char * ems_getThermostatDescription(char * buffer) {
     if (!ems_getThermostatEnabled()) {
         strlcpy(buffer, "<not enabled>", size);
     } else {
-        int  i      = 0;
-        bool found  = false;
         char tmp[6] = {0};
+        int  i      = _ems_findThermostatType(EMS_Thermostat.product_id);
 
-        // scan through known ID types
-        while (i < _Thermostat_Types_max) {
-            if (Thermostat_Types[i].product_id == EMS_Thermostat.product_id) {
-                found = true; // we have a match
-                break;
-            }
-            i++;
-        }
-
-        if (found) {
-            strlcpy(buffer, Thermostat_Types[i].model_string, size);
+        if (i != -1) {
+            strlcpy_P(buffer, Thermostat_Types[i].model_string, size);
         } else {
             strlcpy(buffer, "DeviceID: 0x", size);
             strlcat(buffer, _hextoa(EMS_Thermostat.device_id, tmp), size);
@@ -1865,20 +2777,11 @@ char * ems_getBoilerDescription(char * buffer) {
     if (!ems_getBoilerEnabled()) {
         strlcpy(buffer, "<not enabled>", size);
     } else {
-        int  i      = 0;
-        bool found  = false;
         char tmp[6] = {0};
+        int  i      = _ems_findBoilerType(EMS_Boiler.product_id);
 
-        // scan through known ID types
-        while (i < _Boiler_Types_max) {
-            if (Boiler_Types[i].product_id == EMS_Boiler.product_id) {
-                found = true; // we have a match
-                break;
-            }
-            i++;
-        }
-        if (found) {
-            strlcpy(buffer, Boiler_Types[i].model_string, size);
+        if (i != -1) {
+            strlcpy_P(buffer, Boiler_Types[i].model_string, size);
         } else {
             strlcpy(buffer, "DeviceID: 0x", size);
             strlcat(buffer, _hextoa(EMS_Boiler.device_id, tmp), size);
@@ -1899,104 +2802,251 @@ char * ems_getBoilerDescription(char * buffer) {
 }
 
 /**
- * Find the versions of our connected devices
+ * Send a Version read to a device ID, unless already done during this scan
  */
-void ems_scanDevices() {
-    myDebug_P(PSTR("Started scan on EMS bus for known devices"));
+void _ems_probeDevice(uint8_t device_id) {
+    if (EMS_Discovery.probed[device_id >> 3] & (1 << (device_id & 0x07))) {
+        return;
+    }
+    EMS_Discovery.probed[device_id >> 3] |= (1 << (device_id & 0x07));
+    ems_doReadCommand(EMS_TYPE_Version, device_id);
+}
 
-    std::list<uint8_t> Device_Ids; // create a new list
+/**
+ * Start a scan of the EMS bus for devices. Publishing and polling carry on while it runs.
+ * The boiler (including the Junkers check), solar module, heatpump and any hardcoded thermostat are probed
+ * straight away, as they may be silent. Then after listening for EMS_DISCOVERY_LISTEN_TIME only the device IDs
+ * that were seen sending telegrams are probed, see ems_discoveryTick()
+ * A deep scan also probes all device IDs from the known device lists
+ */
+void ems_scanDevices(bool deep) {
+    myDebug_P(PSTR("Started scan on EMS bus for devices, listening for %d seconds..."), EMS_DISCOVERY_LISTEN_TIME / 1000);
 
-    // add boiler device_id which is always 0x08
-    Device_Ids.push_back(EMS_ID_BOILER);
+    memset(EMS_Discovery.probed, 0, sizeof(EMS_Discovery.probed));
 
-    // copy over thermostats
-    for (_Thermostat_Type tt : Thermostat_Types) {
-        Device_Ids.push_back(tt.device_id);
+    _ems_probeDevice(EMS_ID_BOILER);
+    _ems_detectJunkers();        // special hack for Junkers detection
+    _ems_probeDevice(EMS_ID_SM); // check if there is Solar Module available
+    _ems_probeDevice(EMS_ID_HP); // check if there is HeatPump Module available
+    if (EMS_Thermostat.device_id != EMS_ID_NONE) {
+        _ems_probeDevice(EMS_Thermostat.device_id); // fetch the version and product id of the hardcoded thermostat
     }
 
-    // copy over others
-    for (_Other_Type ot : Other_Types) {
-        Device_Ids.push_back(ot.device_id);
+    // check the devices we already know about are still there, e.g. restored from the device cache
+    for (uint8_t device_id = 1; device_id < EMS_DEVICES_MAX; device_id++) {
+        if (EMS_Devices[device_id].model_type != EMS_DEVICE_TYPE_NONE) {
+            _ems_probeDevice(device_id);
+        }
     }
 
-    // remove duplicates and reserved IDs (like our own device)
-    Device_Ids.sort();
-    Device_Ids.unique();
-    Device_Ids.remove(EMS_MODEL_NONE);
+    EMS_Discovery.deep      = deep;
+    EMS_Discovery.timestamp = millis();
+    EMS_Discovery.status    = EMS_DISCOVERY_LISTEN;
+    _ems_recordEvent(EMS_EVENT_SCAN_START);
+}
 
-    // send the read command with Version command
-    for (uint8_t device_id : Device_Ids) {
-        ems_doReadCommand(EMS_TYPE_Version, device_id);
+/**
+ * Called regularly to move the device scan on to the next phase
+ */
+void ems_discoveryTick() {
+    uint32_t now = millis();
+
+    if (EMS_Discovery.status == EMS_DISCOVERY_LISTEN) {
+        if ((now - EMS_Discovery.timestamp) < EMS_DISCOVERY_LISTEN_TIME) {
+            return;
+        }
+
+        // probe the active device IDs that haven't been identified yet, using the activity in the device registry
+        uint8_t count = 0;
+        for (uint8_t device_id = 1; device_id < EMS_DEVICES_MAX; device_id++) {
+            _EMS_Device * device = &EMS_Devices[device_id];
+            if ((device_id != EMS_ID_ME) && (device->rxCount) && ((now - device->lastSeen) < EMS_DISCOVERY_ACTIVE_TIME)
+                && (device->model_type == EMS_DEVICE_TYPE_NONE)) {
+                _ems_probeDevice(device_id);
+                count++;
+            }
+        }
+
+        if (EMS_Discovery.deep) {
+            for (uint8_t i = 0; i < _Thermostat_Types_max; i++) {
+                _ems_probeDevice(pgm_read_byte(&Thermostat_Types[i].device_id));
+            }
+            for (uint8_t i = 0; i < _Other_Types_max; i++) {
+                _ems_probeDevice(pgm_read_byte(&Other_Types[i].device_id));
+            }
+        }
+
+        myDebug_P(PSTR("Found %d active device IDs on the EMS bus, fetching their versions..."), count);
+
+        EMS_Discovery.timestamp = now;
+        EMS_Discovery.status    = EMS_DISCOVERY_PROBE;
+        return;
     }
 
-    // add a check for Junkers onto the queue
-    _ems_detectJunkers();
+    if (EMS_Discovery.status == EMS_DISCOVERY_PROBE) {
+        // finished when all the Version reads have been sent
+        if ((!EMS_TxQueue.isEmpty()) && ((now - EMS_Discovery.timestamp) < EMS_DISCOVERY_PROBE_TIMEOUT)) {
+            return;
+        }
+
+        // forget devices that have never been heard, e.g. restored from the device cache but no longer on the bus
+        for (uint8_t device_id = 1; device_id < EMS_DEVICES_MAX; device_id++) {
+            _EMS_Device * device = &EMS_Devices[device_id];
+            if ((device->model_type != EMS_DEVICE_TYPE_NONE) && (device->rxCount == 0) && (device->lastSeen == 0)) {
+                device->product_id = EMS_ID_NONE;
+                device->model_type = EMS_DEVICE_TYPE_NONE;
+            }
+        }
+
+        EMS_Discovery.status = EMS_DISCOVERY_IDLE;
+        myDebug_P(PSTR("Finished the EMS device scan."));
+        _ems_recordEvent(EMS_EVENT_SCAN_END);
+
+        // update the device cache if the devices have changed
+        uint32_t checksum = ems_getDeviceChecksum();
+        if (checksum != EMS_Discovery.checksum) {
+            EMS_Discovery.checksum = checksum;
+            myESP.fs_requestSave(); // save config to flash, from the main loop
+        } else if (EMS_Discovery.cached) {
+            myDebug_P(PSTR("The cached EMS devices have been verified"));
+        }
+        EMS_Discovery.cached = false;
+
+        if (EMS_Discovery.deep) {
+            ems_printDevices();
+        }
+    }
 }
 
 /**
- * Print out all handled types
+ * Print one line of the list of supported devices and types, see ems_printAllDevices()
+ * returns false when line is past the end of the list
  */
-void ems_printAllDevices() {
-    uint8_t i;
+bool _ems_printDeviceLine(uint16_t line) {
+    char model_string[50];
 
-    myDebug_P(PSTR("\nThese %d devices are supported as boiler units:"), _Boiler_Types_max);
-    for (i = 0; i < _Boiler_Types_max; i++) {
+    // boilers
+    if (line == 0) {
+        myDebug_P(PSTR("\nThese %d devices are supported as boiler units:"), _Boiler_Types_max);
+        return true;
+    }
+    line--;
+    if (line < _Boiler_Types_max) {
+        strlcpy_P(model_string, Boiler_Types[line].model_string, sizeof(model_string));
         myDebug_P(PSTR(" %s%s%s (DeviceID:0x%02X ProductID:%d)"),
                   COLOR_BOLD_ON,
-                  Boiler_Types[i].model_string,
+                  model_string,
                   COLOR_BOLD_OFF,
                   EMS_ID_BOILER,
-                  Boiler_Types[i].product_id);
+                  pgm_read_byte(&Boiler_Types[line].product_id));
+        return true;
     }
+    line -= _Boiler_Types_max;
 
-    myDebug_P(PSTR("\nThese %d devices are supported as other known EMS devices:"), _Other_Types_max);
-    for (i = 0; i < _Other_Types_max; i++) {
+    // other devices
+    if (line == 0) {
+        myDebug_P(PSTR("\nThese %d devices are supported as other known EMS devices:"), _Other_Types_max);
+        return true;
+    }
+    line--;
+    if (line < _Other_Types_max) {
+        strlcpy_P(model_string, Other_Types[line].model_string, sizeof(model_string));
         myDebug_P(PSTR(" %s%s%s (DeviceID:0x%02X ProductID:%d)"),
                   COLOR_BOLD_ON,
-                  Other_Types[i].model_string,
+                  model_string,
                   COLOR_BOLD_OFF,
-                  Other_Types[i].device_id,
-                  Other_Types[i].product_id);
-    }
-
-    myDebug_P(PSTR("\nThe following telegram type IDs are supported:"));
-    for (i = 0; i < _EMS_Types_max; i++) {
-        if ((EMS_Types[i].model_id == EMS_MODEL_ALL) || (EMS_Types[i].model_id == EMS_MODEL_UBA)) {
-            myDebug_P(PSTR(" type %02X (%s)"), EMS_Types[i].type, EMS_Types[i].typeString);
+                  pgm_read_byte(&Other_Types[line].device_id),
+                  pgm_read_byte(&Other_Types[line].product_id));
+        return true;
+    }
+    line -= _Other_Types_max;
+
+    // telegram types, only the generic and boiler ones
+    if (line == 0) {
+        myDebug_P(PSTR("\nThe following telegram type IDs are supported:"));
+        return true;
+    }
+    line--;
+    if (line < _EMS_Types_max) {
+        uint8_t model_id = pgm_read_byte(&EMS_Types[line].model_id);
+        if ((model_id == EMS_MODEL_ALL) || (model_id == EMS_MODEL_UBA)) {
+            strlcpy_P(model_string, (PGM_P)pgm_read_ptr(&EMS_Types[line].typeString), sizeof(model_string));
+            myDebug_P(PSTR(" type %02X (%s)"), pgm_read_word(&EMS_Types[line].type), model_string);
         }
+        return true;
     }
+    line -= _EMS_Types_max;
 
-    myDebug_P(PSTR("\nThese %d thermostat devices are supported:"), _Thermostat_Types_max);
-    for (i = 0; i < _Thermostat_Types_max; i++) {
+    // thermostats
+    if (line == 0) {
+        myDebug_P(PSTR("\nThese %d thermostat devices are supported:"), _Thermostat_Types_max);
+        return true;
+    }
+    line--;
+    if (line < _Thermostat_Types_max) {
+        strlcpy_P(model_string, Thermostat_Types[line].model_string, sizeof(model_string));
         myDebug_P(PSTR(" %s%s%s (DeviceID:0x%02X ProductID:%d) can write:%c"),
                   COLOR_BOLD_ON,
-                  Thermostat_Types[i].model_string,
+                  model_string,
                   COLOR_BOLD_OFF,
-                  Thermostat_Types[i].device_id,
-                  Thermostat_Types[i].product_id,
-                  (Thermostat_Types[i].write_supported) ? 'y' : 'n');
+                  pgm_read_byte(&Thermostat_Types[line].device_id),
+                  pgm_read_byte(&Thermostat_Types[line].product_id),
+                  (pgm_read_byte(&Thermostat_Types[line].write_supported)) ? 'y' : 'n');
+        return true;
     }
+    line -= _Thermostat_Types_max;
 
     // print out known devices
-    ems_printDevices();
+    if (line == 0) {
+        ems_printDevices();
+        myDebug_P(PSTR("")); // newline
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Print out all handled types
+ * prints EMS_PRINT_LINES lines per call, step counts up from 0. Returns false when it's done
+ */
+bool ems_printAllDevices(uint16_t step) {
+    for (uint16_t line = step * EMS_PRINT_LINES; line < (step + 1) * EMS_PRINT_LINES; line++) {
+        if (!_ems_printDeviceLine(line)) {
+            return false;
+        }
+    }
 
-    myDebug_P(PSTR("")); // newline
+    return true;
 }
 
 /**
  * print out contents of the device list that was captured
  */
 void ems_printDevices() {
-    if (Devices.size() != 0) {
-        myDebug_P(PSTR("\nThese %d EMS devices were detected:"), Devices.size());
-        for (std::list<_Generic_Type>::iterator it = Devices.begin(); it != Devices.end(); it++) {
-            myDebug_P(PSTR(" %s%s%s (DeviceID:0x%02X ProductID:%d Version:%s)"),
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < EMS_DEVICES_MAX; i++) {
+        if (EMS_Devices[i].model_type != EMS_DEVICE_TYPE_NONE) {
+            count++;
+        }
+    }
+
+    if (count != 0) {
+        myDebug_P(PSTR("\nThese %d EMS devices were detected:"), count);
+        char model_string[50];
+        for (uint8_t i = 0; i < EMS_DEVICES_MAX; i++) {
+            _EMS_Device * device = &EMS_Devices[i];
+            if (device->model_type == EMS_DEVICE_TYPE_NONE) {
+                continue;
+            }
+            myDebug_P(PSTR(" %s%s%s (DeviceID:0x%02X ProductID:%d Version:%02d.%02d)"),
                       COLOR_BOLD_ON,
-                      (it)->model_string,
+                      _ems_getDeviceModelString(device, model_string, sizeof(model_string)),
                       COLOR_BOLD_OFF,
-                      (it)->device_id,
-                      (it)->product_id,
-                      (it)->version);
+                      i,
+                      device->product_id,
+                      device->version[0],
+                      device->version[1]);
         }
 
         myDebug_P(PSTR("\nNote: if any devices are marked as 'unknown?' please report this as a GitHub issue so the EMS devices list can be "
@@ -2033,7 +3083,9 @@ void ems_doReadCommand(uint16_t type, uint8_t dest, bool forceRefresh) {
         if (i == -1) {
             myDebug_P(PSTR("Requesting type (0x%02X) from dest 0x%02X"), type, dest);
         } else {
-            myDebug_P(PSTR("Requesting type %s(0x%02X) from dest 0x%02X"), EMS_Types[i].typeString, type, dest);
+            char typeString[50];
+            strlcpy_P(typeString, (PGM_P)pgm_read_ptr(&EMS_Types[i].typeString), sizeof(typeString));
+            myDebug_P(PSTR("Requesting type %s(0x%02X) from dest 0x%02X"), typeString, type, dest);
         }
     }
     EMS_TxTelegram.action             = EMS_TX_TELEGRAM_READ;    // read command
@@ -2049,6 +3101,7 @@ void ems_doReadCommand(uint16_t type, uint8_t dest, bool forceRefresh) {
     EMS_TxTelegram.forceRefresh       = forceRefresh; // should we send to MQTT after a successful read?
 
     EMS_TxQueue.push(EMS_TxTelegram);
+    _ems_recordTxQueue(EMS_TXQUEUE_ADD, &EMS_TxTelegram);
 }
 
 /**
@@ -2100,13 +3153,14 @@ void ems_sendRawTelegram(char * telegram) {
 
     // add to Tx queue. Assume it's not full.
     EMS_TxQueue.push(EMS_TxTelegram);
+    _ems_recordTxQueue(EMS_TXQUEUE_ADD, &EMS_TxTelegram);
 }
 
 /**
- * Set the temperature of the thermostat
+ * Set the temperature of the thermostat, in half degrees C
  * temptype 0 = normal, 1=night temp, 2=day temp, 3=holiday temp
  */
-void ems_setThermostatTemp(float temperature, uint8_t temptype) {
+void ems_setThermostatTemp(uint8_t temperature, uint8_t temptype) {
     if (!ems_getThermostatEnabled()) {
         return;
     }
@@ -2176,13 +3230,14 @@ void ems_setThermostatTemp(float temperature, uint8_t temptype) {
     }
 
     EMS_TxTelegram.length           = EMS_MIN_TELEGRAM_LENGTH;
-    EMS_TxTelegram.dataValue        = (uint8_t)((float)temperature * (float)2); // value
+    EMS_TxTelegram.dataValue        = temperature; // in half degrees
     EMS_TxTelegram.type_validate    = EMS_TxTelegram.type;
     EMS_TxTelegram.comparisonOffset = EMS_TxTelegram.offset;
     EMS_TxTelegram.comparisonValue  = EMS_TxTelegram.dataValue;
 
     EMS_TxTelegram.forceRefresh = false; // send to MQTT is done automatically in EMS_TYPE_RC*StatusMessage
     EMS_TxQueue.push(EMS_TxTelegram);
+    _ems_recordTxQueue(EMS_TXQUEUE_ADD, &EMS_TxTelegram);
 }
 
 /**
@@ -2233,6 +3288,7 @@ void ems_setThermostatMode(uint8_t mode) {
     EMS_TxTelegram.forceRefresh       = false; // send to MQTT is done automatically in 0xA8 process
 
     EMS_TxQueue.push(EMS_TxTelegram);
+    _ems_recordTxQueue(EMS_TXQUEUE_ADD, &EMS_TxTelegram);
 }
 
 /**
@@ -2264,6 +3320,7 @@ void ems_setWarmWaterTemp(uint8_t temperature) {
     EMS_TxTelegram.forceRefresh       = false; // no need to send since this is done by 0x33 process
 
     EMS_TxQueue.push(EMS_TxTelegram);
+    _ems_recordTxQueue(EMS_TXQUEUE_ADD, &EMS_TxTelegram);
 }
 
 /**
@@ -2290,6 +3347,7 @@ void ems_setFlowTemp(uint8_t temperature) {
     EMS_TxTelegram.forceRefresh       = false;
 
     EMS_TxQueue.push(EMS_TxTelegram);
+    _ems_recordTxQueue(EMS_TXQUEUE_ADD, &EMS_TxTelegram);
 }
 
 /**
@@ -2322,6 +3380,7 @@ void ems_setWarmWaterModeComfort(uint8_t comfort) {
     EMS_TxTelegram.type_validate = EMS_ID_NONE; // don't validate
 
     EMS_TxQueue.push(EMS_TxTelegram);
+    _ems_recordTxQueue(EMS_TXQUEUE_ADD, &EMS_TxTelegram);
 }
 
 /**
@@ -2344,6 +3403,7 @@ void ems_setWarmWaterActivated(bool activated) {
     EMS_TxTelegram.dataValue     = (activated ? 0xFF : 0x00); // 0xFF is on, 0x00 is off
 
     EMS_TxQueue.push(EMS_TxTelegram);
+    _ems_recordTxQueue(EMS_TXQUEUE_ADD, &EMS_TxTelegram);
 }
 
 /**
@@ -2398,6 +3458,7 @@ void ems_setWarmTapWaterActivated(bool activated) {
     }
 
     EMS_TxQueue.push(EMS_TxTelegram); // add to queue
+    _ems_recordTxQueue(EMS_TXQUEUE_ADD, &EMS_TxTelegram);
 }
 
 /**
@@ -2467,7 +3528,7 @@ void ems_testTelegram(uint8_t test_num) {
     myDebug_P(PSTR("[TEST %d] Injecting telegram %s"), test_num, TEST_DATA[test_num - 1]);
 
     // go an parse it
-    ems_parseTelegram(telegram, length + 1); // include CRC in length
+    ems_parseTelegram(telegram, length + 1, true); // include CRC in length
 #else
     myDebug_P(PSTR("Firmware not compiled with test data set"));
 #endif
@@ -47,6 +47,20 @@
 
 #define EMS_TX_TELEGRAM_QUEUE_MAX 100 // max size of Tx FIFO queue
 
+#define EMS_DEVICES_MAX 128 // size of the device registry, one entry for each 7-bit EMS device ID
+
+#define EMS_DEVICES_CACHE_MAX 8 // max number of detected devices kept in the config file, to skip discovery on a warm boot
+
+#define EMS_DISCOVERY_LISTEN_TIME 15000   // ms to listen to bus traffic before probing the active device IDs
+#define EMS_DISCOVERY_ACTIVE_TIME 300000  // ms, a device ID is active if it has sent a telegram within this time
+#define EMS_DISCOVERY_PROBE_TIMEOUT 10000 // ms to wait for the Version replies before finishing a scan
+
+#define EMS_POLL_MAX 16               // max number of (device, type) pairs in the poll schedule
+#define EMS_POLL_INTERVALS_MAX 8      // max number of per-type poll interval overrides
+#define EMS_POLL_INTERVAL_DEFAULT 60  // seconds before polled data is considered stale
+
+#define EMS_PRINT_LINES 10 // lines of a long list printed per call, so it can be streamed to telnet
+
 //#define EMS_SYS_LOGGING_DEFAULT EMS_SYS_LOGGING_VERBOSE
 #define EMS_SYS_LOGGING_DEFAULT EMS_SYS_LOGGING_NONE
 
@@ -61,6 +75,23 @@ typedef enum {
     EMS_TX_STATUS_WAIT  // waiting for response from last Tx
 } _EMS_TX_STATUS;
 
+// Tx queue changes for the flight recorder
+typedef enum {
+    EMS_TXQUEUE_ADD,      // added to the queue
+    EMS_TXQUEUE_REMOVE,   // done with, removed from the queue
+    EMS_TXQUEUE_RETRY,    // failed and left on the queue to be sent again
+    EMS_TXQUEUE_VALIDATE, // write replaced by its validate
+    EMS_TXQUEUE_DROP      // removed from the queue without sending
+} _EMS_TXQUEUE_EVENT;
+
+// EMS events for the flight recorder
+typedef enum {
+    EMS_EVENT_BUS_CONNECTED,
+    EMS_EVENT_BUS_DISCONNECTED,
+    EMS_EVENT_SCAN_START,
+    EMS_EVENT_SCAN_END
+} _EMS_EVENT;
+
 #define EMS_TX_SUCCESS 0x01 // EMS single byte after a Tx Write indicating a success
 #define EMS_TX_ERROR 0x04   // EMS single byte after a Tx Write indicating an error
 
@@ -98,8 +129,54 @@ typedef struct {
     bool             emsTxDisabled;    // true to prevent all Tx
     uint8_t          txRetryCount;     // # times the last Tx was re-sent
     bool             emsReverse;       // if true, poll logic is reversed
+    uint32_t         emsRxFiltered;    // telegrams discarded by the Rx filter
+    uint32_t         emsRxUnknown;     // of those, telegrams with a type not in EMS_Types
 } _EMS_Sys_Status;
 
+// Rx filter, checked by the UART interrupt handler before waking up the receive task
+// bitmaps are indexed by device ID (7 bits) and EMS 1.0 type (8 bits, 0xF0-0xFF for EMS+)
+// rebuilt with ems_updateRxFilter() whenever the logging level or the devices change
+typedef struct {
+    bool    acceptAll;  // pass on everything, e.g. when logging raw or verbose
+    uint8_t device[16]; // accept all telegrams from or to these device IDs
+    uint8_t dest[16];   // accept known types sent to these device IDs
+    uint8_t type[32];   // types in EMS_Types, the others are counted as unknown when they're discarded
+} _EMS_RxFilter;
+
+// device discovery, see ems_scanDevices()
+typedef enum {
+    EMS_DISCOVERY_IDLE,   // not running
+    EMS_DISCOVERY_LISTEN, // listening to the bus for active device IDs
+    EMS_DISCOVERY_PROBE   // waiting for the Version replies
+} _EMS_DISCOVERY_STATUS;
+
+typedef struct {
+    _EMS_DISCOVERY_STATUS status;
+    uint32_t              timestamp;                   // millis() when the current phase started
+    bool                  deep;                        // also probe all device IDs from the known device lists
+    bool                  cached;                      // devices were restored from the cache and not yet verified
+    uint32_t              checksum;                    // of the detected devices last saved or restored, see ems_getDeviceChecksum()
+    uint8_t               probed[EMS_DEVICES_MAX / 8]; // bitmap of device IDs sent a Version read, so each is only sent once
+} _EMS_Discovery;
+
+// Poll schedule entry, one for each (device, type) we fetch values from
+// the broadcast cadence is learned from unsolicited telegrams so types that are broadcast aren't polled
+typedef struct {
+    uint8_t  dest;            // device ID
+    uint16_t type;            // type ID
+    uint32_t lastSeen;        // millis() of last telegram received, either broadcast or a reply to us
+    uint32_t lastBroadcast;   // millis() of last broadcast
+    uint32_t broadcastPeriod; // learned broadcast cadence in ms, 0 if unknown
+    uint32_t lastRequested;   // millis() of last read request sent
+    uint16_t pollCount;       // # read requests sent
+} _EMS_Poll;
+
+// Poll interval override for a type, set with 'set poll_interval'
+typedef struct {
+    uint16_t type;     // type ID, 0 if the slot is free
+    uint16_t interval; // seconds, 0 to never poll
+} _EMS_PollInterval;
+
 // The Tx send package
 typedef struct {
     _EMS_TX_TELEGRAM_ACTION action; // read, write, validate, init
@@ -170,12 +247,26 @@ typedef struct {
     bool    write_supported;
 } _Thermostat_Type;
 
+// which of the device lists the model_index of a detected device points to
+typedef enum {
+    EMS_DEVICE_TYPE_NONE,       // not detected
+    EMS_DEVICE_TYPE_UNKNOWN,    // replied to a version request but the product id is not known
+    EMS_DEVICE_TYPE_BOILER,     // Boiler_Types
+    EMS_DEVICE_TYPE_THERMOSTAT, // Thermostat_Types
+    EMS_DEVICE_TYPE_OTHER       // Other_Types
+} _EMS_DEVICE_TYPE;
+
+// device registry entry, indexed by the EMS device ID
+// lastSeen and rxCount are updated by the UART interrupt handler for every valid telegram
 typedef struct {
-    uint8_t product_id;
-    uint8_t device_id;
-    char    version[10];
-    char    model_string[50];
-} _Generic_Type;
+    uint32_t lastSeen;    // millis() of the last telegram sent by this device, 0 if never
+    uint16_t rxCount;     // # telegrams sent by this device
+    uint16_t txCount;     // # telegrams we sent to this device
+    uint8_t  product_id;  // from the version telegram
+    uint8_t  version[2];  // major, minor
+    uint8_t  model_type;  // _EMS_DEVICE_TYPE, which device list model_index refers to
+    uint8_t  model_index; // index into the device list
+} _EMS_Device;
 
 /*
  * Telegram package defintions
@@ -281,32 +372,102 @@ typedef struct {
     uint8_t circuitcalctemp;
 } _EMS_Thermostat;
 
+// groups of decoded values, each with their own last update time
+typedef enum {
+    EMS_VALUES_BOILER,     // EMS_Boiler
+    EMS_VALUES_THERMOSTAT, // EMS_Thermostat
+    EMS_VALUES_OTHER,      // EMS_Other
+    EMS_VALUES_MAX
+} _EMS_VALUES;
+
+#define EMS_SNAPSHOT_VERSION 1 // bump when any of the snapshot structs change
+#define EMS_SNAPSHOT_AGE_NEVER 0xFFFF
+
+// snapshot of the decoded values, kept in RTC memory so they survive a soft reset
+typedef struct {
+    uint16_t        version;                // EMS_SNAPSHOT_VERSION
+    uint16_t        size;                   // sizeof(_EMS_Snapshot)
+    uint32_t        crc;                    // CRC32 of everything after this field
+    uint16_t        age[EMS_VALUES_MAX];    // seconds since each group of values was updated, EMS_SNAPSHOT_AGE_NEVER if never
+    _EMS_Boiler     boiler;
+    _EMS_Thermostat thermostat;
+    _EMS_Other      other;
+} _EMS_Snapshot;
+
 // call back function signature for processing telegram types
 typedef void (*EMS_processType_cb)(_EMS_RxTelegram * EMS_RxTelegram);
 
 // Definition for each EMS type, including the relative callback function
 typedef struct {
     uint8_t            model_id;
-    uint16_t           type; // long to support EMS+ types
-    const char         typeString[50];
+    uint16_t           type;       // long to support EMS+ types
+    PGM_P              typeString; // in flash as well
     EMS_processType_cb processType_cb;
 } _EMS_Type;
 
+// longest strings of a data point, with the '\0'
+#define EMS_DP_KEY_SIZE 20
+#define EMS_DP_LABEL_SIZE 44
+#define EMS_DP_UNIT_SIZE 6
+
+// how a data point is stored in a telegram and in its struct
+typedef enum {
+    EMS_DP_INT,     // 1 byte, EMS_VALUE_INT_NOTSET if not set
+    EMS_DP_SHORT,   // 2 bytes signed, EMS_VALUE_SHORT_NOTSET if not set
+    EMS_DP_USHORT,  // 2 bytes unsigned, EMS_VALUE_SHORT_NOTSET if not set
+    EMS_DP_LONG,    // 3 bytes, kept in a uint32_t, EMS_VALUE_LONG_NOTSET if not set
+    EMS_DP_MINUTES, // as EMS_DP_LONG, shown as days, hours and minutes
+    EMS_DP_BIT,     // a single bit, kept as on/off in a byte
+    EMS_DP_FLAG,    // a byte where 0xFF is on, kept as on/off in a byte
+    EMS_DP_CHARS    // 2 ASCII characters, kept in a char[3]
+} _EMS_DP_FORMAT;
+
+/*
+ * Definition of a decoded value: where it comes from, where it's kept and how it's shown and published
+ * The data points are listed once in EMS_DataPoints and everything is driven from there
+ */
+typedef struct {
+    uint8_t  values;    // _EMS_VALUES, the struct it's kept in
+    uint16_t type;      // type of the telegram it's decoded from
+    uint8_t  offset;    // position in the telegram data
+    uint8_t  bit;       // the bit for EMS_DP_BIT
+    uint8_t  format;    // _EMS_DP_FORMAT
+    uint8_t  div;       // the value is divided by this when shown: 1, 2, 10 or 100
+    uint8_t  storage;   // offset of the field in its struct
+    uint8_t  size;      // size of the field in its struct, checked against the format
+    PGM_P    key;       // key in the MQTT JSON, empty if it's not published
+    PGM_P    label;     // shown by 'info', empty if it's not shown
+    PGM_P    unit;      // shown after the value
+} _EMS_DataPoint;
+
 // function definitions
-extern void ems_parseTelegram(uint8_t * telegram, uint8_t len);
+extern void ems_parseTelegram(uint8_t * telegram, uint8_t len, bool crc_ok);
 void        ems_init();
 void        ems_doReadCommand(uint16_t type, uint8_t dest, bool forceRefresh = false);
 void        ems_sendRawTelegram(char * telegram);
-void        ems_scanDevices();
-void        ems_printAllDevices();
+void        ems_scanDevices(bool deep = false);
+void        ems_discoveryTick();
+char *      ems_getDeviceCache(char * buffer, size_t size);
+bool        ems_restoreDeviceCache(const char * devices, uint32_t checksum);
+uint32_t    ems_getDeviceChecksum();
+void        ems_saveSnapshot();
+bool        ems_restoreSnapshot();
+bool        ems_printAllDevices(uint16_t step);
 void        ems_printDevices();
-void        ems_printTxQueue();
+bool        ems_printTxQueue(uint16_t step);
+void        ems_printTypeStats();
 void        ems_testTelegram(uint8_t test_num);
 void        ems_startupTelegrams();
 bool        ems_checkEMSBUSAlive();
 void        ems_clearDeviceList();
-
-void ems_setThermostatTemp(float temperature, uint8_t temptype = 0);
+void        ems_updateRxFilter();
+void        ems_pollTick();
+void        ems_pollClear();
+void        ems_printPollSchedule();
+bool        ems_setPollInterval(uint16_t type, uint16_t interval);
+uint16_t    ems_getPollInterval(uint16_t type);
+
+void ems_setThermostatTemp(uint8_t temperature, uint8_t temptype = 0); // in half degrees
 void ems_setThermostatMode(uint8_t mode);
 void ems_setThermostatHC(uint8_t hc);
 void ems_setWarmWaterTemp(uint8_t temperature);
@@ -336,6 +497,15 @@ uint8_t          ems_getThermostatModel();
 void             ems_discoverModels();
 bool             ems_getTxCapable();
 uint32_t         ems_getPollFrequency();
+uint8_t          ems_getTxQueueSize();
+bool             ems_getTypeCount(uint8_t index, uint16_t * type, char * typeString, size_t len, uint32_t * count);
+uint32_t         ems_getUnknownTypeCount();
+int32_t          ems_getValuesAge(_EMS_VALUES values);
+bool             ems_getValuesStale(_EMS_VALUES values);
+uint8_t          ems_getDataPointCount();
+void             ems_getDataPoint(uint8_t index, _EMS_DataPoint * dp);
+bool             ems_getDataPointValue(const _EMS_DataPoint * dp, int32_t * value);
+char *           ems_getDataPointString(const _EMS_DataPoint * dp, char * buffer, size_t size);
 
 // private functions
 uint8_t _crcCalculator(uint8_t * data, uint8_t len);
@@ -347,7 +517,11 @@ bool    _ems_setModel(uint8_t model_id);
 void    _removeTxQueue();
 
 // global so can referenced in other classes
-extern _EMS_Sys_Status EMS_Sys_Status;
-extern _EMS_Boiler     EMS_Boiler;
-extern _EMS_Thermostat EMS_Thermostat;
-extern _EMS_Other      EMS_Other;
+extern _EMS_Sys_Status   EMS_Sys_Status;
+extern _EMS_RxFilter     EMS_RxFilter;
+extern _EMS_Device       EMS_Devices[EMS_DEVICES_MAX];
+extern _EMS_PollInterval EMS_PollIntervals[EMS_POLL_INTERVALS_MAX];
+extern _EMS_Boiler       EMS_Boiler;
+extern _EMS_Thermostat   EMS_Thermostat;
+extern _EMS_Other        EMS_Other;
+extern const uint8_t     ems_crc_table[];
@@ -150,7 +150,8 @@ typedef enum {
 // EMS types for known devices. This list will be extended when new devices are recognized.
 // The device_id is always 0x08
 // format is MODEL_ID, PRODUCT ID, DESCRIPTION
-const _Boiler_Type Boiler_Types[] = {
+// the device lists are stored in flash (PROGMEM) so always read them with the pgm_read functions
+constexpr _Boiler_Type Boiler_Types[] PROGMEM = {
 
     {EMS_MODEL_UBA, 72, "MC10 Module"},
     {EMS_MODEL_UBA, 123, "Buderus GB172/Nefit Trendline/Junkers Cerapur"},
@@ -165,7 +166,7 @@ const _Boiler_Type Boiler_Types[] = {
 };
 
 // Other EMS devices which are not considered boilers or thermostats
-const _Other_Type Other_Types[] = {
+constexpr _Other_Type Other_Types[] PROGMEM = {
 
     {EMS_MODEL_OTHER, 69, 0x21, "MM10 Mixer Module"},
     {EMS_MODEL_OTHER, 71, 0x11, "WM10 Switch Module"},
@@ -190,7 +191,7 @@ const _Other_Type Other_Types[] = {
 /*
  * Known thermostat types and their capabilities
  */
-const _Thermostat_Type Thermostat_Types[] = {
+constexpr _Thermostat_Type Thermostat_Types[] PROGMEM = {
 
     // Easy devices - not currently supporting write operations
     {EMS_MODEL_EASY, 202, 0x18, "TC100/Nefit Easy", EMS_THERMOSTAT_WRITE_NO},
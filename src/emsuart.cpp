@@ -8,6 +8,8 @@
 #include "emsuart.h"
 #include "ems.h"
 #include <Arduino.h>
+#include <MyESP.h>
+#include <Trace.h>
 #include <user_interface.h>
 
 _EMSRxBuf * pEMSRxBuf;
@@ -20,20 +22,30 @@ os_event_t recvTaskQueue[EMSUART_recvTaskQueueLen]; // our Rx queue
 // Main interrupt handler
 // Important: do not use ICACHE_FLASH_ATTR !
 //
+// The EMS CRC is calculated here as the bytes are drained from the FIFO, so corrupt telegrams, and
+// telegrams nobody is interested in, can be thrown away without waking up the receive task. We keep the last three CRC values since
+// the CRC covers all bytes except the CRC itself and the BRK 0x00 at the end.
+//
 static void emsuart_rx_intr_handler(void * para) {
     static uint8_t length;
     static uint8_t uart_buffer[EMS_MAXBUFFERSIZE];
+    static uint8_t crc[3]; // running CRC over all bytes received [0], and one [1] and two [2] bytes back
 
     // is a new buffer? if so init the thing for a new telegram
     if (EMS_Sys_Status.emsRxStatus == EMS_RX_STATUS_IDLE) {
         EMS_Sys_Status.emsRxStatus = EMS_RX_STATUS_BUSY; // status set to busy
         length                     = 0;
+        crc[0] = crc[1] = crc[2] = 0;
     }
 
     // fill IRQ buffer, by emptying Rx FIFO
     if (USIS(EMSUART_UART) & ((1 << UIFF) | (1 << UITO) | (1 << UIBD))) {
         while ((USS(EMSUART_UART) >> USRXC) & 0xFF) {
-            uart_buffer[length++] = USF(EMSUART_UART);
+            uint8_t c             = USF(EMSUART_UART);
+            uart_buffer[length++] = c;
+            crc[2]                = crc[1];
+            crc[1]                = crc[0];
+            crc[0]                = ems_crc_table[crc[0]] ^ c;
         }
 
         // clear Rx FIFO full and Rx FIFO timeout interrupts
@@ -46,11 +58,56 @@ static void emsuart_rx_intr_handler(void * para) {
 
         USIC(EMSUART_UART) = (1 << UIBD); // INT clear the BREAK detect interrupt
 
-        pEMSRxBuf->length = length;
-        os_memcpy((void *)pEMSRxBuf->buffer, (void *)&uart_buffer, length); // copy data into transfer buffer, including the BRK 0x00 at the end
-        EMS_Sys_Status.emsRxStatus = EMS_RX_STATUS_IDLE;                    // set the status flag stating BRK has been received and we can start a new package
+        // length includes the BRK at the end
+        // single bytes are polls or status codes and have no CRC
+        // ignore double BRK at the end, possibly from the Tx loopback, and also telegrams with no data value
+        bool post   = false;
+        bool crc_ok = true;
+        if (length == 2) {
+            post = true;
+        } else if ((length > 4) && (uart_buffer[length - 2] != 0x00)) {
+            crc_ok = (crc[2] == uart_buffer[length - 2]); // CRC is the byte before the BRK
+            if (crc_ok) {
+                uint8_t src  = uart_buffer[0] & 0x7F;
+                uint8_t dest = uart_buffer[1] & 0x7F;
+                uint8_t type = uart_buffer[2];
+
+                // keep track of bus activity in the device registry
+                EMS_Devices[src].lastSeen = millis();
+                EMS_Devices[src].rxCount++;
+
+                // check the Rx filter, see ems_updateRxFilter()
+                // echos of our own Tx are never processed, while waiting for a reply to our Tx everything is
+                if (EMS_RxFilter.acceptAll) {
+                    post = true;
+                } else if (src == EMS_ID_ME) {
+                    post = false;
+                } else if (EMS_Sys_Status.emsTxStatus == EMS_TX_STATUS_WAIT) {
+                    post = true;
+                } else {
+                    post = ((EMS_RxFilter.device[src >> 3] & (1 << (src & 0x07))) || (EMS_RxFilter.device[dest >> 3] & (1 << (dest & 0x07)))
+                            || ((EMS_RxFilter.dest[dest >> 3] & (1 << (dest & 0x07))) && (EMS_RxFilter.type[type >> 3] & (1 << (type & 0x07)))));
+                }
+                if (!post) {
+                    EMS_Sys_Status.emsRxFiltered++;
+                    if (!(EMS_RxFilter.type[type >> 3] & (1 << (type & 0x07)))) {
+                        EMS_Sys_Status.emsRxUnknown++;
+                    }
+                }
+            } else {
+                EMS_Sys_Status.emxCrcErr++;
+                post = (EMS_Sys_Status.emsLogging == EMS_SYS_LOGGING_VERBOSE); // only pass on so it can be shown
+            }
+        }
+
+        if (post) {
+            pEMSRxBuf->length = length;
+            pEMSRxBuf->crc_ok = crc_ok;
+            os_memcpy((void *)pEMSRxBuf->buffer, (void *)&uart_buffer, length); // copy data into transfer buffer, including the BRK 0x00 at the end
+            system_os_post(EMSUART_recvTaskPrio, 0, 0);                         // call emsuart_recvTask() at next opportunity
+        }
 
-        system_os_post(EMSUART_recvTaskPrio, 0, 0); // call emsuart_recvTask() at next opportunity
+        EMS_Sys_Status.emsRxStatus = EMS_RX_STATUS_IDLE; // set the status flag stating BRK has been received and we can start a new package
 
         ETS_UART_INTR_ENABLE(); // re-enable UART interrupts
     }
@@ -60,24 +117,32 @@ static void emsuart_rx_intr_handler(void * para) {
  * system task triggered on BRK interrupt
  * incoming received messages are always asynchronous
  * The full buffer is sent to the ems_parseTelegram() function in ems.cpp.
+ * Only buffers that have passed the checks in the interrupt handler get here.
  */
 static void ICACHE_FLASH_ATTR emsuart_recvTask(os_event_t * events) {
+    TRACE_BEGIN(TRACE_TASK, "emsuart_recvTask");
+    uint32_t    cpu      = myESP.cpuStart();
     _EMSRxBuf * pCurrent = pEMSRxBuf;
     uint8_t     length   = pCurrent->length; // number of bytes including the BRK at the end
 
-    // validate and transmit the EMS buffer, excluding the BRK
+    // transmit the EMS buffer, excluding the BRK
+    TRACE_BEGIN(TRACE_TASK, "ems_parseTelegram");
+    uint32_t cpu_parser = myESP.cpuStart();
     if (length == 2) {
         // it's a poll or status code, single byte
-        ems_parseTelegram((uint8_t *)pCurrent->buffer, 1);
-    } else if ((length > 4) && (pCurrent->buffer[length - 2] != 0x00)) {
-        // ignore double BRK at the end, possibly from the Tx loopback
-        // also telegrams with no data value
-        ems_parseTelegram((uint8_t *)pCurrent->buffer, length - 1); // transmit EMS buffer, excluding the BRK
+        ems_parseTelegram((uint8_t *)pCurrent->buffer, 1, true);
+    } else {
+        ems_parseTelegram((uint8_t *)pCurrent->buffer, length - 1, pCurrent->crc_ok); // transmit EMS buffer, excluding the BRK
     }
+    myESP.cpuTrack(MYESP_CPU_PARSER, cpu_parser);
+    TRACE_END(TRACE_TASK, "ems_parseTelegram");
 
     memset(pCurrent->buffer, 0x00, EMS_MAXBUFFERSIZE); // wipe memory just to be safe
 
     pEMSRxBuf = paEMSRxBuf[++emsRxBufIdx % EMS_MAXBUFFERS]; // next free EMS Receive buffer
+
+    myESP.cpuTrack(MYESP_CPU_UART, cpu);
+    TRACE_END(TRACE_TASK, "emsuart_recvTask");
 }
 
 /*
@@ -146,7 +211,7 @@ void ICACHE_FLASH_ATTR emsuart_init() {
 
 /*
  * stop UART0 driver
- * This is called prior to an OTA upload and also before a save to SPIFFS to prevent conflicts
+ * This is called prior to an OTA upload and also before a save of the config to flash to prevent conflicts
  */
 void ICACHE_FLASH_ATTR emsuart_stop() {
     ETS_UART_INTR_DISABLE();
@@ -23,6 +23,7 @@
 
 typedef struct {
     uint8_t length;
+    bool    crc_ok; // CRC verdict, calculated in the ISR as the bytes arrive
     uint8_t buffer[EMS_MAXBUFFERSIZE];
 } _EMSRxBuf;
 
@@ -13,7 +13,7 @@
 // MQTT base name
 #define MQTT_BASE "home" // all MQTT topics are prefix with this string, in the format <MQTT_BASE>/<app name>/<topic>
 
-// MQTT general settings
+// MQTT general settings, QoS and retain are for the topics without a publish policy (see project_policies in ems-esp.cpp)
 #define MQTT_WILL_TOPIC "status"            // for last will & testament topic name
 #define MQTT_WILL_ONLINE_PAYLOAD "online"   // for last will & testament payload
 #define MQTT_WILL_OFFLINE_PAYLOAD "offline" // for last will & testament payload
@@ -70,8 +70,7 @@
 #define TOPIC_SHOWER_COLDSHOT "shower_coldshot" // used to trigger a coldshot from an MQTT command
 
 // MQTT for EXTERNAL SENSORS
-#define TOPIC_EXTERNAL_SENSORS "sensors"   // for sending sensor values to MQTT
-#define PAYLOAD_EXTERNAL_SENSORS "temp_%d" // for formatting the payload for each external dallas sensor
+#define TOPIC_EXTERNAL_SENSORS "sensors" // for sending sensor values to MQTT, each to sensors/<name or address>
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////